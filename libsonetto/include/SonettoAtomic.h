@@ -0,0 +1,119 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_ATOMIC_H
+#define SONETTO_ATOMIC_H
+
+#include "SonettoPrerequisites.h"
+
+#ifdef _MSC_VER
+#   include <windows.h>
+#endif
+
+namespace Sonetto
+{
+    /** Integer counter that can be safely changed from many threads
+
+        Used mainly by the JobSystem to count unfinished jobs, so that a
+        thread can wait for a group of jobs to end (fork-join).
+    */
+    class SONETTO_API AtomicCounter
+    {
+    public:
+        /// Constructor
+        inline AtomicCounter(long value = 0) : mValue(value) {}
+
+        /// Adds one and returns the new value
+        inline long increment()
+        {
+        #ifdef _MSC_VER
+            return InterlockedIncrement(&mValue);
+        #else
+            return __sync_add_and_fetch(&mValue,1);
+        #endif
+        }
+
+        /// Subtracts one and returns the new value
+        inline long decrement()
+        {
+        #ifdef _MSC_VER
+            return InterlockedDecrement(&mValue);
+        #else
+            return __sync_sub_and_fetch(&mValue,1);
+        #endif
+        }
+
+        /// Adds `amount' and returns the new value
+        inline long add(long amount)
+        {
+        #ifdef _MSC_VER
+            return InterlockedExchangeAdd(&mValue,amount) + amount;
+        #else
+            return __sync_add_and_fetch(&mValue,amount);
+        #endif
+        }
+
+        /** Sets the value to `desired' if it is `expected'
+
+        @return
+            Whether the value was set.
+        */
+        inline bool compareAndSwap(long expected,long desired)
+        {
+        #ifdef _MSC_VER
+            return InterlockedCompareExchange(&mValue,desired,expected) ==
+                    expected;
+        #else
+            return __sync_bool_compare_and_swap(&mValue,expected,desired);
+        #endif
+        }
+
+        /// Gets current value
+        inline long get() const
+        {
+        #ifdef _MSC_VER
+            return InterlockedCompareExchange(
+                    const_cast<volatile long *>(&mValue),0,0);
+        #else
+            return __sync_add_and_fetch(const_cast<volatile long *>(&mValue),0);
+        #endif
+        }
+
+    private:
+        /// Counter value
+        volatile long mValue;
+
+        // Not copyable
+        AtomicCounter(const AtomicCounter &);
+        AtomicCounter &operator=(const AtomicCounter &);
+    };
+} // namespace
+
+#endif
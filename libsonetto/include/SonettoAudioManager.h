@@ -31,6 +31,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #define SONETTO_AUDIOMANAGER_H
 
 #include <string>
+#include <vector>
 #include <AL/alc.h>
 #include <OgreSingleton.h>
 #include <OgreSharedPtr.h>
@@ -58,14 +59,44 @@ namespace Sonetto
             device Desired device name to be used (NULL is default).
         */
         AudioManager()
-                : mInitialised(false), mMasterMusicVolume(1.0f), mNextBGM(0),
+                : mInitialised(false), mOpcodesRegistered(false),
+                mDevice(NULL), mMasterMusicVolume(1.0f), mMusicStream(NULL),
+                mNextBGM(0),
                 mNextBGMPos(0), mNextME(0), mMasterSoundVolume(1.0f),
+                mSoundCache(NULL), mSoundBudget(0), mSoundBytes(0),
+                mSoundUseClock(0), mSoundBytesMetric(NULL),
+                mSoundEvictionsMetric(NULL), mSoundReloadsMetric(NULL),
                 mListenerNode(NULL) {}
 
         /// Private destructor, only accessible by the Kernel
         ~AudioManager();
 
-        void initialize(const char *device = NULL);
+        /** Initializes audio
+
+            Opens the audio device and registers audio script opcodes. If no
+            device can be opened (or `openDevice' is false), audio is stubbed
+            out: the opcodes are still registered, but playing, loading and
+            updating do nothing and isInitialised() returns false.
+        @param device
+            Desired device name to be used (NULL is default).
+        @param openDevice
+            Whether to open an audio device at all (false in headless mode).
+        @param musicBufferSize
+            Size of each music stream buffer, in bytes (0 is the default).
+        @param musicBuffers
+            Most buffers the music stream may queue (0 is the default).
+        @param soundCacheDir
+            Directory where decoded sounds are cached (see SoundCache);
+            empty not to cache them.
+        @param soundCacheSize
+            Most bytes the sound cache may take.
+        @see
+            MusicStream::MusicStream()
+        */
+        void initialize(const char *device = NULL,bool openDevice = true,
+                size_t musicBufferSize = 0,size_t musicBuffers = 0,
+                const std::string &soundCacheDir = "",
+                size_t soundCacheSize = 0);
 
         /** Overrides standard Singleton retrieval
 
@@ -105,7 +136,11 @@ namespace Sonetto
         */
         static AudioManager *getSingletonPtr();
 
-        /// Updates
+        /** Updates
+
+            Also uploads to OpenAL the sound sets started with
+            loadSoundSetAsync() that finished decoding.
+        */
         void _update(float deltatime);
 
         /// @see mInitialised
@@ -181,6 +216,51 @@ namespace Sonetto
         /// Returns a sound reference from the loaded sounds map
         inline const Sound &_getSound(size_t id) const { return mSounds.find(id)->second; }
 
+        /** Attaches a loaded sound to a sound source
+
+            Called by SoundSource when it attaches the sound's buffer. The
+            sound cannot be evicted until _releaseSound() is called as many
+            times. If it was evicted, it is loaded again in the background,
+            like loadSoundSetAsync() does, and the sound source waits for
+            it with _getSoundBuffer(). Without an audio device, any sound is
+            accepted.
+        @return
+            The sound's OpenAL buffer (0 while it is being loaded again,
+            and without an audio device).
+        */
+        ALuint _acquireSound(uint32 id);
+
+        /** Gets a loaded sound's OpenAL buffer
+
+            Used by sound sources waiting for a sound that _acquireSound()
+            started loading again.
+        @return
+            The buffer, or 0 while the sound is evicted or not loaded.
+        */
+        ALuint _getSoundBuffer(uint32 id) const;
+
+        /// Detaches a sound acquired with _acquireSound() from a sound source
+        void _releaseSound(uint32 id);
+
+        /** Sets how much memory loaded sounds may take
+
+            Once loaded sounds take more than `bytes', the least recently
+            used ones that no sound source holds are evicted: their buffers
+            are deleted, but they stay loaded, and are loaded again when a
+            sound source uses them (in the background; see _acquireSound()),
+            or when they are loaded again with loadSoundSet() or
+            loadSoundSetAsync().
+        @param
+            bytes Memory budget, in bytes (0 for no limit, the default).
+        */
+        void setSoundBudget(size_t bytes);
+
+        /// Gets how much memory loaded sounds may take (0 for no limit)
+        inline size_t getSoundBudget() const { return mSoundBudget; }
+
+        /// Gets how much memory the buffers of loaded sounds take
+        inline size_t getSoundBytes() const { return mSoundBytes; }
+
         /** Plays a background music
 
             This method has three case scenarios. It can be called when there
@@ -264,8 +344,11 @@ namespace Sonetto
             zero, then there is a BGM to be played, and this method plays
             it from the position described in mNextBGMPos, and with a fade in speed of
             mNextBGMFade.
+        @param
+            continued Whether mMusicStream already went on playing the BGM
+            preloaded by preloadNext(), right after the ME's end.
         */
-        void _streamEnded();
+        void _streamEnded(bool continued);
 
         /** Gets called by mMusicStream when it ends fading a music (both in or out)
 
@@ -302,12 +385,21 @@ namespace Sonetto
             the desired methods, either by creating it with createSound() or by
             playing it with playSound(). A loaded sound can be unloaded with unloadSound().
             Sounds that remain in memory when the AudioManager is destroyed are destroyed
-            too.
+            too. Loading a sound that is already loaded only marks it as recently used
+            (see setSoundBudget()), or loads it again if it was evicted.
         @param
             id An index inside Database::mSoundDefList to be loaded (0 is invalid).
         */
         void loadSound(uint32 id);
 
+        /** Preloads the music that is going to be played next
+
+            Tells mMusicStream to start decoding the queued ME or BGM (see
+            mNextME and mNextBGM), so that no decoding is left to be done when
+            it starts playing. Must be called whenever those change.
+        */
+        void preloadNext();
+
         /** Unloads a sound from memory
 
             This method will delete the mSounds[id] sound entry. Any sound sources using
@@ -322,7 +414,42 @@ namespace Sonetto
             return (mSounds.find(id) != mSounds.end());
         }
 
+        /** Loads all sounds of a sound set into memory
+
+            The sounds are decoded in parallel by the JobSystem's workers
+            (the calling thread helps while waiting for them), and then
+            uploaded to OpenAL by the calling thread. If the set was being
+            loaded by loadSoundSetAsync(), waits for it instead. How long
+            loading took, and how much decoding the sound cache saved, is
+            logged.
+        @param
+            id Index of the sound set in Database::soundSets (0 is invalid).
+        */
         void loadSoundSet(uint32 id);
+
+        /** Starts loading all sounds of a sound set in the background
+
+            Same as loadSoundSet(), but returns right away. The files are
+            opened now; decoding is left to the JobSystem's workers, and
+            _update() uploads the sounds once all of them are decoded, a
+            bounded amount of data per frame.
+            Until then, isSoundSetLoading() returns true for this set and
+            its sounds are not loaded yet. Sounds that another set is
+            already loading are left to that set. Decoding errors are
+            thrown by _update().
+        @param
+            id Index of the sound set in Database::soundSets (0 is invalid).
+        */
+        void loadSoundSetAsync(uint32 id);
+
+        /// Whether a sound set started by loadSoundSetAsync() is still loading
+        bool isSoundSetLoading(uint32 id) const;
+
+        /** Unloads all sounds of a sound set from memory
+
+            If the set is still being loaded by loadSoundSetAsync(), waits
+            for it to finish first.
+        */
         void unloadSoundSet(uint32 id);
 
         /** Creates a new sound source
@@ -377,6 +504,9 @@ namespace Sonetto
         */
         void playSound(size_t id,float aMaxVolume = 1.0f,Ogre::Node *node = NULL);
 
+        /// Gets the number of sound sources currently playing
+        size_t getActiveSoundSourceCount() const;
+
         /** Throws an exception if OpenAL reports an error
 
             This method will throw an Exception with information about
@@ -390,10 +520,123 @@ namespace Sonetto
         */
         void _alErrorCheck(const char *location,const char *desc);
 
+        /** Opens an audio file
+
+            Audio files are looked up in Ogre's resource groups first, so
+            that they can come from any resource location (packs included);
+            files not found there are opened from disk, memory mapped. Open
+            the returned stream with ovOpenDataStream().
+        @param
+            name File name (e.g. SoundDef::FOLDER followed by a sound's
+            filename).
+        */
+        Ogre::DataStreamPtr _openFile(const std::string &name);
+
     private:
+        /// A sound being decoded (defined in SonettoAudioManager.cpp)
+        struct SoundDecode;
+
+        /// A sound set being loaded (defined in SonettoAudioManager.cpp)
+        struct SoundSetLoad;
+
+        /** Opens a sound file to be decoded by decodeSound()
+
+            Throws if `id' is unknown or being loaded.
+        @return
+            Whether the file was opened. Sounds loaded and not evicted are
+            only marked as recently used, and nothing is opened when audio
+            is stubbed out.
+        */
+        bool openSound(uint32 id,SoundDecode &sound);
+
+        /** Fills a sound's SoundFileInfo
+
+            Left empty if the file cannot be found on disk, so that it is
+            hashed every time it is decoded.
+        @param name
+            File name, as given to _openFile().
+        */
+        void statSound(const std::string &name,SoundDecode &sound);
+
+        /** Decodes a sound opened by openSound() into PCM
+
+            Job function run by the JobSystem (`data' is a SoundDecode).
+            Sounds in the sound cache are mapped from it instead, and
+            decoded sounds are stored there. Errors are kept in the
+            SoundDecode, to be thrown by the thread that owns the
+            AudioManager.
+        */
+        static void decodeSound(void *data);
+
+        /** Uploads a decoded sound to an OpenAL buffer
+
+            Adds it to mSounds, or gives its entry the buffer back if it was
+            evicted.
+        */
+        void uploadSound(SoundDecode &sound);
+
+        /// Closes a sound's files and frees its PCM data
+        void releaseSound(SoundDecode &sound);
+
+        /** Opens all sounds of a sound set and submits them to be decoded
+
+            Returns NULL when audio is stubbed out.
+        */
+        SoundSetLoad *beginSoundSetLoad(uint32 id);
+
+        /** Starts loading an evicted sound again in the background
+
+            The load is added to mSoundSetLoads, as a sound set load with
+            ID 0, and uploaded by _update().
+        */
+        void beginSoundReload(uint32 id);
+
+        /** Decodes the sounds of a sound set load
+
+            Submits them to the JobSystem, or decodes them right away if it
+            has no workers.
+        */
+        void decodeSoundSet(SoundSetLoad *load);
+
+        /** Waits for a sound set to be decoded and uploads its sounds
+
+            Deletes `load', even if this method throws.
+        */
+        void finishSoundSetLoad(SoundSetLoad *load);
+
+        /** Uploads the next decoded sounds of a sound set
+
+            Stops once `bytes' of PCM data were uploaded, or when there are
+            no sounds left, but always uploads at least one sound.
+        @return
+            Bytes of PCM data uploaded.
+        */
+        size_t uploadSoundSet(SoundSetLoad *load,size_t bytes);
+
+        /// Releases all sounds of a sound set load and deletes it
+        void discardSoundSetLoad(SoundSetLoad *load);
+
+        /** Removes a sound set from mSoundSetLoads (NULL if it is not there)
+
+            Sound reloads (ID 0) are never taken.
+        */
+        SoundSetLoad *takeSoundSetLoad(uint32 id);
+
+        /// Whether a sound is in a sound set being loaded
+        bool isSoundLoading(uint32 id) const;
+
+        /// Finishes loading the sound set a sound is being loaded with, if any
+        void finishSoundLoading(uint32 id);
+
+        /// Evicts least recently used sounds until mSoundBudget is met
+        void trimSounds();
+
         /// Whether the AudioManager has initialised correctly or not
         bool mInitialised;
 
+        /// Whether audio script opcodes were registered by initialize()
+        bool mOpcodesRegistered;
+
         /// An open OpenAL audio device
         ALCdevice *mDevice;
 
@@ -440,6 +683,30 @@ namespace Sonetto
         */
         SoundSourceVector mSoundSources;
 
+        /// Sound sets started by loadSoundSetAsync() that were not uploaded yet
+        std::vector<SoundSetLoad *> mSoundSetLoads;
+
+        /// Decoded sound cache (NULL if disabled)
+        SoundCache *mSoundCache;
+
+        /// Most bytes the buffers of mSounds may take (0 for no limit)
+        size_t mSoundBudget;
+
+        /// Bytes taken by the buffers of mSounds
+        size_t mSoundBytes;
+
+        /// Incremented whenever a sound is used, to order them (see Sound::lastUse)
+        unsigned long long mSoundUseClock;
+
+        /// Mirrors mSoundBytes
+        MetricGauge *mSoundBytesMetric;
+
+        /// Sounds evicted to meet mSoundBudget
+        MetricCounter *mSoundEvictionsMetric;
+
+        /// Evicted sounds loaded again
+        MetricCounter *mSoundReloadsMetric;
+
         /** Node from which the audio listener will inherit its coordinates
 
             If set to NULL, the audio listener will use Kernel's top module camera position.
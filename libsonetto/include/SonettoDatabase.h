@@ -37,6 +37,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "SonettoMusic.h"
 #include "SonettoSoundSource.h"
 #include "SonettoSoundSet.h"
+#include "SonettoMemory.h"
 
 namespace Sonetto
 {
@@ -57,10 +58,12 @@ namespace Sonetto
         IDVector defaultFootsteps;
     };
 
-    typedef std::vector<GroundType> GroundTypeVector;
+    typedef std::vector<GroundType,TaggedAllocator<GroundType,
+            MEMTAG_DATABASE> > GroundTypeVector;
 
     typedef std::map<uint32,IDVector> FootwearSounds;
-    typedef std::vector<FootwearSounds> FootwearSoundsVector;
+    typedef std::vector<FootwearSounds,TaggedAllocator<FootwearSounds,
+            MEMTAG_DATABASE> > FootwearSoundsVector;
 
     class SONETTO_API Database : public Ogre::Singleton<Database>
     {
@@ -107,6 +107,10 @@ namespace Sonetto
         std::vector<FontGlyph> mGlyph;
         /// Texture Data.
         Ogre::Image * mFontImage;
+        /// Pixel buffer of mFontImage (accounted to MEMTAG_FONTS).
+        unsigned char * mFontImageData;
+        /// Size of mFontImageData in bytes.
+        size_t mFontImageSize;
 
     };
 
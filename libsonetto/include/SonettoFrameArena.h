@@ -0,0 +1,192 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_FRAMEARENA_H
+#define SONETTO_FRAMEARENA_H
+
+#include <cassert>
+#include <vector>
+#include <SDL/SDL_mutex.h>
+#include "SonettoPrerequisites.h"
+#include "SonettoAtomic.h"
+
+namespace Sonetto
+{
+    /// Initial FrameArena capacity, in bytes
+    const size_t DEFAULT_FRAME_ARENA_SIZE = 64 * 1024;
+
+    /** Linear allocator for memory that lives for a single frame
+
+        Owned by the Kernel (see Kernel::getFrameArena()), which resets it
+        at the beginning of every frame. Allocating is a single atomic add,
+        so it can be done from any thread; nothing is freed individually.
+        If a frame needs more than the arena's capacity, the excess is taken
+        from the heap and the arena grows on the next reset, so that the
+        following frames fit in it.
+    @remarks
+        Objects created in the arena are not destroyed by reset(); use
+        FramePtr to destroy them at the end of a scope. In DEBUG builds,
+        reset() fills released memory with FRAME_ARENA_POISON, and FramePtr
+        asserts that its memory was not released meanwhile.
+    */
+    class SONETTO_API FrameArena
+    {
+    public:
+        /// Allocation alignment, in bytes
+        static const size_t ALIGNMENT = 16;
+
+        /// Byte written over released memory in DEBUG builds
+        static const unsigned char FRAME_ARENA_POISON = 0xDD;
+
+        /// Constructor
+        FrameArena(size_t capacity = DEFAULT_FRAME_ARENA_SIZE);
+
+        /// Destructor
+        ~FrameArena();
+
+        /** Allocates memory valid until the next reset()
+
+            The returned memory is aligned to ALIGNMENT bytes.
+        */
+        void *allocate(size_t bytes);
+
+        /** Releases everything allocated since the last reset
+
+            Must only be called while no other thread uses the arena.
+        */
+        void reset();
+
+        /// Gets the number of times reset() was called
+        inline unsigned long getGeneration() const { return mGeneration; }
+
+        /// Gets the number of bytes allocated since the last reset
+        inline size_t getUsed() const { return mOffset.get(); }
+
+        /// Gets the arena capacity, in bytes
+        inline size_t getCapacity() const { return mCapacity; }
+
+        /// Gets the most bytes a frame has allocated
+        inline size_t getPeak() const { return mPeak; }
+
+    private:
+        /** Allocates `bytes' aligned to ALIGNMENT bytes from the heap
+
+            The heap only guarantees the alignment of the largest basic
+            type, so ALIGNMENT - 1 more bytes are taken. The block to be
+            given back to freeAligned() is returned in `block'.
+        */
+        static char *allocateAligned(size_t bytes,void *&block);
+
+        /// Frees memory allocated with allocateAligned()
+        static void freeAligned(void *block,size_t bytes);
+
+        /// Arena memory (aligned to ALIGNMENT bytes)
+        char *mBuffer;
+
+        /// Heap block mBuffer lies in (see allocateAligned())
+        void *mBlock;
+
+        /// Size of mBuffer
+        size_t mCapacity;
+
+        /// Bytes allocated since the last reset (may exceed mCapacity)
+        AtomicCounter mOffset;
+
+        /** Heap blocks allocated when the arena was full, with the
+            sizes given to allocateAligned()
+        */
+        std::vector<std::pair<void *,size_t> > mOverflow;
+
+        /// Guards mOverflow
+        SDL_mutex *mOverflowMutex;
+
+        /// Number of resets
+        volatile unsigned long mGeneration;
+
+        /// Most bytes a frame has allocated
+        size_t mPeak;
+
+        // Not copyable
+        FrameArena(const FrameArena &);
+        FrameArena &operator=(const FrameArena &);
+    };
+
+    /** Scoped pointer to an object created in a FrameArena
+
+        Destroys the object when going out of scope (its memory is only
+        released by FrameArena::reset()). In DEBUG builds, asserts that the
+        arena was not reset while the object was in use.
+        @code
+        FramePtr<Opcode> opcode(arena,
+                new (arena.allocate(sizeof(Opcode))) Opcode(handler));
+        @endcode
+    */
+    template<class T>
+    class FramePtr
+    {
+    public:
+        inline FramePtr(const FrameArena &arena,T *ptr)
+                : mArena(&arena), mGeneration(arena.getGeneration()),
+                  mPtr(ptr) {}
+
+        inline ~FramePtr()
+        {
+            if (mPtr)
+            {
+                check();
+                mPtr->~T();
+            }
+        }
+
+        inline T *operator->() const { check(); return mPtr; }
+        inline T &operator*() const { check(); return *mPtr; }
+        inline T *get() const { check(); return mPtr; }
+
+    private:
+        /// Asserts that the object's memory is still valid
+        inline void check() const
+        {
+        #ifdef DEBUG
+            assert(mArena->getGeneration() == mGeneration &&
+                    "Frame memory used after FrameArena::reset()");
+        #endif
+        }
+
+        const FrameArena *mArena;
+        unsigned long mGeneration;
+        T *mPtr;
+
+        // Not copyable
+        FramePtr(const FramePtr &);
+        FramePtr &operator=(const FramePtr &);
+    };
+} // namespace
+
+#endif
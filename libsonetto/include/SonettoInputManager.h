@@ -30,6 +30,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef SONETTO_INPUTMANAGER_H
 #define SONETTO_INPUTMANAGER_H
 
+#include <fstream>
+#include <vector>
 #include <SDL/SDL.h>
 #include <OgreSingleton.h>
 #include "SonettoPrerequisites.h"
@@ -59,12 +61,11 @@ namespace Sonetto
 
         /** Initializes InputManager
 
-        @remarks
-            On Linux builds, this method takes no parameters
-        @param
-            hWnd Window handle (HWND) to be used with DirectInput.
+        @param useDevices
+            If false, no input devices are opened or polled, and all keys
+            and buttons read as released (used in headless mode).
         */
-        void initialize();
+        void initialize(bool useDevices = true);
 
         /** Overrides standard Singleton retrieval
 
@@ -111,6 +112,24 @@ namespace Sonetto
         */
         void update();
 
+        /** Polls input devices
+
+            First half of update(): takes a snapshot of the keyboard and
+            updates joysticks. Must be called from the main thread.
+        @see
+            Kernel::run()
+        */
+        void _pollDevices();
+
+        /** Updates key and PlayerInput states
+
+            Second half of update(): works only on the snapshot taken by the
+            last call to _pollDevices(), so it can be called from the
+            simulation thread (and more than once per poll, to advance
+            pressed keys to held ones).
+        */
+        void _updateStates();
+
         /** Retrieves a PlayerInput given its index
 
         @remarks
@@ -144,7 +163,90 @@ namespace Sonetto
         */
         inline KeyState getDirectKeyState(uint16 key) const { return mKeyboardStates[key]; }
 
+        /** Checks a physical keyboard key state as of the last poll
+
+            Unlike getDirectKeyState(), which advances once per simulation
+            tick, this advances once per _pollDevices() call, that is, once
+            per rendered frame. Kernel hotkeys use it so that a press is
+            seen exactly once however many ticks a frame runs.
+        @param
+            key Key to be checked.
+        */
+        inline KeyState getFrameKeyState(uint16 key) const { return mFrameKeyStates[key]; }
+
+        /** Sets a raw keyboard key state, as _pollDevices() does
+
+            Lets tools drive input without devices (see initialize()); the
+            next _updateStates() call records it, like a real key press.
+            Overwritten by the next poll when devices are used, or by the
+            replay while replaying.
+        @param
+            key Key to be set (SDLK_FIRST to SDLK_LAST).
+        */
+        inline void _setRawKeyState(uint16 key,bool down) { mRawKeyboard[key] = down; }
+
+        /** Starts recording input into a file
+
+            Raw keyboard and joystick states are recorded once per
+            simulation tick (that is, per _updateStates() call), so that a
+            replay drives the game exactly as it was played, however many
+            ticks each rendered frame ran. Only what changed since the
+            previous tick is written; runs of ticks without changes take a
+            single byte.
+        @remarks
+            Reseeds the pseudo-random number generator, writing the seed
+            into the recording so that startReplay() can reuse it.
+        @remarks
+            Must not be called while the simulation thread is running.
+        @param fileName
+            File to be written.
+        @see
+            startReplay()
+        */
+        void startRecording(const std::string &fileName);
+
+        /// Stops recording and closes the recording file
+        void stopRecording();
+
+        /// Whether input is being recorded
+        inline bool isRecording() const { return mRecordFile.is_open(); }
+
+        /** Replays a recording in place of the input devices
+
+            The whole file is read up front. From the next tick on, raw
+            keyboard and joystick states come from it instead of SDL. When
+            it ends, every key and button is released and devices are used
+            again. For repeatable benchmarks, replay in headless mode (see
+            Kernel::setHeadless()), where each frame runs exactly one tick.
+        @remarks
+            Reseeds the pseudo-random number generator with the recorded
+            seed, so that Math::random() returns what it did when recording.
+        @remarks
+            Must not be called while the simulation thread is running.
+        @param fileName
+            File written by startRecording().
+        */
+        void startReplay(const std::string &fileName);
+
+        /// Stops replaying, releasing every key and button
+        void stopReplay();
+
+        /// Whether a recording is being replayed
+        inline bool isReplaying() const { return mReplaying; }
+
+        /// Whether a replay has reached the end of its recording
+        inline bool isReplayFinished() const { return mReplayFinished; }
+
     private:
+        /// Writes the changes of this tick into the recording
+        void recordTick();
+
+        /// Reads the changes of this tick from the replay
+        void replayTick();
+
+        /// Writes pending ticks without changes into the recording
+        void flushIdleTicks();
+
         /// Vector of Joystick shared pointers
         typedef std::vector<JoystickPtr> JoystickPtrVector;
 
@@ -164,6 +266,9 @@ namespace Sonetto
         /// Whether this singleton is initialized or not
         bool mInitialized;
 
+        /// Whether input devices are polled (see initialize())
+        bool mUseDevices;
+
         /** Keyboard keystates
 
         @see
@@ -171,6 +276,42 @@ namespace Sonetto
         */
         KeyState mKeyboardStates[SDLK_LAST + 1];
 
+        /// Raw keyboard snapshot taken by _pollDevices()
+        uint8 mRawKeyboard[SDLK_LAST + 1];
+
+        /// Keyboard keystates advanced once per poll (see getFrameKeyState())
+        KeyState mFrameKeyStates[SDLK_LAST + 1];
+
+        /// Recording file (see startRecording())
+        std::ofstream mRecordFile;
+
+        /// Raw keyboard state written by the last recorded tick
+        uint8 mRecordKeyboard[SDLK_LAST + 1];
+
+        /// Raw joystick buttons written by the last recorded tick
+        std::vector<uint32> mRecordJoyButtons;
+
+        /// Raw joystick axes written by the last recorded tick
+        std::vector<int16> mRecordJoyAxes;
+
+        /// Recorded ticks without changes not written yet
+        size_t mRecordIdleTicks;
+
+        /// Whole replay file (see startReplay())
+        std::vector<uint8> mReplayData;
+
+        /// Read position in mReplayData
+        size_t mReplayPos;
+
+        /// Ticks without changes left before reading the next record
+        size_t mReplayIdleTicks;
+
+        /// Whether a recording is being replayed
+        bool mReplaying;
+
+        /// Whether the last replay reached its end
+        bool mReplayFinished;
+
         ScriptInputHandler mScriptInputHandler;
     };
 } // namespace
@@ -0,0 +1,347 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_JOBSYSTEM_H
+#define SONETTO_JOBSYSTEM_H
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <SDL/SDL_thread.h>
+#include <SDL/SDL_mutex.h>
+#include <OgreSingleton.h>
+#include "SonettoPrerequisites.h"
+#include "SonettoAtomic.h"
+
+namespace Sonetto
+{
+    /// Function run by a job (`data' is the pointer given to JobSystem::submit())
+    typedef void (*JobFunction)(void *data);
+
+    /** Counts the unfinished jobs of a group
+
+        Given to JobSystem::submit(), which increments it; it is decremented
+        when the job ends. JobSystem::wait() sleeps on it when there is
+        nothing left to help with. Jobs that throw are counted as failed,
+        and the first error message is kept.
+    @remarks
+        Must not be destroyed while any of its jobs is unfinished.
+    */
+    class SONETTO_API JobCounter
+    {
+    public:
+        /// Constructor
+        JobCounter();
+
+        /// Destructor
+        ~JobCounter();
+
+        /// Gets the number of unfinished jobs
+        inline long get() const { return mCount.get(); }
+
+        /// Gets the number of jobs that threw an exception
+        inline long getFailedNum() const { return mFailed.get(); }
+
+        /** Gets the error message of the first job that threw
+
+            Empty if none did. Only meaningful once get() is zero.
+        */
+        inline const std::string &getError() const { return mError; }
+
+    private:
+        friend class JobSystem;
+
+        /// Not copyable
+        JobCounter(const JobCounter &);
+        JobCounter &operator=(const JobCounter &);
+
+        /// Counts a job that ended, failed if `error' is not NULL
+        void jobEnded(const char *error);
+
+        /// Unfinished jobs
+        AtomicCounter mCount;
+
+        /// Jobs that threw
+        AtomicCounter mFailed;
+
+        /// First error message
+        std::string mError;
+
+        /// Guards mError and mCountZero
+        SDL_mutex *mMutex;
+
+        /// Signaled when mCount reaches zero
+        SDL_cond *mCountZero;
+    };
+
+    /** A unit of work to be run by the JobSystem
+
+    @see
+        JobSystem::submit()
+    */
+    struct Job
+    {
+        /// Function to be run
+        JobFunction function;
+
+        /// User data passed to `function'
+        void *data;
+
+        /// Counter decremented when the job ends (can be NULL)
+        JobCounter *counter;
+    };
+
+    /** Pool of worker threads shared by the whole engine
+
+        Owned by the Kernel. Each worker has its own job queue; jobs
+        submitted from a worker go to its own queue, and idle workers steal
+        jobs from the others' queues. Jobs submitted from any other thread
+        go to a shared queue, which workers also steal from.
+
+        Jobs can be grouped with a JobCounter: submit() increments it and it
+        is decremented when the job ends, so that wait() can be used to join
+        a group of jobs. Threads calling wait() run pending jobs instead of
+        blocking, so jobs can themselves fork and join other jobs without
+        deadlocking the pool; they only sleep when the jobs left are all
+        running elsewhere.
+    @remarks
+        Jobs must not touch Ogre, SDL video or OpenAL state unless the
+        called code is known to be thread safe.
+    */
+    class SONETTO_API JobSystem : public Ogre::Singleton<JobSystem>
+    {
+    public:
+        /** Constructor
+
+        @param workers
+            Number of worker threads. If zero, one worker is created for
+            each hardware thread but the one running the calling thread,
+            which is expected to help by calling wait().
+        */
+        JobSystem(size_t workers = 0);
+
+        /// Destructor (waits for the running jobs and stops all workers)
+        ~JobSystem();
+
+        /** Overrides standard Singleton retrieval
+
+        @remarks
+            Warning: These comments below were copied straight from Ogre3D code.
+            Why do we do this? Well, it's because the Singleton
+            implementation is in a .h file, which means it gets compiled
+            into anybody who includes it. This is needed for the
+            Singleton template to work, but we actually only want it
+            compiled into the implementation of the class based on the
+            Singleton, not all of them. If we don't change this, we get
+            link errors when trying to use the Singleton-based class from
+            an outside dll.
+        @param
+            This method just delegates to the template version anyway,
+            but the implementation stays in this single compilation unit,
+            preventing link errors.
+        */
+        static JobSystem &getSingleton();
+
+        /** Overrides standard Singleton retrieval
+
+        @remarks
+            Warning: These comments below were copied straight from Ogre3D code.
+            Why do we do this? Well, it's because the Singleton
+            implementation is in a .h file, which means it gets compiled
+            into anybody who includes it. This is needed for the
+            Singleton template to work, but we actually only want it
+            compiled into the implementation of the class based on the
+            Singleton, not all of them. If we don't change this, we get
+            link errors when trying to use the Singleton-based class from
+            an outside dll.
+        @param
+            This method just delegates to the template version anyway,
+            but the implementation stays in this single compilation unit,
+            preventing link errors.
+        */
+        static JobSystem *getSingletonPtr();
+
+        /** Submits a job
+
+        @param function
+            Function to be run by a worker.
+        @param data
+            Pointer passed to `function'. Must stay valid until the job ends.
+        @param counter
+            If not NULL, incremented now and decremented when the job ends.
+        */
+        void submit(JobFunction function,void *data,
+                JobCounter *counter = NULL);
+
+        /** Waits until `counter' reaches zero
+
+            The calling thread runs pending jobs while waiting, and sleeps
+            when there are none.
+        @remarks
+            Does not throw when jobs failed; check counter.getFailedNum().
+        */
+        void wait(JobCounter &counter);
+
+        /** Runs `function' over a range of indices in parallel
+
+            Splits [begin,end) into chunks of at most `grainSize' indices and
+            calls `function(chunkBegin,chunkEnd)' for each of them in the
+            pool, returning only after all chunks were processed.
+        @remarks
+            If `function' throws, the error is rethrown once every chunk
+            ended.
+        @param grainSize
+            Indices per chunk. If zero, a size that gives each thread a few
+            chunks is chosen.
+        */
+        template<class Function>
+        void parallelFor(size_t begin,size_t end,size_t grainSize,
+                Function &function)
+        {
+            std::vector< ParallelForChunk<Function> > chunks;
+            JobCounter counter;
+
+            if (begin >= end)
+            {
+                return;
+            }
+
+            if (grainSize == 0)
+            {
+                grainSize = (end - begin) / ((mWorkers.size() + 1) * 4);
+                if (grainSize == 0)
+                {
+                    grainSize = 1;
+                }
+            }
+
+            chunks.reserve((end - begin + grainSize - 1) / grainSize);
+            for (size_t i = begin;i < end;i += grainSize)
+            {
+                ParallelForChunk<Function> chunk;
+
+                chunk.function = &function;
+                chunk.begin = i;
+                chunk.end = (end - i > grainSize) ? i + grainSize : end;
+                chunks.push_back(chunk);
+            }
+
+            for (size_t i = 0;i < chunks.size();++i)
+            {
+                submit(&JobSystem::runParallelForChunk<Function>,&chunks[i],
+                        &counter);
+            }
+
+            wait(counter);
+            if (counter.getFailedNum() > 0)
+            {
+                SONETTO_THROW("parallelFor() job failed: " +
+                        counter.getError());
+            }
+        }
+
+        /// Gets the number of worker threads
+        inline size_t getWorkerNum() const { return mWorkers.size(); }
+
+        /// Gets the number of hardware threads in this machine
+        static size_t getHardwareThreadNum();
+
+    private:
+        /// A job queue, guarded by its own mutex
+        struct JobQueue
+        {
+            std::deque<Job> jobs;
+            SDL_mutex *mutex;
+        };
+
+        /// Worker thread data
+        struct Worker
+        {
+            JobSystem *jobSystem;
+            size_t queue;
+            SDL_Thread *thread;
+            volatile Uint32 threadID;
+        };
+
+        /// parallelFor() chunk
+        template<class Function>
+        struct ParallelForChunk
+        {
+            Function *function;
+            size_t begin;
+            size_t end;
+        };
+
+        /// Runs a parallelFor() chunk
+        template<class Function>
+        static void runParallelForChunk(void *data)
+        {
+            ParallelForChunk<Function> *chunk =
+                    static_cast<ParallelForChunk<Function> *>(data);
+
+            (*chunk->function)(chunk->begin,chunk->end);
+        }
+
+        /// Gets the queue owned by the calling thread (0 if not a worker)
+        size_t getCurrentQueue() const;
+
+        /** Runs one pending job, if any
+
+            Takes from the back of the `queue' first, then steals from the
+            front of the other queues.
+        @return
+            Whether a job was run.
+        */
+        bool runPendingJob(size_t queue);
+
+        /// Worker thread entry point (`data' is its Worker)
+        static int workerThread(void *data);
+
+        /// Job queues (0 is shared by threads that are not workers)
+        std::vector<JobQueue> mQueues;
+
+        /// Worker threads
+        std::vector<Worker *> mWorkers;
+
+        /// Jobs submitted and not taken from a queue yet
+        size_t mPendingJobs;
+
+        /// Guards mPendingJobs and mJobsAvailable
+        SDL_mutex *mPendingMutex;
+
+        /// Signaled when a job is submitted, to wake up an idle worker
+        SDL_cond *mJobsAvailable;
+
+        /// Tells workers to finish
+        volatile bool mQuit;
+    };
+} // namespace
+
+#endif
@@ -30,6 +30,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef SONETTO_JOYSTICK_H
 #define SONETTO_JOYSTICK_H
 
+#include <cstring>
 #include <OgreSharedPtr.h>
 #include <OgreVector2.h>
 #include <SDL/SDL_joystick.h>
@@ -77,7 +78,13 @@ namespace Sonetto
             RWA_2
         };
 
-        Joystick(uint32 id) : mID(id),mJoy(NULL) {}
+        /// Number of raw axes kept (two per RawAnalog)
+        static const size_t RAW_AXIS_NUM = 4;
+
+        Joystick(uint32 id) : mID(id),mJoy(NULL),mRawButtons(0)
+        {
+            memset(mRawAxes,0,sizeof(mRawAxes));
+        }
 
         virtual ~Joystick();
 
@@ -90,14 +97,54 @@ namespace Sonetto
 
         void setEnabled(bool enable);
 
+        /** Gets a button state from the last snapshot
+
+        @see
+            _update()
+        */
         bool getRawButtonState(RawButton button);
 
+        /** Gets an analog stick state from the last snapshot
+
+        @see
+            _update()
+        */
         Ogre::Vector2 getRawAnalogState(RawAnalog analog);
 
+        /** Takes a snapshot of the device state
+
+            Called by InputManager::_pollDevices() after SDL_JoystickUpdate().
+            getRawButtonState() and getRawAnalogState() only read this
+            snapshot, so they are safe to call from the simulation thread
+            and can be fed recorded states (see _setRawState()).
+        */
+        void _update();
+
+        /// Gets the raw button snapshot (bit `n - 1' is RawButton `n')
+        inline uint32 _getRawButtons() const { return mRawButtons; }
+
+        /// Gets a raw axis from the snapshot
+        inline int16 _getRawAxis(size_t axis) const { return mRawAxes[axis]; }
+
+        /** Replaces the snapshot (used by input replays)
+
+        @param buttons
+            Raw buttons (see _getRawButtons()).
+        @param axes
+            RAW_AXIS_NUM raw axes.
+        */
+        void _setRawState(uint32 buttons,const int16 *axes);
+
     protected:
         uint32 mID;
 
         SDL_Joystick *mJoy;
+
+        /// Button snapshot (see _getRawButtons())
+        uint32 mRawButtons;
+
+        /// Axes snapshot
+        int16 mRawAxes[RAW_AXIS_NUM];
     };
 } // namespace
 
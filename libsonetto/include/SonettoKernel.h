@@ -33,12 +33,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <SDL/SDL.h>
 #include <SDL/SDL_syswm.h>
 #include <SDL/SDL_video.h>
+#include <SDL/SDL_thread.h>
 #include <Ogre.h>
 #include "SonettoPrerequisites.h"
 #include "SonettoDatabase.h"
 #include "SonettoModule.h"
 #include "SonettoModuleFactory.h"
 #include "SonettoFontManager.h"
+#include "SonettoProfiler.h"
 
 namespace Sonetto
 {
@@ -46,6 +48,68 @@ namespace Sonetto
     const size_t DEFAULT_SCREEN_HEIGHT = 480;
     const size_t DEFAULT_SCREEN_COLOR_DEPTH = 32;
 
+    /// Default simulation rate (ticks per second)
+    const size_t DEFAULT_TICK_RATE = 60;
+
+    /** Maximum simulation ticks run in a single frame
+
+        If a frame takes too long (a hitch, a breakpoint, etc.), the
+        simulation does not try to catch up with all the time lost, which
+        could make the next frame take even longer.
+    */
+    const size_t MAX_TICKS_PER_FRAME = 5;
+
+    /** Time left in the frame budget that the frame limiter spends spinning
+
+        SDL_Delay() is not precise enough to end a frame exactly on time, so
+        the frame limiter only sleeps until this many microseconds are left,
+        and busy-waits the rest.
+    */
+    const unsigned long FRAME_LIMITER_SPIN_MARGIN = 1000;
+
+    /// Metrics file written when [kernel] metricsFile is not set
+    const char * const DEFAULT_METRICS_FILE = "metrics.jsonl";
+
+    /// Metrics file size limit, in kilobytes, when not configured
+    const size_t DEFAULT_METRICS_MAX_SIZE = 1024;
+
+    /// Prefetch manifest file name (see PrefetchManager)
+    const char * const PREFETCH_MANIFEST_FILE = "prefetch.manifest";
+
+    /// Decoded sound cache directory name (see SoundCache)
+    const char * const SOUND_CACHE_DIR = "soundcache";
+
+    /// Decoded sound cache size limit, in megabytes, when not configured
+    const size_t DEFAULT_SOUND_CACHE_SIZE = 64;
+
+    /// Number of frames considered by Kernel::getFrameStats()
+    const size_t FRAME_STATS_WINDOW = 120;
+
+    /** Frame time statistics
+
+        All times are in seconds, taken from the last FRAME_STATS_WINDOW
+        frames.
+    @see
+        Kernel::getFrameStats()
+    */
+    struct FrameStats
+    {
+        /// Average frame time
+        float average;
+
+        /// Shortest frame time
+        float minimum;
+
+        /// Longest frame time
+        float maximum;
+
+        /// Standard deviation of frame times
+        float jitter;
+
+        /// 99th percentile frame time
+        float percentile99;
+    };
+
     /** Sonetto Kernel
 
         This singleton is the core of this library. When its time to run Sonetto,
@@ -99,8 +163,32 @@ namespace Sonetto
             Kernel::initialize().
         */
         Kernel(const ModuleFactory *moduleFactory)
-                : mModuleFactory(moduleFactory),mIsFullScreen(false),
-                  mInitialized(false) {}
+                : mFrameTime(0.0f),mRenderWindow(NULL),mWindow(NULL),
+                  mFrameArena(NULL),mPackArchiveFactory(NULL),
+                  mNullRenderPlugin(NULL),
+                  mModuleFactory(moduleFactory),
+                  mIsFullScreen(false),mTickTime(1.0f / DEFAULT_TICK_RATE),
+                  mTickAccumulator(0.0f),mInterpolation(0.0f),
+                  mSimInterpolation(0.0f),
+                  mTargetFrameMicroseconds(0),
+                  mFrameTimeHistory(FRAME_STATS_WINDOW,0.0f),
+                  mFrameTimeHistoryPos(0),mFrameTimeHistoryCount(0),
+                  mPipelined(false),mSimThread(NULL),mSimStart(NULL),
+                  mSimDone(NULL),mSimTicks(0),mSimQuit(false),
+                  mWorkerThreads(0),mHeadless(false),mHeadlessFrames(0),
+                  mInitialized(false),mBackgroundLoad(false),
+                  mPendingModule(NULL),mPendingAction(MA_NONE),
+                  mModuleLoader(NULL),mMemoryBudget(0),
+                  mPerformanceHUD(NULL),mMetrics(NULL),
+                  mMetricsInterval(0),mMetricsMaxFileSize(0),
+                  mFramesMetric(NULL),mFrameTimeMetric(NULL),
+                  mScriptCostMetric(NULL),mModuleInitMetric(NULL),
+                  mModuleLoadMetric(NULL),mLastInstructionCount(0),
+                  mModuleLoadStart(0),mPrefetchMan(NULL),
+                  mPrefetchEnabled(true),mPrefetchRecord(false),
+                  mMusicBufferSize(0),mMusicBuffers(0),
+                  mSoundCacheEnabled(false),mSoundCacheSize(0),
+                  mSoundBudget(0) {}
 
         /** Destructor
 
@@ -166,15 +254,86 @@ namespace Sonetto
             return when the game end. The program can then return zero, meaning
             everything went smoothly. If any fatal error occurs, Sonetto will
             throw an exception.
+        @remarks
+            The simulation (input and the active module's update()) runs at a
+            fixed rate, set by the `tickRate' setting in the [kernel] section
+            of the configuration file, independently of how fast frames are
+            rendered. Zero or more ticks can run in each frame.
+        @see
+            Kernel::getTickTime()
+        @see
+            Kernel::getInterpolation()
         */
         void run();
 
+        /** Gets the fixed simulation timestep, in seconds
+
+            Each call to Module::update() advances the simulation by exactly
+            this amount of time.
+        */
+        inline float getTickTime() const { return mTickTime; }
+
+        /** Gets how far rendering is between the last two simulation ticks
+
+            Ranges from 0 to 1. Modules can use this to interpolate what they
+            show between the previous and the current simulation states, so
+            that motion stays smooth when the render rate is not a multiple
+            of the tick rate.
+        @remarks
+            This is the interpolation of the simulation state being rendered.
+            In pipelined mode, that state was simulated in the previous
+            frame, and so is its interpolation.
+        */
+        inline float getInterpolation() const { return mInterpolation; }
+
+        /** Gets frame time statistics
+
+            Useful to check how steady the frame rate is, mainly when the
+            frame limiter is active (see the `targetFPS' setting in the
+            [video] section of the configuration file).
+        */
+        FrameStats getFrameStats() const;
+
         /** Gets currently active game module
 
         @see
             Sonetto::Module
         */
-        inline Module *getActiveModule() { return mModuleStack.top(); }
+        inline Module *getActiveModule() { return mModuleStack.back(); }
+
+        /// Gets the number of modules in the module stack
+        inline size_t getModuleStackSize() const { return mModuleStack.size(); }
+
+        /** Enables or disables headless mode
+
+            In headless mode, no SDL window is created, Ogre renders through
+            a NullRenderSystem (resources load as usual but nothing is drawn)
+            and audio and input devices are stubbed out. The clock
+            is deterministic: each frame advances the game by exactly one
+            tick (see getTickTime()). This allows running module logic,
+            scripts and benchmarks on machines without display or GPU.
+        @remarks
+            Must be called before initialize(). Modules need no special
+            handling to run headless, but may check isHeadless() to skip
+            purely visual work.
+        @param headless
+            Whether to run headless.
+        @param frameCount
+            Number of frames run() steps before returning. If zero, run()
+            only returns when the game shuts down or when an input replay
+            ends (see InputManager::startReplay()).
+        */
+        void setHeadless(bool headless,size_t frameCount = 0);
+
+        /// Whether the Kernel is running headless (see setHeadless())
+        inline bool isHeadless() const { return mHeadless; }
+
+        /** Gets the frame arena
+
+            Memory allocated from it is valid until the beginning of the
+            next frame, when run() resets it (see FrameArena).
+        */
+        inline FrameArena &getFrameArena() { return *mFrameArena; }
 
         /** Sets kernel action to be done after rendering
 
@@ -188,6 +347,17 @@ namespace Sonetto
         @remarks
             When calling this method more than once in the same main loop, only
             the last call to it will be in effect.
+        @remarks
+            With `background' set, the new module is instantiated and what it
+            lists in Module::getPreloadList() starts loading, but the current
+            module keeps running until loading is complete; only then is the
+            new module pushed and initialized. Use isModuleLoading() and
+            getModuleLoadProgress() to show a loading overlay meanwhile.
+            Module actions set while a module is loading are only carried out
+            after it has been pushed.
+        @param background
+            Whether to load the new module in the background. Ignored when
+            `mact' is MA_RETURN.
         @see
             Sonetto::Kernel::KernelAction
         @see
@@ -196,7 +366,31 @@ namespace Sonetto
             Sonetto::Module::ModuleType
         */
         void setAction(KernelAction kact,ModuleAction mact = MA_NONE,
-                Module::ModuleType modtype = Module::MT_NONE);
+                Module::ModuleType modtype = Module::MT_NONE,
+                bool background = false);
+
+        /// Whether a module is being loaded in the background
+        inline bool isModuleLoading() const { return mModuleLoader != NULL; }
+
+        /** Gets background module loading progress
+
+        @return
+            Progress from 0 to 1, or 1 if no module is being loaded.
+        @see
+            Kernel::setAction()
+        */
+        float getModuleLoadProgress() const;
+
+        /** Shows or hides the performance HUD
+
+            Called when F10 is pressed. The HUD is created the first time
+            it is shown, and is only available when a font is set for it in
+            the configuration file ([kernel] hudFont) and not in headless
+            mode.
+        @see
+            PerformanceHUD
+        */
+        void togglePerformanceHUD();
 
         /** Get the Render Window */
         Ogre::RenderWindow * getRenderWindow();
@@ -204,8 +398,11 @@ namespace Sonetto
         inline void setFullScreen(bool fullScreen)
         {
             mIsFullScreen = fullScreen;
-            mRenderWindow->setFullscreen(fullScreen,mScreenWidth,
-                    mScreenHeight);
+            if (mRenderWindow)
+            {
+                mRenderWindow->setFullscreen(fullScreen,mScreenWidth,
+                        mScreenHeight);
+            }
         }
 
         /// Reads a string from an std::ifstream given a preceeding uint16 (Temporary)
@@ -214,7 +411,7 @@ namespace Sonetto
         /// Current Screen Pixel Aspect Ratio.
         float mAspectRatio;
 
-        /// Frame Time.
+        /// Real time taken by the last frame, in seconds.
         float mFrameTime;
 
         /// Pointer to OverlayManager.
@@ -243,19 +440,211 @@ namespace Sonetto
         */
         void pushModule(Module::ModuleType modtype,ModuleAction mact);
 
+        /** Pushes an already instantiated module into stack
+
+            Same as pushModule(Module::ModuleType,ModuleAction), but for
+            modules instantiated beforehand (see beginModuleLoad()).
+        */
+        void pushModule(Module *newmod,ModuleAction mact);
+
+        /** Instantiates a module and starts loading it in the background
+
+        @see
+            Kernel::setAction()
+        */
+        void beginModuleLoad(Module::ModuleType modtype,ModuleAction mact);
+
+        /** Advances background module loading
+
+            Pushes the pending module when its loading is complete.
+        */
+        void updateModuleLoad();
+
+        /** Evicts halted modules while over the memory budget
+
+            Unloads the evictable resource groups of halted modules, oldest
+            first, until the memory used by the modules in the stack fits in
+            the budget (see the `memoryBudget' setting in the [kernel] section
+            of the configuration file). The active module is never evicted.
+            Resource groups listed by more than one module are only counted
+            once, and evicting a module only counts what was really
+            unloaded.
+        @see
+            Module::getEvictableResourceGroups()
+        */
+        void enforceMemoryBudget();
+
+        /** Unloads a halted module's evictable resource groups
+
+            Calls Module::evict() first. Groups also listed by a resident
+            module in the stack are kept, and so are groups holding meshes
+            or skeletons of entities in any scene manager (see
+            getReferencedResourceGroups()).
+        @param index
+            Index of the module in mModuleStack.
+        @return
+            Bytes of loaded resources unloaded.
+        */
+        size_t evictModule(size_t index);
+
+        /** Lists resource groups referenced by live entities
+
+            Unloading a mesh or skeleton leaves the entities created from it
+            pointing at freed data, so groups holding meshes or skeletons of
+            entities in any scene manager must not be unloaded.
+        */
+        void getReferencedResourceGroups(std::vector<std::string> &groups);
+
+        /** Loads back an evicted module's evictable resource groups
+
+            Calls Module::restore() once they are loaded.
+        */
+        void restoreModule(Module *module);
+
         /** Pops current active module from stack
 
             Deinitializes, removes from stack and deletes the current active
-            module, resuming any halted module below it in the stack.
+            module, resuming any halted module below it in the stack (after
+            restoring it, if it was evicted).
         @remarks
             If no module remains in the stack, this method will throw an
             exception.
         */
         void popModule();
 
+        /** Registers the Kernel's default metrics
+
+            Frames, frame times, script instructions per frame and module
+            load times (see MetricsRegistry). Other subsystems register
+            their own (such as audio underruns in MusicStream).
+        */
+        void registerMetrics();
+
         /// Reads the Sonetto Project File
         void readSPF();
 
+        /** Creates the SDL window and shows the loading screen on it
+
+        @param wmInfo
+            Receives window information, used to attach Ogre to the window.
+        */
+        void showLoadingScreen(SDL_SysWMinfo &wmInfo);
+
+        /** Runs the active module's simulation ticks
+
+            Updates input states and the active module mSimTicks times.
+            Called from the simulation thread in pipelined mode, from the
+            main thread otherwise.
+        */
+        void simulate();
+
+        /// Starts the simulation thread used in pipelined mode
+        void startSimulationThread();
+
+        /// Stops the simulation thread used in pipelined mode
+        void stopSimulationThread();
+
+        /// Simulation thread entry point (`data' is the Kernel)
+        static int simulationThread(void *data);
+
+        /** A subsystem initializer run by initialize()
+
+        @see
+            Kernel::runStartupTasks()
+        */
+        struct StartupTask
+        {
+            StartupTask(const char *aName,void (*aFunction)(Kernel *),
+                    bool aMainThread)
+                    : name(aName), function(aFunction),
+                      mainThread(aMainThread), kernel(NULL), doneSem(NULL),
+                      started(false), finished(false), startTicks(0),
+                      endTicks(0) {}
+
+            /// Subsystem name, used in the startup timing report
+            const char *name;
+
+            /// Initializer
+            void (*function)(Kernel *kernel);
+
+            /// Indices of the tasks that must finish before this one starts
+            std::vector<size_t> dependencies;
+
+            /// Whether it must run in the main thread (Ogre, SDL video)
+            bool mainThread;
+
+            /// Kernel passed to `function'
+            Kernel *kernel;
+
+            /// Posted when the task finishes
+            SDL_sem *doneSem;
+
+            /// Whether the task was started
+            bool started;
+
+            /// Whether the task finished (set before posting `doneSem')
+            bool finished;
+
+            /// When the task started and finished (SDL_GetTicks())
+            Uint32 startTicks;
+            Uint32 endTicks;
+
+            /// Error thrown by the task, rethrown in the main thread
+            std::string error;
+        };
+
+        typedef std::vector<StartupTask> StartupTaskVector;
+
+        /** Runs subsystem initializers respecting their dependencies
+
+            Tasks whose dependencies are done run concurrently: those not
+            bound to the main thread are submitted to the JobSystem, while
+            the main thread runs the others. Writes a startup timing report
+            to the game log when all of them are done.
+        @remarks
+            Errors thrown by a task are rethrown after every running task
+            finished; tasks not started by then are not run.
+        */
+        void runStartupTasks(StartupTaskVector &tasks);
+
+        /// Runs a startup task (`data' is its StartupTask)
+        static void runStartupTask(void *data);
+
+        /// Initializes Ogre's render system (main thread)
+        static void startupRenderSystem(Kernel *kernel);
+
+        /// Creates the font manager (main thread)
+        static void startupFontManager(Kernel *kernel);
+
+        /// Creates the audio manager and opens the audio device
+        static void startupAudioManager(Kernel *kernel);
+
+        /// Creates the input manager and enumerates joysticks (main thread)
+        static void startupInputManager(Kernel *kernel);
+
+        /// Creates and loads the database
+        static void startupDatabase(Kernel *kernel);
+
+        /// Registers Sonetto's overlay elements (main thread)
+        static void startupOverlayElements(Kernel *kernel);
+
+#ifdef SONETTO_PROFILING
+        /** Dumps profiler events into the game data path
+
+            Called when F12 is pressed and on shutdown. Each dump goes to a
+            new `profileN.json' file, in Chrome's trace event format.
+        */
+        void dumpProfile();
+#endif
+
+        /** Waits until the frame budget set by `targetFPS' is over
+
+            Sleeps for most of the remaining time and spins for the last
+            FRAME_LIMITER_SPIN_MARGIN microseconds. Does nothing if no
+            target frame rate was configured.
+        */
+        void limitFrameRate();
+
         /// Ogre::Root instance
         Ogre::Root *mOgre;
 
@@ -273,6 +662,26 @@ namespace Sonetto
 
         AudioManager *mAudioMan;
 
+        /// Worker thread pool
+        JobSystem *mJobSystem;
+
+        /// Transient per frame memory
+        FrameArena *mFrameArena;
+
+        /// Creates archives for "Pack" resource locations
+        PackArchiveFactory *mPackArchiveFactory;
+
+        /// Provides the render system used in headless mode
+        NullRenderSystemPlugin *mNullRenderPlugin;
+
+#ifdef SONETTO_PROFILING
+        /// Profiler marker collector
+        Profiler *mProfiler;
+
+        /// Number of profiler dumps done so far
+        size_t mProfileDumpNum;
+#endif
+
         /// InputManager
         InputManager *mInputMan;
 
@@ -305,6 +714,64 @@ namespace Sonetto
         /// Screen Mode (Full / Window)
         bool mIsFullScreen;
 
+        /// High resolution clock used to measure frame times
+        Ogre::Timer mFrameTimer;
+
+        /// Fixed simulation timestep, in seconds
+        float mTickTime;
+
+        /// Real time not yet consumed by simulation ticks, in seconds
+        float mTickAccumulator;
+
+        /// Accumulated time over tick time (see getInterpolation())
+        float mInterpolation;
+
+        /// mInterpolation of the ticks last handed to simulate(); becomes
+        /// mInterpolation when their results are published
+        float mSimInterpolation;
+
+        /// Frame budget set by the frame limiter (0 means unlimited)
+        unsigned long mTargetFrameMicroseconds;
+
+        /// Last frame times, in seconds (see getFrameStats())
+        std::vector<float> mFrameTimeHistory;
+
+        /// Where the next frame time is going to be written
+        size_t mFrameTimeHistoryPos;
+
+        /// How many entries of mFrameTimeHistory are valid
+        size_t mFrameTimeHistoryCount;
+
+        /// Whether pipelined modules are simulated in their own thread
+        bool mPipelined;
+
+        /// Simulation thread (pipelined mode only)
+        SDL_Thread *mSimThread;
+
+        /// Signaled by the main thread to start simulating
+        SDL_sem *mSimStart;
+
+        /// Signaled by the simulation thread when done simulating
+        SDL_sem *mSimDone;
+
+        /// Number of ticks to be run by simulate()
+        size_t mSimTicks;
+
+        /// Tells the simulation thread to finish
+        volatile bool mSimQuit;
+
+        /// Error thrown in the simulation thread, rethrown in the main one
+        std::string mSimError;
+
+        /// Number of job system worker threads (0 means automatic)
+        size_t mWorkerThreads;
+
+        /// Whether running headless (see setHeadless())
+        bool mHeadless;
+
+        /// Frames to run in headless mode (0 means until shutdown)
+        size_t mHeadlessFrames;
+
         /// Boot icon filename
         std::string mLoadingImg;
 
@@ -353,6 +820,88 @@ namespace Sonetto
             Sonetto::Kernel::setAction()
         */
         Module::ModuleType mNextModuleType;
+
+        /** Whether the next module is to be loaded in the background
+
+        @see
+            Sonetto::Kernel::setAction()
+        */
+        bool mBackgroundLoad;
+
+        /// Module being loaded in the background (not in the stack yet)
+        Module *mPendingModule;
+
+        /// How mPendingModule will be pushed once loaded
+        ModuleAction mPendingAction;
+
+        /// Loader of mPendingModule's preload list
+        ModuleLoader *mModuleLoader;
+
+        /// Memory budget for modules in the stack, in bytes (0 means none)
+        size_t mMemoryBudget;
+
+        /// Font used by the performance HUD (empty disables the HUD)
+        std::string mHUDFont;
+
+        /// Performance HUD (created the first time it is shown)
+        PerformanceHUD *mPerformanceHUD;
+
+        /// Performance metrics registry
+        MetricsRegistry *mMetrics;
+
+        /// Seconds between metrics exports (0 means not exporting)
+        unsigned long mMetricsInterval;
+
+        /// Metrics file name, relative to mGameDataPath
+        std::string mMetricsFile;
+
+        /// Size in bytes after which the metrics file is rotated
+        size_t mMetricsMaxFileSize;
+
+        /// Frames run
+        MetricCounter *mFramesMetric;
+
+        /// Real frame times, in microseconds
+        MetricHistogram *mFrameTimeMetric;
+
+        /// Script instructions run per frame
+        MetricHistogram *mScriptCostMetric;
+
+        /// Time taken by Module::initialize(), in milliseconds
+        MetricHistogram *mModuleInitMetric;
+
+        /// Time taken by background module loads, in milliseconds
+        MetricHistogram *mModuleLoadMetric;
+
+        /// ScriptManager::getInstructionCount() at the end of last frame
+        unsigned long mLastInstructionCount;
+
+        /// SDL_GetTicks() when the current background module load began
+        Uint32 mModuleLoadStart;
+
+        /// Records and prefetches the files read by the game
+        PrefetchManager *mPrefetchMan;
+
+        /// Whether files are prefetched (and recorded, without a manifest)
+        bool mPrefetchEnabled;
+
+        /// Whether the manifest is recorded again even if there is one
+        bool mPrefetchRecord;
+
+        /// Size of each music stream buffer, in bytes (0 is the default)
+        size_t mMusicBufferSize;
+
+        /// Most buffers the music stream may queue (0 is the default)
+        size_t mMusicBuffers;
+
+        /// Whether decoded sounds are cached in mGameDataPath
+        bool mSoundCacheEnabled;
+
+        /// Most bytes the decoded sound cache may take
+        size_t mSoundCacheSize;
+
+        /// Most bytes loaded sounds may take (0 for no limit)
+        size_t mSoundBudget;
     };
 } // namespace
 
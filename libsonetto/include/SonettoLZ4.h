@@ -0,0 +1,93 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_LZ4_H
+#define SONETTO_LZ4_H
+
+#include <cstddef>
+#include "SonettoPrerequisites.h"
+
+namespace Sonetto
+{
+    /** @file
+        LZ4 block compression
+
+        Implements the LZ4 block format (without the frame format), as used
+        by compressed pack entries (see SonettoPackFormat.h). Blocks made by
+        other LZ4 implementations can be decompressed, and vice-versa. The
+        compressor is a simple greedy one: it is meant for offline use (the
+        archiver tool), while the decompressor is fast and checks bounds,
+        so that corrupt data cannot make it read or write out of its
+        buffers.
+    @remarks
+        Does not depend on Ogre, so that tools can build it as well.
+    */
+
+    /// Largest size lz4Compress() can produce for `size' input bytes
+    inline size_t lz4CompressBound(size_t size)
+    {
+        return size + size / 255 + 16;
+    }
+
+    /** Compresses a block
+
+    @param src
+        Data to be compressed.
+    @param srcSize
+        Size of `src', in bytes.
+    @param dst
+        Where to write compressed data.
+    @param dstCapacity
+        Size of `dst', in bytes.
+    @return
+        Compressed size, or zero if it would not fit in `dstCapacity'.
+    */
+    SONETTO_API size_t lz4Compress(const char *src,size_t srcSize,char *dst,
+            size_t dstCapacity);
+
+    /** Decompresses a block
+
+    @param src
+        Compressed data.
+    @param srcSize
+        Size of `src', in bytes.
+    @param dst
+        Where to write decompressed data.
+    @param dstSize
+        Exact decompressed size, in bytes.
+    @return
+        Whether the block was valid and decompressed to exactly `dstSize'
+        bytes.
+    */
+    SONETTO_API bool lz4Decompress(const char *src,size_t srcSize,char *dst,
+            size_t dstSize);
+} // namespace
+
+#endif
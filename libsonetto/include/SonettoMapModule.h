@@ -35,6 +35,23 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace Sonetto
 {
+    /** Base class for map modules
+
+        A map's meshes, textures and materials live in a resource group of
+        its own (mResourceGroup), which can be unloaded while the map is
+        halted under another module (see Module::getEvictableResourceGroups()).
+        Since evicting the map destroys every object in its scene manager,
+        its scene must be built by createScene(), which runs again when the
+        map is restored.
+    @remarks
+        Overlay elements only point at the materials and fonts they use, so
+        the map's overlay needs nothing from evict(); what it uses from
+        mResourceGroup is loaded back before the map is resumed.
+    @remarks
+        Subclasses fill mResourceGroup, mScripts, mScriptGroup and
+        mSoundSets in their constructors, since getPreloadList() is called
+        before initialize().
+    */
     class SONETTO_API MapModule : public Module
     {
     public:
@@ -46,7 +63,45 @@ namespace Sonetto
         MapModule() {}
         virtual ~MapModule() {}
 
+        /// Initializes the module and builds the map's scene
+        virtual void initialize();
+
+        /// Lists mResourceGroup, mScripts and mSoundSets
+        virtual void getPreloadList(ModulePreloadList &list) const;
+
+        /// Lists mResourceGroup, if set
+        virtual void getEvictableResourceGroups(
+                std::vector<std::string> &groups) const;
+
+        /// Destroys the map's scene, so that mResourceGroup can be unloaded
+        virtual void evict();
+
+        /// Builds the map's scene again
+        virtual void restore();
+
         static _MapData MapData;
+
+    protected:
+        /** Builds the map's scene
+
+            Called by initialize() and restore(). Entities made from meshes
+            in mResourceGroup must be created here, and nowhere else.
+        @remarks
+            Does nothing by default.
+        */
+        virtual void createScene() {}
+
+        /// Resource group holding the map's meshes, textures and materials
+        std::string mResourceGroup;
+
+        /// Event scripts run in the map
+        std::vector<std::string> mScripts;
+
+        /// Resource group mScripts are declared in
+        std::string mScriptGroup;
+
+        /// Sound sets played in the map (see Database::soundSets)
+        IDVector mSoundSets;
     };
 } //namespace
 
@@ -0,0 +1,87 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_MAPPEDDATASTREAM_H
+#define SONETTO_MAPPEDDATASTREAM_H
+
+#include <OgreDataStream.h>
+#include "SonettoPrerequisites.h"
+#include "SonettoMappedFile.h"
+
+namespace Sonetto
+{
+    /** Ogre stream over a memory mapped file
+
+        Reads are copies straight out of the operating system's file cache,
+        with no system call per read, and getData() gives access to the
+        whole file without copying at all.
+    @see
+        MappedFile
+    */
+    class SONETTO_API MappedDataStream : public Ogre::DataStream
+    {
+    public:
+        /// Constructor (maps `fileName'; throws if it cannot)
+        MappedDataStream(const Ogre::String &fileName);
+
+        /// Destructor (unmaps the file)
+        ~MappedDataStream() {}
+
+        /// Copies data out of the mapping
+        size_t read(void *buf,size_t count);
+
+        /// Skips `count' bytes (may be negative)
+        void skip(long count);
+
+        /// Moves to an absolute position
+        void seek(size_t pos);
+
+        /// Gets the current position
+        size_t tell() const { return mPos; }
+
+        /// Whether the end was reached
+        bool eof() const { return mPos >= mSize; }
+
+        /// Unmaps the file
+        void close();
+
+        /// Gets the whole file contents (NULL if empty or closed)
+        inline const char *getData() const { return mFile.getData(); }
+
+    private:
+        /// Mapped file
+        MappedFile mFile;
+
+        /// Current position
+        size_t mPos;
+    };
+} // namespace
+
+#endif
@@ -0,0 +1,106 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_MAPPEDFILE_H
+#define SONETTO_MAPPEDFILE_H
+
+#include <string>
+#include "SonettoPrerequisites.h"
+
+namespace Sonetto
+{
+    /** Read-only memory mapped file
+
+        The whole file is mapped at once; pages are only read from disk
+        when first touched, and are shared with the operating system's file
+        cache, so reading from getData() does not copy anything.
+    */
+    class SONETTO_API MappedFile
+    {
+    public:
+        /// Constructor (no file is mapped)
+        MappedFile();
+
+        /// Destructor (unmaps the file, if any)
+        ~MappedFile();
+
+        /** Maps a file
+
+            Throws if the file cannot be opened or mapped. A file already
+            mapped is unmapped first.
+        */
+        void open(const std::string &fileName);
+
+        /// Unmaps the file (does nothing if none is mapped)
+        void close();
+
+        /// Whether a file is mapped
+        inline bool isOpen() const { return mOpen; }
+
+        /// Gets the mapped file contents (NULL if the file is empty)
+        inline const char *getData() const { return mData; }
+
+        /// Gets the mapped file size, in bytes
+        inline size_t getSize() const { return mSize; }
+
+        /// Gets the mapped file name
+        inline const std::string &getFileName() const { return mFileName; }
+
+    private:
+        /// Mapped file name
+        std::string mFileName;
+
+        /// Whether a file is mapped
+        bool mOpen;
+
+        /// Mapped contents
+        const char *mData;
+
+        /// Size of mData
+        size_t mSize;
+
+    #ifdef WINDOWS
+        /// File handle (a HANDLE)
+        void *mFileHandle;
+
+        /// File mapping handle (a HANDLE)
+        void *mMappingHandle;
+    #else
+        /// File descriptor
+        int mFileDescriptor;
+    #endif
+
+        // Not copyable
+        MappedFile(const MappedFile &);
+        MappedFile &operator=(const MappedFile &);
+    };
+} // namespace
+
+#endif
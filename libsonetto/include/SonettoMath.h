@@ -30,6 +30,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef SONETTO_MATH_H
 #define SONETTO_MATH_H
 
+#include <string>
 #include "SonettoPrerequisites.h"
 
 namespace Sonetto
@@ -62,6 +63,23 @@ namespace Sonetto
         }
 
         static float frand(float from,float to);
+
+        /// Hash of no data at all (FNV-1a offset basis)
+        static const uint32 HASH_BASIS = 2166136261UL;
+
+        /** Hashes a block of memory (32-bit FNV-1a)
+
+            Cheap, non-cryptographic hash used to identify files and
+            resources by name without keeping the strings around. Data
+            can be hashed in blocks by passing the hash of the previous
+            blocks as `basis'.
+        */
+        static uint32 hash(const void *data,size_t len,
+                uint32 basis = HASH_BASIS);
+
+        /// Hashes a string (32-bit FNV-1a)
+        static inline uint32 hash(const std::string &str)
+                { return hash(str.data(),str.length()); }
 	};
 } // namespace
 
@@ -0,0 +1,214 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_MEMORY_H
+#define SONETTO_MEMORY_H
+
+#include <cstddef>
+#include <new>
+#include "SonettoPrerequisites.h"
+
+namespace Sonetto
+{
+    /** Subsystems memory is accounted to
+
+    @see
+        MemoryTracker
+    */
+    enum MemoryTag
+    {
+        /// Anything not accounted to a subsystem below
+        MEMTAG_GENERAL,
+        /// Script bytecode and operand stacks
+        MEMTAG_SCRIPTS,
+        /// Decoded sound PCM (including what is held by OpenAL)
+        MEMTAG_AUDIO,
+        /// Font images
+        MEMTAG_FONTS,
+        /// Database tables
+        MEMTAG_DATABASE,
+        /// Game and script variables
+        MEMTAG_VARIABLES,
+        /// Module instances
+        MEMTAG_MODULES,
+        /// Number of tags
+        MEMTAG_COUNT
+    };
+
+    /** Memory statistics of a MemoryTag
+
+    @see
+        MemoryTracker::getStats()
+    */
+    struct MemoryTagStats
+    {
+        /// Bytes currently allocated
+        size_t bytes;
+
+        /// Highest value `bytes' has reached
+        size_t peakBytes;
+
+        /// Number of live allocations
+        size_t allocations;
+
+        /// Number of allocations made since startup
+        size_t totalAllocations;
+
+        /// Number of allocations made during the last frame
+        size_t frameAllocations;
+    };
+
+    /** Accounts memory to subsystems
+
+        Subsystems allocate through allocate() and deallocate(), or through
+        STL containers using a TaggedAllocator, so that how memory splits
+        between them can be queried at runtime with getStats() or written
+        to the log with logReport(). Memory held outside the process heap
+        (such as OpenAL buffers) can be accounted with _recordAllocation()
+        and _recordDeallocation().
+    @remarks
+        All methods are static and thread safe.
+    */
+    class SONETTO_API MemoryTracker
+    {
+    public:
+        /** Allocates memory accounted to `tag'
+
+            Throws std::bad_alloc on failure, like operator new.
+        */
+        static void *allocate(MemoryTag tag,size_t bytes);
+
+        /** Frees memory returned by allocate()
+
+        @param bytes
+            Size given to allocate().
+        */
+        static void deallocate(MemoryTag tag,void *ptr,size_t bytes);
+
+        /// Accounts memory allocated elsewhere to `tag'
+        static void _recordAllocation(MemoryTag tag,size_t bytes);
+
+        /// Accounts the release of memory recorded with _recordAllocation()
+        static void _recordDeallocation(MemoryTag tag,size_t bytes);
+
+        /** Starts a new frame
+
+            Called by the Kernel at the beginning of every frame, so that
+            MemoryTagStats::frameAllocations covers exactly one frame.
+        */
+        static void _beginFrame();
+
+        /// Gets a tag's statistics
+        static MemoryTagStats getStats(MemoryTag tag);
+
+        /// Gets a tag's name, as shown by logReport()
+        static const char *getTagName(MemoryTag tag);
+
+        /// Writes every tag's statistics to the game log
+        static void logReport();
+    };
+
+    /** STL allocator accounting its memory to a MemoryTag
+
+        @code
+        typedef std::vector<char,TaggedAllocator<char,MEMTAG_SCRIPTS> >
+                ScriptData;
+        @endcode
+    */
+    template<class T,MemoryTag Tag>
+    class TaggedAllocator
+    {
+    public:
+        typedef T value_type;
+        typedef T *pointer;
+        typedef const T *const_pointer;
+        typedef T &reference;
+        typedef const T &const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        template<class U>
+        struct rebind
+        {
+            typedef TaggedAllocator<U,Tag> other;
+        };
+
+        inline TaggedAllocator() {}
+        inline TaggedAllocator(const TaggedAllocator &) {}
+
+        template<class U>
+        inline TaggedAllocator(const TaggedAllocator<U,Tag> &) {}
+
+        inline pointer address(reference value) const { return &value; }
+        inline const_pointer address(const_reference value) const
+        {
+            return &value;
+        }
+
+        inline pointer allocate(size_type num,const void * = 0)
+        {
+            return static_cast<pointer>(
+                    MemoryTracker::allocate(Tag,num * sizeof(T)));
+        }
+
+        inline void deallocate(pointer ptr,size_type num)
+        {
+            MemoryTracker::deallocate(Tag,ptr,num * sizeof(T));
+        }
+
+        inline size_type max_size() const
+        {
+            return size_type(-1) / sizeof(T);
+        }
+
+        inline void construct(pointer ptr,const T &value)
+        {
+            new (ptr) T(value);
+        }
+
+        inline void destroy(pointer ptr) { ptr->~T(); }
+    };
+
+    template<class T,class U,MemoryTag Tag>
+    inline bool operator==(const TaggedAllocator<T,Tag> &,
+            const TaggedAllocator<U,Tag> &)
+    {
+        return true;
+    }
+
+    template<class T,class U,MemoryTag Tag>
+    inline bool operator!=(const TaggedAllocator<T,Tag> &,
+            const TaggedAllocator<U,Tag> &)
+    {
+        return false;
+    }
+} // namespace
+
+#endif
@@ -35,6 +35,11 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace Sonetto
 {
+    /** Base class for menu modules
+
+        Subclasses fill the protected members below in their constructors,
+        since getPreloadList() is called before initialize().
+    */
     class SONETTO_API MenuModule : public Module
     {
     public:
@@ -46,7 +51,29 @@ namespace Sonetto
         MenuModule() {}
         virtual ~MenuModule() {}
 
+        /// Lists mResourceGroup, mFonts, mScripts and mSoundSets
+        virtual void getPreloadList(ModulePreloadList &list) const;
+
         static _MenuData MenuData;
+
+    protected:
+        /// Resource group holding the menu's textures, materials and fonts
+        std::string mResourceGroup;
+
+        /// Fonts used by the menu, if not in mResourceGroup
+        std::vector<std::string> mFonts;
+
+        /// Resource group mFonts are declared in
+        std::string mFontGroup;
+
+        /// Scripts run by the menu (e.g. item and skill effects)
+        std::vector<std::string> mScripts;
+
+        /// Resource group mScripts are declared in
+        std::string mScriptGroup;
+
+        /// Sound sets played in the menu (see Database::soundSets)
+        IDVector mSoundSets;
     };
 } //namespace
 
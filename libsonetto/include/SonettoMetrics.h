@@ -0,0 +1,297 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_METRICS_H
+#define SONETTO_METRICS_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <SDL/SDL_mutex.h>
+#include <SDL/SDL_thread.h>
+#include <OgreSingleton.h>
+#include "SonettoPrerequisites.h"
+#include "SonettoAtomic.h"
+
+namespace Sonetto
+{
+    /** Monotonically increasing metric (such as frames run)
+
+        Updating is a single atomic operation.
+    @see
+        MetricsRegistry::getCounter()
+    */
+    class SONETTO_API MetricCounter
+    {
+    public:
+        /// Adds one
+        inline void increment() { mValue.increment(); }
+
+        /// Adds `amount'
+        inline void add(long amount) { mValue.add(amount); }
+
+        /// Gets current value
+        inline long get() const { return mValue.get(); }
+
+    private:
+        /// Counter value
+        AtomicCounter mValue;
+    };
+
+    /** Metric holding the last value set (such as a queue size)
+    @see
+        MetricsRegistry::getGauge()
+    */
+    class SONETTO_API MetricGauge
+    {
+    public:
+        /// Constructor
+        MetricGauge() : mValue(0) {}
+
+        /// Sets current value
+        inline void set(long value) { mValue = value; }
+
+        /// Gets current value
+        inline long get() const { return mValue; }
+
+    private:
+        /// Gauge value
+        volatile long mValue;
+    };
+
+    /** Distribution of observed values (such as frame times)
+
+        Values are counted in fixed buckets, given by their inclusive upper
+        bounds in increasing order; values above the last bound fall in an
+        extra overflow bucket. Observing a value costs a short linear
+        search and three atomic additions.
+    @see
+        MetricsRegistry::getHistogram()
+    */
+    class SONETTO_API MetricHistogram
+    {
+    public:
+        /// Constructor
+        MetricHistogram(const std::vector<long> &bounds);
+
+        /// Destructor
+        ~MetricHistogram();
+
+        /// Counts a value
+        void observe(long value);
+
+        /// Gets the number of values observed
+        inline long getCount() const { return mCount.get(); }
+
+        /// Gets the sum of the values observed
+        inline long getSum() const { return mSum.get(); }
+
+        /// Gets the bucket upper bounds (without the overflow bucket)
+        inline const std::vector<long> &getBounds() const { return mBounds; }
+
+        /** Gets the number of values that fell in a bucket
+
+        @param index
+            Bucket index, up to getBounds().size() (the overflow bucket).
+        */
+        inline long getBucketCount(size_t index) const
+                { return mBuckets[index].get(); }
+
+    private:
+        /// Bucket upper bounds
+        std::vector<long> mBounds;
+
+        /// Bucket counts (one more than mBounds)
+        AtomicCounter *mBuckets;
+
+        /// Number of values observed
+        AtomicCounter mCount;
+
+        /// Sum of the values observed
+        AtomicCounter mSum;
+
+        // Not copyable
+        MetricHistogram(const MetricHistogram &);
+        MetricHistogram &operator=(const MetricHistogram &);
+    };
+
+    /** Named performance metrics, periodically exported to a file
+
+        Subsystems get their metrics once (getCounter(), getGauge() and
+        getHistogram()) and keep the returned pointers, which stay valid
+        while the registry exists; updating them is lock free.
+    @par
+        When started with startExport(), a background thread appends a
+        snapshot of every metric to a JSON Lines file at a fixed interval,
+        one JSON object per line:
+        @code
+        {"time":5000,"counters":{"frames":300},"gauges":{"startup_ms":812},
+        "histograms":{"frame_time_us":{"count":300,"sum":4999800,
+        "bounds":[8000,16667],"buckets":[0,300,0]}}}
+        @endcode
+        When the file grows past the given size, it is renamed to
+        `file'.1 (replacing the previous one) and a new file is started.
+    @remarks
+        Metric names are written to the file as they are, so they must not
+        need escaping in JSON (use lowercase letters, digits and `_').
+    */
+    class SONETTO_API MetricsRegistry : public Ogre::Singleton<MetricsRegistry>
+    {
+    public:
+        /// Constructor
+        MetricsRegistry();
+
+        /// Destructor (stops exporting)
+        ~MetricsRegistry();
+
+        /** Overrides standard Singleton retrieval
+        @remarks
+            Warning: These comments below were copied straight from Ogre3D code.
+            Why do we do this? Well, it's because the Singleton
+            implementation is in a .h file, which means it gets compiled
+            into anybody who includes it. This is needed for the
+            Singleton template to work, but we actually only want it
+            compiled into the implementation of the class based on the
+            Singleton, not all of them. If we don't change this, we get
+            link errors when trying to use the Singleton-based class from
+            an outside dll.
+        @param
+            This method just delegates to the template version anyway,
+            but the implementation stays in this single compilation unit,
+            preventing link errors.
+        */
+        static MetricsRegistry &getSingleton();
+
+        /** Overrides standard Singleton retrieval
+        @remarks
+            Warning: These comments below were copied straight from Ogre3D code.
+            Why do we do this? Well, it's because the Singleton
+            implementation is in a .h file, which means it gets compiled
+            into anybody who includes it. This is needed for the
+            Singleton template to work, but we actually only want it
+            compiled into the implementation of the class based on the
+            Singleton, not all of them. If we don't change this, we get
+            link errors when trying to use the Singleton-based class from
+            an outside dll.
+        @param
+            This method just delegates to the template version anyway,
+            but the implementation stays in this single compilation unit,
+            preventing link errors.
+        */
+        static MetricsRegistry *getSingletonPtr();
+
+        /// Gets a counter, creating it if needed (thread safe)
+        MetricCounter *getCounter(const std::string &name);
+
+        /// Gets a gauge, creating it if needed (thread safe)
+        MetricGauge *getGauge(const std::string &name);
+
+        /** Gets a histogram, creating it if needed (thread safe)
+
+        @param bounds
+            Bucket upper bounds, in increasing order. Only used when the
+            histogram is created.
+        */
+        MetricHistogram *getHistogram(const std::string &name,
+                const std::vector<long> &bounds);
+
+        /** Starts exporting metrics to a file
+
+        @param fileName
+            Path of the JSON Lines file to append to.
+        @param interval
+            Seconds between snapshots (must not be zero).
+        @param maxFileSize
+            Size in bytes after which the file is rotated (zero means never).
+        */
+        void startExport(const std::string &fileName,unsigned long interval,
+                size_t maxFileSize);
+
+        /** Stops exporting metrics
+
+            Writes a last snapshot before returning. Does nothing if not
+            exporting.
+        */
+        void stopExport();
+
+        /// Whether metrics are being exported
+        inline bool isExporting() const { return mThread != NULL; }
+
+    private:
+        typedef std::map<std::string,MetricCounter *> CounterMap;
+        typedef std::map<std::string,MetricGauge *> GaugeMap;
+        typedef std::map<std::string,MetricHistogram *> HistogramMap;
+
+        /// Export thread entry point (`data' is the MetricsRegistry)
+        static int exportThread(void *data);
+
+        /// Appends a snapshot of every metric to the export file
+        void writeSnapshot();
+
+        /// Renames the export file to `file'.1 and starts a new one
+        void rotate();
+
+        /// Guards the metric maps
+        SDL_mutex *mMutex;
+
+        /// Counters by name
+        CounterMap mCounters;
+
+        /// Gauges by name
+        GaugeMap mGauges;
+
+        /// Histograms by name
+        HistogramMap mHistograms;
+
+        /// Export thread (NULL when not exporting)
+        SDL_Thread *mThread;
+
+        /// Posted to stop the export thread
+        SDL_sem *mStop;
+
+        /// Export file path
+        std::string mFileName;
+
+        /// Export file
+        std::ofstream mFile;
+
+        /// Milliseconds between snapshots
+        Uint32 mInterval;
+
+        /// Export file size limit, in bytes
+        size_t mMaxFileSize;
+
+        /// SDL_GetTicks() when the registry was created
+        Uint32 mStartTime;
+    };
+} // namespace
+
+#endif
@@ -30,12 +30,48 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef SONETTO_MODULE_H
 #define SONETTO_MODULE_H
 
-#include <stack>
+#include <vector>
 #include <Ogre.h>
 #include "SonettoPrerequisites.h"
+#include "SonettoMemory.h"
 
 namespace Sonetto
 {
+    /** What a module needs loaded before it is initialized
+
+        Filled by Module::getPreloadList(). When a module is changed to or
+        called with background loading (see Kernel::setAction()), everything
+        listed here is loaded while the current module keeps running.
+    */
+    struct ModulePreloadList
+    {
+        /// A single resource to be loaded (a script, a font, etc.)
+        struct Resource
+        {
+            Resource(const std::string &aType,const std::string &aName,
+                    const std::string &aGroup)
+                    : type(aType), name(aName), group(aGroup) {}
+
+            /// Resource type (e.g. "SonettoScript" or "SFont")
+            std::string type;
+
+            /// Resource name
+            std::string name;
+
+            /// Resource group the resource was declared in
+            std::string group;
+        };
+
+        /// Resource groups to be loaded as a whole
+        std::vector<std::string> resourceGroups;
+
+        /// Single resources to be loaded
+        std::vector<Resource> resources;
+
+        /// Sound sets whose sounds are to be loaded (see Database::soundSets)
+        IDVector soundSets;
+    };
+
     class SONETTO_API Module
     {
     public:
@@ -50,11 +86,130 @@ namespace Sonetto
             MT_BATTLE
         };
 
-        Module(){}
+        Module() : mEvicted(false) {}
         virtual ~Module() {}
 
+        /// Allocates modules accounted to MEMTAG_MODULES
+        static void *operator new(size_t bytes)
+        {
+            return MemoryTracker::allocate(MEMTAG_MODULES,bytes);
+        }
+
+        /// Frees modules allocated by operator new()
+        static void operator delete(void *ptr,size_t bytes)
+        {
+            MemoryTracker::deallocate(MEMTAG_MODULES,ptr,bytes);
+        }
+
         virtual void initialize();
+
+        /** Lists what this module needs loaded before initialize()
+
+            Called by the Kernel after the module is instantiated, when it is
+            switched to with background loading. The module is only
+            initialized after everything in `list' has been loaded.
+        @remarks
+            Modules list nothing by default.
+        @param list
+            List to be filled.
+        */
+        virtual void getPreloadList(ModulePreloadList &list) const {}
+
+        /** Lists resource groups that can be unloaded while halted
+
+            When this module is halted and the Kernel's memory budget (see the
+            `memoryBudget' setting in the [kernel] section of the
+            configuration file) is exceeded, these groups are unloaded, and
+            loaded back before resume() is called. Resources in them must
+            therefore be reloadable, and the module must not rely on them
+            staying loaded while halted. Groups holding meshes or skeletons
+            of entities that still exist in any scene manager are never
+            unloaded, since entities point into them; modules that want
+            those evicted must destroy such entities in evict() and create
+            them again in restore().
+        @remarks
+            Modules list nothing by default.
+        @param groups
+            List to be filled.
+        */
+        virtual void getEvictableResourceGroups(
+                std::vector<std::string> &groups) const {}
+
+        /** Gets this module's memory footprint, in bytes
+
+            Used by the Kernel to enforce its memory budget. By default, this
+            is the size of the loaded resources in the groups listed by
+            getEvictableResourceGroups(); modules holding other sizeable
+            memory may add it to this.
+        */
+        virtual size_t getMemoryUsage() const;
+
+        /** Gets the size of the loaded resources in some resource groups
+
+            Each resource is counted once, however many of the given groups
+            list it.
+        */
+        static size_t getResourceGroupsMemoryUsage(
+                const std::vector<std::string> &groups);
+
+        /** Lets go of what keeps evictable resource groups loaded
+
+            Called by the Kernel on a halted module about to be evicted,
+            before its evictable resource groups are unloaded. Entities made
+            from meshes in those groups must be destroyed here (see
+            getEvictableResourceGroups()).
+        @remarks
+            Does nothing by default.
+        */
+        virtual void evict() {}
+
+        /** Undoes evict()
+
+            Called by the Kernel after an evicted module's evictable resource
+            groups are loaded back, before resume().
+        @remarks
+            Does nothing by default.
+        */
+        virtual void restore() {}
+
+        /// Whether this module's evictable resource groups are unloaded
+        inline bool isEvicted() const { return mEvicted; }
+
+        /// Flags whether evictable resource groups are unloaded (Kernel only)
+        inline void _setEvicted(bool evicted) { mEvicted = evicted; }
+
+        /** Advances this module by one simulation tick
+
+            Called at a fixed rate by the Kernel (see Kernel::getTickTime()),
+            possibly more than once per rendered frame, or not at all.
+        */
         virtual void update();
+
+        /** Whether this module supports pipelined simulation
+
+            When the Kernel runs in pipelined mode (see the `pipelined'
+            setting in the [kernel] section of the configuration file), the
+            update() of modules that return true here runs on a simulation
+            thread, while the main thread renders the previous frame. Such
+            modules must keep their simulation state apart from their Ogre
+            objects, and must not touch Ogre from update(); the simulation
+            state is copied into Ogre objects by syncRenderState().
+        @remarks
+            Modules are not pipelined by default.
+        */
+        virtual bool isPipelined() const { return false; }
+
+        /** Publishes simulation state for rendering
+
+            Called by the Kernel on the main thread before every rendered
+            frame, while the simulation thread is idle. This is the only
+            place where a pipelined module can copy its simulation state into
+            the scene.
+        @remarks
+            Keeps the camera's aspect ratio up to date; overrides must call
+            Module::syncRenderState().
+        */
+        virtual void syncRenderState();
         virtual void deinitialize();
 
         virtual void halt();
@@ -84,9 +239,13 @@ namespace Sonetto
 
         /// Current background color for this module's viewport.
         Ogre::ColourValue mBgColor;
+
+        /// Whether evictable resource groups are unloaded (see isEvicted())
+        bool mEvicted;
     };
 
-    typedef std::stack<Module *> ModuleStack;
+    /// Module stack; the active module is at the back
+    typedef std::vector<Module *> ModuleStack;
 } // namespace
 
 #endif
@@ -0,0 +1,115 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_MODULELOADER_H
+#define SONETTO_MODULELOADER_H
+
+#include <vector>
+#include <OgreResourceBackgroundQueue.h>
+#include "SonettoPrerequisites.h"
+#include "SonettoModule.h"
+
+namespace Sonetto
+{
+    /** Loads a module's preload list while another module keeps running
+
+        Resource groups and single resources (scripts, fonts, etc.) are loaded
+        by Ogre's ResourceBackgroundQueue; sound sets are decoded by the
+        JobSystem through AudioManager::loadSoundSetAsync(), and uploaded to
+        OpenAL by AudioManager::_update(). The Kernel only swaps modules when
+        isComplete() returns true.
+    @see
+        Module::getPreloadList()
+    @see
+        Kernel::setAction()
+    */
+    class SONETTO_API ModuleLoader
+    {
+    public:
+        /** Constructor
+
+        @param list
+            What to load.
+        @param background
+            Whether to use Ogre's background queue. If false, resource groups
+            and resources are loaded synchronously by the first update() call
+            (used in headless mode, where the queue is not running).
+        */
+        ModuleLoader(const ModulePreloadList &list,bool background);
+
+        /// Destructor
+        ~ModuleLoader() {}
+
+        /** Advances loading
+
+            Checks for finished background requests and sound sets. Called
+            once per frame by the Kernel.
+        @return
+            Whether everything has been loaded.
+        */
+        bool update();
+
+        /// Whether everything has been loaded
+        inline bool isComplete() const { return mDone == mTotal; }
+
+        /// Gets loading progress, from 0 to 1
+        inline float getProgress() const
+        {
+            return (mTotal > 0) ? (float)(mDone) / (float)(mTotal) : 1.0f;
+        }
+
+    private:
+        /// Queues resource groups and resources
+        void start();
+
+        /// What to load
+        ModulePreloadList mList;
+
+        /// Whether to use Ogre's background queue
+        bool mBackground;
+
+        /// Whether start() was called
+        bool mStarted;
+
+        /// Pending background requests
+        std::vector<Ogre::BackgroundProcessTicket> mTickets;
+
+        /// Sound sets still being loaded
+        IDVector mSoundSets;
+
+        /// Number of items loaded so far
+        size_t mDone;
+
+        /// Number of items to be loaded
+        size_t mTotal;
+    };
+} // namespace
+
+#endif
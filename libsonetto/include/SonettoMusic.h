@@ -33,6 +33,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <string>
 #include "SonettoPrerequisites.h"
+#include "SonettoMemory.h"
 
 namespace Sonetto
 {
@@ -55,7 +56,8 @@ namespace Sonetto
     };
 
     /// Vector of Music structures
-    typedef std::vector<Music> MusicVector;
+    typedef std::vector<Music,TaggedAllocator<Music,MEMTAG_DATABASE> >
+            MusicVector;
 } // namespace
 
 #endif
@@ -0,0 +1,225 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_MUSICDECODER_H
+#define SONETTO_MUSICDECODER_H
+
+#include <cstdlib>
+#include <string>
+#include <vorbis/vorbisfile.h>
+#include <SDL/SDL_mutex.h>
+#include <SDL/SDL_thread.h>
+#include <OgreDataStream.h>
+#include "SonettoPrerequisites.h"
+#include "SonettoAtomic.h"
+
+namespace Sonetto
+{
+    /// PCM data decoded by a MusicDecoder, ready to go into an OpenAL buffer
+    struct MusicChunk
+    {
+        /// 16 bits PCM samples, channels interleaved
+        char *data;
+
+        /// How much of `data' is filled (in bytes)
+        size_t size;
+
+        /// Stream position of the first sample (in PCM samples)
+        size_t startPos;
+
+        /** Number of samples before the stream looped back
+
+            Samples from this one on continue from the music's loop point.
+            It equals the chunk's length when the stream didn't loop in it.
+        */
+        size_t loopSample;
+
+        /// Whether the stream has ended with this chunk
+        bool ended;
+    };
+
+    /** Decodes an OGG/Vorbis music in a thread of its own
+
+        A decoding thread opens and seeks the stream, then fills a ring of
+        MusicChunk's ahead of playback, so that creating a decoder costs
+        the caller next to nothing. The ring has
+        exactly one producer (the decoding thread) and one consumer (the
+        MusicStream), so it needs no locks: each side only advances its own
+        counter, and a slot is only touched by the side that owns it.
+
+        The consumer peeks the oldest decoded chunk with peekChunk(), and
+        gives it back with popChunk() after uploading it to OpenAL.
+    */
+    class SONETTO_API MusicDecoder
+    {
+    public:
+        /** Starts opening and decoding a stream
+
+        @param
+            stream Stream with the OGG/Vorbis data.
+        @param
+            pos Seek stream to here before decoding (value in PCM samples).
+        @param
+            loop Whether to loop the stream or to end it at its end.
+        @param
+            loopPoint Where to continue from when looping (in PCM samples).
+        @param
+            chunkSize Size of each decoded chunk (in bytes).
+        @param
+            chunkCount How many chunks can be decoded ahead of playback.
+        */
+        MusicDecoder(const Ogre::DataStreamPtr &stream,size_t pos,bool loop,
+                size_t loopPoint,size_t chunkSize,size_t chunkCount);
+
+        /// Stops the decoding thread and closes the stream
+        ~MusicDecoder();
+
+        /** Gets the oldest decoded chunk
+
+            Throws if opening or decoding failed and every chunk decoded
+            before the failure was already consumed.
+        @return
+            The chunk, or NULL if the decoding thread is lagging behind.
+        */
+        const MusicChunk *peekChunk();
+
+        /// Gives the chunk returned by peekChunk() back to the decoding thread
+        void popChunk();
+
+        /// Gets how many chunks are decoded and waiting to be consumed
+        inline size_t getReadyChunks() const
+                { return static_cast<size_t>(mWritten.get() - mRead.get()); }
+
+        /** Gets the number of channels in the stream
+
+            Like the other stream properties, it is only known once
+            peekChunk() has returned a chunk.
+        */
+        inline int getChannels() const { return mChannels; }
+
+        /// Gets the stream's sample rate (in Hz)
+        inline long getRate() const { return mRate; }
+
+        /// Gets the stream's length (in PCM samples)
+        inline size_t getLength() const { return mStreamLen; }
+
+        /// Gets the stream's loop point (in PCM samples)
+        inline size_t getLoopPoint() const { return mLoopPoint; }
+
+    private:
+        /// Decoding thread entry point (`data' is the MusicDecoder)
+        static int decodeThread(void *data);
+
+        /** Opens and seeks the stream (from the decoding thread)
+
+        @return
+            false on failure, in which case mError is set.
+        */
+        bool open();
+
+        /** Decodes the next chunk from the stream
+
+        @return
+            false on a decoding error, in which case mError is set.
+        */
+        bool decodeChunk(MusicChunk &chunk);
+
+        /// Stops the decoding thread and frees everything opened so far
+        void release();
+
+        /// Stream to be opened (owned by mFile once mOpened is set)
+        Ogre::DataStreamPtr *mStream;
+
+        /// OGG/Vorbis file handle (only used by the decoding thread once running)
+        OggVorbis_File mFile;
+
+        /// Whether mFile was opened
+        bool mOpened;
+
+        /// Ring of decoded chunks
+        MusicChunk *mChunks;
+
+        /// Number of chunks in mChunks
+        size_t mChunkCount;
+
+        /// Size of each chunk's data (in bytes)
+        size_t mChunkSize;
+
+        /// How much of each chunk is filled (mChunkSize, in whole samples)
+        size_t mFillSize;
+
+        /// Chunks decoded so far (advanced only by the decoding thread)
+        AtomicCounter mWritten;
+
+        /// Chunks consumed so far (advanced only by the consumer)
+        AtomicCounter mRead;
+
+        /// Wakes the decoding thread up when a chunk is freed or when stopping
+        SDL_sem *mWake;
+
+        /// Decoding thread
+        SDL_Thread *mThread;
+
+        /// Tells the decoding thread to quit
+        volatile bool mStop;
+
+        /// Set by the decoding thread when decoding failed (non-zero)
+        AtomicCounter mFailed;
+
+        /// Describes the decoding failure (valid once mFailed is set)
+        std::string mError;
+
+        /// Whether to loop the stream
+        bool mLoop;
+
+        /// Where to continue from when looping (in PCM samples)
+        size_t mLoopPoint;
+
+        /// Total length of the stream (in PCM samples)
+        size_t mStreamLen;
+
+        /// Position of the next sample to be decoded (in PCM samples)
+        size_t mPos;
+
+        /// Whether the last decoded chunk ended the stream
+        bool mEnded;
+
+        /// Number of channels in the stream
+        int mChannels;
+
+        /// Sample rate of the stream (in Hz)
+        long mRate;
+
+        /// Bytes taken by one sample in all channels
+        size_t mFrameSize;
+    };
+} // namespace
+
+#endif // SONETTO_MUSICDECODER_H
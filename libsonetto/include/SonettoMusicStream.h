@@ -31,7 +31,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #define SONETTO_MUSICSTREAM_H
 
 #include <cstdlib>
-#include <vorbis/vorbisfile.h>
+#include <deque>
+#include <vector>
+#include <AL/al.h>
 #include "SonettoMath.h"
 #include "SonettoAudioManager.h"
 
@@ -68,6 +70,17 @@ namespace Sonetto
         either by BGMs and MEs. This class is mainly used by the AudioManager.
         Use AudioManager's own interface to play/stop/pause/resume/etc your
         musics.
+
+        Decoding is done ahead of time by a MusicDecoder in a thread of its
+        own; _update() only hands the chunks it has decoded to OpenAL. The
+        music to be played next can be decoded ahead too (see _preload()),
+        and even queued right behind the current one, so that they play
+        without a gap between them.
+
+        The number of buffers kept queued in OpenAL (the queue depth) adapts
+        to how the game runs: it is increased whenever the source runs dry or
+        almost does, and decreased after QUEUE_SHRINK_TIME seconds without
+        trouble, trading underrun safety for latency.
     */
     class SONETTO_API MusicStream
     {
@@ -77,14 +90,30 @@ namespace Sonetto
         @param
             audioMan AudioManager pointer. Needed because when this
             MusicStream is created, the singletons are not set yet.
+        @param
+            bufferSize Size of each OpenAL audio buffer, in bytes (0 is
+            DEFAULT_BUFFER_SIZE).
+        @param
+            maxBuffers Most buffers the queue depth may grow to (0 is
+            DEFAULT_MAX_BUFFERS).
         */
-        MusicStream(AudioManager *audioMan);
+        MusicStream(AudioManager *audioMan,size_t bufferSize = 0,
+                size_t maxBuffers = 0);
 
         /// Protected destructor, only used by the AudioManager
         ~MusicStream();
 
-        /// Size of each OpenAL audio buffer
-        static const size_t BUFFER_SIZE;
+        /// Default size of each OpenAL audio buffer (in bytes)
+        static const size_t DEFAULT_BUFFER_SIZE;
+
+        /// Default number of OpenAL audio buffers (the largest queue depth)
+        static const size_t DEFAULT_MAX_BUFFERS;
+
+        /// Smallest queue depth
+        static const size_t MIN_QUEUE_DEPTH;
+
+        /// Seconds without (near) underruns before the queue depth decreases
+        static const float QUEUE_SHRINK_TIME;
 
         /** Sets the maximum volume
 
@@ -109,6 +138,19 @@ namespace Sonetto
         /// Returns current stream position (in PCM samples)
         size_t _getCurrentPos();
 
+        /** Gets how full the stream's buffer queue is
+
+            Returns the fraction of the queue depth queued and not yet played,
+            between 0.0f (starving) and 1.0f, or 0.0f if no music is set.
+        */
+        float getBufferFill();
+
+        /// Gets how many buffers are currently kept queued in OpenAL
+        inline size_t getQueueDepth() const { return mQueueDepth; }
+
+        /// Gets how many times the source ran out of buffers
+        long getUnderruns() const;
+
         /// Gets whether this stream loops or not
         inline bool _getLoop() const { return mLoop; }
 
@@ -140,6 +182,28 @@ namespace Sonetto
         */
         void _play(size_t id,size_t pos,float fadeIn,bool loop);
 
+        /** Starts decoding the music to be played next
+
+            Opens and decodes the music in the background, so that playing it
+            later with _play() (with the same `id', `pos' and `loop') is only a
+            matter of queueing buffers. Only one music is preloaded at a time;
+            preloading another one drops the previous.
+        @param
+            id The music ID to be preloaded (0 drops the preloaded music).
+        @param
+            pos Seek music stream to here before playing (value in PCM samples)
+        @param
+            fadeIn Fade speed in which the music will fade in (only used if it
+            is chained).
+        @param
+            loop Whether to loop the music or not.
+        @param
+            chain Whether to play it as soon as the current music ends. It is
+            queued right behind the current music's end, and the AudioManager
+            is told with _streamEnded(true) once it starts playing.
+        */
+        void _preload(size_t id,size_t pos,float fadeIn,bool loop,bool chain);
+
         /** Stops the music
 
             Fades out the music and then stops it. If `aFadeOut' is 0.0f,
@@ -171,12 +235,71 @@ namespace Sonetto
         void _pause(float aFadeOut);
 
     private:
-        /** Pulls OGG/Vorbis stream into OpenAL audio buffer
+        /// A decoded chunk of music queued in the OpenAL source
+        struct QueuedChunk
+        {
+            /// OpenAL buffer holding the chunk
+            ALuint buffer;
+
+            /// Stream position of the first sample (in PCM samples)
+            size_t startPos;
+
+            /// Length of the chunk (in PCM samples)
+            size_t samples;
+
+            /// Samples before the stream looped back (see MusicChunk)
+            size_t loopSample;
+
+            /// Where the stream looped back to (in PCM samples)
+            size_t loopPoint;
+
+            /// Whether this is the first chunk of a chained music
+            bool first;
+        };
+
+        /// A music decoded ahead of being played
+        struct NextMusic
+        {
+            /// Its decoder (NULL if there is no such music)
+            MusicDecoder *decoder;
 
+            /// Music ID, position, fade in speed and loop flag (see _play())
+            size_t music;
+            size_t pos;
+            float fadeIn;
+            bool loop;
+        };
+
+        /// Opens a music file and starts decoding it
+        MusicDecoder *createDecoder(size_t id,size_t pos,bool loop);
+
+        /// Sets up the fade in for a music starting to play (see _play())
+        void beginFadeIn(float fadeIn);
+
+        /** Switches to the chained music if it has started playing
+
+        @return
+            false if the stream was stopped instead (then the AudioManager
+            may have played something else already).
+        */
+        bool checkChain();
+
+        /// Uploads decoded chunks into free OpenAL buffers and queues them
+        void queueChunks();
+
+        /// Gets the stream position of a sample inside a queued chunk
+        size_t chunkPos(const QueuedChunk &chunk,size_t sample) const;
+
+        /** Adapts the queue depth to how close the source got to starving
+
+        @param
+            deltatime Time since the last call (in seconds).
         @param
-            buffer An OpenAL audio buffer handle
+            pending Buffers still queued and not played before refilling.
+        @param
+            starved Whether the source has run out of buffers.
         */
-        void pullStream(size_t buffer);
+        void adaptQueueDepth(float deltatime,size_t pending,bool starved);
 
         /// AudioManager singleton pointer (for ease of use)
         AudioManager *mAudioMan;
@@ -188,14 +311,29 @@ namespace Sonetto
 
             OpenAL has audio sources and buffers. Buffers hold only data, whilst
             sources have 3D positioning, and etc. Buffers can be attached to sources
-            so that the data held by them can be played. We use two buffers so that
-            while one is playing, the other is filled with more data from the OGG file
-            (streamed).
+            so that the data held by them can be played. We use several buffers so
+            that while some are playing, the others are filled with more data from
+            the OGG file (streamed).
         */
-        size_t mMusicBuf[2];
+        std::vector<ALuint> mMusicBuf;
+
+        /// Size of each buffer (in bytes)
+        size_t mBufferSize;
+
+        /// How many buffers are kept queued in the source
+        size_t mQueueDepth;
+
+        /// Seconds since the queue depth last had to change
+        float mStableTime;
+
+        /// Buffers not queued in the source, waiting for decoded data
+        std::vector<ALuint> mFreeBuffers;
+
+        /// Chunks queued in the source, in the same order OpenAL has them
+        std::deque<QueuedChunk> mQueuedChunks;
 
         /// OpenAL's audio source
-        size_t mMusicSrc;
+        ALuint mMusicSrc;
 
         /// Maximum volume this music can reach
         float mMaxVolume;
@@ -215,11 +353,44 @@ namespace Sonetto
         /// Stream state
         StreamState mState;
 
-        /// OGG Vorbis file handle
-        OggVorbis_File mFile;
+        /// Decoder of the current music (NULL when no music is set)
+        MusicDecoder *mDecoder;
+
+        /// Stream position right after the last chunk OpenAL has played
+        size_t mPlayedPos;
+
+        /// Whether the chunk ending the stream has been queued
+        bool mEndQueued;
+
+        /// Whether the queue has been filled up since the source (re)started
+        bool mPrimed;
+
+        /// Music decoded ahead by _preload()
+        NextMusic mPreload;
+
+        /// Whether mPreload is to be chained after the current music
+        bool mPreloadChain;
+
+        /// Chained music, being queued behind the current music's end
+        NextMusic mChain;
+
+        /// Whether the next chunk queued is the first one of mChain
+        bool mChainFirst;
+
+        /// Whether the chunk ending mChain's stream has been queued
+        bool mChainEndQueued;
+
+        /// Whether a chained music was dropped after some of it was queued
+        bool mChainDropped;
+
+        /// Counts times the source ran out of buffers and had to restart
+        MetricCounter *mUnderruns;
+
+        /// Counts times the source was down to its last buffer
+        MetricCounter *mNearUnderruns;
 
-        /// Total length of OGG/Vorbis stream (in PCM samples)
-        size_t mStreamLen;
+        /// Current queue depth
+        MetricGauge *mQueueDepthGauge;
     };
 } // namespace
 
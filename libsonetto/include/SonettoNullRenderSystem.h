@@ -0,0 +1,351 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+
+#ifndef SONETTO_NULLRENDERSYSTEM_H
+#define SONETTO_NULLRENDERSYSTEM_H
+
+#include <vector>
+#include <OgreRenderSystem.h>
+#include <OgreRenderWindow.h>
+#include <OgreTexture.h>
+#include <OgreTextureManager.h>
+#include <OgreHardwarePixelBuffer.h>
+#include <OgrePlugin.h>
+#include "SonettoPrerequisites.h"
+
+namespace Sonetto
+{
+    /** Render window of NullRenderSystem
+
+        Has no surface: viewports can be added to it and updated, but
+        nothing is drawn and its contents cannot be read back.
+    */
+    class SONETTO_API NullRenderWindow : public Ogre::RenderWindow
+    {
+    public:
+        /// Constructor (see create())
+        NullRenderWindow() : mClosed(false) {}
+
+        /// Destructor
+        virtual ~NullRenderWindow() {}
+
+        void create(const Ogre::String &name,unsigned int width,
+                unsigned int height,bool fullScreen,
+                const Ogre::NameValuePairList *miscParams);
+        void setFullscreen(bool fullScreen,unsigned int width,
+                unsigned int height);
+        void destroy();
+        bool isClosed() const { return mClosed; }
+        void reposition(int left,int top) {}
+        void resize(unsigned int width,unsigned int height);
+        void copyContentsToMemory(const Ogre::PixelBox &dst,
+                FrameBuffer buffer);
+        bool requiresTextureFlipping() const { return false; }
+
+    private:
+        /// Whether destroy() was called
+        bool mClosed;
+    };
+
+    /** Pixel buffer of NullTexture
+
+        Blitting does nothing. Locking gives scratch memory, which is freed
+        when the buffer is unlocked.
+    */
+    class SONETTO_API NullPixelBuffer : public Ogre::HardwarePixelBuffer
+    {
+    public:
+        NullPixelBuffer(size_t width,size_t height,size_t depth,
+                Ogre::PixelFormat format,
+                Ogre::HardwareBuffer::Usage usage);
+        virtual ~NullPixelBuffer();
+
+        void blitFromMemory(const Ogre::PixelBox &src,
+                const Ogre::Image::Box &dstBox) {}
+        void blitToMemory(const Ogre::Image::Box &srcBox,
+                const Ogre::PixelBox &dst) {}
+
+    protected:
+        Ogre::PixelBox lockImpl(const Ogre::Image::Box lockBox,
+                LockOptions options);
+        void unlockImpl();
+
+        /// Scratch memory handed out by lockImpl()
+        Ogre::uint8 *mLockData;
+    };
+
+    /** Texture of NullRenderSystem
+
+        Images are read as usual, so that sizes and formats are those of
+        the real texture, but their pixels are dropped (see
+        NullPixelBuffer). Render textures are not supported.
+    */
+    class SONETTO_API NullTexture : public Ogre::Texture
+    {
+    public:
+        NullTexture(Ogre::ResourceManager *creator,const Ogre::String &name,
+                Ogre::ResourceHandle handle,const Ogre::String &group,
+                bool isManual = false,Ogre::ManualResourceLoader *loader = 0);
+        virtual ~NullTexture();
+
+        Ogre::HardwarePixelBufferSharedPtr getBuffer(size_t face = 0,
+                size_t mipmap = 0);
+
+    protected:
+        void loadImpl();
+        void unloadImpl();
+        void createInternalResourcesImpl();
+        void freeInternalResourcesImpl();
+
+        /// Pixel buffers, by face and then by mipmap level
+        std::vector<Ogre::HardwarePixelBufferSharedPtr> mSurfaces;
+    };
+
+    /// Creates NullTexture instances
+    class SONETTO_API NullTextureManager : public Ogre::TextureManager
+    {
+    public:
+        NullTextureManager();
+        virtual ~NullTextureManager();
+
+        /// Every format is supported as it is
+        Ogre::PixelFormat getNativeFormat(Ogre::TextureType ttype,
+                Ogre::PixelFormat format,int usage) { return format; }
+
+        /// Every format is supported as it is
+        bool isHardwareFilteringSupported(Ogre::TextureType ttype,
+                Ogre::PixelFormat format,int usage,
+                bool preciseFormatOnly = false) { return true; }
+
+    protected:
+        Ogre::Resource *createImpl(const Ogre::String &name,
+                Ogre::ResourceHandle handle,const Ogre::String &group,
+                bool isManual,Ogre::ManualResourceLoader *loader,
+                const Ogre::NameValuePairList *createParams);
+    };
+
+    /** Render system that renders nothing
+
+        Used in headless mode (see Kernel::setHeadless()), where there is no
+        display or GPU. Ogre is initialised and updated as usual, so
+        modules can create scenes, overlays, fonts, textures and materials,
+        and scene graphs, animations and render queues are still processed
+        on the CPU, but no draw call reaches any device. Vertex and index
+        buffers live in system memory (Ogre::DefaultHardwareBufferManager)
+        and textures are NullTexture instances. GPU programs, render
+        textures and occlusion queries are not supported.
+
+        It is installed as an Ogre plugin (see NullRenderSystemPlugin).
+    */
+    class SONETTO_API NullRenderSystem : public Ogre::RenderSystem
+    {
+    public:
+        NullRenderSystem();
+        virtual ~NullRenderSystem();
+
+        const Ogre::String &getName() const;
+        Ogre::ConfigOptionMap &getConfigOptions() { return mOptions; }
+        void setConfigOption(const Ogre::String &name,
+                const Ogre::String &value) {}
+        Ogre::String validateConfigOptions() { return Ogre::StringUtil::BLANK; }
+
+        Ogre::RenderWindow *_initialise(bool autoCreateWindow,
+                const Ogre::String &windowTitle = "OGRE Render Window");
+        Ogre::RenderSystemCapabilities *createRenderSystemCapabilities()
+                const;
+        void reinitialise();
+        void shutdown();
+
+        Ogre::RenderWindow *_createRenderWindow(const Ogre::String &name,
+                unsigned int width,unsigned int height,bool fullScreen,
+                const Ogre::NameValuePairList *miscParams = 0);
+        Ogre::MultiRenderTarget *createMultiRenderTarget(
+                const Ogre::String &name);
+        Ogre::HardwareOcclusionQuery *createHardwareOcclusionQuery();
+
+        Ogre::String getErrorDescription(long errorNumber) const
+                { return Ogre::StringUtil::BLANK; }
+        Ogre::VertexElementType getColourVertexElementType() const
+                { return Ogre::VET_COLOUR_ABGR; }
+
+        void _convertProjectionMatrix(const Ogre::Matrix4 &matrix,
+                Ogre::Matrix4 &dest,bool forGpuProgram = false);
+        void _makeProjectionMatrix(const Ogre::Radian &fovy,Ogre::Real aspect,
+                Ogre::Real nearPlane,Ogre::Real farPlane,Ogre::Matrix4 &dest,
+                bool forGpuProgram = false);
+        void _makeProjectionMatrix(Ogre::Real left,Ogre::Real right,
+                Ogre::Real bottom,Ogre::Real top,Ogre::Real nearPlane,
+                Ogre::Real farPlane,Ogre::Matrix4 &dest,
+                bool forGpuProgram = false);
+        void _makeOrthoMatrix(const Ogre::Radian &fovy,Ogre::Real aspect,
+                Ogre::Real nearPlane,Ogre::Real farPlane,Ogre::Matrix4 &dest,
+                bool forGpuProgram = false);
+        void _applyObliqueDepthProjection(Ogre::Matrix4 &matrix,
+                const Ogre::Plane &plane,bool forGpuProgram) {}
+
+        Ogre::Real getHorizontalTexelOffset() { return 0.0f; }
+        Ogre::Real getVerticalTexelOffset() { return 0.0f; }
+        Ogre::Real getMinimumDepthInputValue() { return -1.0f; }
+        Ogre::Real getMaximumDepthInputValue() { return 1.0f; }
+
+        // Render state changes are all dropped
+        void setAmbientLight(float r,float g,float b) {}
+        void setShadingType(Ogre::ShadeOptions so) {}
+        void setLightingEnabled(bool enabled) {}
+        void setNormaliseNormals(bool normalise) {}
+        void _useLights(const Ogre::LightList &lights,unsigned short limit) {}
+        void _setWorldMatrix(const Ogre::Matrix4 &m) {}
+        void _setViewMatrix(const Ogre::Matrix4 &m) {}
+        void _setProjectionMatrix(const Ogre::Matrix4 &m) {}
+        void _setSurfaceParams(const Ogre::ColourValue &ambient,
+                const Ogre::ColourValue &diffuse,
+                const Ogre::ColourValue &specular,
+                const Ogre::ColourValue &emissive,Ogre::Real shininess,
+                Ogre::TrackVertexColourType tracking = Ogre::TVC_NONE) {}
+        void _setPointSpritesEnabled(bool enabled) {}
+        void _setPointParameters(Ogre::Real size,bool attenuationEnabled,
+                Ogre::Real constant,Ogre::Real linear,Ogre::Real quadratic,
+                Ogre::Real minSize,Ogre::Real maxSize) {}
+        void _setTexture(size_t unit,bool enabled,
+                const Ogre::TexturePtr &texPtr) {}
+        void _setTextureCoordSet(size_t unit,size_t index) {}
+        void _setTextureCoordCalculation(size_t unit,
+                Ogre::TexCoordCalcMethod m,const Ogre::Frustum *frustum = 0) {}
+        void _setTextureBlendMode(size_t unit,
+                const Ogre::LayerBlendModeEx &bm) {}
+        void _setTextureUnitFiltering(size_t unit,Ogre::FilterType ftype,
+                Ogre::FilterOptions filter) {}
+        void _setTextureLayerAnisotropy(size_t unit,
+                unsigned int maxAnisotropy) {}
+        void _setTextureAddressingMode(size_t unit,
+                const Ogre::TextureUnitState::UVWAddressingMode &uvw) {}
+        void _setTextureBorderColour(size_t unit,
+                const Ogre::ColourValue &colour) {}
+        void _setTextureMipmapBias(size_t unit,float bias) {}
+        void _setTextureMatrix(size_t unit,const Ogre::Matrix4 &xform) {}
+        void _setSceneBlending(Ogre::SceneBlendFactor sourceFactor,
+                Ogre::SceneBlendFactor destFactor) {}
+        void _setSeparateSceneBlending(Ogre::SceneBlendFactor sourceFactor,
+                Ogre::SceneBlendFactor destFactor,
+                Ogre::SceneBlendFactor sourceFactorAlpha,
+                Ogre::SceneBlendFactor destFactorAlpha) {}
+        void _setAlphaRejectSettings(Ogre::CompareFunction func,
+                unsigned char value,bool alphaToCoverage) {}
+        void _setViewport(Ogre::Viewport *vp) { mActiveViewport = vp; }
+        void _setRenderTarget(Ogre::RenderTarget *target)
+                { mActiveRenderTarget = target; }
+        void _setCullingMode(Ogre::CullingMode mode) { mCullingMode = mode; }
+        void _setDepthBufferParams(bool depthTest = true,
+                bool depthWrite = true,
+                Ogre::CompareFunction depthFunction = Ogre::CMPF_LESS_EQUAL) {}
+        void _setDepthBufferCheckEnabled(bool enabled = true) {}
+        void _setDepthBufferWriteEnabled(bool enabled = true) {}
+        void _setDepthBufferFunction(
+                Ogre::CompareFunction func = Ogre::CMPF_LESS_EQUAL) {}
+        void _setColourBufferWriteEnabled(bool red,bool green,bool blue,
+                bool alpha) {}
+        void _setDepthBias(float constantBias,float slopeScaleBias = 0.0f) {}
+        void _setFog(Ogre::FogMode mode = Ogre::FOG_NONE,
+                const Ogre::ColourValue &colour = Ogre::ColourValue::White,
+                Ogre::Real expDensity = 1.0,Ogre::Real linearStart = 0.0,
+                Ogre::Real linearEnd = 1.0) {}
+        void _setPolygonMode(Ogre::PolygonMode level) {}
+        void setStencilCheckEnabled(bool enabled) {}
+        void setStencilBufferParams(
+                Ogre::CompareFunction func = Ogre::CMPF_ALWAYS_PASS,
+                Ogre::uint32 refValue = 0,Ogre::uint32 mask = 0xFFFFFFFF,
+                Ogre::StencilOperation stencilFailOp = Ogre::SOP_KEEP,
+                Ogre::StencilOperation depthFailOp = Ogre::SOP_KEEP,
+                Ogre::StencilOperation passOp = Ogre::SOP_KEEP,
+                bool twoSidedOperation = false) {}
+        void setVertexDeclaration(Ogre::VertexDeclaration *decl) {}
+        void setVertexBufferBinding(Ogre::VertexBufferBinding *binding) {}
+        void bindGpuProgramParameters(Ogre::GpuProgramType gptype,
+                Ogre::GpuProgramParametersSharedPtr params) {}
+        void bindGpuProgramPassIterationParameters(
+                Ogre::GpuProgramType gptype) {}
+        void setScissorTest(bool enabled,size_t left = 0,size_t top = 0,
+                size_t right = 800,size_t bottom = 600) {}
+        void clearFrameBuffer(unsigned int buffers,
+                const Ogre::ColourValue &colour = Ogre::ColourValue::Black,
+                Ogre::Real depth = 1.0f,unsigned short stencil = 0) {}
+        void _beginFrame() {}
+        void _endFrame() {}
+
+        // Nothing is shared with other threads
+        void preExtraThreadsStarted() {}
+        void postExtraThreadsStarted() {}
+        void registerThread() {}
+        void unregisterThread() {}
+
+    protected:
+        void setClipPlanesImpl(const Ogre::PlaneList &clipPlanes) {}
+        void initialiseFromRenderSystemCapabilities(
+                Ogre::RenderSystemCapabilities *caps,
+                Ogre::RenderTarget *primary) {}
+
+        /// Configuration options (there are none)
+        Ogre::ConfigOptionMap mOptions;
+
+        /// System memory vertex and index buffers
+        Ogre::HardwareBufferManager *mHardwareBufferManager;
+
+        /// Creates NullTexture instances
+        NullTextureManager *mTextureManager;
+    };
+
+    /** Plugin installing NullRenderSystem
+
+        Install it into Ogre::Root with Ogre::Root::installPlugin() and
+        delete it after deleting Ogre::Root, which uninstalls it.
+    */
+    class SONETTO_API NullRenderSystemPlugin : public Ogre::Plugin
+    {
+    public:
+        NullRenderSystemPlugin() : mRenderSystem(NULL) {}
+        virtual ~NullRenderSystemPlugin() {}
+
+        const Ogre::String &getName() const;
+
+        /// Creates NullRenderSystem and adds it to Ogre's render systems
+        void install();
+        void initialise() {}
+        void shutdown() {}
+
+        /// Deletes NullRenderSystem
+        void uninstall();
+
+    private:
+        NullRenderSystem *mRenderSystem;
+    };
+} // namespace
+
+#endif
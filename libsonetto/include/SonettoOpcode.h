@@ -31,14 +31,18 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef SONETTO_OPCODE_H
 #define SONETTO_OPCODE_H
 
-#include <vector>
+#include <new>
 #include <map>
 #include "SonettoPrerequisites.h"
+#include "SonettoFrameArena.h"
 
 namespace Sonetto
 {
     struct SONETTO_API OpcodeArgument
     {
+        OpcodeArgument()
+                : size(0), arg(NULL) {}
+
         OpcodeArgument(size_t aSize,void *aArg)
                 : size(aSize), arg(aArg) {}
 
@@ -46,7 +50,48 @@ namespace Sonetto
         void *arg;
     };
 
-    typedef std::vector<OpcodeArgument> ArgumentVector;
+    /// Maximum number of arguments an opcode can have
+    const size_t MAX_OPCODE_ARGUMENTS = 8;
+
+    /** Fixed capacity list of opcode arguments
+
+        Kept inside the opcode itself, so that creating an opcode does not
+        allocate anything besides the opcode.
+    */
+    class SONETTO_API ArgumentVector
+    {
+    public:
+        ArgumentVector() : mSize(0) {}
+
+        inline void push_back(const OpcodeArgument &arg)
+        {
+            if (mSize == MAX_OPCODE_ARGUMENTS)
+            {
+                SONETTO_THROW("Too many opcode arguments");
+            }
+
+            mArgs[mSize++] = arg;
+        }
+
+        inline size_t size() const { return mSize; }
+
+        inline OpcodeArgument &operator[](size_t i)
+        {
+            return mArgs[i];
+        }
+
+        inline const OpcodeArgument &operator[](size_t i) const
+        {
+            return mArgs[i];
+        }
+
+    private:
+        /// Argument storage
+        OpcodeArgument mArgs[MAX_OPCODE_ARGUMENTS];
+
+        /// Number of arguments
+        size_t mSize;
+    };
 
     class SONETTO_API Opcode
     {
@@ -55,7 +100,16 @@ namespace Sonetto
                 : handler(aHandler),mArgsSize(0) {}
         virtual ~Opcode() {}
 
-        virtual inline Opcode *create() const { return new Opcode(handler); }
+        /** Creates an opcode of the same type in a FrameArena
+
+            Called by ScriptManager for every opcode run; the returned
+            opcode must be destroyed (but not deleted) before the arena is
+            reset (see FramePtr).
+        */
+        virtual inline Opcode *create(FrameArena &arena) const
+        {
+            return new (arena.allocate(sizeof(Opcode))) Opcode(handler);
+        }
 
         virtual inline size_t getArgsSize() const { return mArgsSize; }
 
@@ -0,0 +1,176 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_PACKARCHIVE_H
+#define SONETTO_PACKARCHIVE_H
+
+#include <ctime>
+#include <OgreArchive.h>
+#include <OgreArchiveFactory.h>
+#include "SonettoPrerequisites.h"
+#include "SonettoPackFormat.h"
+#include "SonettoMappedFile.h"
+
+namespace Sonetto
+{
+    /** Ogre archive reading Sonetto pack files
+
+        The pack is memory mapped when loaded, and its table of contents is
+        used in place: looking a file up is a hash table probe, and opening
+        it returns a stream over its slice of the mapping, without copying
+        or touching the disk until the data is read. Compressed files are
+        read through a PackBlockStream instead. Resource locations of
+        type "Pack" use this archive:
+        @code
+        Ogre::ResourceGroupManager::getSingleton().addResourceLocation(
+                "data.pak","Pack","General");
+        @endcode
+        Packs are made with the archiver tool (tools/archiver).
+    @see
+        SonettoPackFormat.h
+    */
+    class SONETTO_API PackArchive : public Ogre::Archive
+    {
+    public:
+        /// Constructor
+        PackArchive(const Ogre::String &name,const Ogre::String &archType);
+
+        /// Destructor
+        ~PackArchive();
+
+        /// Names are not case sensitive
+        bool isCaseSensitive() const { return false; }
+
+        /// Maps the pack and validates its header
+        void load();
+
+        /// Unmaps the pack
+        void unload();
+
+        /** Opens a packed file
+
+            The returned stream reads straight from the mapping, or
+            decompresses from it (PackBlockStream) if the file was
+            compressed.
+        */
+        Ogre::DataStreamPtr open(const Ogre::String &filename) const;
+
+        /// Lists packed files (packs have no directories)
+        Ogre::StringVectorPtr list(bool recursive = true,bool dirs = false);
+
+        /// Lists packed files with information (see list())
+        Ogre::FileInfoListPtr listFileInfo(bool recursive = true,
+                bool dirs = false);
+
+        /// Finds packed files matching a pattern
+        Ogre::StringVectorPtr find(const Ogre::String &pattern,
+                bool recursive = true,bool dirs = false);
+
+        /// Finds packed files matching a pattern, with information
+        Ogre::FileInfoListPtr findFileInfo(const Ogre::String &pattern,
+                bool recursive = true,bool dirs = false);
+
+        /// Whether a file is packed
+        bool exists(const Ogre::String &filename);
+
+        /// Gets the modification time of the pack itself
+        time_t getModifiedTime(const Ogre::String &filename);
+
+        /** Gets where a packed file's data lies in the pack
+
+        @param filename
+            Packed file name.
+        @param offset
+            Set to the offset of its data from the beginning of the pack.
+        @param size
+            Set to the size of its data as stored.
+        @return
+            Whether the file is packed.
+        */
+        bool getEntryRange(const Ogre::String &filename,size_t &offset,
+                size_t &size) const;
+
+    private:
+        /// Gets the entry of a packed file (NULL if not found)
+        const PackEntry *findEntry(const Ogre::String &filename) const;
+
+        /// Gets an entry's name
+        inline Ogre::String getEntryName(const PackEntry &entry) const
+        {
+            return Ogre::String(mNames + entry.nameOffset,entry.nameLength);
+        }
+
+        /** Adds entries matching `pattern' to `names' and/or `infos'
+
+            An empty pattern matches everything. As with Ogre's archives,
+            patterns containing a separator are matched against full names,
+            and the others against base names.
+        */
+        void findEntries(const Ogre::String &pattern,bool recursive,
+                Ogre::StringVector *names,Ogre::FileInfoList *infos);
+
+        /// Mapped pack file
+        MappedFile mFile;
+
+        /// Pack header (points into mFile)
+        const PackHeader *mHeader;
+
+        /// Hash table of contents (points into mFile)
+        const uint32 *mSlots;
+
+        /// Entries (point into mFile)
+        const PackEntry *mEntries;
+
+        /// Entry names (point into mFile)
+        const char *mNames;
+    };
+
+    /// Creates PackArchive instances for "Pack" resource locations
+    class SONETTO_API PackArchiveFactory : public Ogre::ArchiveFactory
+    {
+    public:
+        /// Destructor
+        virtual ~PackArchiveFactory() {}
+
+        /// Gets archive type ("Pack")
+        const Ogre::String &getType() const;
+
+        /// Creates a PackArchive
+        Ogre::Archive *createInstance(const Ogre::String &name)
+        {
+            return new PackArchive(name,getType());
+        }
+
+        /// Destroys a PackArchive
+        void destroyInstance(Ogre::Archive *archive) { delete archive; }
+    };
+} // namespace
+
+#endif
@@ -0,0 +1,142 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_PACKBLOCKSTREAM_H
+#define SONETTO_PACKBLOCKSTREAM_H
+
+#include <algorithm>
+#include <vector>
+#include <OgreDataStream.h>
+#include "SonettoPrerequisites.h"
+#include "SonettoPackFormat.h"
+
+namespace Sonetto
+{
+    /** Stream over a compressed pack entry
+
+        Decompresses the entry's blocks as they are read, so that large
+        files (music, for instance) can be streamed without decompressing
+        them whole. Small reads go through a one block cache; reads spanning
+        several whole blocks decompress them straight into the caller's
+        buffer, in parallel in the JobSystem when there is one, so that
+        loading a whole large file uses every core.
+    @see
+        SonettoPackFormat.h, PackArchive
+    */
+    class SONETTO_API PackBlockStream : public Ogre::DataStream
+    {
+    public:
+        /** Constructor
+
+        @param name
+            Stream name.
+        @param data
+            Stored entry data (beginning with the block size table); must
+            remain valid while the stream is in use.
+        @param entry
+            Pack entry.
+        @param blockSize
+            Uncompressed block size (PackHeader::blockSize).
+        */
+        PackBlockStream(const Ogre::String &name,const char *data,
+                const PackEntry &entry,uint32 blockSize);
+
+        /// Destructor
+        ~PackBlockStream() {}
+
+        /// Reads and decompresses data
+        size_t read(void *buf,size_t count);
+
+        /// Skips `count' bytes (may be negative)
+        void skip(long count);
+
+        /// Moves to an absolute position
+        void seek(size_t pos);
+
+        /// Gets the current position
+        size_t tell() const { return mPos; }
+
+        /// Whether the end was reached
+        bool eof() const { return mPos >= mSize; }
+
+        /// Releases the block cache
+        void close();
+
+        /// Gets the number of blocks
+        inline size_t getBlockCount() const { return mBlockOffsets.size() - 1; }
+
+        /** Decompresses a block
+
+        @param index
+            Block index.
+        @param dest
+            Where to write it (getUncompressedBlockSize() bytes).
+        @return
+            Whether the block was valid.
+        @remarks
+            Only reads the stored data, so it may be called from many
+            threads at once.
+        */
+        bool decodeBlock(size_t index,char *dest) const;
+
+        /// Gets the uncompressed size of a block
+        inline size_t getUncompressedBlockSize(size_t index) const
+        {
+            return std::min<size_t>(mBlockSize,mSize - index * mBlockSize);
+        }
+
+    private:
+        /// Decompresses blocks [first,last) to `dest', in parallel if possible
+        void decodeBlocks(size_t first,size_t last,char *dest);
+
+        /// Stored block sizes (with PACK_BLOCK_UNCOMPRESSED flags)
+        const uint32 *mBlockSizes;
+
+        /// Stored blocks
+        const char *mBlocks;
+
+        /// Offsets of stored blocks from mBlocks (plus the end offset)
+        std::vector<size_t> mBlockOffsets;
+
+        /// Uncompressed block size
+        size_t mBlockSize;
+
+        /// Current position
+        size_t mPos;
+
+        /// Last decompressed block
+        std::vector<char> mCache;
+
+        /// Index of the block in mCache (getBlockCount() if none)
+        size_t mCachedBlock;
+    };
+} // namespace
+
+#endif
@@ -0,0 +1,180 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_PACKFORMAT_H
+#define SONETTO_PACKFORMAT_H
+
+#include <cstddef>
+#include "SonettoPrerequisites.h"
+
+namespace Sonetto
+{
+    /** @file
+        Sonetto pack file format (shared by PackArchive and the archiver tool)
+
+        A pack stores many files in one, so that the game opens a single
+        file instead of thousands of loose ones. It is laid out as follows
+        (all integers are little endian):
+        @code
+        PackHeader
+        uint32 slots[PackHeader::slotCount]      hash table of contents
+        PackEntry entries[PackHeader::entryCount]
+        char names[PackHeader::namesSize]        entry names, not terminated
+        (padding)
+        file data, each file starting at a multiple of PackHeader::alignment
+        @endcode
+        Each slot holds an index into `entries' plus one, or zero if empty.
+        Entries flagged PACK_ENTRY_COMPRESSED store their data as
+        independent LZ4 blocks (see SonettoLZ4.h), each holding
+        PackHeader::blockSize bytes of the file (the last one may hold less):
+        @code
+        uint32 blockSizes[packBlockCount(size,blockSize)]  stored sizes
+        blocks, back to back
+        @endcode
+        Blocks flagged PACK_BLOCK_UNCOMPRESSED in their stored size (because
+        they did not compress) are stored as is. Since blocks do not depend
+        on each other, they can be decompressed in parallel, or one at a
+        time while streaming.
+        A name is looked up by starting at slot packHash(name) modulo
+        slotCount (a power of two, at least twice entryCount) and probing
+        the following slots until an empty one is found. Names are stored
+        normalised (see packNormaliseChar()), relative to the packed
+        directory, with `/' separators.
+    */
+
+    /// Pack file identifier
+    const uint32 PACK_FOURCC = MKFOURCC('S','P','K','0');
+
+    /// Pack format version
+    const uint32 PACK_VERSION = 2;
+
+    /// Default file data alignment (a memory page)
+    const uint32 PACK_DEFAULT_ALIGNMENT = 4096;
+
+    /// Default uncompressed size of compressed entry blocks
+    const uint32 PACK_DEFAULT_BLOCK_SIZE = 65536;
+
+    /// PackEntry::flags bit set for compressed entries
+    const uint32 PACK_ENTRY_COMPRESSED = 0x00000001;
+
+    /// Block stored size bit set for blocks stored uncompressed
+    const uint32 PACK_BLOCK_UNCOMPRESSED = 0x80000000;
+
+    /// Pack file header
+    struct PackHeader
+    {
+        /// PACK_FOURCC
+        uint32 fourCC;
+
+        /// PACK_VERSION
+        uint32 version;
+
+        /// Number of entries
+        uint32 entryCount;
+
+        /// Number of hash table slots (a power of two)
+        uint32 slotCount;
+
+        /// Alignment of file data, in bytes
+        uint32 alignment;
+
+        /// Offset of the names block from the beginning of the pack
+        uint32 namesOffset;
+
+        /// Size of the names block, in bytes
+        uint32 namesSize;
+
+        /// Uncompressed size of compressed entry blocks, in bytes
+        uint32 blockSize;
+    };
+
+    /// Table of contents entry
+    struct PackEntry
+    {
+        /// packHash() of the entry name
+        uint32 hash;
+
+        /// Offset of the name in the names block
+        uint32 nameOffset;
+
+        /// Length of the name
+        uint32 nameLength;
+
+        /// Offset of the file data from the beginning of the pack
+        uint32 offset;
+
+        /// Size of the file, in bytes
+        uint32 size;
+
+        /// Size of the file data as stored (equal to `size' unless compressed)
+        uint32 storedSize;
+
+        /// PACK_ENTRY_* flags
+        uint32 flags;
+    };
+
+    /// Gets the number of blocks of a compressed entry
+    inline uint32 packBlockCount(uint32 size,uint32 blockSize)
+    {
+        return size / blockSize + ((size % blockSize != 0) ? 1 : 0);
+    }
+
+    /** Normalises a name character
+
+        Names are case insensitive and may use `\' as separator, so they
+        are lowercased and `\' is turned into `/' before hashing and storing.
+    */
+    inline char packNormaliseChar(char c)
+    {
+        if (c == '\\') {
+            return '/';
+        } else if (c >= 'A' && c <= 'Z') {
+            return c - 'A' + 'a';
+        }
+
+        return c;
+    }
+
+    /// Hashes a name (32 bits FNV-1a over its normalised characters)
+    inline uint32 packHash(const char *name,size_t length)
+    {
+        uint32 hash = 2166136261U;
+
+        for (size_t i = 0;i < length;++i)
+        {
+            hash ^= (uint8)(packNormaliseChar(name[i]));
+            hash *= 16777619U;
+        }
+
+        return hash;
+    }
+} // namespace
+
+#endif
@@ -0,0 +1,134 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_PERFORMANCEHUD_H
+#define SONETTO_PERFORMANCEHUD_H
+
+#include <string>
+#include <OgreOverlay.h>
+#include <OgreOverlayContainer.h>
+#include "SonettoPrerequisites.h"
+#include "SonettoFont.h"
+
+namespace Sonetto
+{
+    /// Seconds between PerformanceHUD text updates
+    const float PERFORMANCE_HUD_REFRESH_INTERVAL = 0.25f;
+
+    /// Size of the PerformanceHUD text buffer, in characters
+    const size_t PERFORMANCE_HUD_TEXT_SIZE = 512;
+
+    /// Z order of the PerformanceHUD overlay (above everything else)
+    const unsigned short PERFORMANCE_HUD_ZORDER = 640;
+
+    /** On-screen performance statistics
+
+        Shows frame times, script instructions, sound sources, music buffer
+        fill, allocations and the module stack depth in an overlay, using a
+        StaticTextElement. Toggled by the Kernel with F10 when a font is
+        set in the configuration file ([kernel] hudFont).
+    @remarks
+        The text is only rebuilt every PERFORMANCE_HUD_REFRESH_INTERVAL
+        seconds, into a fixed buffer, so that the HUD does not allocate
+        memory while running. Rates (such as instructions per frame) are
+        averaged over the frames between two updates.
+    */
+    class SONETTO_API PerformanceHUD
+    {
+    public:
+        /** Constructor
+
+            Creates the overlay, hidden.
+        @param fontName
+            Name of the font resource used to render the text.
+        */
+        PerformanceHUD(const std::string &fontName);
+
+        /// Destructor
+        ~PerformanceHUD();
+
+        /// Shows or hides the HUD
+        void setVisible(bool visible);
+
+        /// Whether the HUD is being shown
+        inline bool isVisible() const { return mVisible; }
+
+        /// Shows the HUD if hidden, hides it otherwise
+        inline void toggle() { setVisible(!mVisible); }
+
+        /** Counts a frame and updates the text when it is due
+
+            Called once per frame by the Kernel. Does nothing while hidden.
+        @param frameTime
+            Real time elapsed since last frame, in seconds.
+        */
+        void update(float frameTime);
+
+    private:
+        /// Samples the statistics and rebuilds the text
+        void refresh();
+
+        /// Samples the counters rates are computed from
+        void sampleCounters(unsigned long &instructions,
+                size_t &allocations,size_t &liveAllocations) const;
+
+        /// Font the text is rendered with
+        FontPtr mFont;
+
+        /// HUD overlay
+        Ogre::Overlay *mOverlay;
+
+        /// Transparent panel holding mTextElement
+        Ogre::OverlayContainer *mPanel;
+
+        /// Text element
+        StaticTextElement *mTextElement;
+
+        /// Whether the HUD is being shown
+        bool mVisible;
+
+        /// Seconds since the last refresh()
+        float mElapsed;
+
+        /// Frames since the last refresh()
+        size_t mFrames;
+
+        /// Script instruction count at the last refresh()
+        unsigned long mLastInstructions;
+
+        /// Allocation count at the last refresh()
+        size_t mLastAllocations;
+
+        /// Text buffer
+        char mBuffer[PERFORMANCE_HUD_TEXT_SIZE];
+    };
+} // namespace
+
+#endif
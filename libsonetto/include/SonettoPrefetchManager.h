@@ -0,0 +1,234 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_PREFETCHMANAGER_H
+#define SONETTO_PREFETCHMANAGER_H
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+#include <SDL/SDL_mutex.h>
+#include <SDL/SDL_thread.h>
+#include <OgreSingleton.h>
+#include "SonettoPrerequisites.h"
+#include "SonettoModule.h"
+
+namespace Sonetto
+{
+    /** Records the order files are read in, and prefetches them later
+
+        While recording, scripts, fonts, sounds and musics report the files
+        they read (see recordResource() and recordFile()), and the Kernel
+        reports module changes (see moduleChanged()). The first read of each
+        file is kept, in order, and written to a manifest when recording
+        stops, split in segments by the module being loaded at the time.
+
+        When a manifest was loaded, moduleChanged() queues the files listed
+        in that module's segments, and a background thread asks the
+        operating system to bring them into the page cache
+        (posix_fadvise(POSIX_FADV_WILLNEED) where available, reading them
+        otherwise), so that they are already in memory by the time the
+        module opens them. Files inside packs are prefetched as their range
+        of the pack only.
+    @remarks
+        Resource names are resolved into files in the calling thread, so
+        moduleChanged() must be called from the main thread; the record
+        functions may be called from any thread.
+    */
+    class SONETTO_API PrefetchManager : public Ogre::Singleton<PrefetchManager>
+    {
+    public:
+        /// Constructor
+        PrefetchManager();
+
+        /// Destructor (stops prefetching, and saves the manifest if recording)
+        ~PrefetchManager();
+
+        /** Overrides standard Singleton retrieval
+        @remarks
+            Warning: These comments below were copied straight from Ogre3D code.
+            Why do we do this? Well, it's because the Singleton
+            implementation is in a .h file, which means it gets compiled
+            into anybody who includes it. This is needed for the
+            Singleton template to work, but we actually only want it
+            compiled into the implementation of the class based on the
+            Singleton, not all of them. If we don't change this, we get
+            link errors when trying to use the Singleton-based class from
+            an outside dll.
+        @param
+            This method just delegates to the template version anyway,
+            but the implementation stays in this single compilation unit,
+            preventing link errors.
+        */
+        static PrefetchManager &getSingleton();
+
+        /** Overrides standard Singleton retrieval
+        @remarks
+            Warning: These comments below were copied straight from Ogre3D code.
+            Why do we do this? Well, it's because the Singleton
+            implementation is in a .h file, which means it gets compiled
+            into anybody who includes it. This is needed for the
+            Singleton template to work, but we actually only want it
+            compiled into the implementation of the class based on the
+            Singleton, not all of them. If we don't change this, we get
+            link errors when trying to use the Singleton-based class from
+            an outside dll.
+        @param
+            This method just delegates to the template version anyway,
+            but the implementation stays in this single compilation unit,
+            preventing link errors.
+        */
+        static PrefetchManager *getSingletonPtr();
+
+        /** Loads a manifest and starts the prefetch thread
+
+        @return
+            Whether the manifest could be read.
+        */
+        bool loadManifest(const std::string &fileName);
+
+        /** Starts recording
+
+        @param fileName
+            Where the manifest is written when recording stops.
+        */
+        void startRecording(const std::string &fileName);
+
+        /// Stops recording and writes the manifest
+        void stopRecording();
+
+        /// Whether file reads are being recorded
+        inline bool isRecording() const { return mRecording; }
+
+        /// Records the read of a resource
+        void recordResource(const std::string &name,const std::string &group);
+
+        /// Records the read of a file, by path
+        void recordFile(const std::string &path);
+
+        /** Tells that a module is about to be loaded
+
+            Starts a new segment in the manifest being recorded, and queues
+            the files recorded for `type' in the loaded manifest for
+            prefetching, ahead of anything still queued.
+        */
+        void moduleChanged(Module::ModuleType type);
+
+    private:
+        /// Manifest entry types
+        enum EntryType
+        {
+            /// Start of a module segment (`name' holds the module type)
+            ET_MODULE,
+
+            /// Ogre resource (`name' in `group')
+            ET_RESOURCE,
+
+            /// File by path (`name')
+            ET_FILE
+        };
+
+        /// Manifest entry
+        struct ManifestEntry
+        {
+            EntryType type;
+            std::string group;
+            std::string name;
+        };
+
+        typedef std::vector<ManifestEntry> ManifestEntryVector;
+
+        /// File range to be prefetched (a zero size means the whole file)
+        struct PrefetchRange
+        {
+            std::string path;
+            size_t offset;
+            size_t size;
+        };
+
+        typedef std::deque<PrefetchRange> PrefetchRangeDeque;
+
+        /// Appends an entry to the recorded manifest, unless already there
+        void record(EntryType type,const std::string &group,
+                const std::string &name);
+
+        /** Queues the files of every manifest segment of a module type
+
+            An empty `typeName' stands for the files read before any module
+            was loaded.
+        */
+        void queueSegments(const std::string &typeName);
+
+        /// Finds where a manifest entry lies on disk
+        bool resolve(const ManifestEntry &entry,PrefetchRange &range) const;
+
+        /// Brings a file range into the page cache
+        void prefetch(const PrefetchRange &range);
+
+        /// Prefetch thread function
+        static int prefetchThread(void *data);
+
+        /// Loaded manifest
+        ManifestEntryVector mManifest;
+
+        /// Manifest being recorded
+        ManifestEntryVector mRecorded;
+
+        /// Keys of entries in mRecorded (to keep first reads only)
+        std::set<std::string> mRecordedKeys;
+
+        /// Where mRecorded is written
+        std::string mRecordFileName;
+
+        /// Whether reads are being recorded
+        volatile bool mRecording;
+
+        /// Ranges waiting to be prefetched
+        PrefetchRangeDeque mQueue;
+
+        /// Guards mRecorded, mRecordedKeys and mQueue
+        SDL_mutex *mMutex;
+
+        /// Posted when ranges are queued, or to stop the thread
+        SDL_sem *mWake;
+
+        /// Prefetch thread (NULL without a manifest)
+        SDL_Thread *mThread;
+
+        /// Tells the prefetch thread to stop
+        volatile bool mStop;
+
+        /// Bytes prefetched
+        MetricCounter *mPrefetchedBytes;
+    };
+} // namespace
+
+#endif
@@ -62,11 +62,12 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace Sonetto
 {
-    // Declare common data types
-    typedef unsigned long uint32;
+    // Declare common data types (int is 32 bits wide on both 32 and 64 bits
+    // targets, while long is 64 bits wide on 64 bits Linux)
+    typedef unsigned int uint32;
     typedef unsigned short uint16;
     typedef unsigned char uint8;
-    typedef signed long int32;
+    typedef signed int int32;
     typedef signed short int16;
     typedef signed char int8;
 
@@ -78,6 +79,7 @@ namespace Sonetto
     class Exception;
     class Module;
     class ModuleFactory;
+    class ModuleLoader;
     class BootModule;
     class TitleModule;
     class MapModule;
@@ -110,9 +112,26 @@ namespace Sonetto
     class AudioManager;
     class Music;
     class MusicStream;
+    class MusicDecoder;
+    class SoundCache;
     class SoundDef;
     class SoundSource;
     class InputManager;
+    class AtomicCounter;
+    class MemoryTracker;
+    class JobSystem;
+    class JobCounter;
+    class FrameArena;
+    class PerformanceHUD;
+    class MetricsRegistry;
+    class MetricCounter;
+    class MetricGauge;
+    class MetricHistogram;
+    class MappedFile;
+    class PackArchive;
+    class PackArchiveFactory;
+    class NullRenderSystemPlugin;
+    class PrefetchManager;
 
     // <todo> Find a good place for this (I don't think this is a good place to
     // put things we don't know where to put; it will probably lead to problems of
@@ -0,0 +1,230 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_PROFILER_H
+#define SONETTO_PROFILER_H
+
+#include "SonettoPrerequisites.h"
+
+/** Scoped CPU timing marker
+
+    Measures the time spent from this line to the end of the enclosing scope
+    and records it in the Profiler under `name', which must be a string
+    literal (only the pointer is stored). Markers can be nested and used from
+    any thread:
+
+    @code
+    void MyModule::update()
+    {
+        SONETTO_PROFILE("MyModule::update");
+        ...
+        {
+            SONETTO_PROFILE("MyModule::update::collisions");
+            ...
+        }
+    }
+    @endcode
+
+    Unless SONETTO_PROFILING is defined when compiling, markers expand to
+    nothing and cost nothing.
+*/
+#ifdef SONETTO_PROFILING
+#   define SONETTO_PROFILE(name) \
+        SONETTO_PROFILE_SCOPE_VAR(name,__LINE__)
+#   define SONETTO_PROFILE_SCOPE_VAR(name,line) \
+        SONETTO_PROFILE_SCOPE_VAR2(name,line)
+#   define SONETTO_PROFILE_SCOPE_VAR2(name,line) \
+        Sonetto::ProfileScope sonettoProfileScope##line(name)
+#else
+#   define SONETTO_PROFILE(name)
+#endif
+
+#ifdef SONETTO_PROFILING
+
+#include <string>
+#include <vector>
+#include <SDL/SDL_mutex.h>
+#include <OgreSingleton.h>
+#include "SonettoAtomic.h"
+
+namespace Sonetto
+{
+    /** Collects SONETTO_PROFILE() markers and exports them
+
+        Each thread records its markers in its own ring buffer, without
+        locking. The buffers are drained by dump(), which writes them in
+        Chrome's trace event format (load them in chrome://tracing).
+    @remarks
+        Only available when SONETTO_PROFILING is defined.
+    */
+    class SONETTO_API Profiler : public Ogre::Singleton<Profiler>
+    {
+    public:
+        /// Number of events each thread can hold before dump() is called
+        static const size_t BUFFER_CAPACITY = 16384;
+
+        /// Constructor
+        Profiler();
+
+        /// Destructor
+        ~Profiler();
+
+        /** Overrides standard Singleton retrieval
+
+        @remarks
+            Warning: These comments below were copied straight from Ogre3D code.
+            Why do we do this? Well, it's because the Singleton
+            implementation is in a .h file, which means it gets compiled
+            into anybody who includes it. This is needed for the
+            Singleton template to work, but we actually only want it
+            compiled into the implementation of the class based on the
+            Singleton, not all of them. If we don't change this, we get
+            link errors when trying to use the Singleton-based class from
+            an outside dll.
+        @param
+            This method just delegates to the template version anyway,
+            but the implementation stays in this single compilation unit,
+            preventing link errors.
+        */
+        static Profiler &getSingleton();
+
+        /** Overrides standard Singleton retrieval
+
+        @remarks
+            Warning: These comments below were copied straight from Ogre3D code.
+            Why do we do this? Well, it's because the Singleton
+            implementation is in a .h file, which means it gets compiled
+            into anybody who includes it. This is needed for the
+            Singleton template to work, but we actually only want it
+            compiled into the implementation of the class based on the
+            Singleton, not all of them. If we don't change this, we get
+            link errors when trying to use the Singleton-based class from
+            an outside dll.
+        @param
+            This method just delegates to the template version anyway,
+            but the implementation stays in this single compilation unit,
+            preventing link errors.
+        */
+        static Profiler *getSingletonPtr();
+
+        /** Records a finished marker (used by ProfileScope)
+
+        @param name
+            Marker name (string literal).
+        @param start
+            When it started (see getMicroseconds()).
+        @param end
+            When it ended (see getMicroseconds()).
+        */
+        void _record(const char *name,unsigned long long start,
+                unsigned long long end);
+
+        /** Drains all recorded events into a Chrome trace file
+
+            Events recorded since the last dump are written, so calling this
+            periodically never loses events unless a thread fills its buffer
+            in between.
+        @return
+            Whether the file could be written.
+        */
+        bool dump(const std::string &fileName);
+
+        /// Gets a monotonic timestamp, in microseconds
+        static unsigned long long getMicroseconds();
+
+    private:
+        /// A recorded marker
+        struct Event
+        {
+            const char *name;
+            unsigned long long start;
+            unsigned long long end;
+        };
+
+        /** Single producer, single consumer ring buffer
+
+            Written only by its thread, read only by dump().
+        */
+        struct ThreadBuffer
+        {
+            Event events[BUFFER_CAPACITY];
+            volatile size_t writePos;
+            volatile size_t readPos;
+            AtomicCounter dropped;
+            size_t threadNum;
+        };
+
+        /** Gets calling thread's buffer, creating it on first use
+
+            Thread local buffer pointers outlive the Profiler that created
+            them, so each one is tagged with its Profiler's generation and
+            replaced when it does not match.
+        */
+        ThreadBuffer *getThreadBuffer();
+
+        /// All thread buffers ever created
+        std::vector<ThreadBuffer *> mBuffers;
+
+        /// Guards mBuffers and dump()
+        SDL_mutex *mMutex;
+
+        /// Unique for each Profiler ever created (see getThreadBuffer())
+        long mGeneration;
+    };
+
+    /** Scoped marker created by SONETTO_PROFILE()
+
+        Records the time between its construction and destruction.
+    */
+    class SONETTO_API ProfileScope
+    {
+    public:
+        inline ProfileScope(const char *name)
+                : mName(name), mStart(Profiler::getMicroseconds()) {}
+
+        inline ~ProfileScope()
+        {
+            Profiler *profiler = Profiler::getSingletonPtr();
+
+            if (profiler)
+            {
+                profiler->_record(mName,mStart,Profiler::getMicroseconds());
+            }
+        }
+
+    private:
+        const char *mName;
+        unsigned long long mStart;
+    };
+} // namespace
+
+#endif // SONETTO_PROFILING
+
+#endif
@@ -46,10 +46,17 @@ namespace Sonetto
     class SONETTO_API Script
     {
     public:
-        Script(ScriptFilePtr file)
-                : mScriptFile(file), mOffset(0),mLocals(NULL) {}
+        /** Constructor
 
-        virtual ~Script() {}
+            Registers this script with the ScriptManager, so that it can be
+            included in script snapshots.
+        @see
+            ScriptManager::saveSnapshot()
+        */
+        Script(ScriptFilePtr file);
+
+        /// Destructor (unregisters this script from the ScriptManager)
+        virtual ~Script();
 
         virtual inline void setLocals(VariableMap *locals) { mLocals = locals; }
         virtual inline VariableMap *getLocals() { return mLocals; }
@@ -60,13 +67,81 @@ namespace Sonetto
 
         virtual inline size_t _getOffset() const { return mOffset; }
 
-        virtual inline void stackPush(const Variable &var) { mVarStack.push(var); }
+        virtual inline void stackPush(const Variable &var) { mVarStack.push_back(var); }
 
         virtual const Variable &stackPeek();
 
         virtual Variable stackPop();
 
+        /** Calculates how many bytes _saveState() will write
+
+        @see
+            ScriptManager::calculateSnapshotSize()
+        */
+        virtual size_t _getStateSize() const;
+
+        /** Writes this script's state into a snapshot buffer
+
+            The offset, operand stack, local variables and wait state are
+            packed into `dest', which must have at least _getStateSize()
+            bytes available.
+        @return
+            Pointer to the byte right after the written state.
+        */
+        virtual char *_saveState(char *dest) const;
+
+        /** Checks a snapshot record against this script
+
+            Throws if the record is truncated, corrupted or was not saved by
+            a script running the same file with the same kind of locals.
+            Nothing is modified.
+        @param src
+            Pointer to a state previously written by _saveState().
+        @param end
+            End of the snapshot buffer (used for bounds checking).
+        @return
+            Pointer to the byte right after the record.
+        */
+        virtual const char *_validateState(const char *src,
+                const char *end) const;
+
+        /** Reads this script's state back from a snapshot buffer
+
+            The operand stack and local variables are overwritten in place
+            whenever possible, so that rewinding a script to a previous state
+            of itself does not allocate memory.
+        @param src
+            Pointer to a state already accepted by _validateState(). No
+            further checks are made.
+        @return
+            Pointer to the byte right after the read state.
+        */
+        virtual const char *_loadState(const char *src);
+
     protected:
+        /** Size of the wait state of this script
+
+            Scripts that can be suspended waiting for something (timers,
+            messages, animations, etc.) should override these three methods
+            so that their waiting state is saved together with the rest of
+            the script. The base Script has no wait state.
+        */
+        virtual size_t _getWaitStateSize() const { return 0; }
+
+        /// Writes wait state (see _getWaitStateSize())
+        virtual void _saveWaitState(char *dest) const {}
+
+        /** Checks wait state before it is read (see _getWaitStateSize())
+
+            Must throw if the wait state cannot be loaded, since
+            _loadWaitState() is only called once every script in the
+            snapshot was validated.
+        */
+        virtual void _validateWaitState(const char *src,size_t size) const {}
+
+        /// Reads wait state (see _getWaitStateSize())
+        virtual void _loadWaitState(const char *src,size_t size) {}
+
         /** ScriptFile pointer
 
             Holds opcodes to be used by this script.
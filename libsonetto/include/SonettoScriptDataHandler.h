@@ -44,8 +44,8 @@ namespace Sonetto
     public:
         OpDataPush(OpcodeHandler *aHandler);
 
-        inline OpDataPush *create() const
-                { return new OpDataPush(handler); }
+        inline OpDataPush *create(FrameArena &arena) const
+                { return new (arena.allocate(sizeof(OpDataPush))) OpDataPush(handler); }
 
         Variable variable;
     };
@@ -55,8 +55,8 @@ namespace Sonetto
     public:
         OpDataPushVar(OpcodeHandler *aHandler);
 
-        inline OpDataPushVar *create() const
-                { return new OpDataPushVar(handler); }
+        inline OpDataPushVar *create(FrameArena &arena) const
+                { return new (arena.allocate(sizeof(OpDataPushVar))) OpDataPushVar(handler); }
 
         char scope;
         uint32 varIndex;
@@ -67,8 +67,8 @@ namespace Sonetto
     public:
         OpDataPopVar(OpcodeHandler *aHandler);
 
-        inline OpDataPopVar *create() const
-                { return new OpDataPopVar(handler); }
+        inline OpDataPopVar *create(FrameArena &arena) const
+                { return new (arena.allocate(sizeof(OpDataPopVar))) OpDataPopVar(handler); }
 
         char scope;
         uint32 varIndex;
@@ -94,8 +94,8 @@ namespace Sonetto
     public:
         OpDataVarChg(OpcodeHandler *aHandler);
 
-        inline OpDataVarChg *create() const
-                { return new OpDataVarChg(handler); }
+        inline OpDataVarChg *create(FrameArena &arena) const
+                { return new (arena.allocate(sizeof(OpDataVarChg))) OpDataVarChg(handler); }
 
         char scope;
         uint32 varIndex;
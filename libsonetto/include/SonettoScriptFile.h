@@ -40,10 +40,13 @@ namespace Sonetto
 #include <OgreResourceManager.h>
 #include "SonettoPrerequisites.h"
 #include "SonettoSharedPtr.h"
+#include "SonettoMemory.h"
 
 namespace Sonetto
 {
-    typedef std::vector<char> ScriptData;
+    /// Script bytecode (accounted to MEMTAG_SCRIPTS)
+    typedef std::vector<char,TaggedAllocator<char,MEMTAG_SCRIPTS> >
+            ScriptData;
 
     class SONETTO_API ScriptFile : public Ogre::Resource
     {
@@ -45,7 +45,8 @@ namespace Sonetto
         OpFlowStop(OpcodeHandler *aHandler)
                 : Opcode(aHandler) {}
 
-        OpFlowStop *create() const { return new OpFlowStop(handler); }
+        OpFlowStop *create(FrameArena &arena) const
+                { return new (arena.allocate(sizeof(OpFlowStop))) OpFlowStop(handler); }
     };
 
     class OpFlowJmp : public Opcode
@@ -53,7 +54,8 @@ namespace Sonetto
     public:
         OpFlowJmp(OpcodeHandler *aHandler);
 
-        OpFlowJmp *create() const { return new OpFlowJmp(handler); }
+        OpFlowJmp *create(FrameArena &arena) const
+                { return new (arena.allocate(sizeof(OpFlowJmp))) OpFlowJmp(handler); }
 
         uint32 address;
     };
@@ -63,7 +65,8 @@ namespace Sonetto
     public:
         OpFlowCJmp(OpcodeHandler *aHandler);
 
-        OpFlowCJmp *create() const { return new OpFlowCJmp(handler); }
+        OpFlowCJmp *create(FrameArena &arena) const
+                { return new (arena.allocate(sizeof(OpFlowCJmp))) OpFlowCJmp(handler); }
 
         char scope;
         uint32 cmpIndex;
@@ -31,17 +31,23 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef SONETTO_SCRIPTMANAGER_H
 #define SONETTO_SCRIPTMANAGER_H
 
+#include <vector>
+
 // Forward declarations
 namespace Sonetto
 {
     class ScriptManager;
 
+    /// Buffer holding a binary snapshot of all running scripts
+    typedef std::vector<char> ScriptSnapshot;
+
     const int SCRIPT_STOP         = -4;
     const int SCRIPT_SUSPEND      = -3;
     const int SCRIPT_SUSPEND_NEXT = -2;
     const int SCRIPT_CONTINUE     = -1;
 }
 
+#include <SDL/SDL_mutex.h>
 #include <OgreResourceManager.h>
 #include <OgreSingleton.h>
 #include "SonettoScript.h"
@@ -108,11 +114,71 @@ namespace Sonetto
                     new ScriptImpl(load(scriptName,groupName)));
         }
 
-        void updateScript(ScriptPtr script);
+        /** Runs a script until it suspends or stops
+
+        @param arena
+            Where opcodes are created while they run (usually
+            Kernel::getFrameArena()). Each one is destroyed once run, but
+            its memory is only released when the arena is reset.
+        */
+        void updateScript(ScriptPtr script,FrameArena &arena);
+
+        /** Gets the number of opcodes run since startup
+
+            Sample it twice to know how many opcodes were run in between
+            (see PerformanceHUD).
+        */
+        inline unsigned long getInstructionCount() const
+                { return mInstructionCount; }
 
+        /** Registers an opcode into the opcode table
+
+        @remarks
+            Thread safe, so that subsystems can register their opcodes while
+            being initialized in parallel (see Kernel::initialize()).
+            Opcodes must not be registered or unregistered while scripts
+            are being run.
+        */
         void _registerOpcode(size_t id,const Opcode *opcode);
+
+        /// Unregisters and deletes an opcode (thread safe)
         void _unregisterOpcode(size_t id);
 
+        /** Calculates the size of a snapshot of all live scripts
+
+            Useful to reserve a ScriptSnapshot buffer up front.
+        */
+        size_t calculateSnapshotSize() const;
+
+        /** Saves the state of all live scripts into a snapshot
+
+            Each script's file (by name hash), offset, operand stack, local
+            variables and wait state are packed in a compact binary format.
+            `snapshot' is resized to fit, but its capacity is kept, so
+            reusing the same buffer every frame does not allocate after the
+            first save.
+        @see
+            Script::_saveState()
+        */
+        void saveSnapshot(ScriptSnapshot &snapshot) const;
+
+        /** Restores the state of all live scripts from a snapshot
+
+            Scripts are matched against the snapshot in creation order, and
+            must be running the same script files they were running when
+            the snapshot was taken.
+        @remarks
+            Throws if the snapshot is malformed or does not match the live
+            scripts. No script is modified in that case.
+        */
+        void restoreSnapshot(const ScriptSnapshot &snapshot);
+
+        /// Called by Script's constructor
+        void _registerScript(Script *script);
+
+        /// Called by Script's destructor
+        void _unregisterScript(Script *script);
+
     protected:
         Ogre::Resource *createImpl(const Ogre::String &name,
                 Ogre::ResourceHandle handle,const Ogre::String &group,
@@ -122,13 +188,23 @@ namespace Sonetto
         void readScriptData(ScriptPtr script,void *dest,
                 size_t bytes,bool updateCursor);
 
-        Opcode *readOpcode(ScriptPtr script,size_t &id,
+        /// Reads the next opcode of a script, creating it in `arena'
+        Opcode *readOpcode(ScriptPtr script,FrameArena &arena,size_t &id,
                 size_t &bytesRead);
 
         size_t seekOpcode(ScriptPtr script,size_t opIndex);
 
         OpcodeTable mOpcodeTable;
 
+        /// Guards mOpcodeTable against concurrent (un)registrations
+        SDL_mutex *mOpcodeMutex;
+
+        /// Live scripts, in creation order
+        std::vector<Script *> mScripts;
+
+        /// Opcodes run since startup
+        volatile unsigned long mInstructionCount;
+
         ScriptFlowHandler mFlowHandler;
     };
 } // namespace Sonetto
@@ -0,0 +1,295 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_SOUNDCACHE_H
+#define SONETTO_SOUNDCACHE_H
+
+#include <map>
+#include <string>
+#include <SDL/SDL_mutex.h>
+#include <OgreDataStream.h>
+#include "SonettoPrerequisites.h"
+
+namespace Sonetto
+{
+    /// Identifies the OGG/Vorbis file a cached sound was decoded from
+    struct SoundCacheKey
+    {
+        /// Math::hash() of the file contents
+        uint32 hash;
+
+        /// File size, in bytes
+        uint32 size;
+    };
+
+    /** Identifies a version of a sound file without reading it
+
+        Lets SoundCache::findKey() tell whether a file changed since it was
+        hashed, the way make does: by its size and modification time.
+    */
+    struct SoundFileInfo
+    {
+        SoundFileInfo() : size(0), modified(0) {}
+
+        /** Path of the file, followed by `:' and the entry name for files
+            inside packs (empty if unknown)
+        */
+        std::string path;
+
+        /// File size, in bytes (uncompressed, for files inside packs)
+        uint32 size;
+
+        /// Modification time of the file, or of the pack it is in
+        uint32 modified;
+    };
+
+    /** Header of a sound cache file
+
+        Followed by `pcmSize' bytes of interleaved 16-bit PCM.
+    */
+    struct SoundCacheHeader
+    {
+        /// SOUND_CACHE_MAGIC
+        uint32 magic;
+
+        /// Number of channels (1 or 2)
+        uint32 channels;
+
+        /// Sample rate, in Hz
+        uint32 rate;
+
+        /// Bytes of PCM data following the header
+        uint32 pcmSize;
+
+        /// Microseconds it took to decode the sound
+        uint32 decodeTime;
+    };
+
+    /// SoundCacheHeader::magic ("SPC1")
+    const uint32 SOUND_CACHE_MAGIC = 0x31435053;
+
+    /** Disk cache of decoded sounds
+
+        Keeps sounds decoded to 16-bit PCM in a directory, one file per
+        sound, named after the hash and size of the file they were decoded
+        from, so that a sound is decoded again only if its file changes.
+        Cached files are memory mapped, and their data can be given
+        straight to alBufferData().
+
+        Hashing a file reads all of it, so the key each file was hashed
+        into is remembered along with its SoundFileInfo (see findKey()),
+        and files are only hashed again after they change.
+
+        The cache is kept under a size limit: when storing a sound would
+        take it over the limit, the least recently used sounds that are not
+        mapped are deleted first. Sizes and use order are kept in an index
+        file in the cache directory, and hashed files in a sources file,
+        both written when the cache is destroyed; files not listed in the
+        index are never read.
+    @remarks
+        open() and store() may be called from any thread.
+    */
+    class SONETTO_API SoundCache
+    {
+    public:
+        /** Constructor
+
+        @param directory
+            Directory holding the cache (created if needed).
+        @param maxSize
+            Most bytes the cached files may take together.
+        */
+        SoundCache(const std::string &directory,size_t maxSize);
+
+        /// Destructor (writes the index)
+        ~SoundCache();
+
+        /** Hashes a stream into a cache key
+
+            Reads the whole stream and seeks it back to its beginning.
+        @return
+            False if the stream cannot seek (and cannot be cached).
+        */
+        static bool makeKey(Ogre::DataStream &stream,SoundCacheKey &key);
+
+        /** Finds the key a file was hashed into before
+
+            Spares reading the whole file with makeKey() again.
+        @return
+            False if the file was never hashed, or changed since.
+        */
+        bool findKey(const SoundFileInfo &file,SoundCacheKey &key);
+
+        /** Remembers the key makeKey() hashed a file into
+
+            Files whose path is unknown are not remembered.
+        */
+        void recordKey(const SoundFileInfo &file,const SoundCacheKey &key);
+
+        /** Maps a cached sound
+
+        @param file
+            Where the sound's file is mapped; its PCM data follows the
+            header, at file.getData() + sizeof(SoundCacheHeader).
+        @param header
+            Receives the sound's header.
+        @return
+            Whether the sound was in the cache. If so, it is not deleted
+            until release() is called.
+        */
+        bool open(const SoundCacheKey &key,MappedFile &file,
+                SoundCacheHeader &header);
+
+        /** Lets a sound mapped by open() be deleted again
+
+            Call it once its MappedFile was closed.
+        */
+        void release(const SoundCacheKey &key);
+
+        /** Stores a decoded sound
+
+            Failing to write it is not an error; the sound is simply not
+            cached. Sounds bigger than the whole cache are never stored.
+        @param header
+            Sound description (`magic' is filled by this method).
+        @param pcm
+            `header.pcmSize' bytes of PCM data.
+        */
+        void store(const SoundCacheKey &key,const SoundCacheHeader &header,
+                const char *pcm);
+
+        /// Gets the bytes taken by cached files
+        inline size_t getSize() const { return mSize; }
+
+        /// Gets the most bytes cached files may take
+        inline size_t getMaxSize() const { return mMaxSize; }
+
+    private:
+        /// A cached file
+        struct Entry
+        {
+            Entry() : size(0), lastUse(0), users(0) {}
+
+            /// File size, in bytes
+            size_t size;
+
+            /// mUseClock when it was last stored or opened
+            unsigned long long lastUse;
+
+            /// Number of times it is mapped by open() and not released
+            size_t users;
+        };
+
+        /// A hashed file (see findKey())
+        struct Source
+        {
+            /// SoundFileInfo::size and SoundFileInfo::modified when hashed
+            uint32 size;
+            uint32 modified;
+
+            /// Key it was hashed into
+            SoundCacheKey key;
+        };
+
+        /// Entries by file name
+        typedef std::map<std::string,Entry> EntryMap;
+
+        /// Hashed files by SoundFileInfo::path
+        typedef std::map<std::string,Source> SourceMap;
+
+        /// Gets the file name of a key
+        static std::string getFileName(const SoundCacheKey &key);
+
+        /// Reads the index, if any
+        void loadIndex();
+
+        /// Writes the index
+        void saveIndex();
+
+        /// Reads the sources file, if any
+        void loadSources();
+
+        /** Writes the sources file
+
+            Files whose cached sound was deleted are left out.
+        */
+        void saveSources();
+
+        /** Deletes a cached file and forgets it
+
+            Must be called with mMutex locked.
+        */
+        void discard(EntryMap::iterator entry);
+
+        /** Deletes least recently used files until at most `size' bytes
+            are left
+
+            Files mapped by open() are kept, so more than `size' bytes may
+            be left. Must be called with mMutex locked.
+        */
+        void trim(size_t size);
+
+        /// Cache directory, ending in a path separator
+        std::string mPath;
+
+        /// Most bytes cached files may take
+        size_t mMaxSize;
+
+        /// Bytes taken by cached files
+        size_t mSize;
+
+        /// Cached files
+        EntryMap mEntries;
+
+        /// Hashed files
+        SourceMap mSources;
+
+        /// Incremented whenever an entry is used, to order them
+        unsigned long long mUseClock;
+
+        /// Guards mSize, mEntries, mSources and mUseClock
+        SDL_mutex *mMutex;
+
+        /// Sounds found in the cache
+        MetricCounter *mHits;
+
+        /// Sounds not found in the cache
+        MetricCounter *mMisses;
+
+        /// Bytes taken by cached files
+        MetricGauge *mBytes;
+
+        // Not copyable
+        SoundCache(const SoundCache &);
+        SoundCache &operator=(const SoundCache &);
+    };
+} // namespace
+
+#endif
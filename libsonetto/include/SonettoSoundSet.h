@@ -32,6 +32,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <vector>
 #include "SonettoPrerequisites.h"
+#include "SonettoMemory.h"
 
 namespace Sonetto
 {
@@ -47,7 +48,8 @@ namespace Sonetto
         IDVector sounds;
     };
 
-    typedef std::vector<SoundSet> SoundSetVector;
+    typedef std::vector<SoundSet,TaggedAllocator<SoundSet,MEMTAG_DATABASE> >
+            SoundSetVector;
 } // namespace
 
 #endif
@@ -31,7 +31,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #define SONETTO_SOUNDSOURCE_H
 
 #include <string>
+#include <AL/al.h>
 #include <OgreSharedPtr.h>
+#include "SonettoMemory.h"
 
 namespace Sonetto
 {
@@ -53,9 +55,20 @@ namespace Sonetto
 
     struct Sound
     {
-        Sound(size_t aBuffer) : buffer(aBuffer) {}
+        Sound(ALuint aBuffer,size_t aSize)
+                : buffer(aBuffer), size(aSize), sources(0), lastUse(0) {}
 
-        size_t buffer;
+        /// OpenAL buffer (0 while evicted; see AudioManager::setSoundBudget())
+        ALuint buffer;
+
+        /// PCM bytes held by `buffer' (accounted to MEMTAG_AUDIO)
+        size_t size;
+
+        /// Number of sound sources `buffer' is attached to
+        size_t sources;
+
+        /// AudioManager use clock when it was last used
+        unsigned long long lastUse;
     };
 
     class SONETTO_API SoundSource
@@ -71,6 +84,9 @@ namespace Sonetto
 
         virtual inline uint32 getSoundID() const { return mSoundID; }
 
+        /// Gets the AudioManager sound whose buffer is attached (0 if none)
+        inline uint32 _getBoundSoundID() const { return mBoundSoundID; }
+
         virtual void setSoundID(uint32 id);
         virtual void setNode(Ogre::Node *node);
 
@@ -81,14 +97,38 @@ namespace Sonetto
         virtual void stop();
 
     protected:
+        /** Whether mALSource is a valid OpenAL audio source
+
+            Never true without an audio device, where sounds are only kept
+            track of (see AudioManager::initialize()).
+        */
+        bool hasALSource() const;
+
         /// A pointer to the AudioManager singleton, for ease of use
         AudioManager *mAudioMan;
 
         /// Sound ID inside AudioManager::mSounds
         uint32 mSoundID;
 
+        /** Sound whose buffer is attached to mALSource (0 if none)
+
+            Differs from mSoundID in subclasses that map their own IDs to
+            AudioManager's (e.g. SoundSetSource).
+        */
+        uint32 mBoundSoundID;
+
+        /** Whether the bound sound is being loaded again in the background
+
+            Its buffer is attached by _update() once it is uploaded (see
+            AudioManager::_acquireSound()).
+        */
+        bool mBufferPending;
+
+        /// Whether play() was called while mBufferPending was true
+        bool mPlayPending;
+
         /// An OpenAL audio source handle
-        size_t mALSource;
+        ALuint mALSource;
 
         /// The maximum volume this source will reach
         float mMaxVolume;
@@ -98,7 +138,8 @@ namespace Sonetto
     };
 
     /// Vector of SoundDef structures
-    typedef std::vector<SoundDef> SoundDefVector;
+    typedef std::vector<SoundDef,TaggedAllocator<SoundDef,MEMTAG_DATABASE> >
+            SoundDefVector;
 
     /// Map of Sound structures
     typedef std::map<uint32,Sound> SoundMap;
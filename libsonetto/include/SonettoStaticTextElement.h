@@ -135,12 +135,32 @@ namespace Sonetto
 
         Ogre::MaterialPtr & getMaterial(void) const;
 
-        /// Internal method to update the element based on transforms applied.
+        /** Internal method to update the element based on transforms applied.
+
+            The vertex buffers are only refilled when the text or anything
+            else its geometry is built from changed since the last update
+            (see isGeometryOutdated()).
+        */
         void _update(void);
     protected:
+        /// Whether the vertex buffers need to be refilled
+        bool isGeometryOutdated(float aspect);
+
         bool mInitialized;
         size_t mStringSize;
         size_t mAllocatedSize;
+
+        /// Whether the vertex buffers hold built geometry
+        bool mGeometryBuilt;
+
+        /// What the geometry in the vertex buffers was built from
+        std::string mBuiltText;
+        float mBuiltAlpha;
+        Ogre::Vector2 mBuiltTextSize;
+        Font *mBuiltFont;
+        float mBuiltAspect;
+        Ogre::Real mBuiltLeft;
+        Ogre::Real mBuiltTop;
     public:
         std::string mText;
         float mAlpha;
@@ -33,8 +33,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <typeinfo>
 #include <cmath>
 #include <map>
-#include <stack>
+#include <vector>
 #include "SonettoPrerequisites.h"
+#include "SonettoMemory.h"
 
 namespace Sonetto
 {
@@ -138,6 +139,7 @@ namespace Sonetto
 
         VariableType getType() const;
         inline char &_getRawType() { return mType; }
+        inline char _getRawType() const { return mType; }
 
         union
         {
@@ -161,8 +163,19 @@ namespace Sonetto
         char mType;
     };
 
-    typedef std::map<int,Variable> VariableMap;
-    typedef std::stack<Variable> VariableStack;
+    /// Variables by ID (accounted to MEMTAG_VARIABLES)
+    typedef std::map<int,Variable,std::less<int>,TaggedAllocator<
+            std::pair<const int,Variable>,MEMTAG_VARIABLES> > VariableMap;
+
+    /** Script operand stack
+
+        Backed by a vector instead of std::stack's default deque, so that
+        its contents are contiguous and its capacity is kept between pushes
+        and pops (and between snapshot restores). Accounted to
+        MEMTAG_SCRIPTS.
+    */
+    typedef std::vector<Variable,TaggedAllocator<Variable,MEMTAG_SCRIPTS> >
+            VariableStack;
 } // namespace
 
 #endif
@@ -0,0 +1,76 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifndef SONETTO_VORBISDATASTREAM_H
+#define SONETTO_VORBISDATASTREAM_H
+
+#include <vorbis/vorbisfile.h>
+#include <OgreDataStream.h>
+#include "SonettoPrerequisites.h"
+
+namespace Sonetto
+{
+    /** Opens an OGG/Vorbis file reading from an Ogre stream
+
+        Works like ov_fopen(), but reads through vorbisfile callbacks
+        bound to `stream', so that audio can come from any resource
+        location (packs and other archives included), or from memory. The
+        stream is kept open until ov_clear() is called on `file'. Streams
+        that cannot seek (with a size of zero) are opened as unseekable.
+    @param stream
+        Stream to be read, positioned at the beginning of the file.
+    @param file
+        vorbisfile handle to be opened.
+    @return
+        Zero on success, or one of vorbisfile's OV_E* codes.
+    */
+    SONETTO_API int ovOpenDataStream(const Ogre::DataStreamPtr &stream,
+            OggVorbis_File *file);
+
+    /** Opens an OGG/Vorbis file reading from a stream it takes over
+
+        Same as ovOpenDataStream(), but instead of copying the stream
+        pointer, takes ownership of `stream' (allocated with new) once
+        opened successfully; ov_clear() deletes it. It leaves the stream's
+        reference count alone, so it can be called from a thread other
+        than the one holding the stream's other references.
+    @param stream
+        Stream to be read, positioned at the beginning of the file. It is
+        left to the caller if opening fails.
+    @param file
+        vorbisfile handle to be opened.
+    @return
+        Zero on success, or one of vorbisfile's OV_E* codes.
+    */
+    SONETTO_API int ovAdoptDataStream(Ogre::DataStreamPtr *stream,
+            OggVorbis_File *file);
+} // namespace
+
+#endif
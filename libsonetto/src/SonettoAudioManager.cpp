@@ -28,12 +28,25 @@ POSSIBILITY OF SUCH DAMAGE.
 -----------------------------------------------------------------------------*/
 
 #include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <OgreArchive.h>
+#include <OgreLogManager.h>
 #include <OgreStringConverter.h>
+#include <OgreResourceGroupManager.h>
+#include <OgreTimer.h>
 #include <AL/al.h>
 #include "SonettoKernel.h"
 #include "SonettoDatabase.h"
 #include "SonettoException.h"
 #include "SonettoAudioManager.h"
+#include "SonettoJobSystem.h"
+#include "SonettoPrefetchManager.h"
+#include "SonettoMappedDataStream.h"
+#include "SonettoMappedFile.h"
+#include "SonettoMetrics.h"
+#include "SonettoSoundCache.h"
+#include "SonettoVorbisDataStream.h"
 
 namespace Sonetto
 {
@@ -42,10 +55,99 @@ namespace Sonetto
     //-----------------------------------------------------------------------------
     SONETTO_SINGLETON_IMPLEMENT(AudioManager);
     //-----------------------------------------------------------------------------
-    void AudioManager::initialize(const char *device)
+    // PCM bytes _update() uploads to OpenAL per frame for sound sets loaded
+    // in the background (at least one sound is always uploaded)
+    static const size_t SOUND_UPLOAD_BYTES_PER_FRAME = 1048576;
+    //-----------------------------------------------------------------------------
+    struct AudioManager::SoundDecode
+    {
+        SoundDecode()
+                : id(0), stream(NULL), opened(false), cache(NULL),
+                cached(NULL), pcm(NULL), capacity(0), data(NULL), size(0),
+                format(0), rate(0), time(0), savedTime(0) {}
+
+        /// Sound ID
+        uint32 id;
+
+        /// Stream opened by openSound() (NULL once `file' took it over)
+        Ogre::DataStreamPtr *stream;
+
+        /// vorbisfile handle (must not be moved once opened)
+        OggVorbis_File file;
+
+        /// Whether `file' is open
+        bool opened;
+
+        /// Sound cache (NULL if disabled)
+        SoundCache *cache;
+
+        /// Identifies the sound file to the cache (see statSound())
+        SoundFileInfo source;
+
+        /// Cache key of the sound file
+        SoundCacheKey key;
+
+        /// Cache file the PCM data is mapped from (NULL if decoded)
+        MappedFile *cached;
+
+        /// Decoded PCM data (allocated with `capacity' bytes)
+        char *pcm;
+        size_t capacity;
+
+        /// PCM data to be uploaded (`pcm', or mapped from `cached')
+        const char *data;
+
+        /// Bytes of PCM data
+        size_t size;
+
+        /// OpenAL format and sample rate of the PCM data
+        ALenum format;
+        long rate;
+
+        /// Microseconds taken to decode it, or to map it from the cache
+        unsigned long time;
+
+        /// Microseconds of decoding the cache saved
+        unsigned long savedTime;
+
+        /// Why decoding failed (empty if it did not)
+        std::string error;
+    };
+    //-----------------------------------------------------------------------------
+    struct AudioManager::SoundSetLoad
+    {
+        /// Sound set ID (0 when reloading an evicted sound)
+        uint32 id;
+
+        /// Number of sounds still being decoded
+        JobCounter pending;
+
+        /// Started when the set began loading
+        Ogre::Timer timer;
+
+        /// Sounds being decoded (not resized once submitted)
+        std::vector<SoundDecode> sounds;
+
+        /// Number of sounds already uploaded by uploadSoundSet()
+        size_t uploaded;
+    };
+    //-----------------------------------------------------------------------------
+    void AudioManager::initialize(const char *device,bool openDevice,
+            size_t musicBufferSize,size_t musicBuffers,
+            const std::string &soundCacheDir,size_t soundCacheSize)
     {
         ALCcontext *context;
 
+        // Opcodes are available even when audio is stubbed out, so that
+        // scripts run the same way with or without an audio device
+        mScriptAudioHandler.registerOpcodes();
+        mOpcodesRegistered = true;
+
+        if (!openDevice)
+        {
+            return;
+        }
+
         // Opens audio device
         mDevice = alcOpenDevice(device);
 
@@ -78,9 +180,19 @@ namespace Sonetto
                 "distance model");
 
         // Now that OpenAL is initialised, we can initialise the music stream
-        mMusicStream = new MusicStream(this);
+        mMusicStream = new MusicStream(this,musicBufferSize,musicBuffers);
 
-        mScriptAudioHandler.registerOpcodes();
+        if (!soundCacheDir.empty())
+        {
+            mSoundCache = new SoundCache(soundCacheDir,soundCacheSize);
+        }
+
+        mSoundBytesMetric = MetricsRegistry::getSingleton().
+                getGauge("sound_buffer_bytes");
+        mSoundEvictionsMetric = MetricsRegistry::getSingleton().
+                getCounter("sound_evictions");
+        mSoundReloadsMetric = MetricsRegistry::getSingleton().
+                getCounter("sound_reloads");
 
         // Everything is fine
         mInitialised = true;
@@ -88,11 +200,34 @@ namespace Sonetto
     //-----------------------------------------------------------------------------
     AudioManager::~AudioManager()
     {
+        if (mOpcodesRegistered)
+        {
+            mScriptAudioHandler.unregisterOpcodes();
+        }
+
         if (mInitialised)
         {
             ALCcontext *context;
 
-            mScriptAudioHandler.unregisterOpcodes();
+            // Drops the sound sets still being decoded
+            for (size_t i = 0;i < mSoundSetLoads.size();++i)
+            {
+                SoundSetLoad *load = mSoundSetLoads[i];
+
+                if (load->pending.get() > 0)
+                {
+                    JobSystem::getSingleton().wait(load->pending);
+                }
+
+                for (size_t j = 0;j < load->sounds.size();++j)
+                {
+                    releaseSound(load->sounds[j]);
+                }
+
+                delete load;
+            }
+
+            delete mSoundCache;
 
             // Deletes sound sources
             while (!mSoundSources.empty())
@@ -110,10 +245,15 @@ namespace Sonetto
                 mSoundSources.pop_back();
             }
 
-            // Deletes sound buffers
+            // Deletes sound buffers (evicted sounds have none)
             for (SoundMap::iterator i = mSounds.begin();i != mSounds.end();++i)
             {
-                alDeleteBuffers(1,&i->second.buffer);
+                if (i->second.buffer != 0)
+                {
+                    alDeleteBuffers(1,&i->second.buffer);
+                    MemoryTracker::_recordDeallocation(MEMTAG_AUDIO,
+                            i->second.size);
+                }
             }
 
             _alErrorCheck("AudioManager::~AudioManager()","Failed deleting "
@@ -137,6 +277,12 @@ namespace Sonetto
         float fadeOut = Math::clamp(aFadeOut,0.0f,1.0f);
         float fadeIn  = Math::clamp(aFadeIn,0.0f,1.0f);
 
+        // Audio is stubbed out without a device
+        if (!mInitialised)
+        {
+            return;
+        }
+
         // If there is nothing being played, start playing new BGM
         if (mMusicStream->getCurrentMusic() == 0    ||
             mMusicStream->isStopped()       == true ||
@@ -152,6 +298,7 @@ namespace Sonetto
             mNextBGM     = id;
             mNextBGMFade = fadeIn;
             mNextBGMPos  = 0;
+            preloadNext();
 
             // Stops the music with the desired fade out speed if the stream
             // is currently a BGM, or waits for the ME to end elsewise
@@ -169,12 +316,19 @@ namespace Sonetto
                 mNextBGM     = id;
                 mNextBGMFade = fadeIn;
                 mNextBGMPos  = 0;
+                preloadNext();
             }
         }
     }
     //-----------------------------------------------------------------------------
     void AudioManager::playME(size_t id,float aFadeOut,float aFadeIn)
     {
+        // Audio is stubbed out without a device
+        if (!mInitialised)
+        {
+            return;
+        }
+
         // If there is nothing being played, start playing new ME
         if (mMusicStream->getCurrentMusic() == 0    ||
             mMusicStream->isStopped()       == true ||
@@ -191,6 +345,7 @@ namespace Sonetto
                 mNextME      = id;
                 mNextBGMFade = fadeIn;
                 mNextBGMPos  = 0;
+                preloadNext();
                 mMusicStream->_stop(fadeOut);
             } else { // ME playing
                 mMusicStream->_play(id,0,0.0f,false);
@@ -204,15 +359,23 @@ namespace Sonetto
             }
 
             mMusicStream->_play(id,0,0.0f,false);
+            preloadNext();
         }
     }
     //-----------------------------------------------------------------------------
     void AudioManager::stopMusic(float fadeOut)
     {
+        // Audio is stubbed out without a device
+        if (!mInitialised)
+        {
+            return;
+        }
+
         // Clears next BGM and ME values to make sure AudioManager::fadeEnded()
         // won't start the queued music when the fade out ends
         mNextBGM = 0;
         mNextME  = 0;
+        preloadNext();
 
         // Stops the music
         if (mMusicStream->_getLoop() == true) { // BGM
@@ -224,17 +387,36 @@ namespace Sonetto
     //-----------------------------------------------------------------------------
     void AudioManager::resumeMusic(float fadeIn)
     {
+        // Audio is stubbed out without a device
+        if (!mInitialised)
+        {
+            return;
+        }
+
         mMusicStream->_resume(Math::clamp(fadeIn,0.0f,1.0f));
     }
     //-----------------------------------------------------------------------------
     void AudioManager::pauseMusic(float fadeOut)
     {
+        // Audio is stubbed out without a device
+        if (!mInitialised)
+        {
+            return;
+        }
+
         mMusicStream->_pause(Math::clamp(fadeOut,0.0f,1.0f));
     }
     //-----------------------------------------------------------------------------
     void AudioManager::_update(float deltatime)
     {
         Ogre::Vector3 listenerPos;
+        size_t uploadBytes = 0;
+
+        // Audio is stubbed out without a device
+        if (!mInitialised)
+        {
+            return;
+        }
 
         // Updates OpenAL's audio listener position
         listenerPos = _getListenerPos();
@@ -245,6 +427,39 @@ namespace Sonetto
         // Updates music stream
         mMusicStream->_update(deltatime);
 
+        // Uploads the sound sets that finished decoding in the background,
+        // a few sounds per frame, so that no single frame uploads them all
+        for (size_t i = 0;i < mSoundSetLoads.size() &&
+                uploadBytes < SOUND_UPLOAD_BYTES_PER_FRAME;++i)
+        {
+            SoundSetLoad *load = mSoundSetLoads[i];
+
+            if (load->pending.get() > 0)
+            {
+                continue;
+            }
+
+            try {
+                uploadBytes += uploadSoundSet(load,
+                        SOUND_UPLOAD_BYTES_PER_FRAME - uploadBytes);
+            } catch (...) {
+                mSoundSetLoads.erase(mSoundSetLoads.begin()+i);
+                discardSoundSetLoad(load);
+                throw;
+            }
+
+            if (load->uploaded == load->sounds.size())
+            {
+                mSoundSetLoads.erase(mSoundSetLoads.begin()+i);
+                --i;
+
+                finishSoundSetLoad(load);
+            }
+        }
+
+        // Evicts sounds released since the last update, if over budget
+        trimSounds();
+
         // Updates sound sources
         for (size_t i = 0;i < mSoundSources.size();++i)
         {
@@ -266,180 +481,817 @@ namespace Sonetto
     //-----------------------------------------------------------------------------
     void AudioManager::loadSound(uint32 id)
     {
+        SoundDecode sound;
+
+        // Nothing to decode if it is in memory already, or if audio is
+        // stubbed out
+        if (!openSound(id,sound))
+        {
+            return;
+        }
+
+        decodeSound(&sound);
+
+        try {
+            if (!sound.error.empty())
+            {
+                SONETTO_THROW(sound.error);
+            }
+
+            uploadSound(sound);
+        } catch (...) {
+            releaseSound(sound);
+            throw;
+        }
+
+        releaseSound(sound);
+        trimSounds();
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::unloadSound(uint32 id)
+    {
+        SoundMap::iterator sound;
+
+        // Audio is stubbed out without a device
+        if (!mInitialised)
+        {
+            return;
+        }
+
+        // Otherwise the background load would bring it back
+        finishSoundLoading(id);
+
+        // Throw exception if the sound is not loaded yet
+        sound = mSounds.find(id);
+        if (sound == mSounds.end())
+        {
+            SONETTO_THROW("Trying to unload a not loaded sound");
+        }
+
+        // Removes this buffer from sound sources using it
+        for (size_t i = 0;i < mSoundSources.size();++i)
+        {
+            SoundSourcePtr snd = mSoundSources[i];
+
+            // If the IDs are the same, invalidate it
+            if (snd->_getBoundSoundID() == id)
+            {
+                snd->setSoundID(0);
+            }
+        }
+
+        // Evicted sounds have no buffer to be deleted
+        if (sound->second.buffer != 0)
+        {
+            alDeleteBuffers(1,&sound->second.buffer);
+            _alErrorCheck("AudioManager::unloadSound()","Failed deleting "
+                    "OpenAL audio buffers");
+            MemoryTracker::_recordDeallocation(MEMTAG_AUDIO,
+                    sound->second.size);
+
+            mSoundBytes -= sound->second.size;
+            mSoundBytesMetric->set(mSoundBytes);
+        }
+
+        mSounds.erase(sound);
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::loadSoundSet(uint32 id)
+    {
+        // Finishes loading it if it was started by loadSoundSetAsync()
+        SoundSetLoad *load = takeSoundSetLoad(id);
+
+        if (!load)
+        {
+            load = beginSoundSetLoad(id);
+            if (!load)
+            {
+                return;
+            }
+        }
+
+        finishSoundSetLoad(load);
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::loadSoundSetAsync(uint32 id)
+    {
+        SoundSetLoad *load = beginSoundSetLoad(id);
+
+        if (load)
+        {
+            mSoundSetLoads.push_back(load);
+        }
+    }
+    //-----------------------------------------------------------------------------
+    bool AudioManager::isSoundSetLoading(uint32 id) const
+    {
+        for (size_t i = 0;i < mSoundSetLoads.size();++i)
+        {
+            // Sound reloads (ID 0) are not sound sets
+            if (id != 0 && mSoundSetLoads[i]->id == id)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::unloadSoundSet(uint32 id)
+    {
+        SoundSetLoad *load = takeSoundSetLoad(id);
+
+        // Its sounds must be loaded before they can be unloaded
+        if (load)
+        {
+            finishSoundSetLoad(load);
+        }
+
+        const SoundSetVector &soundSets = Database::getSingleton().soundSets;
+        if (id == 0 || id > soundSets.size())
+        {
+            SONETTO_THROW("Unknown sound set ID");
+        }
+
+        const IDVector &soundSetSounds = soundSets[id - 1].getSounds();
+        for (size_t i = 0;i < soundSetSounds.size();++i)
+        {
+            unloadSound(soundSetSounds[i]);
+        }
+    }
+    //-----------------------------------------------------------------------------
+    bool AudioManager::openSound(uint32 id,SoundDecode &sound)
+    {
+        SoundMap::iterator loaded;
+
         // Bounds checking
         if (id == 0 || id >= Database::getSingleton().sounds.size()+1)
         {
             SONETTO_THROW("Unknown sound ID");
         }
 
-        // Throw exception if the sound was already loaded
-        if (mSounds.find(id) != mSounds.end())
+        // Throw exception if the sound is still being loaded
+        if (isSoundLoading(id))
         {
-            SONETTO_THROW("Trying to load an already loaded sound");
+            SONETTO_THROW("Trying to load a sound that is already being "
+                    "loaded");
         }
 
+        // Audio is stubbed out without a device
+        if (!mInitialised)
+        {
+            return false;
+        }
+
+        // Loaded sounds only need to be loaded again if they were evicted
+        loaded = mSounds.find(id);
+        if (loaded != mSounds.end() && loaded->second.buffer != 0)
+        {
+            loaded->second.lastUse = ++mSoundUseClock;
+            return false;
+        }
+
+        // Resource groups are only used from this thread, so the file is
+        // opened here even if it is decoded elsewhere
+        sound.id = id;
+        sound.cache = mSoundCache;
+        sound.stream = new Ogre::DataStreamPtr(_openFile(SoundDef::FOLDER +
+                Database::getSingleton().sounds[id-1].filename));
+
+        if (mSoundCache)
+        {
+            statSound(SoundDef::FOLDER +
+                    Database::getSingleton().sounds[id-1].filename,sound);
+        }
+
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::statSound(const std::string &name,SoundDecode &sound)
+    {
+        Ogre::ResourceGroupManager &groups =
+                Ogre::ResourceGroupManager::getSingleton();
+        Ogre::StringVector groupNames = groups.getResourceGroups();
+        std::string path = name;
+        std::string entry;
+        size_t size = 0;
+        struct stat status;
+
+        // Looks it up the way _openFile() does
+        for (size_t i = 0;i < groupNames.size();++i)
+        {
+            if (groups.resourceExists(groupNames[i],name))
+            {
+                Ogre::FileInfoListPtr files =
+                        groups.findResourceFileInfo(groupNames[i],name);
+
+                if (files->empty())
+                {
+                    return;
+                }
+
+                const Ogre::FileInfo &file = files->front();
+
+                // Files inside packs change along with their pack
+                if (file.archive->getType() == "FileSystem") {
+                    path = file.archive->getName() + "/" + file.filename;
+                } else {
+                    path = file.archive->getName();
+                    entry = file.filename;
+                    size = file.uncompressedSize;
+                }
+
+                break;
+            }
+        }
+
+        // Left unknown; the file is hashed every time
+        if (stat(path.c_str(),&status) != 0)
+        {
+            return;
+        }
+
+        if (entry.empty()) {
+            sound.source.path = path;
+            sound.source.size = status.st_size;
+        } else {
+            sound.source.path = path + ":" + entry;
+            sound.source.size = size;
+        }
+
+        sound.source.modified = status.st_mtime;
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::decodeSound(void *data)
+    {
+        SoundDecode *sound = static_cast<SoundDecode *>(data);
+        SoundCacheHeader header;
+        bool keyed = false;
+        bool cacheable = false;
+        Ogre::Timer timer;
         int errCode;
         int bitstream;
-        ALenum format;
-        size_t soundLen;
-        size_t offset = 0;
-        size_t buffer;
-        std::string path = SoundDef::FOLDER + Database::getSingleton().
-                sounds[id-1].filename;
-        char *constlessStr = new char[path.length()+1];
-        char *tmpBuffer;
-        OggVorbis_File file;
+        ogg_int64_t samples;
 
-        // We use this `constlessStr' here because ov_fopen() needs a char *
-        // argument as filename, but std::string::c_str() returns a const char *,
-        // and I don't like const-casts
-        strcpy(constlessStr,path.c_str());
+        // Files are only hashed (which reads all of them) when they are new
+        // to the cache, or changed since they were hashed
+        if (sound->cache)
+        {
+            keyed = sound->cache->findKey(sound->source,sound->key);
+            if (!keyed && SoundCache::makeKey(**sound->stream,sound->key))
+            {
+                sound->cache->recordKey(sound->source,sound->key);
+                keyed = true;
+            }
+        }
 
-        // Opens file and checks for errors
-        // <todo> Check for -1
-        errCode = ov_fopen(constlessStr,&file);
+        // Sounds decoded before are mapped straight from the cache
+        if (keyed)
+        {
+            sound->cached = new MappedFile();
+            if (sound->cache->open(sound->key,*sound->cached,header))
+            {
+                sound->format = (header.channels == 1) ? AL_FORMAT_MONO16 :
+                        AL_FORMAT_STEREO16;
+                sound->rate = header.rate;
+                sound->size = header.pcmSize;
+                sound->data = sound->cached->getData() +
+                        sizeof(SoundCacheHeader);
+                sound->time = timer.getMicroseconds();
+                sound->savedTime = (header.decodeTime > sound->time) ?
+                        header.decodeTime - sound->time : 0;
+                return;
+            }
+
+            delete sound->cached;
+            sound->cached = NULL;
+            cacheable = true;
+        }
+
+        // Takes the stream over without touching its reference count;
+        // it is closed by releaseSound() in the owning thread
+        errCode = ovAdoptDataStream(sound->stream,&sound->file);
         if (errCode != 0)
         {
-            SONETTO_THROW("Failed opening OGG/Vorbis file ("+
-                    Ogre::StringConverter::toString(errCode)+")");
+            sound->error = "Failed opening OGG/Vorbis file ("+
+                    Ogre::StringConverter::toString(errCode)+")";
+            return;
         }
 
-        // Not needed anymore
-        delete[] constlessStr;
+        sound->stream = NULL;
+        sound->opened = true;
 
         // Gets sound length to create audio buffer
-        soundLen = static_cast<size_t>(ov_pcm_total(&file,-1));
-        if ((int)soundLen == OV_EINVAL)
+        samples = ov_pcm_total(&sound->file,-1);
+        if (samples < 0)
         {
-            SONETTO_THROW("Failed telling OGG/Vorbis sound length ("+
-                    Ogre::StringConverter::toString((int)soundLen)+")");
+            sound->error = "Failed telling OGG/Vorbis sound length ("+
+                    Ogre::StringConverter::toString((int)samples)+")";
+            return;
         }
 
         // Gets information about the stream and figures
         // whether the format is mono or stereo
-        if (file.vi->channels == 1) {
-            format = AL_FORMAT_MONO16;
-            soundLen *= 2;
+        sound->rate = sound->file.vi->rate;
+        if (sound->file.vi->channels == 1) {
+            sound->format = AL_FORMAT_MONO16;
+            sound->capacity = static_cast<size_t>(samples) * 2;
         } else {
-            format = AL_FORMAT_STEREO16;
-            soundLen *= 4;
+            sound->format = AL_FORMAT_STEREO16;
+            sound->capacity = static_cast<size_t>(samples) * 4;
         }
 
-        // Creates OpenAL buffer
-        alGenBuffers(1,&buffer);
-        _alErrorCheck("AudioManager::loadSound()","Failed to generate an OpenAL "
-                "audio buffer");
-
-        // Creates temporary audio buffer
-        tmpBuffer = new char[soundLen];
+        sound->pcm = static_cast<char *>(
+                MemoryTracker::allocate(MEMTAG_AUDIO,sound->capacity));
 
         // While we haven't loaded the sound, read more data from OGG stream
-        while (offset < soundLen)
+        while (sound->size < sound->capacity)
         {
+            size_t left = sound->capacity-sound->size;
             int read;
 
-            if (soundLen-offset <= 1024) {
+            if (left <= 1024) {
                 char chunk[1024];
-                read = ov_read(&file,chunk,1024,0,2,1,&bitstream);
+                read = ov_read(&sound->file,chunk,1024,0,2,1,&bitstream);
 
                 if (read > 0)
                 {
-                    // Copy part of data read to `data' buffer
-                    read = soundLen-offset;
-                    memcpy(tmpBuffer+offset,chunk,read);
+                    // Copy part of data read to `pcm' buffer
+                    if ((size_t)read > left)
+                    {
+                        read = left;
+                    }
+
+                    memcpy(sound->pcm+sound->size,chunk,read);
                 }
             } else {
-                read = ov_read(&file,tmpBuffer+offset,soundLen-offset,0,2,1,
+                read = ov_read(&sound->file,sound->pcm+sound->size,left,0,2,1,
                                &bitstream);
             }
 
             if (read > 0) { // There were bytes read
-                offset += read;
+                sound->size += read;
             } else
             if (read == 0) { // No bytes were read
                 break;
             } else { // Error while reading from file
-                SONETTO_THROW("Failed reading from OGG/Vorbis file ("+
-                    Ogre::StringConverter::toString(read)+")");
+                sound->error = "Failed reading from OGG/Vorbis file ("+
+                        Ogre::StringConverter::toString(read)+")";
+                return;
             }
         }
 
-        // Fills an OpenAL audio data buffer with our
-        // just decompressed audio data
-        alBufferData(buffer,format,tmpBuffer,offset,file.vi->rate);
-        _alErrorCheck("AudioManager::loadSound()","Could not fill OpenAL audio buffer");
+        sound->data = sound->pcm;
+        sound->time = timer.getMicroseconds();
+
+        if (cacheable)
+        {
+            header.channels = sound->file.vi->channels;
+            header.rate = sound->rate;
+            header.pcmSize = sound->size;
+            header.decodeTime = sound->time;
+            sound->cache->store(sound->key,header,sound->pcm);
+        }
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::uploadSound(SoundDecode &sound)
+    {
+        ALuint buffer;
+
+        // Creates OpenAL buffer
+        alGenBuffers(1,&buffer);
+        _alErrorCheck("AudioManager::uploadSound()","Failed to generate an "
+                "OpenAL audio buffer");
 
-        // Closes OGG/Vorbis file and deletes temporary buffer
-        ov_clear(&file);
-        delete[] tmpBuffer;
+        // Fills an OpenAL audio data buffer with the decoded audio data
+        alBufferData(buffer,sound.format,sound.data,sound.size,sound.rate);
+        _alErrorCheck("AudioManager::uploadSound()","Could not fill OpenAL "
+                "audio buffer");
+
+        // Inserts our buffer as a loaded sound in mSounds, unless it was
+        // there already, evicted; OpenAL keeps its own copy of the PCM data
+        SoundMap::iterator loaded = mSounds.find(sound.id);
+        if (loaded == mSounds.end()) {
+            loaded = mSounds.insert(std::pair<uint32,Sound>(sound.id,
+                    Sound(buffer,sound.size))).first;
+        } else {
+            loaded->second.buffer = buffer;
+            loaded->second.size = sound.size;
+            mSoundReloadsMetric->increment();
+        }
 
-        // Inserts our buffer as a loaded sound in mSounds
-        mSounds.insert(std::pair<uint32,Sound>(id,Sound(buffer)));
+        loaded->second.lastUse = ++mSoundUseClock;
+
+        MemoryTracker::_recordAllocation(MEMTAG_AUDIO,sound.size);
+        mSoundBytes += sound.size;
+        mSoundBytesMetric->set(mSoundBytes);
     }
     //-----------------------------------------------------------------------------
-    void AudioManager::unloadSound(uint32 id)
+    void AudioManager::releaseSound(SoundDecode &sound)
     {
-        // Throw exception if the sound is not loaded yet
-        if (mSounds.find(id) == mSounds.end())
+        // ov_clear() deletes the stream it took over
+        if (sound.opened)
         {
-            SONETTO_THROW("Trying to unload a not loaded sound");
+            ov_clear(&sound.file);
+            sound.opened = false;
         }
 
-        // Removes this buffer from sound sources using it
-        for (size_t i = 0;i < mSoundSources.size();++i)
-        {
-            SoundSourcePtr snd = mSoundSources[i];
+        delete sound.stream;
+        sound.stream = NULL;
 
-            // If the IDs are the same, invalidate it
-            if (snd->getSoundID() == id)
-            {
-                snd->setSoundID(0);
-            }
+        // Lets the cache delete it again once unmapped
+        if (sound.cached)
+        {
+            delete sound.cached;
+            sound.cached = NULL;
+            sound.cache->release(sound.key);
         }
 
-        alDeleteBuffers(1,&mSounds.find(id)->second.buffer);
-        _alErrorCheck("AudioManager::unloadSound()","Failed deleting OpenAL "
-                "audio buffers");
+        sound.data = NULL;
 
-        mSounds.erase(mSounds.find(id));
+        if (sound.pcm)
+        {
+            MemoryTracker::deallocate(MEMTAG_AUDIO,sound.pcm,sound.capacity);
+            sound.pcm = NULL;
+        }
     }
     //-----------------------------------------------------------------------------
-    void AudioManager::loadSoundSet(uint32 id)
+    AudioManager::SoundSetLoad *AudioManager::beginSoundSetLoad(uint32 id)
     {
         const SoundSetVector &soundSets = Database::getSingleton().soundSets;
+        SoundSetLoad *load;
+
         if (id == 0 || id > soundSets.size())
         {
             SONETTO_THROW("Unknown sound set ID");
         }
 
         const IDVector &soundSetSounds = soundSets[id - 1].getSounds();
-        for (size_t i = 0;i < soundSetSounds.size();++i)
+
+        load = new SoundSetLoad;
+        load->id = id;
+        load->sounds.resize(soundSetSounds.size());
+        load->uploaded = 0;
+
+        try {
+            size_t opened = 0;
+
+            // Only the sounds not in memory yet are kept; those another set
+            // is loading already are left to it
+            for (size_t i = 0;i < soundSetSounds.size();++i)
+            {
+                if (!isSoundLoading(soundSetSounds[i]) &&
+                        openSound(soundSetSounds[i],load->sounds[opened]))
+                {
+                    ++opened;
+                }
+            }
+
+            load->sounds.resize(opened);
+        } catch (...) {
+            discardSoundSetLoad(load);
+            throw;
+        }
+
+        // Audio is stubbed out without a device (the IDs are checked anyway)
+        if (!mInitialised)
         {
-            loadSound(soundSetSounds[i]);
+            delete load;
+            return NULL;
         }
+
+        decodeSoundSet(load);
+        return load;
     }
     //-----------------------------------------------------------------------------
-    void AudioManager::unloadSoundSet(uint32 id)
+    void AudioManager::beginSoundReload(uint32 id)
     {
-        const SoundSetVector &soundSets = Database::getSingleton().soundSets;
-        if (id == 0 || id > soundSets.size())
+        SoundSetLoad *load = new SoundSetLoad;
+
+        load->id = 0;
+        load->sounds.resize(1);
+        load->uploaded = 0;
+
+        try {
+            if (!openSound(id,load->sounds[0]))
+            {
+                // Not evicted after all
+                discardSoundSetLoad(load);
+                return;
+            }
+        } catch (...) {
+            discardSoundSetLoad(load);
+            throw;
+        }
+
+        decodeSoundSet(load);
+        mSoundSetLoads.push_back(load);
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::decodeSoundSet(SoundSetLoad *load)
+    {
+        JobSystem *jobSystem = JobSystem::getSingletonPtr();
+
+        for (size_t i = 0;i < load->sounds.size();++i)
         {
-            SONETTO_THROW("Unknown sound set ID");
+            // Without workers, jobs would only run once someone waits for
+            // them, so they are decoded right away instead
+            if (jobSystem && jobSystem->getWorkerNum() > 0) {
+                jobSystem->submit(&AudioManager::decodeSound,
+                        &load->sounds[i],&load->pending);
+            } else {
+                decodeSound(&load->sounds[i]);
+            }
+        }
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::finishSoundSetLoad(SoundSetLoad *load)
+    {
+        std::string error;
+
+        // Helps decoding the sounds left, if any
+        if (load->pending.get() > 0)
+        {
+            JobSystem::getSingleton().wait(load->pending);
         }
 
-        const IDVector &soundSetSounds = soundSets[id - 1].getSounds();
-        for (size_t i = 0;i < soundSetSounds.size();++i)
+        // Uploads what _update() did not upload yet
+        try {
+            uploadSoundSet(load,(size_t)(-1));
+        } catch (...) {
+            discardSoundSetLoad(load);
+            throw;
+        }
+
+        for (size_t i = 0;i < load->sounds.size();++i)
         {
-            unloadSound(soundSetSounds[i]);
+            if (!load->sounds[i].error.empty())
+            {
+                error = load->sounds[i].error;
+                break;
+            }
+        }
+
+        // Reports how long the set took, and how much the cache saved
+        if (Ogre::LogManager::getSingletonPtr())
+        {
+            std::ostringstream message;
+            unsigned long savedTime = 0;
+            size_t cached = 0;
+
+            for (size_t i = 0;i < load->sounds.size();++i)
+            {
+                if (load->sounds[i].cached)
+                {
+                    savedTime += load->sounds[i].savedTime;
+                    ++cached;
+                }
+            }
+
+            if (load->id == 0) {
+                message << "Reloaded evicted sound " << load->sounds[0].id;
+            } else {
+                message << "Loaded sound set " << load->id;
+            }
+
+            message << " in " << load->timer.getMilliseconds() << " ms";
+            if (mSoundCache)
+            {
+                message << " (" << cached << " of " << load->sounds.size() <<
+                        " sounds from the sound cache, " << savedTime / 1000 <<
+                        " ms of decoding saved)";
+            }
+
+            Ogre::LogManager::getSingleton().logMessage(message.str());
+        }
+
+        discardSoundSetLoad(load);
+        trimSounds();
+
+        // The sounds that could be decoded stay loaded
+        if (!error.empty())
+        {
+            SONETTO_THROW(error);
         }
     }
     //-----------------------------------------------------------------------------
-    void AudioManager::_streamEnded()
+    size_t AudioManager::uploadSoundSet(SoundSetLoad *load,size_t bytes)
+    {
+        size_t uploadBytes = 0;
+
+        while (load->uploaded < load->sounds.size() && uploadBytes < bytes)
+        {
+            SoundDecode &sound = load->sounds[load->uploaded];
+
+            // Sounds that failed decoding are reported by
+            // finishSoundSetLoad()
+            if (sound.error.empty())
+            {
+                uploadSound(sound);
+                uploadBytes += sound.size;
+            }
+
+            ++load->uploaded;
+        }
+
+        return uploadBytes;
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::discardSoundSetLoad(SoundSetLoad *load)
+    {
+        for (size_t i = 0;i < load->sounds.size();++i)
+        {
+            releaseSound(load->sounds[i]);
+        }
+
+        delete load;
+    }
+    //-----------------------------------------------------------------------------
+    AudioManager::SoundSetLoad *AudioManager::takeSoundSetLoad(uint32 id)
+    {
+        // Sound reloads are not sound sets
+        if (id == 0)
+        {
+            return NULL;
+        }
+
+        for (size_t i = 0;i < mSoundSetLoads.size();++i)
+        {
+            if (mSoundSetLoads[i]->id == id)
+            {
+                SoundSetLoad *load = mSoundSetLoads[i];
+
+                mSoundSetLoads.erase(mSoundSetLoads.begin()+i);
+                return load;
+            }
+        }
+
+        return NULL;
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::finishSoundLoading(uint32 id)
+    {
+        for (size_t i = 0;i < mSoundSetLoads.size();++i)
+        {
+            const std::vector<SoundDecode> &sounds = mSoundSetLoads[i]->sounds;
+
+            for (size_t j = 0;j < sounds.size();++j)
+            {
+                if (sounds[j].id == id)
+                {
+                    SoundSetLoad *load = mSoundSetLoads[i];
+
+                    mSoundSetLoads.erase(mSoundSetLoads.begin()+i);
+                    finishSoundSetLoad(load);
+                    return;
+                }
+            }
+        }
+    }
+    //-----------------------------------------------------------------------------
+    ALuint AudioManager::_acquireSound(uint32 id)
+    {
+        SoundMap::iterator sound;
+
+        // Audio is stubbed out without a device; nothing is loaded, so
+        // there is no buffer to be held
+        if (!mInitialised)
+        {
+            return 0;
+        }
+
+        sound = mSounds.find(id);
+        if (sound == mSounds.end())
+        {
+            // Its sound set may still be loading for the first time
+            finishSoundLoading(id);
+
+            sound = mSounds.find(id);
+            if (sound == mSounds.end())
+            {
+                SONETTO_THROW("Trying to use a sound that is not loaded");
+            }
+        }
+
+        // Held first, so that it cannot be evicted again once reloaded
+        ++sound->second.sources;
+        sound->second.lastUse = ++mSoundUseClock;
+
+        // Evicted; decoding it here would stall this frame, so it is
+        // loaded again in the background, unless it is on its way already
+        if (sound->second.buffer == 0 && !isSoundLoading(id))
+        {
+            try {
+                beginSoundReload(id);
+            } catch (...) {
+                --sound->second.sources;
+                throw;
+            }
+        }
+
+        return sound->second.buffer;
+    }
+    //-----------------------------------------------------------------------------
+    ALuint AudioManager::_getSoundBuffer(uint32 id) const
+    {
+        SoundMap::const_iterator sound = mSounds.find(id);
+
+        if (sound == mSounds.end())
+        {
+            return 0;
+        }
+
+        return sound->second.buffer;
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::_releaseSound(uint32 id)
+    {
+        SoundMap::iterator sound = mSounds.find(id);
+
+        // Unloaded sounds are released by unloadSound() itself
+        if (sound != mSounds.end() && sound->second.sources > 0)
+        {
+            --sound->second.sources;
+            sound->second.lastUse = ++mSoundUseClock;
+        }
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::setSoundBudget(size_t bytes)
+    {
+        mSoundBudget = bytes;
+
+        // Audio is stubbed out without a device
+        if (mInitialised)
+        {
+            trimSounds();
+        }
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::trimSounds()
+    {
+        while (mSoundBudget > 0 && mSoundBytes > mSoundBudget)
+        {
+            SoundMap::iterator oldest = mSounds.end();
+
+            // Buffers attached to sound sources cannot be deleted
+            for (SoundMap::iterator i = mSounds.begin();i != mSounds.end();++i)
+            {
+                if (i->second.buffer != 0 && i->second.sources == 0 &&
+                        (oldest == mSounds.end() ||
+                        i->second.lastUse < oldest->second.lastUse))
+                {
+                    oldest = i;
+                }
+            }
+
+            if (oldest == mSounds.end())
+            {
+                break;
+            }
+
+            alDeleteBuffers(1,&oldest->second.buffer);
+            _alErrorCheck("AudioManager::trimSounds()","Failed deleting "
+                    "OpenAL audio buffers");
+            MemoryTracker::_recordDeallocation(MEMTAG_AUDIO,
+                    oldest->second.size);
+
+            mSoundBytes -= oldest->second.size;
+            oldest->second.buffer = 0;
+            mSoundEvictionsMetric->increment();
+        }
+
+        mSoundBytesMetric->set(mSoundBytes);
+    }
+    //-----------------------------------------------------------------------------
+    bool AudioManager::isSoundLoading(uint32 id) const
+    {
+        for (size_t i = 0;i < mSoundSetLoads.size();++i)
+        {
+            const std::vector<SoundDecode> &sounds = mSoundSetLoads[i]->sounds;
+
+            for (size_t j = 0;j < sounds.size();++j)
+            {
+                if (sounds[j].id == id)
+                {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+    //-----------------------------------------------------------------------------
+    void AudioManager::_streamEnded(bool continued)
     {
         if (mNextBGM != 0)
         {
-            mMusicStream->_play(mNextBGM,mNextBGMPos,mNextBGMFade,true);
+            if (!continued)
+            {
+                mMusicStream->_play(mNextBGM,mNextBGMPos,mNextBGMFade,true);
+            }
+
             mNextBGM = 0;
+            preloadNext();
         }
     }
     //-----------------------------------------------------------------------------
@@ -457,10 +1309,12 @@ namespace Sonetto
                         mNextBGMPos = mMusicStream->_getCurrentPos();
                         mMusicStream->_play(mNextME,0,0.0f,false);
                         mNextME = 0;
+                        preloadNext();
                     } else
                     if (mNextBGM != 0) {
                         mMusicStream->_play(mNextBGM,0,mNextBGMFade,true);
                         mNextBGM = 0;
+                        preloadNext();
                     }
                 }
             break;
@@ -469,8 +1323,29 @@ namespace Sonetto
         }
     }
     //-----------------------------------------------------------------------------
+    void AudioManager::preloadNext()
+    {
+        if (mNextME != 0) {
+            // Plays as soon as the current BGM fades out (MEs don't fade)
+            mMusicStream->_preload(mNextME,0,0.0f,false,false);
+        } else
+        if (mNextBGM != 0) {
+            // If an ME is playing, it goes on right after it without a gap
+            mMusicStream->_preload(mNextBGM,mNextBGMPos,mNextBGMFade,true,
+                    true);
+        } else {
+            mMusicStream->_preload(0,0,0.0f,false,false);
+        }
+    }
+    //-----------------------------------------------------------------------------
     void AudioManager::playSound(size_t id,float aMaxVolume,Ogre::Node *node)
     {
+        // Audio is stubbed out without a device
+        if (!mInitialised)
+        {
+            return;
+        }
+
         if (mSounds.find(id) == mSounds.end())
         {
             SONETTO_THROW("Trying to play a sound that is not loaded");
@@ -490,6 +1365,21 @@ namespace Sonetto
         }
     }
     //-----------------------------------------------------------------------------
+    size_t AudioManager::getActiveSoundSourceCount() const
+    {
+        size_t count = 0;
+
+        for (size_t i = 0;i < mSoundSources.size();++i)
+        {
+            if (mSoundSources[i]->getState() == SSS_PLAYING)
+            {
+                ++count;
+            }
+        }
+
+        return count;
+    }
+    //-----------------------------------------------------------------------------
     void AudioManager::_alErrorCheck(const char *location,const char *desc)
     {
         ALenum  alError  = alGetError();
@@ -518,6 +1408,35 @@ namespace Sonetto
         }
     }
     //-----------------------------------------------------------------------------
+    Ogre::DataStreamPtr AudioManager::_openFile(const std::string &name)
+    {
+        Ogre::ResourceGroupManager &groups =
+                Ogre::ResourceGroupManager::getSingleton();
+        PrefetchManager *prefetch = PrefetchManager::getSingletonPtr();
+        Ogre::StringVector groupNames = groups.getResourceGroups();
+
+        for (size_t i = 0;i < groupNames.size();++i)
+        {
+            if (groups.resourceExists(groupNames[i],name))
+            {
+                if (prefetch)
+                {
+                    prefetch->recordResource(name,groupNames[i]);
+                }
+
+                return groups.openResource(name,groupNames[i]);
+            }
+        }
+
+        // Not in any resource location; reads it from disk
+        if (prefetch)
+        {
+            prefetch->recordFile(name);
+        }
+
+        return Ogre::DataStreamPtr(new MappedDataStream(name));
+    }
+    //-----------------------------------------------------------------------------
     Ogre::Vector3 AudioManager::_getListenerPos()
     {
         Ogre::Vector3 pos;
@@ -29,6 +29,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "SonettoFont.h"
 #include "SonettoFontSerializer.h"
+#include "SonettoMemory.h"
+#include "SonettoPrefetchManager.h"
 
 namespace Sonetto
 {
@@ -40,6 +42,8 @@ namespace Sonetto
                 Ogre::Resource(creator, name, handle, group, isManual, loader)
     {
         mFontImage = NULL;
+        mFontImageData = NULL;
+        mFontImageSize = 0;
     }
     // ----------------------------------------------------------------------
     Font::~Font()
@@ -50,7 +54,14 @@ namespace Sonetto
     void Font::loadImpl()
     {
         FontSerializer serializer;
+        PrefetchManager *prefetch = PrefetchManager::getSingletonPtr();
         Ogre::DataStreamPtr stream = Ogre::ResourceGroupManager::getSingleton().openResource(mName, mGroup, true, this);
+
+        if (prefetch)
+        {
+            prefetch->recordResource(mName,mGroup);
+        }
+
         serializer.importFont(stream, this);
     }
     // ----------------------------------------------------------------------
@@ -59,11 +70,17 @@ namespace Sonetto
         mColorList.clear();
         mGlyph.clear();
         delete mFontImage;
+        mFontImage = NULL;
+
+        // The image does not own its pixel buffer
+        MemoryTracker::deallocate(MEMTAG_FONTS,mFontImageData,mFontImageSize);
+        mFontImageData = NULL;
+        mFontImageSize = 0;
     }
     // ----------------------------------------------------------------------
     size_t Font::calculateSize() const
     {
-        return 0;
+        return mFontImageSize;
     }
     // ----------------------------------------------------------------------
 } // namespace
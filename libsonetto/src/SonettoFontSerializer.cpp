@@ -29,6 +29,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "SonettoFontSerializer.h"
 #include "SonettoFont.h"
+#include "SonettoMemory.h"
 
 #include <OgreMaterialManager.h>
 #include <OgreTechnique.h>
@@ -272,11 +273,14 @@ namespace Sonetto
         "Target Image Size: "<<totalimagesize<<"\n"
         "Remaining File Size: "<<stream->size()<<"\n";
 
-        unsigned char * imgbuffer = new unsigned char [totalimagesize];
+        // The font keeps the buffer, so that it is accounted to MEMTAG_FONTS
+        unsigned char * imgbuffer = static_cast<unsigned char *>(MemoryTracker::allocate(MEMTAG_FONTS, totalimagesize));
+        pDest->mFontImageData = imgbuffer;
+        pDest->mFontImageSize = totalimagesize;
 
         stream->read(imgbuffer, totalimagesize);
 
-        pDest->mFontImage->loadDynamicImage(imgbuffer, txt_width, txt_height, txt_depth, (Ogre::PixelFormat)txt_pixelformat, true, txt_faces, txt_mipmaps);
+        pDest->mFontImage->loadDynamicImage(imgbuffer, txt_width, txt_height, txt_depth, (Ogre::PixelFormat)txt_pixelformat, false, txt_faces, txt_mipmaps);
 
         Ogre::TexturePtr texture = Ogre::TextureManager::getSingleton().loadImage(pDest->mIName+"_tex",pDest->getGroup(), *pDest->mFontImage, Ogre::TEX_TYPE_2D, 0);
 
@@ -0,0 +1,140 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#include <cstring>
+#include <algorithm>
+#include "SonettoFrameArena.h"
+#include "SonettoMemory.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Sonetto::FrameArena implementation
+    // ----------------------------------------------------------------------
+    FrameArena::FrameArena(size_t capacity)
+            : mBuffer(NULL), mBlock(NULL), mCapacity(0), mOverflowMutex(NULL),
+              mGeneration(0), mPeak(0)
+    {
+        mOverflowMutex = SDL_CreateMutex();
+        if (!mOverflowMutex)
+        {
+            SONETTO_THROW("Could not create frame arena mutex");
+        }
+
+        mCapacity = (capacity + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        mBuffer = allocateAligned(mCapacity,mBlock);
+    }
+    // ----------------------------------------------------------------------
+    FrameArena::~FrameArena()
+    {
+        reset();
+
+        freeAligned(mBlock,mCapacity);
+        SDL_DestroyMutex(mOverflowMutex);
+    }
+    // ----------------------------------------------------------------------
+    void *FrameArena::allocate(size_t bytes)
+    {
+        size_t end;
+        void *block;
+        char *ptr;
+
+        // Keeps every allocation aligned
+        bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        if (bytes == 0)
+        {
+            bytes = ALIGNMENT;
+        }
+
+        end = mOffset.add(bytes);
+        if (end <= mCapacity)
+        {
+            return mBuffer + end - bytes;
+        }
+
+        // The arena is full; the heap is used until the next reset
+        ptr = allocateAligned(bytes,block);
+
+        SDL_mutexP(mOverflowMutex);
+        mOverflow.push_back(std::make_pair(block,bytes));
+        SDL_mutexV(mOverflowMutex);
+
+        return ptr;
+    }
+    // ----------------------------------------------------------------------
+    void FrameArena::reset()
+    {
+        size_t used = mOffset.get();
+
+        if (used > mPeak)
+        {
+            mPeak = used;
+        }
+
+    #ifdef DEBUG
+        // Makes use of released memory easy to spot
+        memset(mBuffer,FRAME_ARENA_POISON,std::min(used,mCapacity));
+    #endif
+
+        // Releases heap blocks and grows the arena to fit this frame
+        if (!mOverflow.empty())
+        {
+            for (size_t i = 0;i < mOverflow.size();++i)
+            {
+                freeAligned(mOverflow[i].first,mOverflow[i].second);
+            }
+            mOverflow.clear();
+
+            freeAligned(mBlock,mCapacity);
+            mCapacity = ((used + used / 2) + ALIGNMENT - 1) &
+                    ~(ALIGNMENT - 1);
+            mBuffer = allocateAligned(mCapacity,mBlock);
+        }
+
+        mOffset.add(-(long)(used));
+        ++mGeneration;
+    }
+    // ----------------------------------------------------------------------
+    char *FrameArena::allocateAligned(size_t bytes,void *&block)
+    {
+        size_t address;
+
+        block = MemoryTracker::allocate(MEMTAG_GENERAL,bytes + ALIGNMENT - 1);
+        address = reinterpret_cast<size_t>(block);
+
+        return static_cast<char *>(block) +
+                (((address + ALIGNMENT - 1) & ~(ALIGNMENT - 1)) - address);
+    }
+    // ----------------------------------------------------------------------
+    void FrameArena::freeAligned(void *block,size_t bytes)
+    {
+        MemoryTracker::deallocate(MEMTAG_GENERAL,block,bytes + ALIGNMENT - 1);
+    }
+} // namespace
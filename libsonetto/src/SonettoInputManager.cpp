@@ -29,6 +29,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <algorithm>
 #include <vector>
+#include <cstdlib>
+#include <ctime>
 #include <OgreVector2.h>
 #include "SonettoKernel.h"
 #include "SonettoInputManager.h"
@@ -42,14 +44,60 @@ namespace Sonetto
     // ----------------------------------------------------------------------
     SONETTO_SINGLETON_IMPLEMENT(InputManager);
     // ----------------------------------------------------------------------
+    // Advances a key state given whether the key is down now
+    static KeyState advanceKeyState(KeyState state,bool rawState)
+    {
+        switch (state)
+        {
+            case KS_NONE:
+                if (rawState)
+                {
+                    return KS_PRESS;
+                }
+            break;
+
+            case KS_PRESS:
+                if (rawState) {
+                    return KS_HOLD;
+                } else {
+                    return KS_RELEASE;
+                }
+            break;
+
+            case KS_RELEASE:
+                if (rawState) {
+                    return KS_PRESS;
+                } else {
+                    return KS_NONE;
+                }
+            break;
+
+            case KS_HOLD:
+                if (!rawState)
+                {
+                    return KS_RELEASE;
+                }
+            break;
+        }
+
+        return state;
+    }
+    // ----------------------------------------------------------------------
     InputManager::InputManager(uint32 players)
-            : mPlayerNum(players), mInitialized(false)
+            : mPlayerNum(players), mInitialized(false), mUseDevices(true),
+              mRecordIdleTicks(0), mReplayPos(0), mReplayIdleTicks(0),
+              mReplaying(false), mReplayFinished(false)
     {
         memset(mKeyboardStates,0x00,sizeof(mKeyboardStates));
+        memset(mRawKeyboard,0x00,sizeof(mRawKeyboard));
+        memset(mFrameKeyStates,0x00,sizeof(mFrameKeyStates));
+        memset(mRecordKeyboard,0x00,sizeof(mRecordKeyboard));
     }
     // ----------------------------------------------------------------------
     InputManager::~InputManager()
     {
+        stopRecording();
+
         if (mInitialized)
         {
             // Deletes player inputs
@@ -64,7 +112,7 @@ namespace Sonetto
         }
     }
     // ----------------------------------------------------------------------
-    void InputManager::initialize()
+    void InputManager::initialize(bool useDevices)
     {
         if (mInitialized)
         {
@@ -73,9 +121,13 @@ namespace Sonetto
 
         mScriptInputHandler.registerOpcodes();
 
-        for (int i = 1;i <= SDL_NumJoysticks();++i)
+        mUseDevices = useDevices;
+        if (mUseDevices)
         {
-            mJoysticks.push_back(JoystickPtr(new Joystick(i)));
+            for (int i = 1;i <= SDL_NumJoysticks();++i)
+            {
+                mJoysticks.push_back(JoystickPtr(new Joystick(i)));
+            }
         }
 
         // Creates desired number of empty PlayerInput structures
@@ -90,53 +142,64 @@ namespace Sonetto
     // ----------------------------------------------------------------------
     void InputManager::update()
     {
-        // Updates keyboard states
-        for (size_t i = SDLK_FIRST;i <= SDLK_LAST;++i)
+        _pollDevices();
+        _updateStates();
+    }
+    // ----------------------------------------------------------------------
+    void InputManager::_pollDevices()
+    {
+        int numKeys;
+        uint8 *keys;
+
+        // Without devices, everything stays released; while replaying,
+        // raw states come from the recording instead
+        if (mUseDevices && !mReplaying)
         {
-            bool rawState = SDL_GetKeyState(NULL)[i];
+            keys = SDL_GetKeyState(&numKeys);
 
-            switch (mKeyboardStates[i])
+            // Takes a snapshot of the keyboard
+            if (numKeys > SDLK_LAST + 1)
             {
-                case KS_NONE:
-                    if (rawState)
-                    {
-                        mKeyboardStates[i] = KS_PRESS;
-                    }
-                break;
-
-                case KS_PRESS:
-                    if (rawState) {
-                        mKeyboardStates[i] = KS_HOLD;
-                    } else {
-                        mKeyboardStates[i] = KS_RELEASE;
-                    }
-                break;
-
-                case KS_RELEASE:
-                    if (rawState) {
-                        mKeyboardStates[i] = KS_PRESS;
-                    } else {
-                        mKeyboardStates[i] = KS_NONE;
-                    }
-                break;
-
-                case KS_HOLD:
-                    if (!rawState)
-                    {
-                        mKeyboardStates[i] = KS_RELEASE;
-                    }
-                break;
+                numKeys = SDLK_LAST + 1;
+            }
+            memcpy(mRawKeyboard,keys,numKeys);
+
+            SDL_JoystickUpdate();
+            for (size_t i = 0;i < mJoysticks.size();++i)
+            {
+                if (mJoysticks[i].unique()) {
+                    mJoysticks[i]->setEnabled(false);
+                } else {
+                    mJoysticks[i]->setEnabled(true);
+                }
+
+                // Takes a snapshot of the joystick
+                mJoysticks[i]->_update();
             }
         }
 
-        SDL_JoystickUpdate();
-        for (size_t i = 0;i < mJoysticks.size();++i)
+        // Updates per frame keyboard states
+        for (size_t i = SDLK_FIRST;i <= SDLK_LAST;++i)
         {
-            if (mJoysticks[i].unique()) {
-                mJoysticks[i]->setEnabled(false);
-            } else {
-                mJoysticks[i]->setEnabled(true);
-            }
+            mFrameKeyStates[i] = advanceKeyState(mFrameKeyStates[i],
+                    mRawKeyboard[i] != 0);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void InputManager::_updateStates()
+    {
+        // Feeds recorded raw states, or records the current ones
+        if (mReplaying) {
+            replayTick();
+        } else if (mRecordFile.is_open()) {
+            recordTick();
+        }
+
+        // Updates keyboard states
+        for (size_t i = SDLK_FIRST;i <= SDLK_LAST;++i)
+        {
+            mKeyboardStates[i] = advanceKeyState(mKeyboardStates[i],
+                    mRawKeyboard[i] != 0);
         }
 
         // And updates PlayerInputs' states
@@ -146,6 +209,342 @@ namespace Sonetto
         }
     }
     // ----------------------------------------------------------------------
+    // Recording header: uint32 magic, uint32 joystick count, uint32 seed
+    // Each record starts with a byte: if its high bit is set, the lower
+    // bits are a number of ticks without changes; otherwise, it holds
+    // RECORD_KEYBOARD and RECORD_JOYSTICKS flags telling what follows:
+    //   keyboard:  uint16 count, count x uint16 (key | pressed << 15)
+    //   joysticks: uint8 count, count x (uint8 index, uint32 buttons,
+    //              Joystick::RAW_AXIS_NUM x int16 axes)
+    static const uint32 RECORDING_MAGIC = MKFOURCC('S','I','R','1');
+    static const uint8 RECORD_IDLE = 0x80;
+    static const uint8 RECORD_KEYBOARD = 0x01;
+    static const uint8 RECORD_JOYSTICKS = 0x02;
+    static const size_t RECORD_MAX_IDLE_TICKS = 0x7F;
+    // ----------------------------------------------------------------------
+    void InputManager::startRecording(const std::string &fileName)
+    {
+        uint32 header[3];
+
+        if (mReplaying)
+        {
+            SONETTO_THROW("Cannot record input while replaying it");
+        }
+
+        stopRecording();
+
+        mRecordFile.open(fileName.c_str(),std::ios_base::out |
+                std::ios_base::binary | std::ios_base::trunc);
+        if (!mRecordFile.is_open())
+        {
+            SONETTO_THROW("Unable to open input recording file");
+        }
+
+        // Reseeds the pseudo-random number generator (see Math::random())
+        // with a seed the replay will reuse, so that the game takes the
+        // same random decisions again
+        header[0] = RECORDING_MAGIC;
+        header[1] = mJoysticks.size();
+        header[2] = (uint32)(time(NULL));
+        srand(header[2]);
+        mRecordFile.write((const char *)(header),sizeof(header));
+
+        // Everything starts released, so that the first tick records
+        // what is already pressed
+        memset(mRecordKeyboard,0x00,sizeof(mRecordKeyboard));
+        mRecordJoyButtons.assign(mJoysticks.size(),0);
+        mRecordJoyAxes.assign(mJoysticks.size() * Joystick::RAW_AXIS_NUM,0);
+        mRecordIdleTicks = 0;
+    }
+    // ----------------------------------------------------------------------
+    void InputManager::stopRecording()
+    {
+        if (mRecordFile.is_open())
+        {
+            flushIdleTicks();
+            mRecordFile.close();
+        }
+    }
+    // ----------------------------------------------------------------------
+    void InputManager::startReplay(const std::string &fileName)
+    {
+        std::ifstream file;
+        uint32 header[3];
+        std::streamsize size;
+
+        if (mRecordFile.is_open())
+        {
+            SONETTO_THROW("Cannot replay input while recording it");
+        }
+
+        file.open(fileName.c_str(),std::ios_base::in | std::ios_base::binary);
+        if (!file.is_open())
+        {
+            SONETTO_THROW("Unable to open input recording file");
+        }
+
+        // Reads the whole file, so that replaying does no I/O
+        file.seekg(0,std::ios_base::end);
+        size = file.tellg();
+        file.seekg(0,std::ios_base::beg);
+
+        if (size < (std::streamsize)(sizeof(header)))
+        {
+            SONETTO_THROW("Input recording file is truncated");
+        }
+
+        mReplayData.resize(size);
+        file.read((char *)(&mReplayData[0]),size);
+        if (!file.good())
+        {
+            SONETTO_THROW("Unable to read input recording file");
+        }
+
+        memcpy(header,&mReplayData[0],sizeof(header));
+        if (header[0] != RECORDING_MAGIC)
+        {
+            SONETTO_THROW("Invalid input recording file");
+        }
+
+        // Creates joysticks missing in this machine; they are never
+        // opened, only fed by the replay
+        while (mJoysticks.size() < header[1])
+        {
+            mJoysticks.push_back(JoystickPtr(
+                    new Joystick(mJoysticks.size() + 1)));
+        }
+
+        // Same random numbers as when recording
+        srand(header[2]);
+
+        // Everything starts released
+        memset(mRawKeyboard,0x00,sizeof(mRawKeyboard));
+        for (size_t i = 0;i < mJoysticks.size();++i)
+        {
+            int16 axes[Joystick::RAW_AXIS_NUM] = { 0 };
+            mJoysticks[i]->_setRawState(0,axes);
+        }
+
+        mReplayPos = sizeof(header);
+        mReplayIdleTicks = 0;
+        mReplaying = true;
+        mReplayFinished = false;
+    }
+    // ----------------------------------------------------------------------
+    void InputManager::stopReplay()
+    {
+        int16 axes[Joystick::RAW_AXIS_NUM] = { 0 };
+
+        if (!mReplaying)
+        {
+            return;
+        }
+
+        // Releases everything the replay left pressed
+        memset(mRawKeyboard,0x00,sizeof(mRawKeyboard));
+        for (size_t i = 0;i < mJoysticks.size();++i)
+        {
+            mJoysticks[i]->_setRawState(0,axes);
+        }
+
+        mReplayData.clear();
+        mReplaying = false;
+    }
+    // ----------------------------------------------------------------------
+    void InputManager::recordTick()
+    {
+        std::vector<uint16> keys;
+        std::vector<uint8> joysticks;
+        uint8 flags = 0;
+
+        // Collects changed keys
+        for (size_t i = SDLK_FIRST;i <= SDLK_LAST;++i)
+        {
+            if ((mRawKeyboard[i] != 0) != (mRecordKeyboard[i] != 0))
+            {
+                mRecordKeyboard[i] = (mRawKeyboard[i] != 0);
+                keys.push_back(i | (mRecordKeyboard[i] << 15));
+            }
+        }
+
+        // Collects changed joysticks (only those there were at start)
+        for (size_t i = 0;i < mRecordJoyButtons.size();++i)
+        {
+            bool changed = (mJoysticks[i]->_getRawButtons() !=
+                    mRecordJoyButtons[i]);
+
+            for (size_t j = 0;j < Joystick::RAW_AXIS_NUM;++j)
+            {
+                int16 axis = mJoysticks[i]->_getRawAxis(j);
+                int16 &recorded =
+                        mRecordJoyAxes[i * Joystick::RAW_AXIS_NUM + j];
+
+                if (axis != recorded)
+                {
+                    recorded = axis;
+                    changed = true;
+                }
+            }
+
+            if (changed)
+            {
+                mRecordJoyButtons[i] = mJoysticks[i]->_getRawButtons();
+                joysticks.push_back(i);
+            }
+        }
+
+        if (keys.empty() && joysticks.empty())
+        {
+            // Counts ticks without changes, writing them in runs
+            if (++mRecordIdleTicks == RECORD_MAX_IDLE_TICKS)
+            {
+                flushIdleTicks();
+            }
+            return;
+        }
+
+        flushIdleTicks();
+
+        flags |= keys.empty() ? 0 : RECORD_KEYBOARD;
+        flags |= joysticks.empty() ? 0 : RECORD_JOYSTICKS;
+        mRecordFile.write((const char *)(&flags),sizeof(flags));
+
+        if (!keys.empty())
+        {
+            uint16 count = keys.size();
+
+            mRecordFile.write((const char *)(&count),sizeof(count));
+            mRecordFile.write((const char *)(&keys[0]),
+                    keys.size() * sizeof(uint16));
+        }
+
+        if (!joysticks.empty())
+        {
+            uint8 count = joysticks.size();
+
+            mRecordFile.write((const char *)(&count),sizeof(count));
+            for (size_t i = 0;i < joysticks.size();++i)
+            {
+                uint8 index = joysticks[i];
+                const int16 *axes =
+                        &mRecordJoyAxes[index * Joystick::RAW_AXIS_NUM];
+
+                mRecordFile.write((const char *)(&index),sizeof(index));
+                mRecordFile.write((const char *)(&mRecordJoyButtons[index]),
+                        sizeof(uint32));
+                mRecordFile.write((const char *)(axes),
+                        Joystick::RAW_AXIS_NUM * sizeof(int16));
+            }
+        }
+    }
+    // ----------------------------------------------------------------------
+    void InputManager::flushIdleTicks()
+    {
+        if (mRecordIdleTicks > 0)
+        {
+            uint8 record = RECORD_IDLE | mRecordIdleTicks;
+
+            mRecordFile.write((const char *)(&record),sizeof(record));
+            mRecordIdleTicks = 0;
+        }
+    }
+    // ----------------------------------------------------------------------
+    void InputManager::replayTick()
+    {
+        const uint8 *data = &mReplayData[0];
+        size_t size = mReplayData.size();
+        uint8 flags;
+
+        // Nothing changes during a run of idle ticks
+        if (mReplayIdleTicks > 0)
+        {
+            --mReplayIdleTicks;
+            return;
+        }
+
+        if (mReplayPos >= size)
+        {
+            stopReplay();
+            mReplayFinished = true;
+            return;
+        }
+
+        flags = data[mReplayPos++];
+        if (flags & RECORD_IDLE)
+        {
+            // This tick is the first of the run
+            mReplayIdleTicks = (flags & ~RECORD_IDLE) - 1;
+            return;
+        }
+
+        if (flags & RECORD_KEYBOARD)
+        {
+            uint16 count;
+
+            if (mReplayPos + sizeof(count) > size)
+            {
+                SONETTO_THROW("Input recording file is truncated");
+            }
+            memcpy(&count,data + mReplayPos,sizeof(count));
+            mReplayPos += sizeof(count);
+
+            if (mReplayPos + count * sizeof(uint16) > size)
+            {
+                SONETTO_THROW("Input recording file is truncated");
+            }
+
+            for (size_t i = 0;i < count;++i)
+            {
+                uint16 key;
+
+                memcpy(&key,data + mReplayPos,sizeof(key));
+                mReplayPos += sizeof(key);
+
+                if ((key & 0x7FFF) > SDLK_LAST)
+                {
+                    SONETTO_THROW("Invalid input recording file");
+                }
+                mRawKeyboard[key & 0x7FFF] = (key >> 15);
+            }
+        }
+
+        if (flags & RECORD_JOYSTICKS)
+        {
+            const size_t entrySize = sizeof(uint8) + sizeof(uint32) +
+                    Joystick::RAW_AXIS_NUM * sizeof(int16);
+            uint8 count;
+
+            if (mReplayPos + sizeof(count) > size)
+            {
+                SONETTO_THROW("Input recording file is truncated");
+            }
+            count = data[mReplayPos++];
+
+            if (mReplayPos + count * entrySize > size)
+            {
+                SONETTO_THROW("Input recording file is truncated");
+            }
+
+            for (size_t i = 0;i < count;++i)
+            {
+                uint8 index = data[mReplayPos];
+                uint32 buttons;
+                int16 axes[Joystick::RAW_AXIS_NUM];
+
+                memcpy(&buttons,data + mReplayPos + 1,sizeof(buttons));
+                memcpy(axes,data + mReplayPos + 1 + sizeof(buttons),
+                        sizeof(axes));
+                mReplayPos += entrySize;
+
+                if (index >= mJoysticks.size())
+                {
+                    SONETTO_THROW("Invalid input recording file");
+                }
+                mJoysticks[index]->_setRawState(buttons,axes);
+            }
+        }
+    }
+    // ----------------------------------------------------------------------
     JoystickPtr InputManager::_getJoystick(uint32 id)
     {
         // Checks if a joystick with this ID exists and returns it
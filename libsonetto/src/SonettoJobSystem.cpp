@@ -0,0 +1,364 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifdef WINDOWS
+#   include <windows.h>
+#else
+#   include <unistd.h>
+#endif
+#include <OgreLogManager.h>
+#include "SonettoJobSystem.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Sonetto::JobCounter implementation
+    // ----------------------------------------------------------------------
+    JobCounter::JobCounter()
+            : mMutex(NULL), mCountZero(NULL)
+    {
+        mMutex = SDL_CreateMutex();
+        mCountZero = SDL_CreateCond();
+        if (!mMutex || !mCountZero)
+        {
+            if (mMutex)
+            {
+                SDL_DestroyMutex(mMutex);
+            }
+
+            if (mCountZero)
+            {
+                SDL_DestroyCond(mCountZero);
+            }
+
+            SONETTO_THROW("Could not create job counter");
+        }
+    }
+    // ----------------------------------------------------------------------
+    JobCounter::~JobCounter()
+    {
+        SDL_DestroyCond(mCountZero);
+        SDL_DestroyMutex(mMutex);
+    }
+    // ----------------------------------------------------------------------
+    void JobCounter::jobEnded(const char *error)
+    {
+        SDL_mutexP(mMutex);
+
+        if (error)
+        {
+            if (mFailed.increment() == 1)
+            {
+                mError = error;
+            }
+        }
+
+        // Decremented under the mutex, so that a waiter cannot miss the
+        // signal between checking the count and sleeping
+        if (mCount.decrement() == 0)
+        {
+            SDL_CondBroadcast(mCountZero);
+        }
+
+        SDL_mutexV(mMutex);
+    }
+    // ----------------------------------------------------------------------
+    // Sonetto::JobSystem implementation
+    // ----------------------------------------------------------------------
+    SONETTO_SINGLETON_IMPLEMENT(JobSystem);
+    // ----------------------------------------------------------------------
+    JobSystem::JobSystem(size_t workers)
+            : mPendingJobs(0), mPendingMutex(NULL), mJobsAvailable(NULL),
+              mQuit(false)
+    {
+        if (workers == 0)
+        {
+            workers = getHardwareThreadNum();
+            if (workers > 1)
+            {
+                --workers;
+            }
+        }
+
+        mPendingMutex = SDL_CreateMutex();
+        mJobsAvailable = SDL_CreateCond();
+        if (!mPendingMutex || !mJobsAvailable)
+        {
+            SONETTO_THROW("Could not create job system condition");
+        }
+
+        // One queue for each worker, plus a shared one
+        mQueues.resize(workers + 1);
+        for (size_t i = 0;i < mQueues.size();++i)
+        {
+            mQueues[i].mutex = SDL_CreateMutex();
+            if (!mQueues[i].mutex)
+            {
+                SONETTO_THROW("Could not create job queue mutex");
+            }
+        }
+
+        for (size_t i = 0;i < workers;++i)
+        {
+            Worker *worker = new Worker;
+
+            worker->jobSystem = this;
+            worker->queue = i + 1;
+            worker->threadID = 0;
+            mWorkers.push_back(worker);
+
+            worker->thread = SDL_CreateThread(workerThread,worker);
+            if (!worker->thread)
+            {
+                SONETTO_THROW("Could not create job system worker thread");
+            }
+        }
+    }
+    // ----------------------------------------------------------------------
+    JobSystem::~JobSystem()
+    {
+        // Wakes all workers up to let them quit
+        if (mPendingMutex && mJobsAvailable)
+        {
+            SDL_mutexP(mPendingMutex);
+            mQuit = true;
+            SDL_CondBroadcast(mJobsAvailable);
+            SDL_mutexV(mPendingMutex);
+        }
+
+        for (size_t i = 0;i < mWorkers.size();++i)
+        {
+            if (mWorkers[i]->thread)
+            {
+                SDL_WaitThread(mWorkers[i]->thread,NULL);
+            }
+
+            delete mWorkers[i];
+        }
+
+        for (size_t i = 0;i < mQueues.size();++i)
+        {
+            if (mQueues[i].mutex)
+            {
+                SDL_DestroyMutex(mQueues[i].mutex);
+            }
+        }
+
+        if (mJobsAvailable)
+        {
+            SDL_DestroyCond(mJobsAvailable);
+        }
+
+        if (mPendingMutex)
+        {
+            SDL_DestroyMutex(mPendingMutex);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void JobSystem::submit(JobFunction function,void *data,
+            JobCounter *counter)
+    {
+        JobQueue &queue = mQueues[getCurrentQueue()];
+        Job job;
+
+        job.function = function;
+        job.data = data;
+        job.counter = counter;
+
+        // Must be counted before it can possibly end
+        if (counter)
+        {
+            counter->mCount.increment();
+        }
+
+        SDL_mutexP(queue.mutex);
+        queue.jobs.push_back(job);
+        SDL_mutexV(queue.mutex);
+
+        SDL_mutexP(mPendingMutex);
+        ++mPendingJobs;
+        SDL_CondSignal(mJobsAvailable);
+        SDL_mutexV(mPendingMutex);
+    }
+    // ----------------------------------------------------------------------
+    void JobSystem::wait(JobCounter &counter)
+    {
+        size_t queue = getCurrentQueue();
+
+        while (counter.get() > 0)
+        {
+            // Helps instead of blocking
+            if (runPendingJob(queue))
+            {
+                continue;
+            }
+
+            // Nothing to do: the remaining jobs are running in other
+            // threads, so sleeps until they end
+            SDL_mutexP(counter.mMutex);
+            while (counter.get() > 0)
+            {
+                SDL_CondWait(counter.mCountZero,counter.mMutex);
+            }
+            SDL_mutexV(counter.mMutex);
+        }
+
+        // The thread that ended the last job may still be inside
+        // jobEnded(); once it unlocks the mutex, the counter can go away
+        SDL_mutexP(counter.mMutex);
+        SDL_mutexV(counter.mMutex);
+    }
+    // ----------------------------------------------------------------------
+    size_t JobSystem::getHardwareThreadNum()
+    {
+    #ifdef WINDOWS
+        SYSTEM_INFO info;
+
+        GetSystemInfo(&info);
+        return (info.dwNumberOfProcessors > 0) ? info.dwNumberOfProcessors : 1;
+    #else
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+        return (count > 0) ? count : 1;
+    #endif
+    }
+    // ----------------------------------------------------------------------
+    size_t JobSystem::getCurrentQueue() const
+    {
+        Uint32 threadID = SDL_ThreadID();
+
+        for (size_t i = 0;i < mWorkers.size();++i)
+        {
+            if (mWorkers[i]->threadID == threadID)
+            {
+                return mWorkers[i]->queue;
+            }
+        }
+
+        return 0;
+    }
+    // ----------------------------------------------------------------------
+    bool JobSystem::runPendingJob(size_t queue)
+    {
+        bool found = false,failed = false;
+        std::string error;
+        Job job;
+
+        // Takes the newest job from its own queue (most likely to be hot
+        // in cache)
+        SDL_mutexP(mQueues[queue].mutex);
+        if (!mQueues[queue].jobs.empty())
+        {
+            job = mQueues[queue].jobs.back();
+            mQueues[queue].jobs.pop_back();
+            found = true;
+        }
+        SDL_mutexV(mQueues[queue].mutex);
+
+        // Steals the oldest job from the other queues
+        for (size_t i = 1;!found && i < mQueues.size();++i)
+        {
+            JobQueue &victim = mQueues[(queue + i) % mQueues.size()];
+
+            SDL_mutexP(victim.mutex);
+            if (!victim.jobs.empty())
+            {
+                job = victim.jobs.front();
+                victim.jobs.pop_front();
+                found = true;
+            }
+            SDL_mutexV(victim.mutex);
+        }
+
+        if (!found)
+        {
+            return false;
+        }
+
+        SDL_mutexP(mPendingMutex);
+        --mPendingJobs;
+        SDL_mutexV(mPendingMutex);
+
+        // Exceptions cannot cross threads; they are logged and recorded
+        // in the job's counter, and the job is considered finished
+        try {
+            job.function(job.data);
+        } catch (std::exception &e) {
+            error = e.what();
+            failed = true;
+        } catch (...) {
+            error = "unknown exception";
+            failed = true;
+        }
+
+        if (failed && Ogre::LogManager::getSingletonPtr())
+        {
+            Ogre::LogManager::getSingleton().logMessage("Job failed: " +
+                    error);
+        }
+
+        if (job.counter)
+        {
+            job.counter->jobEnded(failed ? error.c_str() : NULL);
+        }
+
+        return true;
+    }
+    // ----------------------------------------------------------------------
+    int JobSystem::workerThread(void *data)
+    {
+        Worker *worker = static_cast<Worker *>(data);
+        JobSystem *jobSystem = worker->jobSystem;
+
+        worker->threadID = SDL_ThreadID();
+
+        while (true)
+        {
+            // Sleeps until something is submitted; jobs taken by other
+            // threads are not counted, so this does not wake up for them
+            SDL_mutexP(jobSystem->mPendingMutex);
+            while (jobSystem->mPendingJobs == 0 && !jobSystem->mQuit)
+            {
+                SDL_CondWait(jobSystem->mJobsAvailable,
+                        jobSystem->mPendingMutex);
+            }
+            SDL_mutexV(jobSystem->mPendingMutex);
+
+            if (jobSystem->mQuit)
+            {
+                break;
+            }
+
+            jobSystem->runPendingJob(worker->queue);
+        }
+
+        return 0;
+    }
+} // namespace
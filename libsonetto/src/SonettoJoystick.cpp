@@ -31,6 +31,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #   include <windows.h>
 #endif
 #include <iostream>
+#include <algorithm>
 #include "SonettoPrerequisites.h"
 #include "SonettoJoystick.h"
 
@@ -122,48 +123,17 @@ namespace Sonetto
     // ----------------------------------------------------------------------
     bool Joystick::getRawButtonState(RawButton button)
     {
-        if (!mJoy)
+        if (button == RWB_NONE)
         {
             return false;
         }
 
-        if (button < RWB_FIRST_HAT) {
-            return SDL_JoystickGetButton(mJoy,button - 1);
-        } else {
-            if (SDL_JoystickNumHats(mJoy) < 1)
-            {
-                return false;
-            }
-
-            uint8 hatone = SDL_JoystickGetHat(mJoy,0);
-            switch (button - RWB_FIRST_HAT)
-            {
-                case 0:
-                    return (hatone & SDL_HAT_UP);
-                break;
-
-                case 1:
-                    return (hatone & SDL_HAT_RIGHT);
-                break;
-
-                case 2:
-                    return (hatone & SDL_HAT_DOWN);
-                break;
-
-                case 3:
-                    return (hatone & SDL_HAT_LEFT);
-                break;
-
-                default:
-                    return false;
-                break;
-            }
-        }
+        return (mRawButtons & (1 << (button - 1))) != 0;
     }
     // ----------------------------------------------------------------------
     Ogre::Vector2 Joystick::getRawAnalogState(RawAnalog analog)
     {
-        if (!mJoy)
+        if (analog == RWA_NONE)
         {
             return Ogre::Vector2(0.0f,0.0f);
         }
@@ -171,13 +141,72 @@ namespace Sonetto
         Ogre::Vector2 state;
         uint8 baseid = (analog - 1) * 2;
 
-        state.x = SDL_JoystickGetAxis(mJoy,baseid);
-        state.y = SDL_JoystickGetAxis(mJoy,baseid + 1);
+        state.x = mRawAxes[baseid];
+        state.y = mRawAxes[baseid + 1];
 
         state.x /= ((state.x > 0) ? 32767.0f : 32768.0f);
         state.y /= ((state.y > 0) ? 32767.0f : 32768.0f);
 
         return state;
     }
+    // ----------------------------------------------------------------------
+    void Joystick::_update()
+    {
+        int num;
+
+        mRawButtons = 0;
+        memset(mRawAxes,0,sizeof(mRawAxes));
+
+        if (!mJoy)
+        {
+            return;
+        }
+
+        num = std::min(SDL_JoystickNumButtons(mJoy),RWB_FIRST_HAT - 1);
+        for (int i = 0;i < num;++i)
+        {
+            if (SDL_JoystickGetButton(mJoy,i))
+            {
+                mRawButtons |= 1 << i;
+            }
+        }
+
+        if (SDL_JoystickNumHats(mJoy) > 0)
+        {
+            uint8 hatone = SDL_JoystickGetHat(mJoy,0);
+
+            if (hatone & SDL_HAT_UP)
+            {
+                mRawButtons |= 1 << (RWB_HAT_UP - 1);
+            }
+
+            if (hatone & SDL_HAT_RIGHT)
+            {
+                mRawButtons |= 1 << (RWB_HAT_RIGHT - 1);
+            }
+
+            if (hatone & SDL_HAT_DOWN)
+            {
+                mRawButtons |= 1 << (RWB_HAT_DOWN - 1);
+            }
+
+            if (hatone & SDL_HAT_LEFT)
+            {
+                mRawButtons |= 1 << (RWB_HAT_LEFT - 1);
+            }
+        }
+
+        num = std::min(SDL_JoystickNumAxes(mJoy),(int)(RAW_AXIS_NUM));
+        for (int i = 0;i < num;++i)
+        {
+            mRawAxes[i] = SDL_JoystickGetAxis(mJoy,i);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void Joystick::_setRawState(uint32 buttons,const int16 *axes)
+    {
+        mRawButtons = buttons;
+        memcpy(mRawAxes,axes,sizeof(mRawAxes));
+    }
 } // namespace
 
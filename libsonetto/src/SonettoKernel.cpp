@@ -29,6 +29,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <cstdlib>
 #include <ctime>
+#include <cmath>
+#include <algorithm>
 #ifndef WINDOWS
 #   include <sys/stat.h>
 #   include <dirent.h>
@@ -39,6 +41,16 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "SonettoScriptManager.h"
 #include "SonettoStaticTextElement.h"
 #include "SonettoAudioManager.h"
+#include "SonettoJobSystem.h"
+#include "SonettoFrameArena.h"
+#include "SonettoPerformanceHUD.h"
+#include "SonettoMetrics.h"
+#include "SonettoPackArchive.h"
+#include "SonettoNullRenderSystem.h"
+#include "SonettoPrefetchManager.h"
+#include "SonettoModuleLoader.h"
+#include "SonettoMemory.h"
+#include "SonettoProfiler.h"
 
 namespace Sonetto
 {
@@ -54,8 +66,6 @@ namespace Sonetto
             SONETTO_THROW("Kernel was already initialized");
         }
 
-        SDL_Surface *loading = NULL;
-        SDL_Rect loadingSrc,loadingDest;
         Ogre::NameValuePairList wndParamList;
         SDL_SysWMinfo wmInfo;
         const char *defaultCfgName = "defaultcfg.dat";
@@ -66,6 +76,12 @@ namespace Sonetto
             SONETTO_THROW("Kernel is already initialized");
         }
 
+#ifdef SONETTO_PROFILING
+        // Starts collecting profiler markers
+        mProfiler = new Profiler();
+        mProfileDumpNum = 0;
+#endif
+
         // Seeds pseudo-random number generator
         srand(time(NULL));
 
@@ -75,8 +91,9 @@ namespace Sonetto
         // ------------------
         // SDL Initialisation
         // ------------------
-        // Initializes SDL video and joystick subsystems
-        if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_JOYSTICK) == -1)
+        // Initializes SDL video and joystick subsystems (none of them
+        // in headless mode)
+        if (SDL_Init(mHeadless ? 0 : SDL_INIT_VIDEO|SDL_INIT_JOYSTICK) == -1)
         {
             SONETTO_THROW("Could not initialize SDL");
         }
@@ -84,56 +101,12 @@ namespace Sonetto
         mAspectRatio = (float)(DEFAULT_SCREEN_WIDTH) /
                 (float)(DEFAULT_SCREEN_HEIGHT);
 
-        // Creates SDL rendering window with default resolutions
-        // (resized later to the desired resolution)
-        mWindow = SDL_SetVideoMode(DEFAULT_SCREEN_WIDTH,DEFAULT_SCREEN_HEIGHT,
-                DEFAULT_SCREEN_COLOR_DEPTH,0);
-
-        if (!mWindow)
-        {
-            SONETTO_THROW("Could not create SDL window");
-        }
-
-        // Disable cursor, Sonetto does not support mouse for now.
-        SDL_ShowCursor(SDL_DISABLE);
-        SDL_WM_SetCaption("Now Loading...","Now Loading...");
-
-        // Fills the screen with the background colour
-        // taken from the SPF file
-        SDL_FillRect(mWindow,NULL,SDL_MapRGB(mWindow->format,
-                mLoadingBGR,mLoadingBGG,mLoadingBGB));
-
-        if (mLoadingImg.size() > 0)
+        // Shows the loading screen (there is no window in headless mode)
+        if (!mHeadless)
         {
-            // Loads loading image and checks for errors
-            loading = SDL_LoadBMP(mLoadingImg.c_str());
-            if (!loading)
-            {
-                SONETTO_THROW("Unable to find " + mLoadingImg);
-            }
-
-            // Source rectangle: Full image
-            loadingSrc.x = loadingSrc.y = 0;
-            loadingSrc.w = loading->w;
-            loadingSrc.h = loading->h;
-
-            // Destination rectangle: Position took from SPF file
-            loadingDest.x = mLoadingImgLeft;
-            loadingDest.y = mLoadingImgTop;
-
-            // Blits loading image into screen buffer and flips it
-            SDL_BlitSurface(loading,&loadingSrc,mWindow,&loadingDest);
-            SDL_Flip(mWindow);
-
-            // Frees loaded loading image
-            //SDL_BlitSurface(loading,&loadingSrc,mWindow,&loadingDest);
-            //SDL_FreeSurface(loading);
+            showLoadingScreen(wmInfo);
         }
 
-        // Get window info to attach Ogre at it
-        SDL_VERSION(&wmInfo.version);
-        SDL_GetWMInfo(&wmInfo);
-
         #ifdef WINDOWS
         {
             // Get the User Application Data directory.
@@ -175,13 +148,13 @@ namespace Sonetto
             struct stat fstat; // Used to check file existence
 
             // Gets user home directory
-            mGameData = std::string("/home/") + getenv("PWD");
+            mGameData = getenv("HOME");
 
             // Appends Sonetto directory to the end of it
             mGameData += "/.sonetto/";
 
             // Verifies existence of directory
-            dir = opendir(mGameData.c_str(),0);
+            dir = opendir(mGameData.c_str());
             if (!dir) {
                 // If it does not exist, creates it
                 mkdir(mGameData.c_str(),S_IRWXU);
@@ -194,7 +167,7 @@ namespace Sonetto
             mGameDataPath = mGameData + mGameIdentifier + "/";
 
             // Verifies existence of directory
-            dir = opendir(mGameDataPath.c_str(),0);
+            dir = opendir(mGameDataPath.c_str());
             if (!dir) {
                 // If it does not exist, creates it
                 mkdir(mGameDataPath.c_str(),S_IRWXU);
@@ -207,8 +180,8 @@ namespace Sonetto
             std::string configfile = mGameDataPath + mGameIdentifier + ".INI";
             if (stat(configfile.c_str(),&fstat) < 0)
             {
-                ifstream src;
-                ofstream dest;
+                std::ifstream src;
+                std::ofstream dest;
 
                 // Opens default configuration file
                 src.open(defaultCfgName);
@@ -244,48 +217,104 @@ namespace Sonetto
         mOgre = new Ogre::Root("","","");
 #endif
 
-        // Flips loading screen (temporary)
-        SDL_Flip(mWindow);
+        // Lets resource locations be Sonetto packs (see PackArchive)
+        mPackArchiveFactory = new PackArchiveFactory();
+        Ogre::ArchiveManager::getSingleton().addArchiveFactory(
+                mPackArchiveFactory);
+
+        if (!mHeadless)
+        {
+            // Flips loading screen (temporary)
+            SDL_Flip(mWindow);
 
 #ifdef WINDOWS
-        wndParamList["externalWindowHandle"] =
-                Ogre::StringConverter::toString((uint32)wmInfo.window);
+            wndParamList["externalWindowHandle"] =
+                    Ogre::StringConverter::toString((uint32)wmInfo.window);
 #else
-        #error External window handle is not yet implemented on non Windows \
-               applications.
+            // GLX expects "display:screen:window"
+            wndParamList["parentWindowHandle"] =
+                    Ogre::StringConverter::toString(
+                    (unsigned long)wmInfo.info.x11.display) + ":" +
+                    Ogre::StringConverter::toString(
+                    DefaultScreen(wmInfo.info.x11.display)) + ":" +
+                    Ogre::StringConverter::toString(
+                    (unsigned long)wmInfo.info.x11.window);
 #endif
+        }
 
         // Load and configure Sonetto
         loadConfig(mGameDataPath+mGameIdentifier + ".INI",wndParamList);
 
-        SDL_Flip(mWindow);
+        // Creates the worker thread pool shared by the whole engine
+        mJobSystem = new JobSystem(mWorkerThreads);
 
-        // Initialize Ogre Root
-        mOgre->initialise(false);
+        // Creates the arena transient per frame allocations come from
+        mFrameArena = new FrameArena();
+
+        // Creates the metrics registry before the subsystems, which get
+        // their own metrics from it while being initialized
+        mMetrics = new MetricsRegistry();
+        registerMetrics();
+
+        if (mMetricsInterval > 0)
+        {
+            mMetrics->startExport(mGameDataPath + mMetricsFile,
+                    mMetricsInterval,mMetricsMaxFileSize);
+        }
+
+        // Prefetches files in the order a previous session read them, or
+        // records that order if it is not known yet
+        mPrefetchMan = new PrefetchManager();
+        if (mPrefetchEnabled)
+        {
+            std::string manifest = mGameDataPath + PREFETCH_MANIFEST_FILE;
+
+            if (!mPrefetchMan->loadManifest(manifest) || mPrefetchRecord)
+            {
+                mPrefetchMan->startRecording(manifest);
+            }
+        }
 
         // Get ogre managers and copy them to pointers for easy access.
         mOverlayMan  = Ogre::OverlayManager::getSingletonPtr();
 
-        // Flips loading screen (temporary)
-        SDL_Flip(mWindow);
-
+        // Other subsystems register opcodes into the script manager, so it
+        // exists before any of them starts (creating it is cheap)
         mScriptMan = new ScriptManager();
 
-        mAudioMan = new AudioManager();
-        mAudioMan->initialize();
+        // Brings up the subsystems; the audio device and the database are
+        // initialized in worker threads while the main thread initializes
+        // Ogre's render system
+        {
+            StartupTaskVector tasks;
+            size_t renderTask,fontTask;
+
+            // Runs first among main thread tasks (they are run in order)
+            renderTask = tasks.size();
+            tasks.push_back(StartupTask("Render system",
+                    &Kernel::startupRenderSystem,true));
 
-        // Initializes input manager
-        mInputMan = new InputManager(4);
-        mInputMan->initialize();
+            fontTask = tasks.size();
+            tasks.push_back(StartupTask("FontManager",
+                    &Kernel::startupFontManager,true));
 
-        mFontMan = new FontManager();
+            tasks.push_back(StartupTask("AudioManager",
+                    &Kernel::startupAudioManager,false));
 
-        mDatabase = new Database();
-        mDatabase->initialize();
+            // SDL 1.2 joystick enumeration is not thread safe
+            tasks.push_back(StartupTask("InputManager",
+                    &Kernel::startupInputManager,true));
 
-        // Initialize Objects/Elements;
-        StaticTextElementFactory * mTextElementFactory = new StaticTextElementFactory();
-        mOverlayMan->addOverlayElementFactory(mTextElementFactory);
+            tasks.push_back(StartupTask("Database",
+                    &Kernel::startupDatabase,false));
+
+            tasks.push_back(StartupTask("Overlay elements",
+                    &Kernel::startupOverlayElements,true));
+            tasks.back().dependencies.push_back(renderTask);
+            tasks.back().dependencies.push_back(fontTask);
+
+            runStartupTasks(tasks);
+        }
 
         int sdlscreenflags;
         if(mIsFullScreen) {
@@ -296,40 +325,61 @@ namespace Sonetto
 
         mAspectRatio = mScreenWidth / mScreenHeight;
 
-        // Resets video mode to loaded configurations
-        mWindow = SDL_SetVideoMode(mScreenWidth,mScreenHeight,
-                mScreenColorDepth,sdlscreenflags);
+        if (!mHeadless)
+        {
+            // Resets video mode to loaded configurations
+            mWindow = SDL_SetVideoMode(mScreenWidth,mScreenHeight,
+                    mScreenColorDepth,sdlscreenflags);
+        }
 
         // Create the Ogre Render Window
         mRenderWindow = mOgre->createRenderWindow("",mScreenWidth,
                 mScreenHeight,mIsFullScreen,&wndParamList);
 
-        // Resets caption to real game window caption
-        SDL_WM_SetCaption(mGameTitle.c_str(),mGameTitle.c_str());
+        if (!mHeadless)
+        {
+            // Resets caption to real game window caption
+            SDL_WM_SetCaption(mGameTitle.c_str(),mGameTitle.c_str());
+        }
 
         // Creates a Boot Module and activates it
         pushModule(Module::MT_BOOT,MA_CHANGE);
 
+        // Time since SDL was initialized
+        mMetrics->getGauge("startup_ms")->set(SDL_GetTicks());
+
         // Flags we have initialized
         mInitialized = true;
     }
     // ----------------------------------------------------------------------
     Kernel::~Kernel()
     {
+        // Makes sure the simulation thread is not running
+        stopSimulationThread();
+
         // Deinitialize if initialized
         if (mInitialized)
         {
+            // Drops any module still being loaded (it was never initialized)
+            delete mModuleLoader;
+            delete mPendingModule;
+
             // Deinitializes and deletes instantiated modules
             while (!mModuleStack.empty())
             {
-                Module *module = mModuleStack.top();
+                Module *module = mModuleStack.back();
 
                 // Deinitializes, deletes and removes from stack
                 module->deinitialize();
-                delete mModuleStack.top();
-                mModuleStack.pop();
+                delete module;
+                mModuleStack.pop_back();
             }
 
+            delete mPerformanceHUD;
+
+            // Stops prefetching and writes the recorded manifest
+            delete mPrefetchMan;
+
             // Deletes input manager
             delete mInputMan;
 
@@ -341,9 +391,27 @@ namespace Sonetto
             delete mFontMan;
             delete mScriptMan;
 
+            // Stops worker threads
+            delete mJobSystem;
+
+            delete mFrameArena;
+
+            // Writes a last metrics snapshot and stops exporting
+            delete mMetrics;
+
+#ifdef SONETTO_PROFILING
+            delete mProfiler;
+#endif
+
             // Deletes Ogre
             delete mOgre;
 
+            // Ogre does not own its archive factories
+            delete mPackArchiveFactory;
+
+            // Nor its plugins; this one was uninstalled by Ogre's destructor
+            delete mNullRenderPlugin;
+
             // Deinitialize SDL
             SDL_Quit();
         }
@@ -352,23 +420,46 @@ namespace Sonetto
     void Kernel::run()
     {
         bool running = true;
+        size_t frameNum = 0;
+
+        // Pipelined modules are simulated in their own thread
+        if (mPipelined)
+        {
+            startSimulationThread();
+        }
+
+        // Starts counting time from here, so that the first frame does not
+        // account for initialization time
+        mFrameTimer.reset();
 
         while (running)
         {
+            SONETTO_PROFILE("Kernel::run");
             SDL_Event evt;
+            unsigned long frameMicroseconds;
+
+            // Per frame allocation counts start over
+            MemoryTracker::_beginFrame();
+
+            // Releases last frame's transient memory
+            mFrameArena->reset();
 
-            // Pump events
-            while (SDL_PollEvent(&evt))
+            // Pump events (there are none in headless mode)
+            if (!mHeadless)
             {
-                if (evt.type == SDL_QUIT)
+                SONETTO_PROFILE("Kernel::run::events");
+                while (SDL_PollEvent(&evt))
                 {
-                    // Shutdowns the game when asked to
-                    mKernelAction = KA_SHUTDOWN;
+                    if (evt.type == SDL_QUIT)
+                    {
+                        // Shutdowns the game when asked to
+                        mKernelAction = KA_SHUTDOWN;
+                    }
                 }
             }
 
             // Stops game while window is deactivated (minimised)
-            if (!(SDL_GetAppState() & SDL_APPACTIVE))
+            if (!mHeadless && !(SDL_GetAppState() & SDL_APPACTIVE))
             {
                 // Loop until the window gets activated again
                 while (SDL_WaitEvent(&evt))
@@ -379,26 +470,97 @@ namespace Sonetto
                         break;
                     }
                 }
+
+                // Time spent minimised must not be simulated
+                mFrameTimer.reset();
+            }
+
+            // Measures real time elapsed since last frame
+            frameMicroseconds = mFrameTimer.getMicroseconds();
+            mFrameTimer.reset();
+            mFrameTime = frameMicroseconds / 1000000.0f;
+
+            // Keeps history for frame statistics
+            mFrameTimeHistory[mFrameTimeHistoryPos] = mFrameTime;
+            mFramesMetric->increment();
+            mFrameTimeMetric->observe(frameMicroseconds);
+
+            // In headless mode, the clock is deterministic: each frame
+            // advances the game by exactly one tick, however long it takes
+            if (mHeadless)
+            {
+                mFrameTime = mTickTime;
+            }
+            mFrameTimeHistoryPos = (mFrameTimeHistoryPos + 1) %
+                    FRAME_STATS_WINDOW;
+            if (mFrameTimeHistoryCount < FRAME_STATS_WINDOW)
+            {
+                ++mFrameTimeHistoryCount;
+            }
+
+            // Polls input devices; their states are updated once per tick
+            // by simulate(), but kernel hotkeys below use per frame states,
+            // so that they fire exactly once per press however many ticks
+            // (if any) this frame runs
+            {
+                SONETTO_PROFILE("InputManager::_pollDevices");
+                mInputMan->_pollDevices();
             }
 
-            if (mInputMan->getDirectKeyState(SDLK_LALT) == KS_HOLD &&
-                mInputMan->getDirectKeyState(SDLK_F4) == KS_PRESS)
+            if (mInputMan->getFrameKeyState(SDLK_LALT) == KS_HOLD &&
+                mInputMan->getFrameKeyState(SDLK_F4) == KS_PRESS)
             {
                 mKernelAction = KA_SHUTDOWN;
             }
 
-            if (mInputMan->getDirectKeyState(SDLK_LALT) == KS_HOLD &&
-                mInputMan->getDirectKeyState(SDLK_RETURN) == KS_PRESS)
+            if (mInputMan->getFrameKeyState(SDLK_LALT) == KS_HOLD &&
+                mInputMan->getFrameKeyState(SDLK_RETURN) == KS_PRESS)
             {
                 setFullScreen(!mIsFullScreen);
             }
 
+            // Shows or hides the performance HUD
+            if (mInputMan->getFrameKeyState(SDLK_F10) == KS_PRESS)
+            {
+                togglePerformanceHUD();
+            }
+
+            // Writes memory usage to the log
+            if (mInputMan->getFrameKeyState(SDLK_F11) == KS_PRESS)
+            {
+                MemoryTracker::logReport();
+            }
+
+#ifdef SONETTO_PROFILING
+            // Dumps profiler events
+            if (mInputMan->getFrameKeyState(SDLK_F12) == KS_PRESS)
+            {
+                dumpProfile();
+            }
+#endif
+
+            // Pushes the module being loaded in the background when ready
+            if (mModuleLoader)
+            {
+                updateModuleLoad();
+            }
+
             switch (mKernelAction)
             {
                 case KA_CHANGE_MODULE:
+                    // Module actions wait for the pending module to be pushed
+                    if (mModuleLoader)
+                    {
+                        break;
+                    }
+
                     if (mModuleAction == MA_RETURN) {
                         // Pops current module, returning to the previous one
                         popModule();
+                    } else if (mBackgroundLoad) {
+                        // Starts loading the desired module; the current one
+                        // keeps running until it is ready
+                        beginModuleLoad(mNextModuleType,mModuleAction);
                     } else {
                         // Pushes desired module with the desired action
                         // (if action is MA_CHANGE, pushModule() will remove
@@ -410,6 +572,7 @@ namespace Sonetto
                     mKernelAction   = KA_NONE;
                     mModuleAction   = MA_NONE;
                     mNextModuleType = Module::MT_NONE;
+                    mBackgroundLoad = false;
                 break;
 
                 case KA_SHUTDOWN:
@@ -420,11 +583,17 @@ namespace Sonetto
                 default: break;
             }
 
-            // <todo> Use deltatime
-            mAudioMan->_update(0.001f);
+            // Audio fades run in real time
+            {
+                SONETTO_PROFILE("AudioManager::_update");
+                mAudioMan->_update(mFrameTime);
+            }
 
-            // Updates input manager
-            mInputMan->update();
+            // Updates performance HUD text when due
+            if (mPerformanceHUD)
+            {
+                mPerformanceHUD->update(mFrameTime);
+            }
 
             // Checks whether the stack is empty
             if (mModuleStack.empty())
@@ -432,101 +601,642 @@ namespace Sonetto
                 SONETTO_THROW("The module stack is empty");
             }
 
-            // Updates active module
-            mModuleStack.top()->update();
+            // Runs as many fixed timestep ticks as needed to catch up with
+            // real time, discarding time that would need too many of them
+            mTickAccumulator += mFrameTime;
+            if (mTickAccumulator > mTickTime * MAX_TICKS_PER_FRAME)
+            {
+                mTickAccumulator = mTickTime * MAX_TICKS_PER_FRAME;
+            }
+
+            mSimTicks = 0;
+            while (mTickAccumulator >= mTickTime)
+            {
+                ++mSimTicks;
+                mTickAccumulator -= mTickTime;
+            }
+
+            if (mSimThread && mModuleStack.back()->isPipelined()) {
+                // Hand-off: the simulation thread is idle here, so the
+                // results of the last simulation can be published safely,
+                // along with the interpolation they were simulated for
+                mInterpolation = mSimInterpolation;
+                mSimInterpolation = mTickAccumulator / mTickTime;
+                mModuleStack.back()->syncRenderState();
+
+                // Simulates next frame while this one is rendered
+                SDL_SemPost(mSimStart);
+                try {
+                    SONETTO_PROFILE("Ogre::Root::renderOneFrame");
+                    mOgre->renderOneFrame();
+                } catch (...) {
+                    SDL_SemWait(mSimDone);
+                    throw;
+                }
+                SDL_SemWait(mSimDone);
+
+                // Rethrows errors from the simulation thread
+                if (!mSimError.empty())
+                {
+                    std::string error = mSimError;
+
+                    mSimError.clear();
+                    SONETTO_THROW("Simulation thread error: " + error);
+                }
+            } else {
+                // How far we are between the last tick and the next one
+                mInterpolation = mTickAccumulator / mTickTime;
+                mSimInterpolation = mInterpolation;
+
+                // Updates input states and the active module
+                simulate();
+                mModuleStack.back()->syncRenderState();
 
-            // Renders one frame
-            mOgre->renderOneFrame();
+                // Renders one frame
+                SONETTO_PROFILE("Ogre::Root::renderOneFrame");
+                mOgre->renderOneFrame();
+            }
+
+            // Script instructions run by this frame's ticks
+            {
+                unsigned long instructionCount =
+                        mScriptMan->getInstructionCount();
+
+                mScriptCostMetric->observe(instructionCount -
+                        mLastInstructionCount);
+                mLastInstructionCount = instructionCount;
+            }
+
+            if (mHeadless) {
+                // Stops after the requested number of frames, if any, or
+                // else when an input replay ends
+                ++frameNum;
+                if (mHeadlessFrames > 0) {
+                    if (frameNum >= mHeadlessFrames)
+                    {
+                        running = false;
+                    }
+                } else if (mInputMan->isReplayFinished()) {
+                    running = false;
+                }
+            } else {
+                // Waits for the rest of the frame budget, if any
+                limitFrameRate();
+            }
         }
+
+        stopSimulationThread();
+
+        // Writes memory usage on shutdown
+        MemoryTracker::logReport();
+
+#ifdef SONETTO_PROFILING
+        // Dumps what was left on shutdown
+        dumpProfile();
+#endif
     }
     // ----------------------------------------------------------------------
-    void Kernel::setAction(KernelAction kact,ModuleAction mact,
-            Module::ModuleType modtype)
+    void Kernel::simulate()
     {
-        switch (kact)
+        for (size_t i = 0;i < mSimTicks;++i)
         {
-            case KA_NONE:
-                // Makes sure parameters are valid
-                assert(mact == MA_NONE && modtype == Module::MT_NONE);
-
-                // Sets action parameters
-                mKernelAction   = KA_NONE;
-                mModuleAction   = MA_NONE;
-                mNextModuleType = Module::MT_NONE;
-            break;
-
-            case KA_CHANGE_MODULE:
-                // Makes sure parameters are valid
-                assert(mact != MA_NONE && modtype != Module::MT_NONE);
+            // Updates input states
+            {
+                SONETTO_PROFILE("InputManager::_updateStates");
+                mInputMan->_updateStates();
+            }
 
-                // Sets action parameters
-                mKernelAction   = KA_CHANGE_MODULE;
-                mModuleAction   = mact;
-                mNextModuleType = modtype;
-            break;
+            // Updates active module
+            SONETTO_PROFILE("Module::update");
+            mModuleStack.back()->update();
+        }
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::startSimulationThread()
+    {
+        if (mSimThread)
+        {
+            return;
+        }
 
-            case KA_SHUTDOWN:
-                // Makes sure parameters are valid
-                assert(mact == MA_NONE && modtype == Module::MT_NONE);
+        mSimQuit = false;
+        mSimStart = SDL_CreateSemaphore(0);
+        mSimDone = SDL_CreateSemaphore(0);
+        if (!mSimStart || !mSimDone)
+        {
+            SONETTO_THROW("Could not create simulation thread semaphores");
+        }
 
-                // Sets action parameters
-                mKernelAction   = KA_SHUTDOWN;
-                mModuleAction   = MA_NONE;
-                mNextModuleType = Module::MT_NONE;
-            break;
+        mSimThread = SDL_CreateThread(simulationThread,this);
+        if (!mSimThread)
+        {
+            SONETTO_THROW("Could not create simulation thread");
         }
     }
     // ----------------------------------------------------------------------
-    Ogre::RenderWindow * Kernel::getRenderWindow()
+    void Kernel::stopSimulationThread()
     {
-        return mRenderWindow;
+        if (mSimThread)
+        {
+            // Wakes the thread up only to let it quit
+            mSimQuit = true;
+            SDL_SemPost(mSimStart);
+            SDL_WaitThread(mSimThread,NULL);
+            mSimThread = NULL;
+        }
+
+        if (mSimStart)
+        {
+            SDL_DestroySemaphore(mSimStart);
+            mSimStart = NULL;
+        }
+
+        if (mSimDone)
+        {
+            SDL_DestroySemaphore(mSimDone);
+            mSimDone = NULL;
+        }
     }
     // ----------------------------------------------------------------------
-    void Kernel::loadConfig(const std::string &fname,
-            Ogre::NameValuePairList &wndParamList)
+    int Kernel::simulationThread(void *data)
     {
-        // Checks for config file existence
-        {
-            const std::string cannotLoadMsg = "Unable to load " + fname +
-                    ",\nthe file does not exist";
+        Kernel *kernel = static_cast<Kernel *>(data);
 
-        #ifdef WINDOWS
-            if((_access(fname.c_str(),0)) == -1)
+        while (true)
+        {
+            SDL_SemWait(kernel->mSimStart);
+            if (kernel->mSimQuit)
             {
-                SONETTO_THROW(cannotLoadMsg);
+                break;
             }
-        #else
-            struct stat fstat;
-            if (stat(fname.c_str(),&fstat) < 0)
-            {
-                SONETTO_THROW(cannotLoadMsg);
+
+            // Exceptions cannot cross threads; they are rethrown
+            // by the main thread after the hand-off
+            try {
+                kernel->simulate();
+            } catch (std::exception &e) {
+                kernel->mSimError = e.what();
+            } catch (...) {
+                kernel->mSimError = "Unknown error";
             }
-        #endif
+
+            SDL_SemPost(kernel->mSimDone);
         }
 
-        Ogre::ConfigFile        config;
-        Ogre::RenderSystemList *renderers;
+        return 0;
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::runStartupTasks(StartupTaskVector &tasks)
+    {
+        SONETTO_PROFILE("Kernel::runStartupTasks");
+        SDL_sem *doneSem = SDL_CreateSemaphore(0);
+        Uint32 startTicks = SDL_GetTicks();
+        size_t running = 0,finished = 0;
+        bool failed = false;
 
-        // Loads file into Ogre::ConfigFile
-        config.load(fname);
+        if (!doneSem)
+        {
+            SONETTO_THROW("Could not create startup semaphore");
+        }
 
-        // Video configuration section name
-        const char *videoSectName = "video";
+        for (size_t i = 0;i < tasks.size();++i)
+        {
+            tasks[i].kernel = this;
+            tasks[i].doneSem = doneSem;
+        }
 
-        // Loads the desired render system plugin
-        mOgre->loadPlugin(config.getSetting("renderSystem",
-                videoSectName));
+        while (finished < tasks.size())
+        {
+            StartupTask *mainTask = NULL;
 
-        // Gets list of loaded render systems and makes sure it's not empty
-        renderers = mOgre->getAvailableRenderers();
-        assert(!renderers->empty());
+            // Starts every task whose dependencies are done, unless a task
+            // has failed
+            for (size_t i = 0;i < tasks.size() && !failed;++i)
+            {
+                bool ready = !tasks[i].started;
 
-        // Sets the render system we've just loaded as active
-        mOgre->setRenderSystem(renderers->back());
+                for (size_t j = 0;ready &&
+                        j < tasks[i].dependencies.size();++j)
+                {
+                    ready = tasks[tasks[i].dependencies[j]].finished;
+                }
 
-        // Gets resolution config string
-        std::string resolution = config.getSetting("screenResolution",
-                videoSectName);
+                if (!ready)
+                {
+                    continue;
+                }
+
+                // Without worker threads, everything runs here
+                if (tasks[i].mainThread || mJobSystem->getWorkerNum() == 0) {
+                    if (!mainTask)
+                    {
+                        mainTask = &tasks[i];
+                    }
+                } else {
+                    tasks[i].started = true;
+                    ++running;
+                    mJobSystem->submit(&Kernel::runStartupTask,&tasks[i]);
+                }
+            }
+
+            // Runs one main thread task while the others run in workers
+            if (mainTask) {
+                mainTask->started = true;
+                ++running;
+                runStartupTask(mainTask);
+            } else if (running == 0) {
+                // Nothing else can be started
+                break;
+            }
+
+            // Collects finished tasks (waits for one if none finished yet)
+            SDL_SemWait(doneSem);
+            do
+            {
+                --running;
+                ++finished;
+            } while (SDL_SemTryWait(doneSem) == 0);
+
+            for (size_t i = 0;i < tasks.size();++i)
+            {
+                if (tasks[i].finished && !tasks[i].error.empty())
+                {
+                    failed = true;
+                }
+            }
+        }
+
+        SDL_DestroySemaphore(doneSem);
+
+        // Rethrows the first error
+        for (size_t i = 0;i < tasks.size();++i)
+        {
+            if (!tasks[i].error.empty())
+            {
+                SONETTO_THROW(std::string(tasks[i].name) + " startup "
+                        "failed: " + tasks[i].error);
+            }
+        }
+
+        if (finished < tasks.size())
+        {
+            SONETTO_THROW("Circular startup task dependencies");
+        }
+
+        // Writes startup timing report
+        Ogre::LogManager::getSingleton().logMessage("Sonetto startup "
+                "timing:");
+        for (size_t i = 0;i < tasks.size();++i)
+        {
+            Ogre::LogManager::getSingleton().logMessage("  " +
+                    Ogre::String(tasks[i].name) + ": " +
+                    Ogre::StringConverter::toString(tasks[i].endTicks -
+                    tasks[i].startTicks) + " ms (started at " +
+                    Ogre::StringConverter::toString(tasks[i].startTicks -
+                    startTicks) + " ms" + (tasks[i].mainThread ?
+                    ", main thread)" : ")"));
+        }
+        Ogre::LogManager::getSingleton().logMessage("  Total: " +
+                Ogre::StringConverter::toString(SDL_GetTicks() -
+                startTicks) + " ms");
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::runStartupTask(void *data)
+    {
+        StartupTask *task = static_cast<StartupTask *>(data);
+
+        task->startTicks = SDL_GetTicks();
+        try {
+            task->function(task->kernel);
+        } catch (std::exception &e) {
+            task->error = e.what();
+        } catch (...) {
+            task->error = "Unknown error";
+        }
+        task->endTicks = SDL_GetTicks();
+
+        task->finished = true;
+        SDL_SemPost(task->doneSem);
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::startupRenderSystem(Kernel *kernel)
+    {
+        SONETTO_PROFILE("Kernel::startupRenderSystem");
+
+        // There is no loading screen in headless mode
+        if (!kernel->mHeadless)
+        {
+            SDL_Flip(kernel->mWindow);
+        }
+
+        // Initialize Ogre Root
+        kernel->mOgre->initialise(false);
+
+        if (!kernel->mHeadless)
+        {
+            // Flips loading screen (temporary)
+            SDL_Flip(kernel->mWindow);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::startupFontManager(Kernel *kernel)
+    {
+        SONETTO_PROFILE("Kernel::startupFontManager");
+        kernel->mFontMan = new FontManager();
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::startupAudioManager(Kernel *kernel)
+    {
+        SONETTO_PROFILE("Kernel::startupAudioManager");
+
+        // Audio devices are stubbed out in headless mode
+        kernel->mAudioMan = new AudioManager();
+        kernel->mAudioMan->initialize(NULL,!kernel->mHeadless,
+                kernel->mMusicBufferSize,kernel->mMusicBuffers,
+                kernel->mSoundCacheEnabled ? kernel->mGameDataPath +
+                SOUND_CACHE_DIR : std::string(),kernel->mSoundCacheSize);
+        kernel->mAudioMan->setSoundBudget(kernel->mSoundBudget);
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::startupInputManager(Kernel *kernel)
+    {
+        SONETTO_PROFILE("Kernel::startupInputManager");
+
+        // Input devices are stubbed out in headless mode
+        kernel->mInputMan = new InputManager(4);
+        kernel->mInputMan->initialize(!kernel->mHeadless);
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::startupDatabase(Kernel *kernel)
+    {
+        SONETTO_PROFILE("Kernel::startupDatabase");
+        kernel->mDatabase = new Database();
+        kernel->mDatabase->initialize();
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::startupOverlayElements(Kernel *kernel)
+    {
+        SONETTO_PROFILE("Kernel::startupOverlayElements");
+
+        // Initialize Objects/Elements;
+        StaticTextElementFactory * mTextElementFactory = new StaticTextElementFactory();
+        kernel->mOverlayMan->addOverlayElementFactory(mTextElementFactory);
+    }
+    // ----------------------------------------------------------------------
+#ifdef SONETTO_PROFILING
+    void Kernel::dumpProfile()
+    {
+        std::string fileName = mGameDataPath + "profile" +
+                Ogre::StringConverter::toString(mProfileDumpNum++) + ".json";
+
+        if (mProfiler->dump(fileName)) {
+            Ogre::LogManager::getSingleton().logMessage(
+                    "Profiler events dumped to " + fileName);
+        } else {
+            Ogre::LogManager::getSingleton().logMessage(
+                    "Could not dump profiler events to " + fileName);
+        }
+    }
+    // ----------------------------------------------------------------------
+#endif
+    void Kernel::limitFrameRate()
+    {
+        unsigned long elapsed;
+
+        if (mTargetFrameMicroseconds == 0)
+        {
+            return;
+        }
+
+        // Sleeps while there is more than the spin margin left; rounds up so
+        // that a precise SDL_Delay() leaves us inside the margin
+        elapsed = mFrameTimer.getMicroseconds();
+        while (elapsed + FRAME_LIMITER_SPIN_MARGIN < mTargetFrameMicroseconds)
+        {
+            unsigned long sleepTime = mTargetFrameMicroseconds - elapsed -
+                    FRAME_LIMITER_SPIN_MARGIN;
+
+            SDL_Delay((sleepTime + 999) / 1000);
+            elapsed = mFrameTimer.getMicroseconds();
+        }
+
+        // Spins for the remaining time
+        while (mFrameTimer.getMicroseconds() < mTargetFrameMicroseconds);
+    }
+    // ----------------------------------------------------------------------
+    FrameStats Kernel::getFrameStats() const
+    {
+        FrameStats stats;
+        float sum = 0.0f,squareSum = 0.0f,variance;
+
+        stats.average = stats.minimum = stats.maximum = stats.jitter =
+                stats.percentile99 = 0.0f;
+        if (mFrameTimeHistoryCount == 0)
+        {
+            return stats;
+        }
+
+        stats.minimum = stats.maximum = mFrameTimeHistory[0];
+        for (size_t i = 0;i < mFrameTimeHistoryCount;++i)
+        {
+            float frameTime = mFrameTimeHistory[i];
+
+            sum += frameTime;
+            squareSum += frameTime * frameTime;
+
+            if (frameTime < stats.minimum)
+            {
+                stats.minimum = frameTime;
+            }
+
+            if (frameTime > stats.maximum)
+            {
+                stats.maximum = frameTime;
+            }
+        }
+
+        stats.average = sum / mFrameTimeHistoryCount;
+
+        // Rounding errors can make this slightly negative
+        variance = squareSum / mFrameTimeHistoryCount -
+                stats.average * stats.average;
+        stats.jitter = (variance > 0.0f) ? std::sqrt(variance) : 0.0f;
+
+        // Partially sorts a copy of the history (on the stack, so that
+        // this can be called every frame without allocating)
+        float sorted[FRAME_STATS_WINDOW];
+        size_t rank = (mFrameTimeHistoryCount * 99 + 99) / 100 - 1;
+
+        std::copy(mFrameTimeHistory.begin(),mFrameTimeHistory.begin() +
+                mFrameTimeHistoryCount,sorted);
+        std::nth_element(sorted,sorted + rank,sorted + mFrameTimeHistoryCount);
+        stats.percentile99 = sorted[rank];
+
+        return stats;
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::registerMetrics()
+    {
+        std::vector<long> bounds;
+        static const long frameTimeBounds[] = { 4000,8000,12000,16667,
+                20000,25000,33333,50000,66667,100000,250000 };
+        static const long scriptCostBounds[] = { 0,10,50,100,500,1000,
+                5000,10000,50000 };
+        static const long loadTimeBounds[] = { 10,50,100,250,500,1000,
+                2500,5000,10000,30000 };
+
+        mFramesMetric = mMetrics->getCounter("frames");
+
+        bounds.assign(frameTimeBounds,frameTimeBounds +
+                sizeof(frameTimeBounds) / sizeof(frameTimeBounds[0]));
+        mFrameTimeMetric = mMetrics->getHistogram("frame_time_us",bounds);
+
+        bounds.assign(scriptCostBounds,scriptCostBounds +
+                sizeof(scriptCostBounds) / sizeof(scriptCostBounds[0]));
+        mScriptCostMetric = mMetrics->getHistogram(
+                "script_instructions_per_frame",bounds);
+
+        bounds.assign(loadTimeBounds,loadTimeBounds +
+                sizeof(loadTimeBounds) / sizeof(loadTimeBounds[0]));
+        mModuleInitMetric = mMetrics->getHistogram("module_init_ms",bounds);
+        mModuleLoadMetric = mMetrics->getHistogram("module_load_ms",bounds);
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::togglePerformanceHUD()
+    {
+        if (!mPerformanceHUD)
+        {
+            // Nothing is rendered in headless mode
+            if (mHeadless)
+            {
+                return;
+            }
+
+            if (mHUDFont.empty())
+            {
+                Ogre::LogManager::getSingleton().logMessage(
+                        "Performance HUD disabled: no hudFont set in the "
+                        "[kernel] section of the configuration file");
+                return;
+            }
+
+            mPerformanceHUD = new PerformanceHUD(mHUDFont);
+        }
+
+        mPerformanceHUD->toggle();
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::setHeadless(bool headless,size_t frameCount)
+    {
+        if (mInitialized)
+        {
+            SONETTO_THROW("Headless mode must be set before initializing "
+                    "the Kernel");
+        }
+
+        mHeadless = headless;
+        mHeadlessFrames = frameCount;
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::setAction(KernelAction kact,ModuleAction mact,
+            Module::ModuleType modtype,bool background)
+    {
+        switch (kact)
+        {
+            case KA_NONE:
+                // Makes sure parameters are valid
+                assert(mact == MA_NONE && modtype == Module::MT_NONE);
+
+                // Sets action parameters
+                mKernelAction   = KA_NONE;
+                mModuleAction   = MA_NONE;
+                mNextModuleType = Module::MT_NONE;
+            break;
+
+            case KA_CHANGE_MODULE:
+                // Makes sure parameters are valid
+                assert(mact != MA_NONE && modtype != Module::MT_NONE);
+
+                // Sets action parameters
+                mKernelAction   = KA_CHANGE_MODULE;
+                mModuleAction   = mact;
+                mNextModuleType = modtype;
+                mBackgroundLoad = background;
+            break;
+
+            case KA_SHUTDOWN:
+                // Makes sure parameters are valid
+                assert(mact == MA_NONE && modtype == Module::MT_NONE);
+
+                // Sets action parameters
+                mKernelAction   = KA_SHUTDOWN;
+                mModuleAction   = MA_NONE;
+                mNextModuleType = Module::MT_NONE;
+            break;
+        }
+    }
+    // ----------------------------------------------------------------------
+    float Kernel::getModuleLoadProgress() const
+    {
+        return mModuleLoader ? mModuleLoader->getProgress() : 1.0f;
+    }
+    // ----------------------------------------------------------------------
+    Ogre::RenderWindow * Kernel::getRenderWindow()
+    {
+        return mRenderWindow;
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::loadConfig(const std::string &fname,
+            Ogre::NameValuePairList &wndParamList)
+    {
+        // Checks for config file existence
+        {
+            const std::string cannotLoadMsg = "Unable to load " + fname +
+                    ",\nthe file does not exist";
+
+        #ifdef WINDOWS
+            if((_access(fname.c_str(),0)) == -1)
+            {
+                SONETTO_THROW(cannotLoadMsg);
+            }
+        #else
+            struct stat fstat;
+            if (stat(fname.c_str(),&fstat) < 0)
+            {
+                SONETTO_THROW(cannotLoadMsg);
+            }
+        #endif
+        }
+
+        Ogre::ConfigFile        config;
+        Ogre::RenderSystemList *renderers;
+
+        // Loads file into Ogre::ConfigFile
+        config.load(fname);
+
+        // Video configuration section name
+        const char *videoSectName = "video";
+
+        if (!mHeadless) {
+            // Loads the desired render system plugin
+            mOgre->loadPlugin(config.getSetting("renderSystem",
+                    videoSectName));
+        } else {
+            // Headless mode renders nowhere, whatever the configuration says
+            mNullRenderPlugin = new NullRenderSystemPlugin();
+            mOgre->installPlugin(mNullRenderPlugin);
+        }
+
+        // Gets list of loaded render systems and makes sure it's not empty
+        renderers = mOgre->getAvailableRenderers();
+        assert(!renderers->empty());
+
+        // Sets the render system we've just loaded as active
+        mOgre->setRenderSystem(renderers->back());
+
+        // Gets resolution config string
+        std::string resolution = config.getSetting("screenResolution",
+                videoSectName);
 
         // Explodes resolution string on the "x" and validates it
         std::vector<Ogre::String> res = Ogre::StringUtil::split(resolution,"x",1);
@@ -571,30 +1281,139 @@ namespace Sonetto
                 getSetting("displayFrequency",videoSectName);
         wndParamList["colourDepth"] = colorDepthStr;
         wndParamList["FSAA"] = config.getSetting("FSAA",videoSectName);
+
+        // Gets frame limiter target (optional; zero means unlimited)
+        Ogre::String targetFPSStr = config.getSetting("targetFPS",
+                videoSectName);
+        if (!targetFPSStr.empty())
+        {
+            unsigned int targetFPS =
+                    Ogre::StringConverter::parseUnsignedInt(targetFPSStr);
+
+            mTargetFrameMicroseconds = (targetFPS > 0) ?
+                    1000000 / targetFPS : 0;
+        }
+
+        // Kernel configuration section name
+        const char *kernelSectName = "kernel";
+
+        // Gets simulation tick rate (optional)
+        Ogre::String tickRateStr = config.getSetting("tickRate",
+                kernelSectName);
+        if (!tickRateStr.empty())
+        {
+            unsigned int tickRate =
+                    Ogre::StringConverter::parseUnsignedInt(tickRateStr);
+
+            if (tickRate == 0)
+            {
+                SONETTO_THROW("Invalid tick rate set in configuration file");
+            }
+
+            mTickTime = 1.0f / tickRate;
+        }
+
+        // Gets number of job system worker threads (optional; zero means
+        // one for each hardware thread but the main one)
+        mWorkerThreads = Ogre::StringConverter::parseUnsignedInt(
+                config.getSetting("workerThreads",kernelSectName));
+
+        // Gets whether pipelined simulation is enabled (optional)
+        mPipelined = (config.getSetting("pipelined",kernelSectName) == "true");
+
+        // Gets memory budget for modules in the stack, in megabytes
+        // (optional; zero means no budget)
+        mMemoryBudget = Ogre::StringConverter::parseUnsignedInt(
+                config.getSetting("memoryBudget",kernelSectName)) *
+                1024 * 1024;
+
+        // Gets font used by the performance HUD (optional; the HUD is
+        // disabled without it)
+        mHUDFont = config.getSetting("hudFont",kernelSectName);
+
+        // Gets metrics export settings (optional; an interval of zero
+        // seconds means metrics are not exported)
+        mMetricsInterval = Ogre::StringConverter::parseUnsignedInt(
+                config.getSetting("metricsInterval",kernelSectName));
+
+        mMetricsFile = config.getSetting("metricsFile",kernelSectName);
+        if (mMetricsFile.empty())
+        {
+            mMetricsFile = DEFAULT_METRICS_FILE;
+        }
+
+        // In kilobytes; zero means the file is never rotated
+        Ogre::String metricsMaxSizeStr = config.getSetting("metricsMaxSize",
+                kernelSectName);
+        mMetricsMaxFileSize = (metricsMaxSizeStr.empty() ?
+                DEFAULT_METRICS_MAX_SIZE : Ogre::StringConverter::
+                parseUnsignedInt(metricsMaxSizeStr)) * 1024;
+
+        // Gets whether files are prefetched (optional; on by default), and
+        // whether their order is recorded again every session (optional)
+        mPrefetchEnabled = (config.getSetting("prefetch",kernelSectName) !=
+                "false");
+        mPrefetchRecord = (config.getSetting("prefetchRecord",
+                kernelSectName) == "true");
+
+        // Audio configuration section name
+        const char *audioSectName = "audio";
+
+        // Gets music stream buffer size, in kilobytes, and how many buffers
+        // it may queue at most (both optional; zero means the default)
+        mMusicBufferSize = Ogre::StringConverter::parseUnsignedInt(
+                config.getSetting("musicBufferSize",audioSectName)) * 1024;
+        mMusicBuffers = Ogre::StringConverter::parseUnsignedInt(
+                config.getSetting("musicBuffers",audioSectName));
+
+        // Gets whether decoded sounds are cached (optional; off by default),
+        // and the cache size limit, in megabytes (optional)
+        mSoundCacheEnabled = (config.getSetting("soundCache",audioSectName) ==
+                "true");
+
+        Ogre::String soundCacheSizeStr = config.getSetting("soundCacheSize",
+                audioSectName);
+        mSoundCacheSize = (soundCacheSizeStr.empty() ?
+                DEFAULT_SOUND_CACHE_SIZE : Ogre::StringConverter::
+                parseUnsignedInt(soundCacheSizeStr)) * 1024 * 1024;
+
+        // Gets how much memory loaded sounds may take, in megabytes
+        // (optional; zero or unset means no limit)
+        mSoundBudget = Ogre::StringConverter::parseUnsignedInt(
+                config.getSetting("soundBudget",audioSectName)) * 1024 * 1024;
     }
     // ----------------------------------------------------------------------
     void Kernel::pushModule(Module::ModuleType modtype,ModuleAction mact)
     {
-        Module *newmod,*curmod = NULL;
-
         // Makes sure parameters are valid
-        assert(modtype != Module::MT_NONE && mact != MA_NONE &&
-                mact != MA_RETURN);
+        assert(modtype != Module::MT_NONE);
+
+        // Brings the files it read last time into memory
+        mPrefetchMan->moduleChanged(modtype);
 
-        // Instantiates new module
-        newmod = mModuleFactory->createModule(modtype);
+        // Instantiates new module and pushes it
+        pushModule(mModuleFactory->createModule(modtype),mact);
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::pushModule(Module *newmod,ModuleAction mact)
+    {
+        SONETTO_PROFILE("Kernel::pushModule");
+        Module *curmod = NULL;
+
+        // Makes sure parameters are valid
+        assert(newmod && mact != MA_NONE && mact != MA_RETURN);
 
         // Gets current active module (if any)
         if (!mModuleStack.empty())
         {
-            curmod = mModuleStack.top();
+            curmod = mModuleStack.back();
 
             if (mact == MA_CHANGE) {
                 // Deinitializes, deletes and removes the
                 // current module from the stack
                 curmod->deinitialize();
                 delete curmod;
-                mModuleStack.pop();
+                mModuleStack.pop_back();
             } else {
                 // Halts current module
                 curmod->halt();
@@ -602,12 +1421,218 @@ namespace Sonetto
         }
 
         // Pushes new module into stack and initializes it
-        mModuleStack.push(newmod);
-        newmod->initialize();
+        mModuleStack.push_back(newmod);
+        {
+            Uint32 startTicks = SDL_GetTicks();
+
+            newmod->initialize();
+            mModuleInitMetric->observe(SDL_GetTicks() - startTicks);
+        }
+
+        // Makes room for the new module's resources
+        if (mMemoryBudget > 0)
+        {
+            enforceMemoryBudget();
+        }
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::beginModuleLoad(Module::ModuleType modtype,
+            ModuleAction mact)
+    {
+        SONETTO_PROFILE("Kernel::beginModuleLoad");
+        ModulePreloadList list;
+
+        // Makes sure parameters are valid
+        assert(modtype != Module::MT_NONE && mact != MA_NONE &&
+                mact != MA_RETURN);
+        assert(!mModuleLoader && !mPendingModule);
+
+        // Starts bringing the files it read last time into memory
+        mPrefetchMan->moduleChanged(modtype);
+
+        // Instantiates new module, but leaves it out of the stack
+        mPendingModule = mModuleFactory->createModule(modtype);
+        mPendingAction = mact;
+
+        // Starts loading what it needs; Ogre's background queue is not
+        // running in headless mode, so it is loaded synchronously there
+        mPendingModule->getPreloadList(list);
+        mModuleLoader = new ModuleLoader(list,!mHeadless);
+        mModuleLoadStart = SDL_GetTicks();
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::updateModuleLoad()
+    {
+        SONETTO_PROFILE("Kernel::updateModuleLoad");
+        Module *newmod;
+
+        if (!mModuleLoader->update())
+        {
+            return;
+        }
+
+        // Loading is complete; the loader is not needed anymore
+        delete mModuleLoader;
+        mModuleLoader = NULL;
+        mModuleLoadMetric->observe(SDL_GetTicks() - mModuleLoadStart);
+
+        // Pushes the loaded module into the stack
+        newmod = mPendingModule;
+        mPendingModule = NULL;
+        pushModule(newmod,mPendingAction);
+        mPendingAction = MA_NONE;
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::enforceMemoryBudget()
+    {
+        SONETTO_PROFILE("Kernel::enforceMemoryBudget");
+        std::vector<std::string> groups;
+        size_t total = 0;
+
+        // Memory modules hold outside their evictable groups is counted per
+        // module; groups are counted once for the whole stack, since
+        // modules may share them (evicted groups hardly count, since only
+        // loaded resources do)
+        for (size_t i = 0;i < mModuleStack.size();++i)
+        {
+            std::vector<std::string> moduleGroups;
+            size_t usage,groupUsage;
+
+            mModuleStack[i]->getEvictableResourceGroups(moduleGroups);
+            usage = mModuleStack[i]->getMemoryUsage();
+            groupUsage = Module::getResourceGroupsMemoryUsage(moduleGroups);
+            if (usage > groupUsage)
+            {
+                total += usage - groupUsage;
+            }
+
+            for (size_t j = 0;j < moduleGroups.size();++j)
+            {
+                if (std::find(groups.begin(),groups.end(),moduleGroups[j]) ==
+                        groups.end())
+                {
+                    groups.push_back(moduleGroups[j]);
+                }
+            }
+        }
+        total += Module::getResourceGroupsMemoryUsage(groups);
+
+        // Evicts halted modules, oldest first (the active one is last),
+        // counting only what each eviction really unloaded
+        for (size_t i = 0;i + 1 < mModuleStack.size() &&
+                total > mMemoryBudget;++i)
+        {
+            if (!mModuleStack[i]->isEvicted())
+            {
+                size_t freed = evictModule(i);
+
+                total -= std::min(freed,total);
+            }
+        }
+
+        if (total > mMemoryBudget)
+        {
+            Ogre::LogManager::getSingleton().logMessage(
+                    "Module memory budget exceeded by the active module (" +
+                    Ogre::StringConverter::toString(total) + " bytes)");
+        }
+    }
+    // ----------------------------------------------------------------------
+    size_t Kernel::evictModule(size_t index)
+    {
+        Ogre::ResourceGroupManager &groupMan =
+                Ogre::ResourceGroupManager::getSingleton();
+        std::vector<std::string> groups,keep,unload;
+        Module *module = mModuleStack[index];
+        size_t freed;
+
+        // Lets the module destroy its own entities first, or else they
+        // would keep its groups loaded
+        module->evict();
+
+        // Groups also used by resident modules must stay loaded, and so
+        // must groups live entities point into
+        for (size_t i = 0;i < mModuleStack.size();++i)
+        {
+            if (i != index && !mModuleStack[i]->isEvicted())
+            {
+                mModuleStack[i]->getEvictableResourceGroups(keep);
+            }
+        }
+        getReferencedResourceGroups(keep);
+
+        module->getEvictableResourceGroups(groups);
+        for (size_t i = 0;i < groups.size();++i)
+        {
+            if (std::find(keep.begin(),keep.end(),groups[i]) == keep.end() &&
+                    std::find(unload.begin(),unload.end(),groups[i]) ==
+                    unload.end())
+            {
+                unload.push_back(groups[i]);
+            }
+        }
+
+        // Measured before unloading, since unloaded resources count nothing
+        freed = Module::getResourceGroupsMemoryUsage(unload);
+        for (size_t i = 0;i < unload.size();++i)
+        {
+            groupMan.unloadResourceGroup(unload[i]);
+        }
+
+        module->_setEvicted(true);
+        return freed;
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::getReferencedResourceGroups(std::vector<std::string> &groups)
+    {
+        Ogre::SceneManagerEnumerator::SceneManagerIterator sceneManIter =
+                Ogre::Root::getSingleton().getSceneManagerIterator();
+
+        while (sceneManIter.hasMoreElements())
+        {
+            Ogre::SceneManager::MovableObjectIterator entityIter =
+                    sceneManIter.getNext()->getMovableObjectIterator(
+                    Ogre::EntityFactory::FACTORY_TYPE_NAME);
+
+            while (entityIter.hasMoreElements())
+            {
+                Ogre::Entity *entity =
+                        static_cast<Ogre::Entity *>(entityIter.getNext());
+                const Ogre::MeshPtr &mesh = entity->getMesh();
+
+                if (mesh.isNull())
+                {
+                    continue;
+                }
+
+                groups.push_back(mesh->getGroup());
+                if (mesh->hasSkeleton() && !mesh->getSkeleton().isNull())
+                {
+                    groups.push_back(mesh->getSkeleton()->getGroup());
+                }
+            }
+        }
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::restoreModule(Module *module)
+    {
+        SONETTO_PROFILE("Kernel::restoreModule");
+        std::vector<std::string> groups;
+
+        module->getEvictableResourceGroups(groups);
+        for (size_t i = 0;i < groups.size();++i)
+        {
+            Ogre::ResourceGroupManager::getSingleton().
+                    loadResourceGroup(groups[i]);
+        }
+
+        module->restore();
+        module->_setEvicted(false);
     }
     // ----------------------------------------------------------------------
     void Kernel::popModule()
     {
+        SONETTO_PROFILE("Kernel::popModule");
         Module *module;
 
         // Makes sure this won't leave the stack empty
@@ -617,12 +1642,80 @@ namespace Sonetto
         }
 
         // Gets current active module, deinitializes and deletes it
-        module = mModuleStack.top();
+        module = mModuleStack.back();
         module->deinitialize();
         delete module;
+        mModuleStack.pop_back();
 
-        // Gets new top module and resume its execution
-        mModuleStack.top()->resume();
+        // Gets new top module, restores it if evicted and resume its execution
+        module = mModuleStack.back();
+        if (module->isEvicted())
+        {
+            restoreModule(module);
+        }
+        module->resume();
+
+        // The restored module may push others over the budget
+        if (mMemoryBudget > 0)
+        {
+            enforceMemoryBudget();
+        }
+    }
+    // ----------------------------------------------------------------------
+    void Kernel::showLoadingScreen(SDL_SysWMinfo &wmInfo)
+    {
+        SDL_Surface *loading = NULL;
+        SDL_Rect loadingSrc,loadingDest;
+
+        // Creates SDL rendering window with default resolutions
+        // (resized later to the desired resolution)
+        mWindow = SDL_SetVideoMode(DEFAULT_SCREEN_WIDTH,DEFAULT_SCREEN_HEIGHT,
+                DEFAULT_SCREEN_COLOR_DEPTH,0);
+
+        if (!mWindow)
+        {
+            SONETTO_THROW("Could not create SDL window");
+        }
+
+        // Disable cursor, Sonetto does not support mouse for now.
+        SDL_ShowCursor(SDL_DISABLE);
+        SDL_WM_SetCaption("Now Loading...","Now Loading...");
+
+        // Fills the screen with the background colour
+        // taken from the SPF file
+        SDL_FillRect(mWindow,NULL,SDL_MapRGB(mWindow->format,
+                mLoadingBGR,mLoadingBGG,mLoadingBGB));
+
+        if (mLoadingImg.size() > 0)
+        {
+            // Loads loading image and checks for errors
+            loading = SDL_LoadBMP(mLoadingImg.c_str());
+            if (!loading)
+            {
+                SONETTO_THROW("Unable to find " + mLoadingImg);
+            }
+
+            // Source rectangle: Full image
+            loadingSrc.x = loadingSrc.y = 0;
+            loadingSrc.w = loading->w;
+            loadingSrc.h = loading->h;
+
+            // Destination rectangle: Position took from SPF file
+            loadingDest.x = mLoadingImgLeft;
+            loadingDest.y = mLoadingImgTop;
+
+            // Blits loading image into screen buffer and flips it
+            SDL_BlitSurface(loading,&loadingSrc,mWindow,&loadingDest);
+            SDL_Flip(mWindow);
+
+            // Frees loaded loading image
+            //SDL_BlitSurface(loading,&loadingSrc,mWindow,&loadingDest);
+            //SDL_FreeSurface(loading);
+        }
+
+        // Get window info to attach Ogre at it
+        SDL_VERSION(&wmInfo.version);
+        SDL_GetWMInfo(&wmInfo);
     }
     // ----------------------------------------------------------------------
     void Kernel::readSPF()
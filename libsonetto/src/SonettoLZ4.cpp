@@ -0,0 +1,290 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#include <cstring>
+#include <vector>
+#include "SonettoLZ4.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // LZ4 block format constants
+    // ----------------------------------------------------------------------
+    /// Shortest match
+    static const size_t LZ4_MIN_MATCH = 4;
+
+    /// Longest match offset
+    static const size_t LZ4_MAX_OFFSET = 65535;
+
+    /// The last match must start at least this far from the end
+    static const size_t LZ4_MF_LIMIT = 12;
+
+    /// The last bytes are always literals
+    static const size_t LZ4_LAST_LITERALS = 5;
+
+    /// Bits of the compressor's hash table index
+    static const size_t LZ4_HASH_BITS = 12;
+    // ----------------------------------------------------------------------
+    /// Reads 4 bytes, whatever their alignment
+    static inline uint32 lz4Read32(const uint8 *p)
+    {
+        uint32 value;
+
+        memcpy(&value,p,sizeof(value));
+        return value;
+    }
+    // ----------------------------------------------------------------------
+    /// Hashes 4 bytes into a compressor hash table index
+    static inline uint32 lz4Hash(uint32 sequence)
+    {
+        return (sequence * 2654435761U) >> (32 - LZ4_HASH_BITS);
+    }
+    // ----------------------------------------------------------------------
+    /// Writes a length's extra bytes (after the 15 stored in the token)
+    static inline uint8 *lz4WriteLength(uint8 *op,size_t length)
+    {
+        while (length >= 255)
+        {
+            *op++ = 255;
+            length -= 255;
+        }
+        *op++ = (uint8)(length);
+
+        return op;
+    }
+    // ----------------------------------------------------------------------
+    /** Writes a sequence (literals followed by a match)
+
+        If `matchLength' is zero, only literals are written (last sequence).
+        Returns NULL if it does not fit before `oend'.
+    */
+    static uint8 *lz4WriteSequence(uint8 *op,uint8 *oend,
+            const uint8 *literals,size_t literalLength,size_t offset,
+            size_t matchLength)
+    {
+        uint8 *token = op++;
+        size_t needed = literalLength + literalLength / 255 + 1 +
+                ((matchLength > 0) ? 2 + matchLength / 255 + 1 : 0);
+
+        if ((size_t)(oend - token) < needed + 1)
+        {
+            return NULL;
+        }
+
+        if (literalLength >= 15) {
+            *token = 15 << 4;
+            op = lz4WriteLength(op,literalLength - 15);
+        } else {
+            *token = (uint8)(literalLength << 4);
+        }
+
+        memcpy(op,literals,literalLength);
+        op += literalLength;
+
+        if (matchLength > 0)
+        {
+            size_t length = matchLength - LZ4_MIN_MATCH;
+
+            *op++ = (uint8)(offset & 0xFF);
+            *op++ = (uint8)(offset >> 8);
+
+            if (length >= 15) {
+                *token |= 15;
+                op = lz4WriteLength(op,length - 15);
+            } else {
+                *token |= (uint8)(length);
+            }
+        }
+
+        return op;
+    }
+    // ----------------------------------------------------------------------
+    size_t lz4Compress(const char *src,size_t srcSize,char *dst,
+            size_t dstCapacity)
+    {
+        const uint8 *base = reinterpret_cast<const uint8 *>(src);
+        const uint8 *ip = base,*anchor = base;
+        const uint8 *iend = base + srcSize;
+        uint8 *op = reinterpret_cast<uint8 *>(dst);
+        uint8 *oend = op + dstCapacity;
+
+        // Too short to hold a match
+        if (srcSize > LZ4_MF_LIMIT)
+        {
+            const uint8 *mfLimit = iend - LZ4_MF_LIMIT;
+            const uint8 *matchLimit = iend - LZ4_LAST_LITERALS;
+
+            // Positions (plus one) of the last sequences seen by hash
+            std::vector<uint32> table(1 << LZ4_HASH_BITS,0);
+
+            while (ip < mfLimit)
+            {
+                uint32 sequence = lz4Read32(ip);
+                uint32 &entry = table[lz4Hash(sequence)];
+                const uint8 *match = base + entry - 1;
+                bool found = (entry != 0 &&
+                        (size_t)(ip - match) <= LZ4_MAX_OFFSET &&
+                        lz4Read32(match) == sequence);
+
+                entry = (uint32)(ip - base) + 1;
+                if (!found)
+                {
+                    ++ip;
+                    continue;
+                }
+
+                // Extends the match as far as allowed
+                size_t matchLength = LZ4_MIN_MATCH;
+                while (ip + matchLength < matchLimit &&
+                        ip[matchLength] == match[matchLength])
+                {
+                    ++matchLength;
+                }
+
+                op = lz4WriteSequence(op,oend,anchor,ip - anchor,ip - match,
+                        matchLength);
+                if (!op)
+                {
+                    return 0;
+                }
+
+                ip += matchLength;
+                anchor = ip;
+            }
+        }
+
+        // Last literals
+        op = lz4WriteSequence(op,oend,anchor,iend - anchor,0,0);
+        if (!op)
+        {
+            return 0;
+        }
+
+        return op - reinterpret_cast<uint8 *>(dst);
+    }
+    // ----------------------------------------------------------------------
+    bool lz4Decompress(const char *src,size_t srcSize,char *dst,
+            size_t dstSize)
+    {
+        const uint8 *ip = reinterpret_cast<const uint8 *>(src);
+        const uint8 *iend = ip + srcSize;
+        uint8 *op = reinterpret_cast<uint8 *>(dst);
+        uint8 *ostart = op;
+        uint8 *oend = op + dstSize;
+
+        while (ip < iend)
+        {
+            size_t token = *ip++;
+            size_t length = token >> 4;
+            size_t offset;
+            const uint8 *match;
+
+            // Literals
+            if (length == 15)
+            {
+                size_t extra;
+
+                do {
+                    if (ip == iend)
+                    {
+                        return false;
+                    }
+
+                    extra = *ip++;
+                    length += extra;
+                } while (extra == 255);
+            }
+
+            if ((size_t)(iend - ip) < length || (size_t)(oend - op) < length)
+            {
+                return false;
+            }
+
+            memcpy(op,ip,length);
+            ip += length;
+            op += length;
+
+            // The last sequence has no match
+            if (ip == iend)
+            {
+                break;
+            }
+
+            // Match
+            if (iend - ip < 2)
+            {
+                return false;
+            }
+
+            offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > (size_t)(op - ostart))
+            {
+                return false;
+            }
+
+            length = token & 15;
+            if (length == 15)
+            {
+                size_t extra;
+
+                do {
+                    if (ip == iend)
+                    {
+                        return false;
+                    }
+
+                    extra = *ip++;
+                    length += extra;
+                } while (extra == 255);
+            }
+            length += LZ4_MIN_MATCH;
+
+            if ((size_t)(oend - op) < length)
+            {
+                return false;
+            }
+
+            // Matches may overlap what they produce
+            match = op - offset;
+            if (offset >= length) {
+                memcpy(op,match,length);
+                op += length;
+            } else {
+                while (length-- > 0)
+                {
+                    *op++ = *match++;
+                }
+            }
+        }
+
+        return op == oend;
+    }
+} // namespace
@@ -35,4 +35,48 @@ namespace Sonetto
     // Sonetto::MapModule implementation
     // ----------------------------------------------------------------------
     MapModule::_MapData MapModule::MapData;
+    // ----------------------------------------------------------------------
+    void MapModule::initialize()
+    {
+        Module::initialize();
+        createScene();
+    }
+    // ----------------------------------------------------------------------
+    void MapModule::getPreloadList(ModulePreloadList &list) const
+    {
+        if (!mResourceGroup.empty())
+        {
+            list.resourceGroups.push_back(mResourceGroup);
+        }
+
+        for (size_t i = 0;i < mScripts.size();++i)
+        {
+            list.resources.push_back(ModulePreloadList::Resource(
+                    "SonettoScript",mScripts[i],mScriptGroup));
+        }
+
+        list.soundSets.insert(list.soundSets.end(),mSoundSets.begin(),
+                mSoundSets.end());
+    }
+    // ----------------------------------------------------------------------
+    void MapModule::getEvictableResourceGroups(
+            std::vector<std::string> &groups) const
+    {
+        if (!mResourceGroup.empty())
+        {
+            groups.push_back(mResourceGroup);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void MapModule::evict()
+    {
+        // Entities point into meshes in mResourceGroup (the camera is kept)
+        mSceneMan->clearScene();
+    }
+    // ----------------------------------------------------------------------
+    void MapModule::restore()
+    {
+        createScene();
+    }
+    // ----------------------------------------------------------------------
 } // namespace
@@ -0,0 +1,81 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cstring>
+#include "SonettoMappedDataStream.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Sonetto::MappedDataStream implementation
+    // ----------------------------------------------------------------------
+    MappedDataStream::MappedDataStream(const Ogre::String &fileName)
+            : Ogre::DataStream(fileName), mPos(0)
+    {
+        mFile.open(fileName);
+        mSize = mFile.getSize();
+    }
+    // ----------------------------------------------------------------------
+    size_t MappedDataStream::read(void *buf,size_t count)
+    {
+        if (mPos >= mSize)
+        {
+            return 0;
+        }
+
+        count = std::min(count,mSize - mPos);
+        memcpy(buf,mFile.getData() + mPos,count);
+        mPos += count;
+
+        return count;
+    }
+    // ----------------------------------------------------------------------
+    void MappedDataStream::skip(long count)
+    {
+        if (count < 0 && (size_t)(-count) > mPos) {
+            mPos = 0;
+        } else {
+            seek(mPos + count);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void MappedDataStream::seek(size_t pos)
+    {
+        mPos = std::min(pos,mSize);
+    }
+    // ----------------------------------------------------------------------
+    void MappedDataStream::close()
+    {
+        mFile.close();
+        mSize = 0;
+        mPos = 0;
+    }
+} // namespace
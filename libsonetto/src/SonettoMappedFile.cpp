@@ -0,0 +1,171 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifdef WINDOWS
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+#include "SonettoMappedFile.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Sonetto::MappedFile implementation
+    // ----------------------------------------------------------------------
+    MappedFile::MappedFile()
+            : mOpen(false), mData(NULL), mSize(0),
+    #ifdef WINDOWS
+              mFileHandle(INVALID_HANDLE_VALUE), mMappingHandle(NULL)
+    #else
+              mFileDescriptor(-1)
+    #endif
+    {}
+    // ----------------------------------------------------------------------
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+    // ----------------------------------------------------------------------
+    void MappedFile::open(const std::string &fileName)
+    {
+        close();
+        mFileName = fileName;
+
+    #ifdef WINDOWS
+        LARGE_INTEGER size;
+
+        mFileHandle = CreateFileA(fileName.c_str(),GENERIC_READ,
+                FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+        if (mFileHandle == INVALID_HANDLE_VALUE)
+        {
+            SONETTO_THROW("Could not open " + fileName);
+        }
+
+        if (!GetFileSizeEx(mFileHandle,&size))
+        {
+            close();
+            SONETTO_THROW("Could not get the size of " + fileName);
+        }
+        mSize = (size_t)(size.QuadPart);
+
+        // Windows cannot map empty files
+        if (mSize > 0)
+        {
+            mMappingHandle = CreateFileMappingA(mFileHandle,NULL,
+                    PAGE_READONLY,0,0,NULL);
+            if (!mMappingHandle)
+            {
+                close();
+                SONETTO_THROW("Could not map " + fileName);
+            }
+
+            mData = static_cast<const char *>(MapViewOfFile(mMappingHandle,
+                    FILE_MAP_READ,0,0,0));
+            if (!mData)
+            {
+                close();
+                SONETTO_THROW("Could not map " + fileName);
+            }
+        }
+    #else
+        struct stat info;
+
+        mFileDescriptor = ::open(fileName.c_str(),O_RDONLY);
+        if (mFileDescriptor == -1)
+        {
+            SONETTO_THROW("Could not open " + fileName);
+        }
+
+        if (fstat(mFileDescriptor,&info) != 0)
+        {
+            close();
+            SONETTO_THROW("Could not get the size of " + fileName);
+        }
+        mSize = (size_t)(info.st_size);
+
+        // Empty files cannot be mapped
+        if (mSize > 0)
+        {
+            void *data = mmap(NULL,mSize,PROT_READ,MAP_SHARED,
+                    mFileDescriptor,0);
+
+            if (data == MAP_FAILED)
+            {
+                close();
+                SONETTO_THROW("Could not map " + fileName);
+            }
+            mData = static_cast<const char *>(data);
+        }
+    #endif
+
+        mOpen = true;
+    }
+    // ----------------------------------------------------------------------
+    void MappedFile::close()
+    {
+    #ifdef WINDOWS
+        if (mData)
+        {
+            UnmapViewOfFile(mData);
+        }
+
+        if (mMappingHandle)
+        {
+            CloseHandle(mMappingHandle);
+            mMappingHandle = NULL;
+        }
+
+        if (mFileHandle != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(mFileHandle);
+            mFileHandle = INVALID_HANDLE_VALUE;
+        }
+    #else
+        if (mData)
+        {
+            munmap(const_cast<char *>(mData),mSize);
+        }
+
+        if (mFileDescriptor != -1)
+        {
+            ::close(mFileDescriptor);
+            mFileDescriptor = -1;
+        }
+    #endif
+
+        mData = NULL;
+        mSize = 0;
+        mOpen = false;
+    }
+} // namespace
@@ -65,4 +65,18 @@ namespace Sonetto
         uint32 max = (RAND_MAX << 4) | RAND_MAX;
         return from + ( ((float)val / (float)max) * (to - from) );
     }
+    //--------------------------------------------------------------------------
+    uint32 Math::hash(const void *data,size_t len,uint32 basis)
+    {
+        const uint8 *bytes = static_cast<const uint8 *>(data);
+        uint32 hash = basis; // FNV offset basis, unless continuing
+
+        for (size_t i = 0;i < len;++i)
+        {
+            hash ^= bytes[i];
+            hash  = (hash * 16777619UL) & 0xFFFFFFFFUL; // FNV prime
+        }
+
+        return hash;
+    }
 }
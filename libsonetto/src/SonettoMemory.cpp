@@ -0,0 +1,177 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#include <cstdlib>
+#include <OgreLogManager.h>
+#include <OgreStringConverter.h>
+#include "SonettoMemory.h"
+#include "SonettoAtomic.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Counters of a MemoryTag
+    struct MemoryTagCounters
+    {
+        AtomicCounter bytes;
+        AtomicCounter peakBytes;
+        AtomicCounter allocations;
+        AtomicCounter totalAllocations;
+        AtomicCounter frameAllocations;
+        volatile long lastFrameAllocations;
+    };
+    // ----------------------------------------------------------------------
+    static MemoryTagCounters sCounters[MEMTAG_COUNT];
+    // ----------------------------------------------------------------------
+    static const char *const sTagNames[MEMTAG_COUNT] =
+    {
+        "General",
+        "Scripts",
+        "Audio",
+        "Fonts",
+        "Database",
+        "Variables",
+        "Modules"
+    };
+    // ----------------------------------------------------------------------
+    // Sonetto::MemoryTracker implementation
+    // ----------------------------------------------------------------------
+    void *MemoryTracker::allocate(MemoryTag tag,size_t bytes)
+    {
+        void *ptr = malloc(bytes > 0 ? bytes : 1);
+
+        if (!ptr)
+        {
+            throw std::bad_alloc();
+        }
+
+        _recordAllocation(tag,bytes);
+        return ptr;
+    }
+    // ----------------------------------------------------------------------
+    void MemoryTracker::deallocate(MemoryTag tag,void *ptr,size_t bytes)
+    {
+        if (ptr)
+        {
+            free(ptr);
+            _recordDeallocation(tag,bytes);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void MemoryTracker::_recordAllocation(MemoryTag tag,size_t bytes)
+    {
+        MemoryTagCounters &counters = sCounters[tag];
+        long current = counters.bytes.add(bytes);
+
+        counters.allocations.increment();
+        counters.totalAllocations.increment();
+        counters.frameAllocations.increment();
+
+        // Raises the peak, unless another thread raised it higher
+        for (;;)
+        {
+            long peak = counters.peakBytes.get();
+
+            if (current <= peak ||
+                    counters.peakBytes.compareAndSwap(peak,current))
+            {
+                break;
+            }
+        }
+    }
+    // ----------------------------------------------------------------------
+    void MemoryTracker::_recordDeallocation(MemoryTag tag,size_t bytes)
+    {
+        MemoryTagCounters &counters = sCounters[tag];
+
+        counters.bytes.add(-(long)(bytes));
+        counters.allocations.decrement();
+    }
+    // ----------------------------------------------------------------------
+    void MemoryTracker::_beginFrame()
+    {
+        for (size_t i = 0;i < MEMTAG_COUNT;++i)
+        {
+            MemoryTagCounters &counters = sCounters[i];
+            long frameAllocations = counters.frameAllocations.get();
+
+            // Only subtracts what was read, so that allocations made in
+            // other threads meanwhile count for the next frame
+            counters.frameAllocations.add(-frameAllocations);
+            counters.lastFrameAllocations = frameAllocations;
+        }
+    }
+    // ----------------------------------------------------------------------
+    MemoryTagStats MemoryTracker::getStats(MemoryTag tag)
+    {
+        const MemoryTagCounters &counters = sCounters[tag];
+        MemoryTagStats stats;
+
+        stats.bytes = counters.bytes.get();
+        stats.peakBytes = counters.peakBytes.get();
+        stats.allocations = counters.allocations.get();
+        stats.totalAllocations = counters.totalAllocations.get();
+        stats.frameAllocations = counters.lastFrameAllocations;
+
+        return stats;
+    }
+    // ----------------------------------------------------------------------
+    const char *MemoryTracker::getTagName(MemoryTag tag)
+    {
+        return sTagNames[tag];
+    }
+    // ----------------------------------------------------------------------
+    void MemoryTracker::logReport()
+    {
+        Ogre::LogManager &logMan = Ogre::LogManager::getSingleton();
+        size_t totalBytes = 0;
+
+        logMan.logMessage("Sonetto memory usage:");
+        for (size_t i = 0;i < MEMTAG_COUNT;++i)
+        {
+            MemoryTagStats stats = getStats((MemoryTag)(i));
+
+            logMan.logMessage("  " + Ogre::String(sTagNames[i]) + ": " +
+                    Ogre::StringConverter::toString(stats.bytes) +
+                    " bytes (peak " +
+                    Ogre::StringConverter::toString(stats.peakBytes) +
+                    "), " +
+                    Ogre::StringConverter::toString(stats.allocations) +
+                    " allocations (" +
+                    Ogre::StringConverter::toString(stats.totalAllocations) +
+                    " total, " +
+                    Ogre::StringConverter::toString(stats.frameAllocations) +
+                    " last frame)");
+            totalBytes += stats.bytes;
+        }
+        logMan.logMessage("  Total: " +
+                Ogre::StringConverter::toString(totalBytes) + " bytes");
+    }
+} // namespace
@@ -35,4 +35,30 @@ namespace Sonetto
     // Sonetto::MenuModule implementation
     // ----------------------------------------------------------------------
     MenuModule::_MenuData MenuModule::MenuData;
+    // ----------------------------------------------------------------------
+    void MenuModule::getPreloadList(ModulePreloadList &list) const
+    {
+        if (!mResourceGroup.empty())
+        {
+            list.resourceGroups.push_back(mResourceGroup);
+        }
+
+        // Fonts are usually shared by every menu and kept in a group of
+        // their own
+        for (size_t i = 0;i < mFonts.size();++i)
+        {
+            list.resources.push_back(ModulePreloadList::Resource(
+                    "SFont",mFonts[i],mFontGroup));
+        }
+
+        for (size_t i = 0;i < mScripts.size();++i)
+        {
+            list.resources.push_back(ModulePreloadList::Resource(
+                    "SonettoScript",mScripts[i],mScriptGroup));
+        }
+
+        list.soundSets.insert(list.soundSets.end(),mSoundSets.begin(),
+                mSoundSets.end());
+    }
+    // ----------------------------------------------------------------------
 } // namespace
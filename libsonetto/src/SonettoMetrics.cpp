@@ -0,0 +1,327 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifdef WINDOWS
+#   include <windows.h>
+#else
+#   include <sys/resource.h>
+#endif
+#include <cstdio>
+#include <sstream>
+#include <SDL/SDL_timer.h>
+#include <OgreLogManager.h>
+#include "SonettoMetrics.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Sonetto::MetricHistogram implementation
+    // ----------------------------------------------------------------------
+    MetricHistogram::MetricHistogram(const std::vector<long> &bounds)
+            : mBounds(bounds)
+    {
+        mBuckets = new AtomicCounter[mBounds.size() + 1];
+    }
+    // ----------------------------------------------------------------------
+    MetricHistogram::~MetricHistogram()
+    {
+        delete[] mBuckets;
+    }
+    // ----------------------------------------------------------------------
+    void MetricHistogram::observe(long value)
+    {
+        size_t bucket = 0;
+
+        while (bucket < mBounds.size() && value > mBounds[bucket])
+        {
+            ++bucket;
+        }
+
+        mBuckets[bucket].increment();
+        mCount.increment();
+        mSum.add(value);
+    }
+    // ----------------------------------------------------------------------
+    // Sonetto::MetricsRegistry implementation
+    // ----------------------------------------------------------------------
+    SONETTO_SINGLETON_IMPLEMENT(MetricsRegistry);
+    // ----------------------------------------------------------------------
+    MetricsRegistry::MetricsRegistry()
+            : mMutex(NULL), mThread(NULL), mStop(NULL), mInterval(0),
+              mMaxFileSize(0), mStartTime(SDL_GetTicks())
+    {
+        mMutex = SDL_CreateMutex();
+        if (!mMutex)
+        {
+            SONETTO_THROW("Could not create metrics registry mutex");
+        }
+    }
+    // ----------------------------------------------------------------------
+    MetricsRegistry::~MetricsRegistry()
+    {
+        stopExport();
+
+        for (CounterMap::iterator i = mCounters.begin();
+                i != mCounters.end();++i)
+        {
+            delete i->second;
+        }
+
+        for (GaugeMap::iterator i = mGauges.begin();i != mGauges.end();++i)
+        {
+            delete i->second;
+        }
+
+        for (HistogramMap::iterator i = mHistograms.begin();
+                i != mHistograms.end();++i)
+        {
+            delete i->second;
+        }
+
+        SDL_DestroyMutex(mMutex);
+    }
+    // ----------------------------------------------------------------------
+    MetricCounter *MetricsRegistry::getCounter(const std::string &name)
+    {
+        MetricCounter *counter;
+
+        SDL_mutexP(mMutex);
+        MetricCounter *&entry = mCounters[name];
+        if (!entry)
+        {
+            entry = new MetricCounter();
+        }
+        counter = entry;
+        SDL_mutexV(mMutex);
+
+        return counter;
+    }
+    // ----------------------------------------------------------------------
+    MetricGauge *MetricsRegistry::getGauge(const std::string &name)
+    {
+        MetricGauge *gauge;
+
+        SDL_mutexP(mMutex);
+        MetricGauge *&entry = mGauges[name];
+        if (!entry)
+        {
+            entry = new MetricGauge();
+        }
+        gauge = entry;
+        SDL_mutexV(mMutex);
+
+        return gauge;
+    }
+    // ----------------------------------------------------------------------
+    MetricHistogram *MetricsRegistry::getHistogram(const std::string &name,
+            const std::vector<long> &bounds)
+    {
+        MetricHistogram *histogram;
+
+        SDL_mutexP(mMutex);
+        MetricHistogram *&entry = mHistograms[name];
+        if (!entry)
+        {
+            entry = new MetricHistogram(bounds);
+        }
+        histogram = entry;
+        SDL_mutexV(mMutex);
+
+        return histogram;
+    }
+    // ----------------------------------------------------------------------
+    void MetricsRegistry::startExport(const std::string &fileName,
+            unsigned long interval,size_t maxFileSize)
+    {
+        if (mThread)
+        {
+            SONETTO_THROW("Metrics are already being exported");
+        }
+
+        if (interval == 0)
+        {
+            SONETTO_THROW("Invalid metrics export interval");
+        }
+
+        mFileName = fileName;
+        mInterval = interval * 1000;
+        mMaxFileSize = maxFileSize;
+
+        mFile.open(mFileName.c_str(),std::ios_base::out | std::ios_base::app);
+        if (!mFile.is_open())
+        {
+            SONETTO_THROW("Could not open metrics file " + mFileName);
+        }
+
+        mStop = SDL_CreateSemaphore(0);
+        if (!mStop)
+        {
+            SONETTO_THROW("Could not create metrics export semaphore");
+        }
+
+        mThread = SDL_CreateThread(exportThread,this);
+        if (!mThread)
+        {
+            SONETTO_THROW("Could not create metrics export thread");
+        }
+
+        Ogre::LogManager::getSingleton().logMessage(
+                "Exporting metrics to " + mFileName);
+    }
+    // ----------------------------------------------------------------------
+    void MetricsRegistry::stopExport()
+    {
+        if (mThread)
+        {
+            SDL_SemPost(mStop);
+            SDL_WaitThread(mThread,NULL);
+            mThread = NULL;
+        }
+
+        if (mStop)
+        {
+            SDL_DestroySemaphore(mStop);
+            mStop = NULL;
+        }
+
+        if (mFile.is_open())
+        {
+            mFile.close();
+        }
+    }
+    // ----------------------------------------------------------------------
+    int MetricsRegistry::exportThread(void *data)
+    {
+        MetricsRegistry *registry = static_cast<MetricsRegistry *>(data);
+        bool running = true;
+
+        // Formatting and writing snapshots must not show up in the frame
+        // times being measured; an export running a bit late does no harm.
+        // SDL 1.2 cannot lower a thread's priority, so the OS is asked
+        // directly (a nice value only applies to this thread on Linux)
+    #ifdef WINDOWS
+        SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_LOWEST);
+    #else
+        setpriority(PRIO_PROCESS,0,10);
+    #endif
+
+        while (running)
+        {
+            // Sleeps for an interval, or until stopExport() wakes it up
+            running = (SDL_SemWaitTimeout(registry->mStop,
+                    registry->mInterval) == SDL_MUTEX_TIMEDOUT);
+
+            // A last snapshot is written when stopping
+            registry->writeSnapshot();
+        }
+
+        return 0;
+    }
+    // ----------------------------------------------------------------------
+    void MetricsRegistry::writeSnapshot()
+    {
+        std::ostringstream line;
+        const char *separator;
+
+        line << "{\"time\":" << (SDL_GetTicks() - mStartTime);
+
+        // Metrics may be created meanwhile; values are read atomically
+        SDL_mutexP(mMutex);
+
+        line << ",\"counters\":{";
+        separator = "";
+        for (CounterMap::const_iterator i = mCounters.begin();
+                i != mCounters.end();++i)
+        {
+            line << separator << '"' << i->first << "\":" << i->second->get();
+            separator = ",";
+        }
+
+        line << "},\"gauges\":{";
+        separator = "";
+        for (GaugeMap::const_iterator i = mGauges.begin();
+                i != mGauges.end();++i)
+        {
+            line << separator << '"' << i->first << "\":" << i->second->get();
+            separator = ",";
+        }
+
+        line << "},\"histograms\":{";
+        separator = "";
+        for (HistogramMap::const_iterator i = mHistograms.begin();
+                i != mHistograms.end();++i)
+        {
+            const MetricHistogram *histogram = i->second;
+            const std::vector<long> &bounds = histogram->getBounds();
+
+            line << separator << '"' << i->first << "\":{\"count\":" <<
+                    histogram->getCount() << ",\"sum\":" <<
+                    histogram->getSum() << ",\"bounds\":[";
+            for (size_t j = 0;j < bounds.size();++j)
+            {
+                line << ((j > 0) ? "," : "") << bounds[j];
+            }
+
+            line << "],\"buckets\":[";
+            for (size_t j = 0;j <= bounds.size();++j)
+            {
+                line << ((j > 0) ? "," : "") << histogram->getBucketCount(j);
+            }
+
+            line << "]}";
+            separator = ",";
+        }
+
+        SDL_mutexV(mMutex);
+
+        line << "}}\n";
+
+        mFile << line.str();
+        mFile.flush();
+
+        if (mMaxFileSize > 0 && (size_t)(mFile.tellp()) >= mMaxFileSize)
+        {
+            rotate();
+        }
+    }
+    // ----------------------------------------------------------------------
+    void MetricsRegistry::rotate()
+    {
+        std::string oldFileName = mFileName + ".1";
+
+        mFile.close();
+
+        std::remove(oldFileName.c_str());
+        std::rename(mFileName.c_str(),oldFileName.c_str());
+
+        mFile.clear();
+        mFile.open(mFileName.c_str(),std::ios_base::out | std::ios_base::trunc);
+    }
+} // namespace
@@ -27,6 +27,7 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 POSSIBILITY OF SUCH DAMAGE.
 -----------------------------------------------------------------------------*/
 
+#include <algorithm>
 #include "SonettoModule.h"
 #include "SonettoKernel.h"
 
@@ -55,8 +56,11 @@ namespace Sonetto
         mOverlay->show();
     }
     // ----------------------------------------------------------------------
-    void Module::update()
+    void Module::update() {}
+    // ----------------------------------------------------------------------
+    void Module::syncRenderState()
     {
+        // Not in update(), which may run while Ogre renders
         mCamera->setAspectRatio(Kernel::getSingletonPtr()->mAspectRatio);
     }
     // ----------------------------------------------------------------------
@@ -96,6 +100,49 @@ namespace Sonetto
 
     }
     // ----------------------------------------------------------------------
+    size_t Module::getMemoryUsage() const
+    {
+        std::vector<std::string> groups;
+
+        getEvictableResourceGroups(groups);
+        return getResourceGroupsMemoryUsage(groups);
+    }
+    // ----------------------------------------------------------------------
+    size_t Module::getResourceGroupsMemoryUsage(
+            const std::vector<std::string> &groups)
+    {
+        size_t usage = 0;
+
+        if (groups.empty())
+        {
+            return 0;
+        }
+
+        // Sums the size of loaded resources in the groups, from every
+        // resource manager
+        Ogre::ResourceGroupManager::ResourceManagerIterator managerIter =
+                Ogre::ResourceGroupManager::getSingleton().
+                getResourceManagerIterator();
+        while (managerIter.hasMoreElements())
+        {
+            Ogre::ResourceManager::ResourceMapIterator resIter =
+                    managerIter.getNext()->getResourceIterator();
+
+            while (resIter.hasMoreElements())
+            {
+                Ogre::ResourcePtr res = resIter.getNext();
+
+                if (res->isLoaded() && std::find(groups.begin(),
+                        groups.end(),res->getGroup()) != groups.end())
+                {
+                    usage += res->getSize();
+                }
+            }
+        }
+
+        return usage;
+    }
+    // ----------------------------------------------------------------------
     void Module::setBgColor(const Ogre::ColourValue &col)
     {
         mBgColor = col;
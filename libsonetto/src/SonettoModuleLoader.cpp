@@ -0,0 +1,150 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#include <OgreResourceGroupManager.h>
+#include "SonettoModuleLoader.h"
+#include "SonettoAudioManager.h"
+#include "SonettoDatabase.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Sonetto::ModuleLoader implementation
+    // ----------------------------------------------------------------------
+    ModuleLoader::ModuleLoader(const ModulePreloadList &list,bool background)
+            : mList(list), mBackground(background), mStarted(false),
+              mDone(0), mTotal(0)
+    {
+        const SoundSetVector &soundSets = Database::getSingleton().soundSets;
+
+        // Sound sets are checked here, so that a bad preload list fails
+        // when the transition starts
+        for (size_t i = 0;i < mList.soundSets.size();++i)
+        {
+            uint32 setID = mList.soundSets[i];
+
+            if (setID == 0 || setID > soundSets.size())
+            {
+                SONETTO_THROW("Unknown sound set ID");
+            }
+        }
+
+        mTotal = mList.resourceGroups.size() + mList.resources.size() +
+                mList.soundSets.size();
+    }
+    // ----------------------------------------------------------------------
+    bool ModuleLoader::update()
+    {
+        AudioManager &audioMan = AudioManager::getSingleton();
+
+        if (!mStarted)
+        {
+            start();
+            mStarted = true;
+        }
+
+        // Checks for finished background requests
+        for (size_t i = 0;i < mTickets.size();++i)
+        {
+            if (Ogre::ResourceBackgroundQueue::getSingleton().
+                    isProcessComplete(mTickets[i]))
+            {
+                mTickets.erase(mTickets.begin() + i);
+                ++mDone;
+                --i;
+            }
+        }
+
+        // Checks for sound sets AudioManager::_update() finished uploading
+        for (size_t i = 0;i < mSoundSets.size();++i)
+        {
+            if (!audioMan.isSoundSetLoading(mSoundSets[i]))
+            {
+                mSoundSets.erase(mSoundSets.begin() + i);
+                ++mDone;
+                --i;
+            }
+        }
+
+        return isComplete();
+    }
+    // ----------------------------------------------------------------------
+    void ModuleLoader::start()
+    {
+        AudioManager &audioMan = AudioManager::getSingleton();
+
+        // Sound sets are decoded by the JobSystem in any case; sets already
+        // being loaded (or listed twice) are only waited for
+        for (size_t i = 0;i < mList.soundSets.size();++i)
+        {
+            uint32 setID = mList.soundSets[i];
+
+            if (!audioMan.isSoundSetLoading(setID))
+            {
+                audioMan.loadSoundSetAsync(setID);
+            }
+
+            mSoundSets.push_back(setID);
+        }
+
+        if (mBackground) {
+            Ogre::ResourceBackgroundQueue &queue =
+                    Ogre::ResourceBackgroundQueue::getSingleton();
+
+            for (size_t i = 0;i < mList.resourceGroups.size();++i)
+            {
+                mTickets.push_back(queue.loadResourceGroup(
+                        mList.resourceGroups[i]));
+            }
+
+            for (size_t i = 0;i < mList.resources.size();++i)
+            {
+                const ModulePreloadList::Resource &res = mList.resources[i];
+                mTickets.push_back(queue.load(res.type,res.name,res.group));
+            }
+        } else {
+            for (size_t i = 0;i < mList.resourceGroups.size();++i)
+            {
+                Ogre::ResourceGroupManager::getSingleton().
+                        loadResourceGroup(mList.resourceGroups[i]);
+                ++mDone;
+            }
+
+            for (size_t i = 0;i < mList.resources.size();++i)
+            {
+                const ModulePreloadList::Resource &res = mList.resources[i];
+                Ogre::ResourceGroupManager::getSingleton().
+                        _getResourceManager(res.type)->load(res.name,
+                        res.group);
+                ++mDone;
+            }
+        }
+    }
+} // namespace
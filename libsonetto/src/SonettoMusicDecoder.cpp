@@ -0,0 +1,297 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifdef WINDOWS
+#   include <windows.h>
+#endif
+#include <OgreStringConverter.h>
+#include "SonettoMusicDecoder.h"
+#include "SonettoMemory.h"
+#include "SonettoVorbisDataStream.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Sonetto::MusicDecoder implementation
+    // ----------------------------------------------------------------------
+    MusicDecoder::MusicDecoder(const Ogre::DataStreamPtr &stream,size_t pos,
+            bool loop,size_t loopPoint,size_t chunkSize,size_t chunkCount)
+            : mStream(new Ogre::DataStreamPtr(stream)), mOpened(false),
+            mChunks(NULL), mChunkCount(chunkCount), mChunkSize(chunkSize),
+            mFillSize(chunkSize), mWake(NULL), mThread(NULL), mStop(false),
+            mLoop(loop), mLoopPoint(loopPoint), mStreamLen(0), mPos(pos),
+            mEnded(false), mChannels(0), mRate(0), mFrameSize(0)
+    {
+        mChunks = new MusicChunk[mChunkCount]();
+        for (size_t i = 0;i < mChunkCount;++i)
+        {
+            mChunks[i].data = static_cast<char *>(
+                    MemoryTracker::allocate(MEMTAG_AUDIO,mChunkSize));
+        }
+
+        mWake = SDL_CreateSemaphore(0);
+        if (!mWake)
+        {
+            release();
+            SONETTO_THROW("Could not create music decoder semaphore");
+        }
+
+        mThread = SDL_CreateThread(decodeThread,this);
+        if (!mThread)
+        {
+            release();
+            SONETTO_THROW("Could not create music decoding thread");
+        }
+    }
+    // ----------------------------------------------------------------------
+    MusicDecoder::~MusicDecoder()
+    {
+        release();
+    }
+    // ----------------------------------------------------------------------
+    const MusicChunk *MusicDecoder::peekChunk()
+    {
+        // Chunks decoded before a failure are still good
+        if (mWritten.get() != mRead.get())
+        {
+            return &mChunks[mRead.get() % mChunkCount];
+        }
+
+        if (mFailed.get() != 0)
+        {
+            SONETTO_THROW(mError);
+        }
+
+        return NULL;
+    }
+    // ----------------------------------------------------------------------
+    void MusicDecoder::popChunk()
+    {
+        // The slot belongs to the decoding thread again from here on
+        mRead.increment();
+        SDL_SemPost(mWake);
+    }
+    // ----------------------------------------------------------------------
+    int MusicDecoder::decodeThread(void *data)
+    {
+        MusicDecoder *decoder = static_cast<MusicDecoder *>(data);
+        const long chunkCount = static_cast<long>(decoder->mChunkCount);
+
+    #ifdef WINDOWS
+        // Playback starves if decoding lags (SDL 1.2 cannot set priorities)
+        SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_ABOVE_NORMAL);
+    #endif
+
+        if (!decoder->open())
+        {
+            decoder->mFailed.increment();
+            return 1;
+        }
+
+        while (!decoder->mStop)
+        {
+            // Decodes until the ring is full or the stream has ended
+            while (!decoder->mStop && !decoder->mEnded &&
+                    decoder->mWritten.get() - decoder->mRead.get() < chunkCount)
+            {
+                MusicChunk &chunk = decoder->mChunks[
+                        decoder->mWritten.get() % chunkCount];
+
+                if (!decoder->decodeChunk(chunk))
+                {
+                    decoder->mFailed.increment();
+                    return 1;
+                }
+
+                // Publishes the chunk to the consumer
+                decoder->mWritten.increment();
+            }
+
+            // Sleeps until a chunk is consumed, or until release() wakes it up
+            SDL_SemWait(decoder->mWake);
+        }
+
+        return 0;
+    }
+    // ----------------------------------------------------------------------
+    bool MusicDecoder::open()
+    {
+        ogg_int64_t length;
+        int errCode;
+
+        // Opens file and checks for errors
+        errCode = ovAdoptDataStream(mStream,&mFile);
+        if (errCode != 0)
+        {
+            mError = "Failed opening OGG/Vorbis file ("+
+                    Ogre::StringConverter::toString(errCode)+")";
+            return false;
+        }
+
+        mOpened    = true;
+        mChannels  = mFile.vi->channels;
+        mRate      = mFile.vi->rate;
+        mFrameSize = mChannels * 2;
+
+        // Tells the length of our stream
+        length = ov_pcm_total(&mFile,-1);
+        if (length < 0)
+        {
+            mError = "Failed telling OGG/Vorbis stream length ("+
+                    Ogre::StringConverter::toString((int)length)+")";
+            return false;
+        }
+
+        mStreamLen = static_cast<size_t>(length);
+
+        // Seeks stream
+        if (mPos != 0)
+        {
+            errCode = ov_pcm_seek(&mFile,mPos);
+            if (errCode != 0)
+            {
+                mError = "Couldn't seek OGG/Vorbis stream position";
+                return false;
+            }
+        }
+
+        // Chunks must hold whole samples, otherwise ov_read() would
+        // return 0 before the end of the stream
+        mFillSize = mChunkSize - mChunkSize % mFrameSize;
+
+        return true;
+    }
+    // ----------------------------------------------------------------------
+    bool MusicDecoder::decodeChunk(MusicChunk &chunk)
+    {
+        bool wrapped = false; // Whether the stream looped in this chunk
+        bool seeked  = false; // Whether nothing was read since looping
+        int  bitstream;
+
+        chunk.size     = 0;
+        chunk.startPos = mPos;
+        chunk.ended    = false;
+
+        // While we haven't filled the chunk, read more data from OGG stream
+        while (chunk.size < mFillSize)
+        {
+            long read = ov_read(&mFile,chunk.data + chunk.size,
+                    static_cast<int>(mFillSize - chunk.size),0,2,1,&bitstream);
+
+            if (read > 0) { // There were bytes read
+                chunk.size += read;
+                mPos       += read / mFrameSize;
+                seeked      = false;
+            } else
+            if (read == 0) { // No bytes were read
+                // An empty loop would make us seek forever
+                if (!mLoop || seeked)
+                {
+                    // Nothing more to be read
+                    chunk.ended = true;
+                    mEnded      = true;
+                    break;
+                }
+
+                // A chunk records a single loop; if the loop is shorter
+                // than a chunk, the next one goes on from the loop point
+                if (wrapped)
+                {
+                    break;
+                }
+
+                // Seeks stream to loop point
+                if (ov_pcm_seek(&mFile,mLoopPoint) != 0)
+                {
+                    mError = "Couldn't seek OGG/Vorbis stream position";
+                    return false;
+                }
+
+                chunk.loopSample = chunk.size / mFrameSize;
+                mPos    = mLoopPoint;
+                wrapped = true;
+                seeked  = true;
+            } else { // Error while reading from file
+                mError = "Failed reading from OGG/Vorbis file ("+
+                        Ogre::StringConverter::toString(read)+")";
+                return false;
+            }
+        }
+
+        if (!wrapped)
+        {
+            chunk.loopSample = chunk.size / mFrameSize;
+        }
+
+        return true;
+    }
+    // ----------------------------------------------------------------------
+    void MusicDecoder::release()
+    {
+        if (mThread)
+        {
+            mStop = true;
+            SDL_SemPost(mWake);
+            SDL_WaitThread(mThread,NULL);
+            mThread = NULL;
+        }
+
+        if (mWake)
+        {
+            SDL_DestroySemaphore(mWake);
+            mWake = NULL;
+        }
+
+        if (mChunks)
+        {
+            for (size_t i = 0;i < mChunkCount;++i)
+            {
+                if (mChunks[i].data)
+                {
+                    MemoryTracker::deallocate(MEMTAG_AUDIO,mChunks[i].data,
+                            mChunkSize);
+                }
+            }
+
+            delete[] mChunks;
+            mChunks = NULL;
+        }
+
+        // Destroys OGG file handle, or the stream it was to be read from
+        if (mOpened) {
+            ov_clear(&mFile);
+        } else {
+            delete mStream;
+        }
+
+        mOpened = false;
+        mStream = NULL;
+    }
+} // namespace
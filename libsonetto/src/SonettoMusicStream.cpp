@@ -27,28 +27,67 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 POSSIBILITY OF SUCH DAMAGE.
 -----------------------------------------------------------------------------*/
 
+#include <algorithm>
 #include <AL/al.h>
 #include "SonettoKernel.h"
 #include "SonettoDatabase.h"
 #include "SonettoAudioManager.h"
 #include "SonettoMusicStream.h"
+#include "SonettoMetrics.h"
+#include "SonettoMusicDecoder.h"
 
 namespace Sonetto
 {
     //-----------------------------------------------------------------------------
     // Sonetto::MusicStream implementation.
     //-----------------------------------------------------------------------------
-    const size_t MusicStream::BUFFER_SIZE = 163840;
+    const size_t MusicStream::DEFAULT_BUFFER_SIZE = 32768;
+    const size_t MusicStream::DEFAULT_MAX_BUFFERS = 16;
+    const size_t MusicStream::MIN_QUEUE_DEPTH = 3;
+    const float  MusicStream::QUEUE_SHRINK_TIME = 10.0f;
     //-----------------------------------------------------------------------------
-    MusicStream::MusicStream(AudioManager *audioMan)
-            : mAudioMan(audioMan), mMusic(0), mMaxVolume(1.0f), mLoop(true),
-                mFade(MF_NO_FADE), mState(MSS_IDLE)
+    MusicStream::MusicStream(AudioManager *audioMan,size_t bufferSize,
+            size_t maxBuffers)
+            : mAudioMan(audioMan), mMusic(0), mBufferSize(bufferSize),
+                mStableTime(0.0f), mMaxVolume(1.0f), mLoop(true),
+                mFade(MF_NO_FADE), mState(MSS_IDLE), mDecoder(NULL),
+                mPreloadChain(false), mChainFirst(false), mChainEndQueued(false),
+                mChainDropped(false)
     {
+        MetricsRegistry &metrics = MetricsRegistry::getSingleton();
+
+        mPreload.decoder = NULL;
+        mChain.decoder   = NULL;
+
+        if (mBufferSize == 0)
+        {
+            mBufferSize = DEFAULT_BUFFER_SIZE;
+        }
+
+        if (maxBuffers == 0)
+        {
+            maxBuffers = DEFAULT_MAX_BUFFERS;
+        }
+
+        // The queue depth can't go below its minimum
+        maxBuffers = std::max(maxBuffers,MIN_QUEUE_DEPTH);
+
+        // Starts halfway, so that it can quickly adapt either way
+        mQueueDepth = std::max(maxBuffers / 2,MIN_QUEUE_DEPTH);
+
+        mUnderruns       = metrics.getCounter("audio_underruns");
+        mNearUnderruns   = metrics.getCounter("audio_near_underruns");
+        mQueueDepthGauge = metrics.getGauge("music_queue_depth");
+        mQueueDepthGauge->set(static_cast<long>(mQueueDepth));
+
         // Creates OpenAL audio buffers
-        alGenBuffers(2,mMusicBuf);
+        mMusicBuf.resize(maxBuffers);
+        alGenBuffers(static_cast<ALsizei>(maxBuffers),&mMusicBuf[0]);
         mAudioMan->_alErrorCheck("MusicStream::MusicStream()",
                                 "Failed generating music buffers");
 
+        mFreeBuffers = mMusicBuf;
+
         // Creates music source
         alGenSources(1,&mMusicSrc);
         mAudioMan->_alErrorCheck("MusicStream::MusicStream()",
@@ -57,11 +96,10 @@ namespace Sonetto
     //-----------------------------------------------------------------------------
     MusicStream::~MusicStream()
     {
-        // Destroys OGG file handle
-        if (mMusic != 0)
-        {
-            ov_clear(&mFile);
-        }
+        // Stops decoding and destroys OGG file handles
+        delete mDecoder;
+        delete mChain.decoder;
+        delete mPreload.decoder;
 
         // Destroys music source
         alDeleteSources(1,&mMusicSrc);
@@ -69,7 +107,7 @@ namespace Sonetto
                                 "Failed destroying music source");
 
         // Destroys OpenAL audio buffers
-        alDeleteBuffers(2,mMusicBuf);
+        alDeleteBuffers(static_cast<ALsizei>(mMusicBuf.size()),&mMusicBuf[0]);
         mAudioMan->_alErrorCheck("MusicStream::~MusicStream()",
                                 "Failed destroying music buffers");
     }
@@ -80,7 +118,6 @@ namespace Sonetto
         {
             ALenum srcState;
             int    processed;
-            size_t buffers[2];
 
             // Updates fading
             switch (mFade)
@@ -136,48 +173,80 @@ namespace Sonetto
             mAudioMan->_alErrorCheck("MusicStream::_update()",
                                     "Failed setting music source volume");
 
-            // Refills processed buffer with more data from the stream
+            // Takes back the buffers OpenAL has finished playing
             alGetSourcei(mMusicSrc,AL_BUFFERS_PROCESSED,&processed);
             mAudioMan->_alErrorCheck("MusicStream::_update()",
                     "Failed getting number of processed buffers from music source");
 
-            alSourceUnqueueBuffers(mMusicSrc,processed,buffers);
-            mAudioMan->_alErrorCheck("MusicStream::_update()",
-                    "Failed unqueuing processed buffers from music source");
-
             for (int i = 0;i < processed;++i)
             {
-                if (mState == MSS_ENDED)
+                ALuint buffer;
+
+                alSourceUnqueueBuffers(mMusicSrc,1,&buffer);
+                mAudioMan->_alErrorCheck("MusicStream::_update()",
+                        "Failed unqueuing processed buffers from music source");
+
+                if (!checkChain())
                 {
-                    mAudioMan->_streamEnded();
-                    break;
+                    return;
                 }
 
-                // Gets more data from OGG/Vorbis stream and queue it back
-                pullStream(buffers[i]);
-                alSourceQueueBuffers(mMusicSrc,1,&buffers[i]);
-                mAudioMan->_alErrorCheck("MusicStream::_update()",
-                        "Failed queueing audio buffer in music source");
+                mPlayedPos = chunkPos(mQueuedChunks.front(),
+                        mQueuedChunks.front().samples);
+                mQueuedChunks.pop_front();
+                mFreeBuffers.push_back(buffer);
+            }
+
+            if (!checkChain())
+            {
+                return;
             }
 
-            // Makes sure the music doesn't stuck stopped
-            // It may happen when you drag the window for too long
             alGetSourcei(mMusicSrc,AL_SOURCE_STATE,&srcState);
             mAudioMan->_alErrorCheck("MusicStream::_update()",
                     "Failed getting music source state");
 
-            if (srcState == AL_STOPPED)
+            // Whatever is left queued is all that stood between the source
+            // and an underrun (it means nothing while the queue is still
+            // filling up after starting, or at the stream's end, though)
+            if (srcState == AL_PLAYING && mState == MSS_IDLE && mPrimed &&
+                    !mEndQueued)
             {
-                if (mState != MSS_ENDED)
-                {
-                    alSourcePlay(mMusicSrc);
-                    mAudioMan->_alErrorCheck("MusicStream::_update()",
-                            "Failed playing music source");
+                adaptQueueDepth(deltatime,mQueuedChunks.size(),false);
+            }
+
+            // Refills them with what the decoding thread has got ready
+            queueChunks();
+
+            // Starts the source as soon as there is something decoded, and
+            // makes sure the music doesn't stuck stopped (it may happen when
+            // you drag the window for too long, or when decoding lags behind)
+            if (srcState == AL_INITIAL || srcState == AL_STOPPED)
+            {
+                if (!mQueuedChunks.empty()) {
+                    // Sources stopped by fading out must stay stopped
+                    if (mState == MSS_IDLE || mState == MSS_ENDED)
+                    {
+                        if (srcState == AL_STOPPED)
+                        {
+                            mUnderruns->increment();
+                            adaptQueueDepth(deltatime,0,true);
+                        }
+
+                        mPrimed = false;
+
+                        alSourcePlay(mMusicSrc);
+                        mAudioMan->_alErrorCheck("MusicStream::_update()",
+                                "Failed playing music source");
+                    }
+                } else
+                if (mEndQueued) {
+                    // Everything has been played
+                    _stop(0.0f);
+                    mAudioMan->_streamEnded(false);
                 }
             }
         }
-
-        _getCurrentPos();
     }
     //-----------------------------------------------------------------------------
     void MusicStream::_play(size_t id,size_t pos,float fadeIn,bool loop)
@@ -188,51 +257,26 @@ namespace Sonetto
             SONETTO_THROW("Unknown music ID");
         }
 
-        int errCode;
-        char fill;
-        std::string path = Music::FOLDER + Database::getSingleton().musics[id-1].
-                filename;
-        char *constlessStr = new char[path.length()+1];
-
-        // We use this `constlessStr' here because ov_fopen() needs a char *
-        // argument as filename, but std::string::c_str() returns a const char *,
-        // and I don't like const-casts
-        strcpy(constlessStr,path.c_str());
-
         // Stops current music, if any
         _stop(0.0f);
 
-        // Opens file and checks for errors
-        errCode = ov_fopen(constlessStr,&mFile);
-        if (errCode != 0)
-        {
-            SONETTO_THROW("Failed opening OGG/Vorbis file ("+
-                    Ogre::StringConverter::toString(errCode)+")");
-        }
-
-        // We don't need this anymore
-        delete[] constlessStr;
-
-        // Tells the length of our stream
-        mStreamLen = static_cast<size_t>(ov_pcm_total(&mFile,-1));
-        if ((int)mStreamLen == OV_EINVAL)
-        {
-            SONETTO_THROW("Failed telling OGG/Vorbis stream length ("+
-                    Ogre::StringConverter::toString((int)mStreamLen)+")");
+        if (mPreload.decoder && mPreload.music == id && mPreload.pos == pos &&
+                mPreload.loop == loop) {
+            // Decoded ahead: playing it is a matter of queueing its buffers
+            mDecoder = mPreload.decoder;
+            mPreload.decoder = NULL;
+        } else {
+            mDecoder = createDecoder(id,pos,loop);
         }
 
         // Sets current music index
-        mMusic = id;
+        mMusic      = id;
+        mPlayedPos  = pos;
+        mEndQueued  = false;
+        mPrimed     = false;
 
         // Sets fade state and speed
-        mFadeSpd = Math::clamp(fadeIn,0.0f,1.0f);
-        if (mFadeSpd == 0.0f) {
-            mFadeVolume = 1.0f;
-            mFade = MF_NO_FADE;
-        } else {
-            mFadeVolume = 0.0f;
-            mFade = MF_FADE_IN;
-        }
+        beginFadeIn(fadeIn);
 
         // Sets whether to loop or not
         mLoop = loop;
@@ -240,44 +284,76 @@ namespace Sonetto
         // Resets stream state
         mState = MSS_IDLE;
 
-        // Seeks stream
-        if (pos != 0)
+        // Sets source volume
+        alSourcef(mMusicSrc,AL_GAIN,mFadeVolume*mMaxVolume);
+        mAudioMan->_alErrorCheck("MusicStream::_play()",
+                                "Failed setting music source volume");
+
+        // The music starts playing from _update(), once its first chunk is
+        // decoded; until then the source is neither stopped nor paused
+        alSourceRewind(mMusicSrc);
+        mAudioMan->_alErrorCheck("MusicStream::_play()",
+                                "Failed rewinding music source");
+    }
+    //-----------------------------------------------------------------------------
+    void MusicStream::_preload(size_t id,size_t pos,float fadeIn,bool loop,
+            bool chain)
+    {
+        if (mChain.decoder)
         {
-            errCode = ov_pcm_seek(&mFile,pos);
-            if (errCode != 0)
+            // Already queued behind the current music
+            if (chain && mChain.music == id && mChain.pos == pos &&
+                    mChain.loop == loop)
             {
-                SONETTO_THROW("Couldn't seek OGG/Vorbis stream position");
+                mChain.fadeIn = fadeIn;
+
+                delete mPreload.decoder;
+                mPreload.decoder = NULL;
+                return;
             }
+
+            // Something else is to be played next; whatever was already
+            // queued of the chained music is dropped by checkChain(), and
+            // nothing else can be chained behind it
+            mChainDropped = !mChainFirst;
+
+            delete mChain.decoder;
+            mChain.decoder  = NULL;
+            mChainFirst     = false;
+            mChainEndQueued = false;
         }
 
-        // Fills buffers
-        fill = 1;
-        pullStream(mMusicBuf[0]);
-        if (loop) {
-            fill = 2;
-            pullStream(mMusicBuf[1]);
-        } else {
-            if (mState != MSS_ENDED)
+        mPreloadChain = chain;
+
+        if (mPreload.decoder)
+        {
+            if (mPreload.music == id && mPreload.pos == pos &&
+                    mPreload.loop == loop)
             {
-                fill = 2;
-                pullStream(mMusicBuf[1]);
+                mPreload.fadeIn = fadeIn;
+                return;
             }
+
+            delete mPreload.decoder;
+            mPreload.decoder = NULL;
         }
 
-        // Queues buffers
-        alSourceQueueBuffers(mMusicSrc,fill,mMusicBuf);
-        mAudioMan->_alErrorCheck("MusicStream::_play()",
-                                "Failed queuing music buffers");
+        if (id == 0)
+        {
+            return;
+        }
 
-        // Sets source volume
-        alSourcef(mMusicSrc,AL_GAIN,mFadeVolume*mMaxVolume);
-        mAudioMan->_alErrorCheck("MusicStream::_play()",
-                                "Failed setting music source volume");
+        // Checks bounds
+        if (id > Database::getSingleton().musics.size())
+        {
+            SONETTO_THROW("Unknown music ID");
+        }
 
-        // Starts playing the music
-        alSourcePlay(mMusicSrc);
-        mAudioMan->_alErrorCheck("MusicStream::_play()",
-                                "Failed playing music source");
+        mPreload.decoder = createDecoder(id,pos,loop);
+        mPreload.music   = id;
+        mPreload.pos     = pos;
+        mPreload.fadeIn  = fadeIn;
+        mPreload.loop    = loop;
     }
     //-----------------------------------------------------------------------------
     void MusicStream::_stop(float aFadeOut)
@@ -287,9 +363,17 @@ namespace Sonetto
             float fadeOut = Math::clamp(aFadeOut,0.0f,1.0f);
             if (fadeOut == 0.0f) {
                 int buffers;
-                size_t unqueue[2];
 
-                ov_clear(&mFile);
+                // Stops decoding and destroys OGG file handles (the
+                // preloaded music is kept, it may still be played next)
+                delete mDecoder;
+                mDecoder = NULL;
+
+                delete mChain.decoder;
+                mChain.decoder  = NULL;
+                mChainFirst     = false;
+                mChainEndQueued = false;
+                mChainDropped   = false;
 
                 alSourceStop(mMusicSrc);
                 mAudioMan->_alErrorCheck("MusicStream::_stop()",
@@ -299,9 +383,17 @@ namespace Sonetto
                 mAudioMan->_alErrorCheck("MusicStream::_stop()",
                                         "Couldn't get number of processed buffers");
 
-                alSourceUnqueueBuffers(mMusicSrc,buffers,unqueue);
-                mAudioMan->_alErrorCheck("MusicStream::_stop()",
-                                        "Couldn't unqueue buffers");
+                if (buffers > 0)
+                {
+                    std::vector<ALuint> unqueue(buffers);
+
+                    alSourceUnqueueBuffers(mMusicSrc,buffers,&unqueue[0]);
+                    mAudioMan->_alErrorCheck("MusicStream::_stop()",
+                                            "Couldn't unqueue buffers");
+                }
+
+                mQueuedChunks.clear();
+                mFreeBuffers = mMusicBuf;
 
                 mMusic = 0;
             } else {
@@ -414,127 +506,267 @@ namespace Sonetto
     //-----------------------------------------------------------------------------
     size_t MusicStream::_getCurrentPos()
     {
-        // <todo> This method is not working with OGG files smaller than
-        // BUFFER_SIZE (fix it)
         if (mMusic != 0)
         {
-            int alPos,buffers;
-            size_t streamPos     = static_cast<size_t>(ov_pcm_tell(&mFile));
-            size_t loopPoint     = Database::getSingleton().musics[mMusic-1].
-                    loopPoint;
-            size_t sizeInSamples = BUFFER_SIZE/2;
-            size_t offset        = 666666666;
-
-            if ((int)streamPos == OV_EINVAL)
-            {
-                SONETTO_THROW("Failed telling current stream offset in music file ("+
-                        Ogre::StringConverter::toString(streamPos)+")");
-            }
+            ALenum srcState;
+            int    alPos;
+            size_t offset;
 
-            if (sizeInSamples > mStreamLen)
+            alGetSourcei(mMusicSrc,AL_SOURCE_STATE,&srcState);
+            mAudioMan->_alErrorCheck("MusicStream::_getCurrentPos()",
+                    "Failed getting music source state");
+
+            // A stopped source has played all that was queued
+            if (srcState == AL_STOPPED && !mQueuedChunks.empty())
             {
-                sizeInSamples = mStreamLen;
+                return chunkPos(mQueuedChunks.back(),
+                        mQueuedChunks.back().samples);
             }
 
             alGetSourcei(mMusicSrc,AL_SAMPLE_OFFSET,&alPos);
             mAudioMan->_alErrorCheck("MusicStream::_getCurrentPos()",
                     "Failed getting music source sample offset");
 
-            alGetSourcei(mMusicSrc,AL_BUFFERS_PROCESSED,&buffers);
-            mAudioMan->_alErrorCheck("MusicStream::_getCurrentPos()",
-                    "Failed getting number of processed buffers in music source");
-
-            alPos -= buffers*sizeInSamples;
-            if (streamPos < loopPoint || streamPos-loopPoint > sizeInSamples) {
-                offset = streamPos-(sizeInSamples-alPos);
-            } else {
-                size_t warped   = streamPos-loopPoint;
-                size_t unwarped = sizeInSamples-warped;
-
-                if ((size_t)alPos >= unwarped) {
-                    offset = streamPos-(sizeInSamples-alPos);
-                } else {
-                    offset = mStreamLen-(sizeInSamples-alPos);
+            // The offset counts from the first chunk still in the queue
+            offset = static_cast<size_t>(alPos);
+            for (std::deque<QueuedChunk>::const_iterator i =
+                    mQueuedChunks.begin();i != mQueuedChunks.end();++i)
+            {
+                if (offset < i->samples)
+                {
+                    return chunkPos(*i,offset);
                 }
+
+                offset -= i->samples;
             }
 
-            return offset;
+            return mPlayedPos;
         }
 
         return 0;
     }
     //-----------------------------------------------------------------------------
-    void MusicStream::pullStream(size_t buffer)
+    float MusicStream::getBufferFill()
     {
-        int          bitstream;
-        ALenum       format;              // Stream format (Mono/Stereo)
-        char         data[BUFFER_SIZE*2]; // Temporary PCM buffer
-        size_t       offset = 0;          // How much data was already read
+        int queued,processed;
 
-        if (mState == MSS_ENDED)
+        if (mMusic == 0)
         {
-            SONETTO_THROW("Trying to stream an ended stream");
+            return 0.0f;
         }
 
-        // While we haven't filled a buffer, read more data from OGG stream
-        while (offset < BUFFER_SIZE)
+        alGetSourcei(mMusicSrc,AL_BUFFERS_QUEUED,&queued);
+        mAudioMan->_alErrorCheck("MusicStream::getBufferFill()",
+                "Failed getting number of queued buffers in music source");
+
+        alGetSourcei(mMusicSrc,AL_BUFFERS_PROCESSED,&processed);
+        mAudioMan->_alErrorCheck("MusicStream::getBufferFill()",
+                "Failed getting number of processed buffers in music source");
+
+        // Shrinking the depth leaves more queued for a while
+        return std::min(static_cast<float>(queued - processed) / mQueueDepth,
+                1.0f);
+    }
+    //-----------------------------------------------------------------------------
+    long MusicStream::getUnderruns() const
+    {
+        return mUnderruns->get();
+    }
+    //-----------------------------------------------------------------------------
+    void MusicStream::queueChunks()
+    {
+        while (mQueuedChunks.size() < mQueueDepth && !mFreeBuffers.empty())
         {
-            int read;
+            MusicDecoder *decoder;
+            const MusicChunk *chunk;
+            ALenum format; // Stream format (Mono/Stereo)
 
-            if (BUFFER_SIZE-offset <= 1024) {
-                char chunk[1024];
-                read = ov_read(&mFile,chunk,1024,0,2,1,&bitstream);
+            if (!mEndQueued) {
+                decoder = mDecoder;
+            } else
+            if (mChain.decoder) {
+                if (mChainEndQueued)
+                {
+                    break;
+                }
 
-                if (read > 0)
+                decoder = mChain.decoder;
+            } else
+            if (mPreload.decoder && mPreloadChain && !mChainDropped) {
+                // Waits until the preloaded music has something decoded
+                if (!mPreload.decoder->peekChunk())
                 {
-                    // Copy part of data read to `data' buffer
-                    read = BUFFER_SIZE-offset;
-                    memcpy(data+offset,chunk,read);
+                    break;
                 }
+
+                // Goes on with it right behind the current music's end
+                mChain = mPreload;
+                mChainFirst = true;
+                mPreload.decoder = NULL;
+
+                decoder = mChain.decoder;
             } else {
-                read = ov_read(&mFile,data+offset,BUFFER_SIZE-offset,0,2,1,
-                               &bitstream);
+                break;
             }
 
-            if (read > 0) { // There were bytes read
-                offset += read;
-            } else
-            if (read == 0) { // No bytes were read
-                if (mLoop) {
-                    // Seeks stream to loop point
-                    int errCode = ov_pcm_seek(&mFile,Database::getSingleton().
-                            musics[mMusic-1].loopPoint);
+            chunk = decoder->peekChunk();
+            if (!chunk)
+            {
+                break;
+            }
 
-                    if (errCode != 0)
-                    {
-                        SONETTO_THROW("Couldn't seek OGG/Vorbis stream position");
-                    }
+            if (chunk->size > 0)
+            {
+                QueuedChunk queued;
+
+                queued.buffer     = mFreeBuffers.back();
+                queued.startPos   = chunk->startPos;
+                queued.samples    = chunk->size / (decoder->getChannels() * 2);
+                queued.loopSample = chunk->loopSample;
+                queued.loopPoint  = decoder->getLoopPoint();
+                queued.first      = (decoder == mChain.decoder && mChainFirst);
+
+                // Figures whether the format is mono or stereo
+                if (decoder->getChannels() == 1) {
+                    format = AL_FORMAT_MONO16;
+                } else {
+                    format = AL_FORMAT_STEREO16;
+                }
+
+                // Fills an OpenAL audio data buffer with the decoded chunk
+                alBufferData(queued.buffer,format,chunk->data,chunk->size,
+                        decoder->getRate());
+                mAudioMan->_alErrorCheck("MusicStream::queueChunks()",
+                        "Could not fill OpenAL audio buffer");
+
+                alSourceQueueBuffers(mMusicSrc,1,&queued.buffer);
+                mAudioMan->_alErrorCheck("MusicStream::queueChunks()",
+                        "Failed queueing audio buffer in music source");
+
+                mFreeBuffers.pop_back();
+                mQueuedChunks.push_back(queued);
+
+                if (queued.first)
+                {
+                    mChainFirst = false;
+                }
+
+                if (mQueuedChunks.size() >= mQueueDepth)
+                {
+                    mPrimed = true;
+                }
+            }
 
-                    continue; // Continue reading from new position
+            if (chunk->ended)
+            {
+                // Nothing more to be read
+                if (decoder == mDecoder) {
+                    mEndQueued = true;
+                    mState     = MSS_ENDED;
                 } else {
-                    // Nothing more to be read
-                    mState = MSS_ENDED;
-                    break;
+                    mChainEndQueued = true;
                 }
-            } else { // Error while reading from file
-                SONETTO_THROW("Failed reading from OGG/Vorbis file ("+
-                    Ogre::StringConverter::toString(read)+")");
             }
+
+            // OpenAL has its own copy of the data now
+            decoder->popChunk();
         }
+    }
+    //-----------------------------------------------------------------------------
+    void MusicStream::adaptQueueDepth(float deltatime,size_t pending,
+            bool starved)
+    {
+        if (starved) {
+            // Ran dry: doubles the depth
+            mQueueDepth = std::min(mQueueDepth * 2,mMusicBuf.size());
+            mStableTime = 0.0f;
+        } else
+        if (pending <= 1) {
+            // Down to the buffer being played: one more buffer
+            mNearUnderruns->increment();
+
+            mQueueDepth = std::min(mQueueDepth + 1,mMusicBuf.size());
+            mStableTime = 0.0f;
+        } else {
+            mStableTime += deltatime;
+
+            // Has been fine for a while: one less buffer
+            if (mStableTime >= QUEUE_SHRINK_TIME)
+            {
+                mQueueDepth = std::max(mQueueDepth - 1,MIN_QUEUE_DEPTH);
+                mStableTime = 0.0f;
+            }
+        }
+
+        mQueueDepthGauge->set(static_cast<long>(mQueueDepth));
+    }
+    //-----------------------------------------------------------------------------
+    size_t MusicStream::chunkPos(const QueuedChunk &chunk,size_t sample) const
+    {
+        if (sample < chunk.loopSample)
+        {
+            return chunk.startPos + sample;
+        }
+
+        // Past the loop, the chunk goes on from the loop point
+        return chunk.loopPoint + (sample - chunk.loopSample);
+    }
+    //-----------------------------------------------------------------------------
+    MusicDecoder *MusicStream::createDecoder(size_t id,size_t pos,bool loop)
+    {
+        const Music &music = Database::getSingleton().musics[id-1];
+        std::string path = Music::FOLDER + music.filename;
 
-        // Gets information about the stream and figures
-        // whether the format is mono or stereo
-        if (mFile.vi->channels == 1) {
-            format = AL_FORMAT_MONO16;
+        // Opening, seeking and decoding are all done by the decoder's thread
+        return new MusicDecoder(mAudioMan->_openFile(path),pos,loop,
+                music.loopPoint,mBufferSize,mMusicBuf.size());
+    }
+    //-----------------------------------------------------------------------------
+    void MusicStream::beginFadeIn(float fadeIn)
+    {
+        mFadeSpd = Math::clamp(fadeIn,0.0f,1.0f);
+        if (mFadeSpd == 0.0f) {
+            mFadeVolume = 1.0f;
+            mFade = MF_NO_FADE;
         } else {
-            format = AL_FORMAT_STEREO16;
+            mFadeVolume = 0.0f;
+            mFade = MF_FADE_IN;
+        }
+    }
+    //-----------------------------------------------------------------------------
+    bool MusicStream::checkChain()
+    {
+        if (mQueuedChunks.empty() || !mQueuedChunks.front().first)
+        {
+            return true;
+        }
+
+        // _preload() dropped the chained music after it was queued, so it
+        // must not be played; the AudioManager plays what it wants instead
+        if (!mChain.decoder)
+        {
+            _stop(0.0f);
+            mAudioMan->_streamEnded(false);
+            return false;
         }
 
-        // Fills an OpenAL audio data buffer with our
-        // just decompressed audio data
-        alBufferData(buffer,format,data,offset,mFile.vi->rate);
-        mAudioMan->_alErrorCheck("MusicStream::pullStream()",
-                "Could not fill OpenAL audio buffer");
+        mQueuedChunks.front().first = false;
+
+        // The chained music has started playing: it is the current one now
+        delete mDecoder;
+        mDecoder = mChain.decoder;
+        mChain.decoder = NULL;
+
+        mMusic          = mChain.music;
+        mLoop           = mChain.loop;
+        mEndQueued      = mChainEndQueued;
+        mChainEndQueued = false;
+        mState          = (mEndQueued ? MSS_ENDED : MSS_IDLE);
+
+        beginFadeIn(mChain.fadeIn);
+
+        mAudioMan->_streamEnded(true);
+        return true;
     }
 } // namespace
 
@@ -0,0 +1,425 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+
+#include <OgreRoot.h>
+#include <OgreImage.h>
+#include <OgreFrustum.h>
+#include <OgreDefaultHardwareBufferManager.h>
+#include "SonettoException.h"
+#include "SonettoNullRenderSystem.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Sonetto::NullRenderWindow implementation
+    // ----------------------------------------------------------------------
+    void NullRenderWindow::create(const Ogre::String &name,unsigned int width,
+            unsigned int height,bool fullScreen,
+            const Ogre::NameValuePairList *miscParams)
+    {
+        mName = name;
+        mWidth = width;
+        mHeight = height;
+        mColourDepth = 32;
+        mIsFullScreen = fullScreen;
+        mActive = true;
+        mClosed = false;
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderWindow::setFullscreen(bool fullScreen,unsigned int width,
+            unsigned int height)
+    {
+        mIsFullScreen = fullScreen;
+        resize(width,height);
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderWindow::destroy()
+    {
+        mActive = false;
+        mClosed = true;
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderWindow::resize(unsigned int width,unsigned int height)
+    {
+        mWidth = width;
+        mHeight = height;
+
+        // Viewports are relative to the window size
+        for (ViewportList::iterator i = mViewportList.begin();
+                i != mViewportList.end();++i)
+        {
+            i->second->_updateDimensions();
+        }
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderWindow::copyContentsToMemory(const Ogre::PixelBox &dst,
+            FrameBuffer buffer)
+    {
+        SONETTO_THROW("Null render windows have no contents to be copied");
+    }
+    // ----------------------------------------------------------------------
+    // Sonetto::NullPixelBuffer implementation
+    // ----------------------------------------------------------------------
+    NullPixelBuffer::NullPixelBuffer(size_t width,size_t height,size_t depth,
+            Ogre::PixelFormat format,Ogre::HardwareBuffer::Usage usage)
+            : Ogre::HardwarePixelBuffer(width,height,depth,format,usage,
+              false,false), mLockData(NULL) {}
+    // ----------------------------------------------------------------------
+    NullPixelBuffer::~NullPixelBuffer()
+    {
+        delete[] mLockData;
+    }
+    // ----------------------------------------------------------------------
+    Ogre::PixelBox NullPixelBuffer::lockImpl(const Ogre::Image::Box lockBox,
+            LockOptions options)
+    {
+        // Box coordinates are relative to the whole buffer, so the scratch
+        // memory has its size even if only part of it is locked
+        mLockData = new Ogre::uint8[mSizeInBytes];
+        return Ogre::PixelBox(mWidth,mHeight,mDepth,mFormat,mLockData).
+                getSubVolume(lockBox);
+    }
+    // ----------------------------------------------------------------------
+    void NullPixelBuffer::unlockImpl()
+    {
+        delete[] mLockData;
+        mLockData = NULL;
+    }
+    // ----------------------------------------------------------------------
+    // Sonetto::NullTexture implementation
+    // ----------------------------------------------------------------------
+    NullTexture::NullTexture(Ogre::ResourceManager *creator,
+            const Ogre::String &name,Ogre::ResourceHandle handle,
+            const Ogre::String &group,bool isManual,
+            Ogre::ManualResourceLoader *loader)
+            : Ogre::Texture(creator,name,handle,group,isManual,loader) {}
+    // ----------------------------------------------------------------------
+    NullTexture::~NullTexture()
+    {
+        // Must be done here, while unloadImpl() is still ours
+        if (isLoaded()) {
+            unload();
+        } else {
+            freeInternalResources();
+        }
+    }
+    // ----------------------------------------------------------------------
+    Ogre::HardwarePixelBufferSharedPtr NullTexture::getBuffer(size_t face,
+            size_t mipmap)
+    {
+        if (face >= getNumFaces() || mipmap > mNumMipmaps)
+        {
+            SONETTO_THROW("Texture face or mipmap level out of range");
+        }
+
+        return mSurfaces[face * (mNumMipmaps + 1) + mipmap];
+    }
+    // ----------------------------------------------------------------------
+    void NullTexture::loadImpl()
+    {
+        static const char *cubeSuffixes[6] = {
+                "_rt","_lf","_up","_dn","_fr","_bk" };
+        std::vector<Ogre::Image> images;
+        Ogre::ConstImagePtrList imagePtrs;
+        size_t extPos = mName.find_last_of('.');
+        Ogre::String ext;
+
+        if (extPos != Ogre::String::npos)
+        {
+            ext = mName.substr(extPos);
+            Ogre::StringUtil::toLowerCase(ext);
+        }
+
+        // Like in Ogre's own render systems, cube maps not in a single DDS
+        // file come in six files, one per face
+        if (mTextureType == Ogre::TEX_TYPE_CUBE_MAP && !ext.empty() &&
+                ext != ".dds") {
+            images.resize(6);
+            for (size_t i = 0;i < images.size();++i)
+            {
+                images[i].load(mName.substr(0,extPos) + cubeSuffixes[i] +
+                        mName.substr(extPos),mGroup);
+            }
+        } else {
+            images.resize(1);
+            images[0].load(mName,mGroup);
+        }
+
+        for (size_t i = 0;i < images.size();++i)
+        {
+            imagePtrs.push_back(&images[i]);
+        }
+
+        // Sets the texture's size and format, then "uploads" the pixels
+        _loadImages(imagePtrs);
+    }
+    // ----------------------------------------------------------------------
+    void NullTexture::unloadImpl()
+    {
+        freeInternalResources();
+    }
+    // ----------------------------------------------------------------------
+    void NullTexture::createInternalResourcesImpl()
+    {
+        mSurfaces.clear();
+
+        for (size_t face = 0;face < getNumFaces();++face)
+        {
+            size_t width = mWidth,height = mHeight,depth = mDepth;
+
+            for (size_t mip = 0;mip <= mNumMipmaps;++mip)
+            {
+                mSurfaces.push_back(Ogre::HardwarePixelBufferSharedPtr(
+                        new NullPixelBuffer(width,height,depth,mFormat,
+                        static_cast<Ogre::HardwareBuffer::Usage>(mUsage))));
+
+                width = (width > 1 ? width / 2 : 1);
+                height = (height > 1 ? height / 2 : 1);
+                depth = (depth > 1 ? depth / 2 : 1);
+            }
+        }
+    }
+    // ----------------------------------------------------------------------
+    void NullTexture::freeInternalResourcesImpl()
+    {
+        mSurfaces.clear();
+    }
+    // ----------------------------------------------------------------------
+    // Sonetto::NullTextureManager implementation
+    // ----------------------------------------------------------------------
+    NullTextureManager::NullTextureManager()
+    {
+        // Registers the resource manager with Ogre
+        Ogre::ResourceGroupManager::getSingleton()._registerResourceManager(
+                mResourceType,this);
+    }
+    // ----------------------------------------------------------------------
+    NullTextureManager::~NullTextureManager()
+    {
+        // Unregisters the resource manager
+        Ogre::ResourceGroupManager::getSingleton().
+                _unregisterResourceManager(mResourceType);
+    }
+    // ----------------------------------------------------------------------
+    Ogre::Resource *NullTextureManager::createImpl(const Ogre::String &name,
+            Ogre::ResourceHandle handle,const Ogre::String &group,
+            bool isManual,Ogre::ManualResourceLoader *loader,
+            const Ogre::NameValuePairList *createParams)
+    {
+        return new NullTexture(this,name,handle,group,isManual,loader);
+    }
+    // ----------------------------------------------------------------------
+    // Sonetto::NullRenderSystem implementation
+    // ----------------------------------------------------------------------
+    NullRenderSystem::NullRenderSystem()
+            : mHardwareBufferManager(NULL), mTextureManager(NULL) {}
+    // ----------------------------------------------------------------------
+    NullRenderSystem::~NullRenderSystem()
+    {
+        shutdown();
+    }
+    // ----------------------------------------------------------------------
+    const Ogre::String &NullRenderSystem::getName() const
+    {
+        static Ogre::String name = "Sonetto Null Rendering Subsystem";
+        return name;
+    }
+    // ----------------------------------------------------------------------
+    Ogre::RenderWindow *NullRenderSystem::_initialise(bool autoCreateWindow,
+            const Ogre::String &windowTitle)
+    {
+        Ogre::RenderWindow *window = NULL;
+
+        Ogre::RenderSystem::_initialise(autoCreateWindow,windowTitle);
+
+        // reinitialise() comes through here again
+        delete mRealCapabilities;
+        mRealCapabilities = createRenderSystemCapabilities();
+        mCurrentCapabilities = mRealCapabilities;
+
+        // Other render systems create these along with their first window,
+        // but there is no device to wait for here
+        mHardwareBufferManager = new Ogre::DefaultHardwareBufferManager();
+        mTextureManager = new NullTextureManager();
+
+        if (autoCreateWindow)
+        {
+            window = _createRenderWindow(windowTitle,800,600,false);
+        }
+
+        return window;
+    }
+    // ----------------------------------------------------------------------
+    Ogre::RenderSystemCapabilities *
+            NullRenderSystem::createRenderSystemCapabilities() const
+    {
+        Ogre::RenderSystemCapabilities *caps =
+                new Ogre::RenderSystemCapabilities();
+
+        // Materials never need to be split into more passes
+        caps->setNumTextureUnits(OGRE_MAX_TEXTURE_LAYERS);
+
+        return caps;
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderSystem::reinitialise()
+    {
+        shutdown();
+        _initialise(true);
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderSystem::shutdown()
+    {
+        // Destroys render targets
+        Ogre::RenderSystem::shutdown();
+
+        delete mTextureManager;
+        mTextureManager = NULL;
+
+        delete mHardwareBufferManager;
+        mHardwareBufferManager = NULL;
+    }
+    // ----------------------------------------------------------------------
+    Ogre::RenderWindow *NullRenderSystem::_createRenderWindow(
+            const Ogre::String &name,unsigned int width,unsigned int height,
+            bool fullScreen,const Ogre::NameValuePairList *miscParams)
+    {
+        NullRenderWindow *window;
+
+        if (mRenderTargets.find(name) != mRenderTargets.end())
+        {
+            SONETTO_THROW("A render target named \"" + name + "\" already "
+                    "exists");
+        }
+
+        window = new NullRenderWindow();
+        window->create(name,width,height,fullScreen,miscParams);
+        attachRenderTarget(*window);
+
+        return window;
+    }
+    // ----------------------------------------------------------------------
+    Ogre::MultiRenderTarget *NullRenderSystem::createMultiRenderTarget(
+            const Ogre::String &name)
+    {
+        SONETTO_THROW("NullRenderSystem does not support multiple render "
+                "targets");
+    }
+    // ----------------------------------------------------------------------
+    Ogre::HardwareOcclusionQuery *
+            NullRenderSystem::createHardwareOcclusionQuery()
+    {
+        SONETTO_THROW("NullRenderSystem does not support occlusion queries");
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderSystem::_convertProjectionMatrix(
+            const Ogre::Matrix4 &matrix,Ogre::Matrix4 &dest,
+            bool forGpuProgram)
+    {
+        // Matrices are kept in Ogre's (OpenGL's) convention
+        dest = matrix;
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderSystem::_makeProjectionMatrix(const Ogre::Radian &fovy,
+            Ogre::Real aspect,Ogre::Real nearPlane,Ogre::Real farPlane,
+            Ogre::Matrix4 &dest,bool forGpuProgram)
+    {
+        Ogre::Real top = Ogre::Math::Tan(fovy * 0.5f) * nearPlane;
+        Ogre::Real right = top * aspect;
+
+        _makeProjectionMatrix(-right,right,-top,top,nearPlane,farPlane,dest,
+                forGpuProgram);
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderSystem::_makeProjectionMatrix(Ogre::Real left,
+            Ogre::Real right,Ogre::Real bottom,Ogre::Real top,
+            Ogre::Real nearPlane,Ogre::Real farPlane,Ogre::Matrix4 &dest,
+            bool forGpuProgram)
+    {
+        Ogre::Real q,qn;
+
+        // Same as glFrustum(); a far plane at zero means infinity
+        if (farPlane == 0) {
+            q = Ogre::Frustum::INFINITE_FAR_PLANE_ADJUST - 1;
+            qn = nearPlane * (Ogre::Frustum::INFINITE_FAR_PLANE_ADJUST - 2);
+        } else {
+            q = -(farPlane + nearPlane) / (farPlane - nearPlane);
+            qn = -2 * (farPlane * nearPlane) / (farPlane - nearPlane);
+        }
+
+        dest = Ogre::Matrix4::ZERO;
+        dest[0][0] = 2 * nearPlane / (right - left);
+        dest[0][2] = (right + left) / (right - left);
+        dest[1][1] = 2 * nearPlane / (top - bottom);
+        dest[1][2] = (top + bottom) / (top - bottom);
+        dest[2][2] = q;
+        dest[2][3] = qn;
+        dest[3][2] = -1;
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderSystem::_makeOrthoMatrix(const Ogre::Radian &fovy,
+            Ogre::Real aspect,Ogre::Real nearPlane,Ogre::Real farPlane,
+            Ogre::Matrix4 &dest,bool forGpuProgram)
+    {
+        Ogre::Real top = Ogre::Math::Tan(fovy * 0.5f) * nearPlane;
+        Ogre::Real right = top * aspect;
+        Ogre::Real q = (farPlane == 0 ? 0 : 2 / (farPlane - nearPlane));
+
+        // Same as glOrtho()
+        dest = Ogre::Matrix4::ZERO;
+        dest[0][0] = 1 / right;
+        dest[1][1] = 1 / top;
+        dest[2][2] = -q;
+        dest[2][3] = (farPlane == 0 ? -1 :
+                -(farPlane + nearPlane) / (farPlane - nearPlane));
+        dest[3][3] = 1;
+    }
+    // ----------------------------------------------------------------------
+    // Sonetto::NullRenderSystemPlugin implementation
+    // ----------------------------------------------------------------------
+    const Ogre::String &NullRenderSystemPlugin::getName() const
+    {
+        static Ogre::String name = "Sonetto Null RenderSystem";
+        return name;
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderSystemPlugin::install()
+    {
+        mRenderSystem = new NullRenderSystem();
+        Ogre::Root::getSingleton().addRenderSystem(mRenderSystem);
+    }
+    // ----------------------------------------------------------------------
+    void NullRenderSystemPlugin::uninstall()
+    {
+        delete mRenderSystem;
+        mRenderSystem = NULL;
+    }
+} // namespace
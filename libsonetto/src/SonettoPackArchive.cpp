@@ -0,0 +1,354 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#include <sys/stat.h>
+#include <OgreDataStream.h>
+#include <OgreString.h>
+#include "SonettoPackArchive.h"
+#include "SonettoPackBlockStream.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Sonetto::PackArchive implementation
+    // ----------------------------------------------------------------------
+    PackArchive::PackArchive(const Ogre::String &name,
+            const Ogre::String &archType)
+            : Ogre::Archive(name,archType), mHeader(NULL), mSlots(NULL),
+              mEntries(NULL), mNames(NULL) {}
+    // ----------------------------------------------------------------------
+    PackArchive::~PackArchive()
+    {
+        unload();
+    }
+    // ----------------------------------------------------------------------
+    void PackArchive::load()
+    {
+        size_t tocSize;
+        uint32 usedSlots = 0;
+
+        mFile.open(mName);
+
+        // Checks header
+        if (mFile.getSize() < sizeof(PackHeader))
+        {
+            unload();
+            SONETTO_THROW(mName + " is not a pack file");
+        }
+
+        mHeader = reinterpret_cast<const PackHeader *>(mFile.getData());
+        if (mHeader->fourCC != PACK_FOURCC)
+        {
+            unload();
+            SONETTO_THROW(mName + " is not a pack file");
+        }
+
+        if (mHeader->version != PACK_VERSION)
+        {
+            unload();
+            SONETTO_THROW(mName + " was made by an incompatible archiver "
+                    "version");
+        }
+
+        // findEntry() only stops probing at an empty slot, so there must
+        // be more slots than entries (the format asks for twice as many)
+        if (mHeader->slotCount == 0 ||
+                (mHeader->slotCount & (mHeader->slotCount - 1)) != 0 ||
+                mHeader->slotCount / 2 < mHeader->entryCount ||
+                mHeader->blockSize == 0)
+        {
+            unload();
+            SONETTO_THROW(mName + " has an invalid table of contents");
+        }
+
+        // Checks that the table of contents and the names are inside the
+        // file (bounding the counts first, so that the sum cannot wrap
+        // around), and that every entry points inside it too
+        if (mHeader->slotCount > mFile.getSize() / sizeof(uint32) ||
+                mHeader->entryCount > mFile.getSize() / sizeof(PackEntry))
+        {
+            unload();
+            SONETTO_THROW(mName + " is truncated");
+        }
+
+        tocSize = sizeof(PackHeader) + mHeader->slotCount * sizeof(uint32) +
+                mHeader->entryCount * sizeof(PackEntry);
+        if (tocSize > mHeader->namesOffset ||
+                (size_t)(mHeader->namesOffset) + mHeader->namesSize >
+                mFile.getSize())
+        {
+            unload();
+            SONETTO_THROW(mName + " is truncated");
+        }
+
+        mSlots = reinterpret_cast<const uint32 *>(mFile.getData() +
+                sizeof(PackHeader));
+        mEntries = reinterpret_cast<const PackEntry *>(mSlots +
+                mHeader->slotCount);
+        mNames = mFile.getData() + mHeader->namesOffset;
+
+        // Every slot must be empty or point at an entry, and there must be
+        // no more used slots than entries, so that some slot is empty
+        for (uint32 i = 0;i < mHeader->slotCount;++i)
+        {
+            if (mSlots[i] > mHeader->entryCount)
+            {
+                unload();
+                SONETTO_THROW(mName + " has an invalid table of contents");
+            }
+
+            if (mSlots[i] != 0)
+            {
+                ++usedSlots;
+            }
+        }
+
+        if (usedSlots > mHeader->entryCount)
+        {
+            unload();
+            SONETTO_THROW(mName + " has an invalid table of contents");
+        }
+
+        for (uint32 i = 0;i < mHeader->entryCount;++i)
+        {
+            const PackEntry &entry = mEntries[i];
+
+            if ((size_t)(entry.nameOffset) + entry.nameLength >
+                    mHeader->namesSize ||
+                    (size_t)(entry.offset) + entry.storedSize >
+                    mFile.getSize() ||
+                    (!(entry.flags & PACK_ENTRY_COMPRESSED) &&
+                    entry.storedSize != entry.size))
+            {
+                unload();
+                SONETTO_THROW(mName + " is truncated");
+            }
+        }
+    }
+    // ----------------------------------------------------------------------
+    void PackArchive::unload()
+    {
+        mFile.close();
+
+        mHeader = NULL;
+        mSlots = NULL;
+        mEntries = NULL;
+        mNames = NULL;
+    }
+    // ----------------------------------------------------------------------
+    Ogre::DataStreamPtr PackArchive::open(const Ogre::String &filename) const
+    {
+        const PackEntry *entry = findEntry(filename);
+
+        if (!entry)
+        {
+            SONETTO_THROW("Could not find " + filename + " in " + mName);
+        }
+
+        if (entry->flags & PACK_ENTRY_COMPRESSED)
+        {
+            return Ogre::DataStreamPtr(new PackBlockStream(filename,
+                    mFile.getData() + entry->offset,*entry,
+                    mHeader->blockSize));
+        }
+
+        // The mapping is read only; MemoryDataStream only reads from it
+        return Ogre::DataStreamPtr(new Ogre::MemoryDataStream(filename,
+                const_cast<char *>(mFile.getData() + entry->offset),
+                entry->size,false));
+    }
+    // ----------------------------------------------------------------------
+    Ogre::StringVectorPtr PackArchive::list(bool recursive,bool dirs)
+    {
+        return find("",recursive,dirs);
+    }
+    // ----------------------------------------------------------------------
+    Ogre::FileInfoListPtr PackArchive::listFileInfo(bool recursive,bool dirs)
+    {
+        return findFileInfo("",recursive,dirs);
+    }
+    // ----------------------------------------------------------------------
+    Ogre::StringVectorPtr PackArchive::find(const Ogre::String &pattern,
+            bool recursive,bool dirs)
+    {
+        Ogre::StringVectorPtr names(new Ogre::StringVector());
+
+        // There are no directories in packs
+        if (!dirs)
+        {
+            findEntries(pattern,recursive,names.getPointer(),NULL);
+        }
+
+        return names;
+    }
+    // ----------------------------------------------------------------------
+    Ogre::FileInfoListPtr PackArchive::findFileInfo(
+            const Ogre::String &pattern,bool recursive,bool dirs)
+    {
+        Ogre::FileInfoListPtr infos(new Ogre::FileInfoList());
+
+        if (!dirs)
+        {
+            findEntries(pattern,recursive,NULL,infos.getPointer());
+        }
+
+        return infos;
+    }
+    // ----------------------------------------------------------------------
+    bool PackArchive::exists(const Ogre::String &filename)
+    {
+        return findEntry(filename) != NULL;
+    }
+    // ----------------------------------------------------------------------
+    time_t PackArchive::getModifiedTime(const Ogre::String &filename)
+    {
+        struct stat info;
+
+        // Packed files are as old as the pack
+        if (stat(mName.c_str(),&info) != 0)
+        {
+            return 0;
+        }
+
+        return info.st_mtime;
+    }
+    // ----------------------------------------------------------------------
+    bool PackArchive::getEntryRange(const Ogre::String &filename,
+            size_t &offset,size_t &size) const
+    {
+        const PackEntry *entry = findEntry(filename);
+
+        if (!entry)
+        {
+            return false;
+        }
+
+        offset = entry->offset;
+        size = entry->storedSize;
+        return true;
+    }
+    // ----------------------------------------------------------------------
+    const PackEntry *PackArchive::findEntry(
+            const Ogre::String &filename) const
+    {
+        uint32 hash,mask,slot;
+
+        if (!mHeader)
+        {
+            return NULL;
+        }
+
+        hash = packHash(filename.c_str(),filename.size());
+        mask = mHeader->slotCount - 1;
+
+        // Probes from the hashed slot until an empty one
+        for (slot = hash & mask;mSlots[slot] != 0;slot = (slot + 1) & mask)
+        {
+            const PackEntry &entry = mEntries[mSlots[slot] - 1];
+
+            if (entry.hash == hash && entry.nameLength == filename.size())
+            {
+                const char *name = mNames + entry.nameOffset;
+                size_t i;
+
+                for (i = 0;i < entry.nameLength;++i)
+                {
+                    if (name[i] != packNormaliseChar(filename[i]))
+                    {
+                        break;
+                    }
+                }
+
+                if (i == entry.nameLength)
+                {
+                    return &entry;
+                }
+            }
+        }
+
+        return NULL;
+    }
+    // ----------------------------------------------------------------------
+    void PackArchive::findEntries(const Ogre::String &pattern,
+            bool recursive,Ogre::StringVector *names,
+            Ogre::FileInfoList *infos)
+    {
+        bool fullMatch = (pattern.find_first_of("/\\") != Ogre::String::npos);
+
+        if (!mHeader)
+        {
+            return;
+        }
+
+        for (uint32 i = 0;i < mHeader->entryCount;++i)
+        {
+            Ogre::String name = getEntryName(mEntries[i]);
+            Ogre::String baseName,path;
+
+            Ogre::StringUtil::splitFilename(name,baseName,path);
+            if (!recursive && !path.empty())
+            {
+                continue;
+            }
+
+            if (!pattern.empty() && !Ogre::StringUtil::match(
+                    fullMatch ? name : baseName,pattern,false))
+            {
+                continue;
+            }
+
+            if (names)
+            {
+                names->push_back(name);
+            }
+
+            if (infos)
+            {
+                Ogre::FileInfo info;
+
+                info.archive = this;
+                info.filename = name;
+                info.basename = baseName;
+                info.path = path;
+                info.compressedSize = mEntries[i].storedSize;
+                info.uncompressedSize = mEntries[i].size;
+                infos->push_back(info);
+            }
+        }
+    }
+    // ----------------------------------------------------------------------
+    // Sonetto::PackArchiveFactory implementation
+    // ----------------------------------------------------------------------
+    const Ogre::String &PackArchiveFactory::getType() const
+    {
+        static Ogre::String type = "Pack";
+        return type;
+    }
+} // namespace
@@ -0,0 +1,225 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#include <cstring>
+#include "SonettoPackBlockStream.h"
+#include "SonettoJobSystem.h"
+#include "SonettoLZ4.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    /// Reads spanning at least this many blocks are decoded in parallel
+    static const size_t PACK_PARALLEL_MIN_BLOCKS = 4;
+    // ----------------------------------------------------------------------
+    /// JobSystem::parallelFor() functor decoding blocks into a buffer
+    struct PackBlockDecoder
+    {
+        const PackBlockStream *stream;
+        size_t firstBlock;
+        size_t blockSize;
+        char *dest;
+        volatile bool failed;
+
+        void operator()(size_t begin,size_t end)
+        {
+            for (size_t i = begin;i < end;++i)
+            {
+                if (!stream->decodeBlock(i,dest + (i - firstBlock) * blockSize))
+                {
+                    failed = true;
+                }
+            }
+        }
+    };
+    // ----------------------------------------------------------------------
+    // Sonetto::PackBlockStream implementation
+    // ----------------------------------------------------------------------
+    PackBlockStream::PackBlockStream(const Ogre::String &name,
+            const char *data,const PackEntry &entry,uint32 blockSize)
+            : Ogre::DataStream(name), mBlockSizes(NULL), mBlocks(NULL),
+              mBlockSize(blockSize), mPos(0), mCachedBlock(0)
+    {
+        size_t blockCount = packBlockCount(entry.size,blockSize);
+        size_t tableSize = blockCount * sizeof(uint32);
+
+        mSize = entry.size;
+
+        if (tableSize > entry.storedSize)
+        {
+            SONETTO_THROW(name + " is corrupt");
+        }
+
+        mBlockSizes = reinterpret_cast<const uint32 *>(data);
+        mBlocks = data + tableSize;
+
+        // Checks that every block is inside the entry
+        mBlockOffsets.resize(blockCount + 1);
+        mBlockOffsets[0] = 0;
+        for (size_t i = 0;i < blockCount;++i)
+        {
+            mBlockOffsets[i + 1] = mBlockOffsets[i] +
+                    (mBlockSizes[i] & ~PACK_BLOCK_UNCOMPRESSED);
+
+            if (mBlockOffsets[i + 1] > entry.storedSize - tableSize)
+            {
+                SONETTO_THROW(name + " is corrupt");
+            }
+        }
+
+        mCachedBlock = blockCount;
+    }
+    // ----------------------------------------------------------------------
+    size_t PackBlockStream::read(void *buf,size_t count)
+    {
+        char *dest = static_cast<char *>(buf);
+        size_t total;
+
+        if (mPos >= mSize)
+        {
+            return 0;
+        }
+
+        if (count > mSize - mPos)
+        {
+            count = mSize - mPos;
+        }
+        total = count;
+
+        while (count > 0)
+        {
+            size_t block = mPos / mBlockSize;
+            size_t blockPos = mPos % mBlockSize;
+            size_t chunk;
+
+            // Whole blocks go straight to the caller
+            if (blockPos == 0)
+            {
+                size_t last = (mPos + count == mSize) ? getBlockCount() :
+                        (mPos + count) / mBlockSize;
+
+                if (last - block >= 2)
+                {
+                    decodeBlocks(block,last,dest);
+
+                    chunk = std::min(count,(last - block) * mBlockSize);
+                    dest += chunk;
+                    mPos += chunk;
+                    count -= chunk;
+                    continue;
+                }
+            }
+
+            if (mCachedBlock != block)
+            {
+                mCache.resize(mBlockSize);
+                if (!decodeBlock(block,&mCache[0]))
+                {
+                    mCachedBlock = getBlockCount();
+                    SONETTO_THROW(mName + " is corrupt");
+                }
+
+                mCachedBlock = block;
+            }
+
+            chunk = std::min(count,getUncompressedBlockSize(block) - blockPos);
+            memcpy(dest,&mCache[blockPos],chunk);
+            dest += chunk;
+            mPos += chunk;
+            count -= chunk;
+        }
+
+        return total;
+    }
+    // ----------------------------------------------------------------------
+    void PackBlockStream::skip(long count)
+    {
+        if (count < 0 && (size_t)(-count) > mPos) {
+            mPos = 0;
+        } else {
+            seek(mPos + count);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void PackBlockStream::seek(size_t pos)
+    {
+        mPos = std::min(pos,mSize);
+    }
+    // ----------------------------------------------------------------------
+    void PackBlockStream::close()
+    {
+        std::vector<char>().swap(mCache);
+        mCachedBlock = getBlockCount();
+    }
+    // ----------------------------------------------------------------------
+    bool PackBlockStream::decodeBlock(size_t index,char *dest) const
+    {
+        const char *src = mBlocks + mBlockOffsets[index];
+        size_t storedSize = mBlockOffsets[index + 1] - mBlockOffsets[index];
+        size_t size = getUncompressedBlockSize(index);
+
+        if (mBlockSizes[index] & PACK_BLOCK_UNCOMPRESSED)
+        {
+            if (storedSize != size)
+            {
+                return false;
+            }
+
+            memcpy(dest,src,size);
+            return true;
+        }
+
+        return lz4Decompress(src,storedSize,dest,size);
+    }
+    // ----------------------------------------------------------------------
+    void PackBlockStream::decodeBlocks(size_t first,size_t last,char *dest)
+    {
+        JobSystem *jobSystem = JobSystem::getSingletonPtr();
+        PackBlockDecoder decoder;
+
+        decoder.stream = this;
+        decoder.firstBlock = first;
+        decoder.blockSize = mBlockSize;
+        decoder.dest = dest;
+        decoder.failed = false;
+
+        if (jobSystem && jobSystem->getWorkerNum() > 0 &&
+                last - first >= PACK_PARALLEL_MIN_BLOCKS) {
+            jobSystem->parallelFor(first,last,1,decoder);
+        } else {
+            decoder(first,last);
+        }
+
+        if (decoder.failed)
+        {
+            SONETTO_THROW(mName + " is corrupt");
+        }
+    }
+} // namespace
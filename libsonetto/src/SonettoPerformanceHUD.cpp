@@ -0,0 +1,205 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#include <cstdio>
+#include <OgreOverlayManager.h>
+#include <OgrePanelOverlayElement.h>
+#include <OgreResourceGroupManager.h>
+#include "SonettoPerformanceHUD.h"
+#include "SonettoKernel.h"
+#include "SonettoFontManager.h"
+#include "SonettoStaticTextElement.h"
+#include "SonettoScriptManager.h"
+#include "SonettoAudioManager.h"
+#include "SonettoMemory.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Sonetto::PerformanceHUD implementation
+    // ----------------------------------------------------------------------
+    PerformanceHUD::PerformanceHUD(const std::string &fontName)
+            : mOverlay(NULL), mPanel(NULL), mTextElement(NULL),
+              mVisible(false), mElapsed(0.0f), mFrames(0),
+              mLastInstructions(0), mLastAllocations(0)
+    {
+        Ogre::OverlayManager &overlayMan =
+                Ogre::OverlayManager::getSingleton();
+        Ogre::PanelOverlayElement *panel;
+
+        mFont = FontManager::getSingleton().load(fontName,
+                Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME);
+
+        // Full screen panel with nothing but the text in it
+        panel = static_cast<Ogre::PanelOverlayElement *>(overlayMan.
+                createOverlayElement("Panel","Sonetto/PerformanceHUD/Panel"));
+        panel->setMetricsMode(Ogre::GMM_RELATIVE);
+        panel->setPosition(0.0f,0.0f);
+        panel->setDimensions(1.0f,1.0f);
+        panel->setTransparent(true);
+        mPanel = panel;
+
+        mTextElement = static_cast<StaticTextElement *>(overlayMan.
+                createOverlayElement("StaticText",
+                "Sonetto/PerformanceHUD/Text"));
+        mTextElement->setMetricsMode(Ogre::GMM_RELATIVE);
+        mTextElement->setPosition(0.01f,0.01f);
+        mTextElement->mpFont = mFont.getPointer();
+        mTextElement->mTextSize = Ogre::Vector2(0.035f,0.035f);
+
+        // Reserved up front, so that updating the text never allocates
+        mTextElement->mText.reserve(PERFORMANCE_HUD_TEXT_SIZE);
+        mBuffer[0] = '\0';
+
+        mPanel->addChild(mTextElement);
+
+        mOverlay = overlayMan.create("Sonetto/PerformanceHUD");
+        mOverlay->setZOrder(PERFORMANCE_HUD_ZORDER);
+        mOverlay->add2D(mPanel);
+        mOverlay->hide();
+    }
+    // ----------------------------------------------------------------------
+    PerformanceHUD::~PerformanceHUD()
+    {
+        Ogre::OverlayManager &overlayMan =
+                Ogre::OverlayManager::getSingleton();
+
+        mOverlay->remove2D(mPanel);
+        mPanel->removeChild(mTextElement->getName());
+
+        overlayMan.destroyOverlayElement(mTextElement);
+        overlayMan.destroyOverlayElement(mPanel);
+        overlayMan.destroy(mOverlay);
+    }
+    // ----------------------------------------------------------------------
+    void PerformanceHUD::setVisible(bool visible)
+    {
+        size_t liveAllocations;
+
+        if (visible == mVisible)
+        {
+            return;
+        }
+
+        mVisible = visible;
+        if (mVisible) {
+            // Rates start over from here
+            sampleCounters(mLastInstructions,mLastAllocations,
+                    liveAllocations);
+            mElapsed = 0.0f;
+            mFrames = 0;
+
+            refresh();
+            mOverlay->show();
+        } else {
+            mOverlay->hide();
+        }
+    }
+    // ----------------------------------------------------------------------
+    void PerformanceHUD::update(float frameTime)
+    {
+        if (!mVisible)
+        {
+            return;
+        }
+
+        ++mFrames;
+        mElapsed += frameTime;
+        if (mElapsed >= PERFORMANCE_HUD_REFRESH_INTERVAL)
+        {
+            refresh();
+
+            mElapsed = 0.0f;
+            mFrames = 0;
+        }
+    }
+    // ----------------------------------------------------------------------
+    void PerformanceHUD::refresh()
+    {
+        Kernel &kernel = Kernel::getSingleton();
+        AudioManager &audioMan = AudioManager::getSingleton();
+        FrameStats stats = kernel.getFrameStats();
+        unsigned long instructions;
+        size_t allocations,liveAllocations;
+        size_t frames = (mFrames > 0) ? mFrames : 1;
+        float musicFill = 0.0f;
+        size_t musicDepth = 0;
+        long musicUnderruns = 0;
+
+        sampleCounters(instructions,allocations,liveAllocations);
+
+        if (audioMan.isInitialised() && audioMan.getMusicStream())
+        {
+            musicFill = audioMan.getMusicStream()->getBufferFill();
+            musicDepth = audioMan.getMusicStream()->getQueueDepth();
+            musicUnderruns = audioMan.getMusicStream()->getUnderruns();
+        }
+
+        std::sprintf(mBuffer,
+                "Frame: %.2f ms avg, %.2f ms p99\n"
+                "FPS: %.1f\n"
+                "Script instructions/frame: %lu\n"
+                "Sound sources: %lu\n"
+                "Music buffers: %d%% of %lu (%ld underruns)\n"
+                "Allocations/frame: %lu (%lu live)\n"
+                "Module stack: %lu",
+                stats.average * 1000.0f,stats.percentile99 * 1000.0f,
+                (stats.average > 0.0f) ? 1.0f / stats.average : 0.0f,
+                (unsigned long)((instructions - mLastInstructions) / frames),
+                (unsigned long)(audioMan.getActiveSoundSourceCount()),
+                (int)(musicFill * 100.0f),(unsigned long)(musicDepth),
+                musicUnderruns,
+                (unsigned long)((allocations - mLastAllocations) / frames),
+                (unsigned long)(liveAllocations),
+                (unsigned long)(kernel.getModuleStackSize()));
+
+        // Fits in the reserved capacity; does not allocate
+        mTextElement->mText.assign(mBuffer);
+
+        mLastInstructions = instructions;
+        mLastAllocations = allocations;
+    }
+    // ----------------------------------------------------------------------
+    void PerformanceHUD::sampleCounters(unsigned long &instructions,
+            size_t &allocations,size_t &liveAllocations) const
+    {
+        instructions = ScriptManager::getSingleton().getInstructionCount();
+
+        allocations = liveAllocations = 0;
+        for (size_t i = 0;i < MEMTAG_COUNT;++i)
+        {
+            MemoryTagStats tagStats =
+                    MemoryTracker::getStats(static_cast<MemoryTag>(i));
+
+            allocations += tagStats.totalAllocations;
+            liveAllocations += tagStats.allocations;
+        }
+    }
+} // namespace
@@ -0,0 +1,470 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifdef WINDOWS
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/resource.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+#include <fstream>
+#include <OgreLogManager.h>
+#include <OgreResourceGroupManager.h>
+#include <OgreStringConverter.h>
+#include "SonettoPrefetchManager.h"
+#include "SonettoPackArchive.h"
+#include "SonettoMetrics.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    /// First line of manifest files
+    static const char * const PREFETCH_MANIFEST_HEADER = "SonettoPrefetch 1";
+    // ----------------------------------------------------------------------
+    // Sonetto::PrefetchManager implementation
+    // ----------------------------------------------------------------------
+    SONETTO_SINGLETON_IMPLEMENT(PrefetchManager);
+    // ----------------------------------------------------------------------
+    PrefetchManager::PrefetchManager()
+            : mRecording(false), mMutex(NULL), mWake(NULL), mThread(NULL),
+              mStop(false), mPrefetchedBytes(NULL)
+    {
+        mMutex = SDL_CreateMutex();
+        if (!mMutex)
+        {
+            SONETTO_THROW("Could not create prefetch manager mutex");
+        }
+
+        mPrefetchedBytes = MetricsRegistry::getSingleton().
+                getCounter("prefetch_bytes");
+    }
+    // ----------------------------------------------------------------------
+    PrefetchManager::~PrefetchManager()
+    {
+        if (mThread)
+        {
+            mStop = true;
+            SDL_SemPost(mWake);
+            SDL_WaitThread(mThread,NULL);
+        }
+
+        if (mWake)
+        {
+            SDL_DestroySemaphore(mWake);
+        }
+
+        stopRecording();
+        SDL_DestroyMutex(mMutex);
+    }
+    // ----------------------------------------------------------------------
+    bool PrefetchManager::loadManifest(const std::string &fileName)
+    {
+        std::ifstream file(fileName.c_str());
+        std::string line;
+
+        if (mThread)
+        {
+            SONETTO_THROW("A prefetch manifest was already loaded");
+        }
+
+        if (!std::getline(file,line) || line != PREFETCH_MANIFEST_HEADER)
+        {
+            return false;
+        }
+
+        mManifest.clear();
+        while (std::getline(file,line))
+        {
+            ManifestEntry entry;
+            size_t tab = line.find('\t');
+
+            if (tab == std::string::npos)
+            {
+                continue;
+            }
+
+            entry.name = line.substr(tab + 1);
+            line.erase(tab);
+
+            if (line == "module") {
+                entry.type = ET_MODULE;
+            } else if (line == "file") {
+                entry.type = ET_FILE;
+            } else if (line == "resource") {
+                // Groups cannot hold tabs; names might
+                tab = entry.name.find('\t');
+                if (tab == std::string::npos)
+                {
+                    continue;
+                }
+
+                entry.type = ET_RESOURCE;
+                entry.group = entry.name.substr(0,tab);
+                entry.name.erase(0,tab + 1);
+            } else {
+                continue;
+            }
+
+            mManifest.push_back(entry);
+        }
+
+        mWake = SDL_CreateSemaphore(0);
+        if (!mWake)
+        {
+            SONETTO_THROW("Could not create prefetch semaphore");
+        }
+
+        mThread = SDL_CreateThread(prefetchThread,this);
+        if (!mThread)
+        {
+            SONETTO_THROW("Could not create prefetch thread");
+        }
+
+        Ogre::LogManager::getSingleton().logMessage("Loaded prefetch "
+                "manifest " + fileName + " (" + Ogre::StringConverter::
+                toString(mManifest.size()) + " entries)");
+
+        // Files read before the first module was loaded
+        queueSegments("");
+        return true;
+    }
+    // ----------------------------------------------------------------------
+    void PrefetchManager::startRecording(const std::string &fileName)
+    {
+        SDL_mutexP(mMutex);
+        mRecordFileName = fileName;
+        mRecorded.clear();
+        mRecordedKeys.clear();
+        mRecording = true;
+        SDL_mutexV(mMutex);
+    }
+    // ----------------------------------------------------------------------
+    void PrefetchManager::stopRecording()
+    {
+        std::ofstream file;
+
+        if (!mRecording)
+        {
+            return;
+        }
+
+        SDL_mutexP(mMutex);
+        mRecording = false;
+
+        file.open(mRecordFileName.c_str(),std::ios_base::out |
+                std::ios_base::trunc);
+        if (file.is_open())
+        {
+            file << PREFETCH_MANIFEST_HEADER << '\n';
+            for (size_t i = 0;i < mRecorded.size();++i)
+            {
+                const ManifestEntry &entry = mRecorded[i];
+
+                switch (entry.type)
+                {
+                    case ET_MODULE:
+                        file << "module\t" << entry.name << '\n';
+                    break;
+
+                    case ET_RESOURCE:
+                        file << "resource\t" << entry.group << '\t' <<
+                                entry.name << '\n';
+                    break;
+
+                    case ET_FILE:
+                        file << "file\t" << entry.name << '\n';
+                    break;
+                }
+            }
+        }
+        SDL_mutexV(mMutex);
+
+        if (!file.is_open())
+        {
+            Ogre::LogManager::getSingleton().logMessage("Could not write "
+                    "prefetch manifest " + mRecordFileName);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void PrefetchManager::recordResource(const std::string &name,
+            const std::string &group)
+    {
+        if (mRecording)
+        {
+            record(ET_RESOURCE,group,name);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void PrefetchManager::recordFile(const std::string &path)
+    {
+        if (mRecording)
+        {
+            record(ET_FILE,"",path);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void PrefetchManager::moduleChanged(Module::ModuleType type)
+    {
+        std::string typeName = Ogre::StringConverter::toString(
+                static_cast<int>(type));
+
+        if (mRecording)
+        {
+            SDL_mutexP(mMutex);
+
+            // Segments left empty are reused
+            if (!mRecorded.empty() && mRecorded.back().type == ET_MODULE)
+            {
+                mRecorded.pop_back();
+            }
+
+            ManifestEntry entry;
+            entry.type = ET_MODULE;
+            entry.name = typeName;
+            mRecorded.push_back(entry);
+
+            SDL_mutexV(mMutex);
+        }
+
+        if (mThread)
+        {
+            queueSegments(typeName);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void PrefetchManager::queueSegments(const std::string &typeName)
+    {
+        PrefetchRangeDeque ranges;
+        bool inSegment = typeName.empty();
+
+        // Gathers the files of every segment recorded for this module type
+        for (size_t i = 0;i < mManifest.size();++i)
+        {
+            const ManifestEntry &entry = mManifest[i];
+            PrefetchRange range;
+
+            if (entry.type == ET_MODULE) {
+                inSegment = (entry.name == typeName);
+            } else if (inSegment && resolve(entry,range)) {
+                ranges.push_back(range);
+            }
+        }
+
+        // Goes ahead of what is still queued for the previous module
+        SDL_mutexP(mMutex);
+        mQueue.insert(mQueue.begin(),ranges.begin(),ranges.end());
+        SDL_mutexV(mMutex);
+
+        for (size_t i = 0;i < ranges.size();++i)
+        {
+            SDL_SemPost(mWake);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void PrefetchManager::record(EntryType type,const std::string &group,
+            const std::string &name)
+    {
+        std::string key = group + '\t' + name;
+
+        SDL_mutexP(mMutex);
+        if (mRecording && mRecordedKeys.insert(key).second)
+        {
+            ManifestEntry entry;
+
+            entry.type = type;
+            entry.group = group;
+            entry.name = name;
+            mRecorded.push_back(entry);
+        }
+        SDL_mutexV(mMutex);
+    }
+    // ----------------------------------------------------------------------
+    bool PrefetchManager::resolve(const ManifestEntry &entry,
+            PrefetchRange &range) const
+    {
+        Ogre::FileInfoListPtr infos;
+        PackArchive *pack;
+
+        range.offset = 0;
+        range.size = 0;
+
+        if (entry.type == ET_FILE)
+        {
+            range.path = entry.name;
+            return true;
+        }
+
+        // The group may not exist anymore, or not yet
+        try {
+            infos = Ogre::ResourceGroupManager::getSingleton().
+                    findResourceFileInfo(entry.group,entry.name);
+        } catch (Ogre::Exception &) {
+            return false;
+        }
+
+        if (infos->empty())
+        {
+            return false;
+        }
+
+        const Ogre::FileInfo &info = infos->front();
+
+        pack = dynamic_cast<PackArchive *>(info.archive);
+        if (pack) {
+            range.path = pack->getName();
+            return pack->getEntryRange(info.filename,range.offset,range.size);
+        } else if (info.archive->getType() == "FileSystem") {
+            range.path = info.archive->getName() + "/" + info.filename;
+            return true;
+        }
+
+        // Other archives (Zip) would have to be read whole
+        return false;
+    }
+    // ----------------------------------------------------------------------
+    void PrefetchManager::prefetch(const PrefetchRange &range)
+    {
+#ifdef WINDOWS
+        // Windows has no readahead hint for files; they are read instead
+        static char buffer[256 * 1024];
+        HANDLE file = CreateFileA(range.path.c_str(),GENERIC_READ,
+                FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,
+                NULL);
+        LARGE_INTEGER offset;
+        size_t left = range.size;
+        DWORD bytesRead;
+
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        offset.QuadPart = range.offset;
+        if (!SetFilePointerEx(file,offset,NULL,FILE_BEGIN))
+        {
+            CloseHandle(file);
+            return;
+        }
+
+        // Reads in chunks, so that stopping is never held for long
+        while (!mStop && (range.size == 0 || left > 0))
+        {
+            DWORD chunk = sizeof(buffer);
+
+            if (range.size != 0 && left < chunk)
+            {
+                chunk = left;
+            }
+
+            if (!ReadFile(file,buffer,chunk,&bytesRead,NULL) ||
+                    bytesRead == 0)
+            {
+                break;
+            }
+
+            left -= (range.size != 0) ? bytesRead : 0;
+            mPrefetchedBytes->add(bytesRead);
+        }
+
+        CloseHandle(file);
+#else
+        int fd = open(range.path.c_str(),O_RDONLY);
+        size_t size = range.size;
+
+        if (fd < 0)
+        {
+            return;
+        }
+
+        if (size == 0)
+        {
+            struct stat info;
+
+            if (fstat(fd,&info) == 0)
+            {
+                size = info.st_size;
+            }
+        }
+
+        // Starts reading the range in the background, into the page cache
+        if (posix_fadvise(fd,range.offset,size,POSIX_FADV_WILLNEED) == 0)
+        {
+            mPrefetchedBytes->add(size);
+        }
+
+        close(fd);
+#endif
+    }
+    // ----------------------------------------------------------------------
+    int PrefetchManager::prefetchThread(void *data)
+    {
+        PrefetchManager *manager = static_cast<PrefetchManager *>(data);
+
+        // Prefetching is only a hint: a range read late costs a little
+        // loading time, while a thread competing with the game for the CPU
+        // costs frames. SDL 1.2 has no thread priorities, so they are set
+        // by hand; Linux nice values are per thread, so this one is reniced
+    #ifdef WINDOWS
+        SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_LOWEST);
+    #else
+        setpriority(PRIO_PROCESS,0,10);
+    #endif
+
+        for (;;)
+        {
+            PrefetchRange range;
+            bool queued;
+
+            SDL_SemWait(manager->mWake);
+            if (manager->mStop)
+            {
+                break;
+            }
+
+            SDL_mutexP(manager->mMutex);
+            queued = !manager->mQueue.empty();
+            if (queued)
+            {
+                range = manager->mQueue.front();
+                manager->mQueue.pop_front();
+            }
+            SDL_mutexV(manager->mMutex);
+
+            if (queued)
+            {
+                manager->prefetch(range);
+            }
+        }
+
+        return 0;
+    }
+} // namespace
@@ -0,0 +1,232 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#include "SonettoProfiler.h"
+
+#ifdef SONETTO_PROFILING
+
+#include <fstream>
+#include <SDL/SDL_thread.h>
+#ifdef WINDOWS
+#   include <windows.h>
+#else
+#   include <time.h>
+#endif
+
+// Thread local storage and memory barriers
+#ifdef _MSC_VER
+#   define SONETTO_THREAD_LOCAL __declspec(thread)
+#   define SONETTO_MEMORY_BARRIER() MemoryBarrier()
+#else
+#   define SONETTO_THREAD_LOCAL __thread
+#   define SONETTO_MEMORY_BARRIER() __sync_synchronize()
+#endif
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    // Calling thread's buffer (a Profiler::ThreadBuffer), and the
+    // generation of the Profiler that owns it
+    static SONETTO_THREAD_LOCAL void *sThreadBuffer = NULL;
+    static SONETTO_THREAD_LOCAL long sThreadBufferGeneration = 0;
+
+    // Last Profiler generation handed out
+    static AtomicCounter sGenerations;
+    // ----------------------------------------------------------------------
+    // Sonetto::Profiler implementation
+    // ----------------------------------------------------------------------
+    SONETTO_SINGLETON_IMPLEMENT(Profiler);
+    // ----------------------------------------------------------------------
+    Profiler::Profiler()
+            : mGeneration(sGenerations.increment())
+    {
+        mMutex = SDL_CreateMutex();
+        if (!mMutex)
+        {
+            SONETTO_THROW("Could not create profiler mutex");
+        }
+    }
+    // ----------------------------------------------------------------------
+    Profiler::~Profiler()
+    {
+        // Buffers are left dangling in their threads' storage; make sure
+        // markers in threads still running do not record into them (a
+        // later Profiler will not either, since its generation differs)
+        ms_Singleton = NULL;
+
+        for (size_t i = 0;i < mBuffers.size();++i)
+        {
+            delete mBuffers[i];
+        }
+
+        SDL_DestroyMutex(mMutex);
+    }
+    // ----------------------------------------------------------------------
+    void Profiler::_record(const char *name,unsigned long long start,
+            unsigned long long end)
+    {
+        ThreadBuffer *buffer = getThreadBuffer();
+        size_t writePos = buffer->writePos;
+
+        // Drops the event if the buffer is full
+        if (writePos - buffer->readPos >= BUFFER_CAPACITY)
+        {
+            buffer->dropped.increment();
+            return;
+        }
+
+        Event &event = buffer->events[writePos % BUFFER_CAPACITY];
+        event.name = name;
+        event.start = start;
+        event.end = end;
+
+        // Publishes the event only after it is completely written
+        SONETTO_MEMORY_BARRIER();
+        buffer->writePos = writePos + 1;
+    }
+    // ----------------------------------------------------------------------
+    bool Profiler::dump(const std::string &fileName)
+    {
+        std::ofstream file(fileName.c_str());
+        bool first = true;
+
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        SDL_mutexP(mMutex);
+
+        file << "{\"traceEvents\":[\n";
+        for (size_t i = 0;i < mBuffers.size();++i)
+        {
+            ThreadBuffer *buffer = mBuffers[i];
+            size_t readPos = buffer->readPos;
+            size_t writePos = buffer->writePos;
+
+            // Reads events only after reading where they end
+            SONETTO_MEMORY_BARRIER();
+
+            for (;readPos != writePos;++readPos)
+            {
+                const Event &event = buffer->events[readPos % BUFFER_CAPACITY];
+
+                if (!first)
+                {
+                    file << ",\n";
+                }
+                first = false;
+
+                file << "{\"name\":\"" << event.name << "\",\"ph\":\"X\","
+                        "\"pid\":0,\"tid\":" << buffer->threadNum <<
+                        ",\"ts\":" << event.start <<
+                        ",\"dur\":" << event.end - event.start << "}";
+            }
+
+            // Frees the slots only after they were read
+            SONETTO_MEMORY_BARRIER();
+            buffer->readPos = readPos;
+
+            // Takes away only what was counted, so drops racing with this
+            // are reported next time
+            long dropped = buffer->dropped.get();
+            if (dropped > 0)
+            {
+                buffer->dropped.add(-dropped);
+
+                if (!first)
+                {
+                    file << ",\n";
+                }
+                first = false;
+
+                // Instant event warning about lost markers
+                file << "{\"name\":\"Dropped " << dropped <<
+                        " events\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,"
+                        "\"tid\":" << buffer->threadNum << ",\"ts\":" <<
+                        getMicroseconds() << "}";
+            }
+        }
+        file << "\n]}\n";
+
+        SDL_mutexV(mMutex);
+
+        return file.good();
+    }
+    // ----------------------------------------------------------------------
+    unsigned long long Profiler::getMicroseconds()
+    {
+    #ifdef WINDOWS
+        static LARGE_INTEGER frequency = { { 0, 0 } };
+        LARGE_INTEGER counter;
+
+        if (frequency.QuadPart == 0)
+        {
+            QueryPerformanceFrequency(&frequency);
+        }
+
+        // Splits the conversion to avoid overflowing
+        QueryPerformanceCounter(&counter);
+        return (unsigned long long)(counter.QuadPart / frequency.QuadPart) *
+                1000000 + (unsigned long long)(counter.QuadPart %
+                frequency.QuadPart) * 1000000 / frequency.QuadPart;
+    #else
+        struct timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC,&now);
+        return (unsigned long long)(now.tv_sec) * 1000000 +
+                now.tv_nsec / 1000;
+    #endif
+    }
+    // ----------------------------------------------------------------------
+    Profiler::ThreadBuffer *Profiler::getThreadBuffer()
+    {
+        // A buffer from an older Profiler was already freed with it
+        if (!sThreadBuffer || sThreadBufferGeneration != mGeneration)
+        {
+            ThreadBuffer *buffer = new ThreadBuffer;
+
+            buffer->writePos = 0;
+            buffer->readPos = 0;
+
+            SDL_mutexP(mMutex);
+            buffer->threadNum = mBuffers.size();
+            mBuffers.push_back(buffer);
+            SDL_mutexV(mMutex);
+
+            sThreadBuffer = buffer;
+            sThreadBufferGeneration = mGeneration;
+        }
+
+        return static_cast<ThreadBuffer *>(sThreadBuffer);
+    }
+} // namespace
+
+#endif // SONETTO_PROFILING
@@ -28,13 +28,63 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 POSSIBILITY OF SUCH DAMAGE.
 -----------------------------------------------------------------------------*/
 
+#include <cstring>
+#include "SonettoMath.h"
 #include "SonettoScript.h"
+#include "SonettoScriptManager.h"
 
 namespace Sonetto
 {
     //--------------------------------------------------------------------------
     // Sonetto::Script implementation.
     //--------------------------------------------------------------------------
+    // Snapshot record layout (all fields native endian):
+    //     uint32 recordSize, fileHash, offset, stackCount, localCount, waitSize
+    //     stackCount * (char type, int32 raw)
+    //     localCount * (int32 key, char type, int32 raw)
+    //     waitSize bytes of wait state
+    // localCount is NO_LOCALS when the script has no local variable map.
+    static const size_t STATE_HEADER_SIZE = 6 * sizeof(uint32);
+    static const size_t STATE_STACK_ENTRY_SIZE = sizeof(char) + sizeof(int32);
+    static const size_t STATE_LOCAL_ENTRY_SIZE = sizeof(int32) + sizeof(char) +
+            sizeof(int32);
+    static const uint32 NO_LOCALS = 0xFFFFFFFF;
+    //--------------------------------------------------------------------------
+    template<typename T>
+    static inline char *writeState(char *dest,const T &value)
+    {
+        memcpy(dest,&value,sizeof(T));
+        return dest + sizeof(T);
+    }
+    //--------------------------------------------------------------------------
+    template<typename T>
+    static inline const char *readState(const char *src,T &value)
+    {
+        memcpy(&value,src,sizeof(T));
+        return src + sizeof(T);
+    }
+    //--------------------------------------------------------------------------
+    Script::Script(ScriptFilePtr file)
+            : mScriptFile(file), mOffset(0),mLocals(NULL)
+    {
+        ScriptManager *scriptMan = ScriptManager::getSingletonPtr();
+
+        if (scriptMan)
+        {
+            scriptMan->_registerScript(this);
+        }
+    }
+    //--------------------------------------------------------------------------
+    Script::~Script()
+    {
+        ScriptManager *scriptMan = ScriptManager::getSingletonPtr();
+
+        if (scriptMan)
+        {
+            scriptMan->_unregisterScript(this);
+        }
+    }
+    //--------------------------------------------------------------------------
     const Variable &Script::stackPeek()
     {
         if (mVarStack.empty())
@@ -42,7 +92,7 @@ namespace Sonetto
             SONETTO_THROW("Script stack is empty");
         }
 
-        return mVarStack.top();
+        return mVarStack.back();
     }
     //--------------------------------------------------------------------------
     Variable Script::stackPop()
@@ -52,8 +102,179 @@ namespace Sonetto
             SONETTO_THROW("Script stack is empty");
         }
 
-        Variable retn(mVarStack.top());
-        mVarStack.pop();
+        Variable retn(mVarStack.back());
+        mVarStack.pop_back();
         return retn;
     }
+    //--------------------------------------------------------------------------
+    size_t Script::_getStateSize() const
+    {
+        size_t size = STATE_HEADER_SIZE;
+
+        size += mVarStack.size() * STATE_STACK_ENTRY_SIZE;
+        if (mLocals)
+        {
+            size += mLocals->size() * STATE_LOCAL_ENTRY_SIZE;
+        }
+
+        return size + _getWaitStateSize();
+    }
+    //--------------------------------------------------------------------------
+    char *Script::_saveState(char *dest) const
+    {
+        uint32 waitSize = _getWaitStateSize();
+        uint32 localCount = (mLocals ? mLocals->size() : NO_LOCALS);
+
+        dest = writeState(dest,(uint32)(_getStateSize()));
+        dest = writeState(dest,Math::hash(mScriptFile->getName()));
+        dest = writeState(dest,(uint32)(mOffset));
+        dest = writeState(dest,(uint32)(mVarStack.size()));
+        dest = writeState(dest,localCount);
+        dest = writeState(dest,waitSize);
+
+        for (size_t i = 0;i < mVarStack.size();++i)
+        {
+            dest = writeState(dest,mVarStack[i]._getRawType());
+            dest = writeState(dest,mVarStack[i]._int);
+        }
+
+        if (mLocals)
+        {
+            VariableMap::const_iterator iter;
+            for (iter = mLocals->begin();iter != mLocals->end();++iter)
+            {
+                dest = writeState(dest,(int32)(iter->first));
+                dest = writeState(dest,iter->second._getRawType());
+                dest = writeState(dest,iter->second._int);
+            }
+        }
+
+        _saveWaitState(dest);
+        return dest + waitSize;
+    }
+    //--------------------------------------------------------------------------
+    const char *Script::_validateState(const char *src,const char *end) const
+    {
+        uint32 recordSize,fileHash,offset,stackCount,localCount,waitSize;
+        const char *record = src;
+        size_t expectedSize;
+
+        if (end - src < (ptrdiff_t)(STATE_HEADER_SIZE))
+        {
+            SONETTO_THROW("Script snapshot is truncated");
+        }
+
+        src = readState(src,recordSize);
+        src = readState(src,fileHash);
+        src = readState(src,offset);
+        src = readState(src,stackCount);
+        src = readState(src,localCount);
+        src = readState(src,waitSize);
+
+        if (fileHash != Math::hash(mScriptFile->getName()))
+        {
+            SONETTO_THROW("Script snapshot does not match running script");
+        }
+
+        if ((localCount == NO_LOCALS) != (mLocals == NULL))
+        {
+            SONETTO_THROW("Script snapshot local variables do not match "
+                    "running script");
+        }
+
+        // Bounds the counts by the record size first, so that the sum
+        // below cannot wrap around
+        if (stackCount > recordSize / STATE_STACK_ENTRY_SIZE ||
+                waitSize > recordSize || (mLocals &&
+                localCount > recordSize / STATE_LOCAL_ENTRY_SIZE))
+        {
+            SONETTO_THROW("Script snapshot is corrupted");
+        }
+
+        expectedSize = STATE_HEADER_SIZE +
+                stackCount * STATE_STACK_ENTRY_SIZE + waitSize;
+        if (mLocals)
+        {
+            expectedSize += localCount * STATE_LOCAL_ENTRY_SIZE;
+        }
+
+        if (recordSize != expectedSize || end - record < (ptrdiff_t)(recordSize))
+        {
+            SONETTO_THROW("Script snapshot is corrupted");
+        }
+
+        if (offset > mScriptFile->_getScriptData().size())
+        {
+            SONETTO_THROW("Script snapshot offset overflows script data");
+        }
+
+        _validateWaitState(record + recordSize - waitSize,waitSize);
+        return record + recordSize;
+    }
+    //--------------------------------------------------------------------------
+    const char *Script::_loadState(const char *src)
+    {
+        uint32 recordSize,fileHash,offset,stackCount,localCount,waitSize;
+
+        src = readState(src,recordSize);
+        src = readState(src,fileHash);
+        src = readState(src,offset);
+        src = readState(src,stackCount);
+        src = readState(src,localCount);
+        src = readState(src,waitSize);
+
+        mOffset = offset;
+
+        // Overwrites the stack in place; resize() only allocates when the
+        // stack was never this deep before
+        mVarStack.resize(stackCount);
+        for (size_t i = 0;i < stackCount;++i)
+        {
+            src = readState(src,mVarStack[i]._getRawType());
+            src = readState(src,mVarStack[i]._int);
+        }
+
+        if (mLocals)
+        {
+            VariableMap::iterator iter = mLocals->begin();
+            const char *localsStart = src;
+            bool sameKeys = (mLocals->size() == localCount);
+
+            // Overwrites values in place if the snapshot has the very same
+            // keys as the current map (the common case when rewinding)
+            for (size_t i = 0;sameKeys && i < localCount;++i,++iter)
+            {
+                int32 key;
+
+                src = readState(src,key);
+                if (iter->first != key)
+                {
+                    sameKeys = false;
+                    break;
+                }
+
+                src = readState(src,iter->second._getRawType());
+                src = readState(src,iter->second._int);
+            }
+
+            if (!sameKeys)
+            {
+                mLocals->clear();
+                src = localsStart;
+                for (size_t i = 0;i < localCount;++i)
+                {
+                    Variable var;
+                    int32 key;
+
+                    src = readState(src,key);
+                    src = readState(src,var._getRawType());
+                    src = readState(src,var._int);
+                    mLocals->insert(std::make_pair((int)(key),var));
+                }
+            }
+        }
+
+        _loadWaitState(src,waitSize);
+        return src + waitSize;
+    }
 } // namespace Sonetto
@@ -30,6 +30,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "SonettoScriptFile.h"
 #include "SonettoScriptFileSerializer.h"
+#include "SonettoPrefetchManager.h"
 
 namespace Sonetto {
     //--------------------------------------------------------------------------
@@ -51,8 +52,15 @@ namespace Sonetto {
     void ScriptFile::loadImpl()
     {
         ScriptFileSerializer serializer;
+        PrefetchManager *prefetch = PrefetchManager::getSingletonPtr();
         Ogre::DataStreamPtr stream = Ogre::ResourceGroupManager::getSingleton().
                                         openResource(mName,mGroup,true,this);
+
+        if (prefetch)
+        {
+            prefetch->recordResource(mName,mGroup);
+        }
+
         serializer.importScriptFile(stream,this);
     }
     //--------------------------------------------------------------------------
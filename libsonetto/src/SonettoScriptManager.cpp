@@ -28,6 +28,8 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 POSSIBILITY OF SUCH DAMAGE.
 -----------------------------------------------------------------------------*/
 
+#include <algorithm>
+#include <cstring>
 #include "SonettoException.h"
 #include "SonettoScriptManager.h"
 
@@ -39,6 +41,7 @@ namespace Sonetto
     SONETTO_SINGLETON_IMPLEMENT(ScriptManager);
     //--------------------------------------------------------------------------
     ScriptManager::ScriptManager()
+            : mInstructionCount(0)
     {
         mResourceType = "SonettoScript";
 
@@ -49,6 +52,12 @@ namespace Sonetto
         Ogre::ResourceGroupManager::getSingleton().
                 _registerResourceManager(mResourceType,this);
 
+        mOpcodeMutex = SDL_CreateMutex();
+        if (!mOpcodeMutex)
+        {
+            SONETTO_THROW("Could not create opcode table mutex");
+        }
+
         // Registers basic flow control opcodes
         mFlowHandler.registerOpcodes();
     }
@@ -58,6 +67,8 @@ namespace Sonetto
         // and this is how we unregister it
         Ogre::ResourceGroupManager::getSingleton().
                 _unregisterResourceManager(mResourceType);
+
+        SDL_DestroyMutex(mOpcodeMutex);
     }
     //--------------------------------------------------------------------------
     ScriptFilePtr ScriptManager::load(const Ogre::String &name,
@@ -82,7 +93,7 @@ namespace Sonetto
         return new ScriptFile(this,name,handle,group,isManual,loader);
     }
     //--------------------------------------------------------------------------
-    void ScriptManager::updateScript(ScriptPtr script)
+    void ScriptManager::updateScript(ScriptPtr script,FrameArena &arena)
     {
         size_t scriptSize = script->getScriptFile()->calculateSize();
 
@@ -97,11 +108,13 @@ namespace Sonetto
         {
             size_t opID,oplength;
             int opmove;
-            Opcode *opcode;
             //ArgumentVector *args;
 
-            // Reads opcode from script file
-            opcode = readOpcode(script,opID,oplength);
+            // Reads opcode from script file; it lives in the arena and is
+            // destroyed at the end of this iteration
+            FramePtr<Opcode> opcode(arena,
+                    readOpcode(script,arena,opID,oplength));
+            ++mInstructionCount;
 
             //std::cout << " --> readOpcode (id: " << opID << ", length: "
             //        << oplength << ")\n";
@@ -137,9 +150,8 @@ namespace Sonetto
             }
             std::cout << "-----\n";*/
 
-            // Send opcode to its handler and deletes it
-            opmove = opcode->handler->handleOpcode(script,opID,opcode);
-            delete opcode;
+            // Send opcode to its handler
+            opmove = opcode->handler->handleOpcode(script,opID,opcode.get());
 
             //std::cout << " --> handleOpcode (id: " << opID << ", move: "
             //        << opmove << ")\n";
@@ -178,26 +190,131 @@ namespace Sonetto
     //--------------------------------------------------------------------------
     void ScriptManager::_registerOpcode(size_t id,const Opcode *opcode)
     {
+        SDL_mutexP(mOpcodeMutex);
+
         if (mOpcodeTable.find(id) != mOpcodeTable.end())
         {
+            SDL_mutexV(mOpcodeMutex);
             SONETTO_THROW("Requested opcode is already registered");
         }
 
         mOpcodeTable.insert(std::pair<size_t,const Opcode *>(id,opcode));
+
+        SDL_mutexV(mOpcodeMutex);
     }
     //--------------------------------------------------------------------------
     void ScriptManager::_unregisterOpcode(size_t id)
     {
-        OpcodeTable::iterator iter = mOpcodeTable.find(id);
+        OpcodeTable::iterator iter;
 
+        SDL_mutexP(mOpcodeMutex);
+
+        iter = mOpcodeTable.find(id);
         if (iter == mOpcodeTable.end())
         {
+            SDL_mutexV(mOpcodeMutex);
             SONETTO_THROW("Requested opcode is not registered");
         }
 
         // Deletes and removes opcode from opcode table
         delete iter->second;
         mOpcodeTable.erase(iter);
+
+        SDL_mutexV(mOpcodeMutex);
+    }
+    //--------------------------------------------------------------------------
+    // Snapshot header: uint32 magic, uint32 script count, uint32 total size
+    static const uint32 SNAPSHOT_MAGIC = MKFOURCC('S','S','S','0');
+    static const size_t SNAPSHOT_HEADER_SIZE = 3 * sizeof(uint32);
+    //--------------------------------------------------------------------------
+    size_t ScriptManager::calculateSnapshotSize() const
+    {
+        size_t size = SNAPSHOT_HEADER_SIZE;
+
+        for (size_t i = 0;i < mScripts.size();++i)
+        {
+            size += mScripts[i]->_getStateSize();
+        }
+
+        return size;
+    }
+    //--------------------------------------------------------------------------
+    void ScriptManager::saveSnapshot(ScriptSnapshot &snapshot) const
+    {
+        uint32 header[3];
+        char *dest;
+
+        header[0] = SNAPSHOT_MAGIC;
+        header[1] = mScripts.size();
+        header[2] = calculateSnapshotSize();
+
+        // resize() keeps capacity, so a reused snapshot buffer only
+        // allocates when it grows
+        snapshot.resize(header[2]);
+        dest = &snapshot[0];
+
+        memcpy(dest,header,SNAPSHOT_HEADER_SIZE);
+        dest += SNAPSHOT_HEADER_SIZE;
+
+        for (size_t i = 0;i < mScripts.size();++i)
+        {
+            dest = mScripts[i]->_saveState(dest);
+        }
+    }
+    //--------------------------------------------------------------------------
+    void ScriptManager::restoreSnapshot(const ScriptSnapshot &snapshot)
+    {
+        uint32 header[3];
+        const char *src,*end;
+
+        if (snapshot.size() < SNAPSHOT_HEADER_SIZE)
+        {
+            SONETTO_THROW("Script snapshot is truncated");
+        }
+
+        src = &snapshot[0];
+        end = src + snapshot.size();
+        memcpy(header,src,SNAPSHOT_HEADER_SIZE);
+
+        if (header[0] != SNAPSHOT_MAGIC || header[2] != snapshot.size())
+        {
+            SONETTO_THROW("Invalid script snapshot");
+        }
+
+        if (header[1] != mScripts.size())
+        {
+            SONETTO_THROW("Script snapshot does not match running scripts");
+        }
+
+        // Validates every record before touching any script, so that a
+        // bad snapshot leaves all scripts untouched
+        const char *record = src + SNAPSHOT_HEADER_SIZE;
+        for (size_t i = 0;i < mScripts.size();++i)
+        {
+            record = mScripts[i]->_validateState(record,end);
+        }
+
+        src += SNAPSHOT_HEADER_SIZE;
+        for (size_t i = 0;i < mScripts.size();++i)
+        {
+            src = mScripts[i]->_loadState(src);
+        }
+    }
+    //--------------------------------------------------------------------------
+    void ScriptManager::_registerScript(Script *script)
+    {
+        mScripts.push_back(script);
+    }
+    //--------------------------------------------------------------------------
+    void ScriptManager::_unregisterScript(Script *script)
+    {
+        std::vector<Script *>::iterator iter =
+                std::find(mScripts.begin(),mScripts.end(),script);
+
+        if (iter != mScripts.end())
+        {
+            mScripts.erase(iter);
+        }
     }
     //--------------------------------------------------------------------------
     void ScriptManager::readScriptData(ScriptPtr script,void *dest,
@@ -219,15 +336,17 @@ namespace Sonetto
         memcpy(dest,&data[offset],bytes);
     }
     //--------------------------------------------------------------------------
-    Opcode *ScriptManager::readOpcode(ScriptPtr script,size_t &id,
-            size_t &bytesRead)
+    Opcode *ScriptManager::readOpcode(ScriptPtr script,FrameArena &arena,
+            size_t &id,size_t &bytesRead)
     {
         OpcodeTable::iterator iter;
         Opcode *opcode;
+        uint32 fileID;
 
-        // Reads ID and moves forward
-        readScriptData(script,&id,sizeof(id),true);
-        bytesRead = sizeof(id);
+        // Reads ID and moves forward (IDs are 32 bits wide in script files)
+        readScriptData(script,&fileID,sizeof(fileID),true);
+        bytesRead = sizeof(fileID);
+        id = fileID;
 
         // Gets iterator to the corresponding mOpcodeTable entry for
         // the opcode ID read (`id')
@@ -239,8 +358,8 @@ namespace Sonetto
             SONETTO_THROW("Script manager error: Invalid opcode");
         }
 
-        // Creates the desired opcode
-        opcode = iter->second->create();
+        // Creates the desired opcode in the caller's arena
+        opcode = iter->second->create(arena);
 
         // Reads opcode arguments into its pointers
         for (size_t i = 0;i < opcode->arguments.size();++i)
@@ -261,7 +380,8 @@ namespace Sonetto
         for (size_t opnum = 0;opnum < opIndex;++opnum)
         {
             OpcodeTable::iterator iter;
-            size_t opID,oplength;
+            size_t oplength;
+            uint32 opID;
 
             readScriptData(script,&opID,sizeof(opID),true);
 
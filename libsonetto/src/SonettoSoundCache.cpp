@@ -0,0 +1,487 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifdef WINDOWS
+#   include <windows.h>
+#else
+#   include <sys/stat.h>
+#endif
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <SDL/SDL_thread.h>
+#include <OgreLogManager.h>
+#include <OgreStringConverter.h>
+#include "SonettoSoundCache.h"
+#include "SonettoException.h"
+#include "SonettoMappedFile.h"
+#include "SonettoMath.h"
+#include "SonettoMetrics.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    /// First line of the index file
+    static const char * const SOUND_CACHE_INDEX_HEADER = "SonettoSoundCache 1";
+
+    /// Index file name, inside the cache directory
+    static const char * const SOUND_CACHE_INDEX_FILE = "index";
+
+    /// First line of the sources file
+    static const char * const SOUND_CACHE_SOURCES_HEADER =
+            "SonettoSoundCacheSources 1";
+
+    /// Sources file name, inside the cache directory
+    static const char * const SOUND_CACHE_SOURCES_FILE = "sources";
+    // ----------------------------------------------------------------------
+    // Sonetto::SoundCache implementation
+    // ----------------------------------------------------------------------
+    SoundCache::SoundCache(const std::string &directory,size_t maxSize)
+            : mPath(directory + "/"), mMaxSize(maxSize), mSize(0),
+              mUseClock(0), mMutex(NULL), mHits(NULL), mMisses(NULL),
+              mBytes(NULL)
+    {
+        MetricsRegistry &metrics = MetricsRegistry::getSingleton();
+
+        mMutex = SDL_CreateMutex();
+        if (!mMutex)
+        {
+            SONETTO_THROW("Could not create sound cache mutex");
+        }
+
+        mHits = metrics.getCounter("sound_cache_hits");
+        mMisses = metrics.getCounter("sound_cache_misses");
+        mBytes = metrics.getGauge("sound_cache_bytes");
+
+        // Fails harmlessly if it already exists
+    #ifdef WINDOWS
+        CreateDirectory(directory.c_str(),NULL);
+    #else
+        mkdir(directory.c_str(),S_IRWXU);
+    #endif
+
+        loadIndex();
+        loadSources();
+
+        // The limit may have been lowered since the index was written
+        trim(mMaxSize);
+        mBytes->set(mSize);
+    }
+    // ----------------------------------------------------------------------
+    SoundCache::~SoundCache()
+    {
+        saveIndex();
+        saveSources();
+        SDL_DestroyMutex(mMutex);
+    }
+    // ----------------------------------------------------------------------
+    bool SoundCache::makeKey(Ogre::DataStream &stream,SoundCacheKey &key)
+    {
+        char buffer[4096];
+        size_t read;
+
+        // Unseekable streams cannot be read twice
+        if (stream.size() == 0)
+        {
+            return false;
+        }
+
+        key.hash = Math::HASH_BASIS;
+        key.size = stream.size();
+
+        stream.seek(0);
+        while ((read = stream.read(buffer,sizeof(buffer))) > 0)
+        {
+            key.hash = Math::hash(buffer,read,key.hash);
+        }
+
+        stream.seek(0);
+        return true;
+    }
+    // ----------------------------------------------------------------------
+    bool SoundCache::findKey(const SoundFileInfo &file,SoundCacheKey &key)
+    {
+        SourceMap::const_iterator source;
+        bool found = false;
+
+        if (file.path.empty())
+        {
+            return false;
+        }
+
+        SDL_mutexP(mMutex);
+        source = mSources.find(file.path);
+        if (source != mSources.end() && source->second.size == file.size &&
+                source->second.modified == file.modified)
+        {
+            key = source->second.key;
+            found = true;
+        }
+        SDL_mutexV(mMutex);
+
+        return found;
+    }
+    // ----------------------------------------------------------------------
+    void SoundCache::recordKey(const SoundFileInfo &file,
+            const SoundCacheKey &key)
+    {
+        if (file.path.empty())
+        {
+            return;
+        }
+
+        SDL_mutexP(mMutex);
+        Source &source = mSources[file.path];
+
+        source.size = file.size;
+        source.modified = file.modified;
+        source.key = key;
+        SDL_mutexV(mMutex);
+    }
+    // ----------------------------------------------------------------------
+    bool SoundCache::open(const SoundCacheKey &key,MappedFile &file,
+            SoundCacheHeader &header)
+    {
+        std::string fileName = getFileName(key);
+        EntryMap::iterator entry;
+        bool found = false;
+        bool valid = false;
+
+        // Held while mapped, so that trim() leaves it alone
+        SDL_mutexP(mMutex);
+        entry = mEntries.find(fileName);
+        if (entry != mEntries.end())
+        {
+            entry->second.lastUse = ++mUseClock;
+            ++entry->second.users;
+            found = true;
+        }
+        SDL_mutexV(mMutex);
+
+        if (!found)
+        {
+            mMisses->increment();
+            return false;
+        }
+
+        try {
+            file.open(mPath + fileName);
+            if (file.getSize() >= sizeof(SoundCacheHeader))
+            {
+                memcpy(&header,file.getData(),sizeof(SoundCacheHeader));
+                valid = (header.magic == SOUND_CACHE_MAGIC &&
+                        (header.channels == 1 || header.channels == 2) &&
+                        header.pcmSize == file.getSize() -
+                        sizeof(SoundCacheHeader));
+            }
+        } catch (Exception &) {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            // Missing or damaged; it is decoded and stored again, unless
+            // someone else has it mapped
+            file.close();
+
+            SDL_mutexP(mMutex);
+            entry = mEntries.find(fileName);
+            if (entry != mEntries.end() && --entry->second.users == 0)
+            {
+                discard(entry);
+            }
+            mBytes->set(mSize);
+            SDL_mutexV(mMutex);
+
+            mMisses->increment();
+            return false;
+        }
+
+        mHits->increment();
+        return true;
+    }
+    // ----------------------------------------------------------------------
+    void SoundCache::release(const SoundCacheKey &key)
+    {
+        EntryMap::iterator entry;
+
+        SDL_mutexP(mMutex);
+        entry = mEntries.find(getFileName(key));
+        if (entry != mEntries.end() && entry->second.users > 0)
+        {
+            --entry->second.users;
+        }
+        SDL_mutexV(mMutex);
+    }
+    // ----------------------------------------------------------------------
+    void SoundCache::store(const SoundCacheKey &key,
+            const SoundCacheHeader &header,const char *pcm)
+    {
+        std::string fileName = getFileName(key);
+        std::string tempName = mPath + fileName + "." +
+                Ogre::StringConverter::toString(
+                static_cast<unsigned long>(SDL_ThreadID())) + ".tmp";
+        size_t size = sizeof(SoundCacheHeader) + header.pcmSize;
+        SoundCacheHeader fileHeader = header;
+        std::ofstream file;
+        EntryMap::iterator entry;
+
+        if (size > mMaxSize)
+        {
+            return;
+        }
+
+        // Written under a temporary name, so that a half written file is
+        // never taken for a cached sound
+        fileHeader.magic = SOUND_CACHE_MAGIC;
+        file.open(tempName.c_str(),std::ios_base::out |
+                std::ios_base::binary | std::ios_base::trunc);
+        file.write(reinterpret_cast<const char *>(&fileHeader),
+                sizeof(SoundCacheHeader));
+        file.write(pcm,header.pcmSize);
+        file.close();
+
+        if (!file)
+        {
+            std::remove(tempName.c_str());
+            return;
+        }
+
+        SDL_mutexP(mMutex);
+
+        // Makes room before the file is added, so that the limit holds;
+        // there may be no room if the cached sounds are mapped, and a
+        // mapped file cannot be replaced
+        entry = mEntries.find(fileName);
+        if (entry != mEntries.end() && entry->second.users == 0)
+        {
+            discard(entry);
+            entry = mEntries.end();
+        }
+
+        trim(mMaxSize - size);
+        if (entry != mEntries.end() || mSize + size > mMaxSize)
+        {
+            std::remove(tempName.c_str());
+            SDL_mutexV(mMutex);
+            return;
+        }
+
+        // A file left over without being indexed would make rename() fail
+        // on some platforms
+        std::remove((mPath + fileName).c_str());
+        if (std::rename(tempName.c_str(),(mPath + fileName).c_str()) == 0) {
+            Entry &added = mEntries[fileName];
+
+            added.size = size;
+            added.lastUse = ++mUseClock;
+            mSize += size;
+        } else {
+            std::remove(tempName.c_str());
+        }
+
+        mBytes->set(mSize);
+        SDL_mutexV(mMutex);
+    }
+    // ----------------------------------------------------------------------
+    std::string SoundCache::getFileName(const SoundCacheKey &key)
+    {
+        std::ostringstream name;
+
+        name.fill('0');
+        name << std::hex;
+        name.width(8);
+        name << key.hash;
+        name.width(8);
+        name << key.size << ".pcm";
+
+        return name.str();
+    }
+    // ----------------------------------------------------------------------
+    void SoundCache::loadIndex()
+    {
+        std::ifstream file((mPath + SOUND_CACHE_INDEX_FILE).c_str());
+        std::string line;
+
+        if (!std::getline(file,line) || line != SOUND_CACHE_INDEX_HEADER)
+        {
+            return;
+        }
+
+        while (std::getline(file,line))
+        {
+            std::istringstream fields(line);
+            std::string name;
+            Entry entry;
+
+            if (!(fields >> name >> entry.size >> entry.lastUse))
+            {
+                continue;
+            }
+
+            if (mEntries.find(name) == mEntries.end())
+            {
+                mEntries[name] = entry;
+                mSize += entry.size;
+
+                if (entry.lastUse > mUseClock)
+                {
+                    mUseClock = entry.lastUse;
+                }
+            }
+        }
+    }
+    // ----------------------------------------------------------------------
+    void SoundCache::saveIndex()
+    {
+        std::string fileName = mPath + SOUND_CACHE_INDEX_FILE;
+        std::ofstream file;
+
+        SDL_mutexP(mMutex);
+
+        file.open(fileName.c_str(),std::ios_base::out |
+                std::ios_base::trunc);
+        if (file.is_open())
+        {
+            file << SOUND_CACHE_INDEX_HEADER << '\n';
+            for (EntryMap::const_iterator i = mEntries.begin();
+                    i != mEntries.end();++i)
+            {
+                file << i->first << ' ' << i->second.size << ' ' <<
+                        i->second.lastUse << '\n';
+            }
+        }
+
+        SDL_mutexV(mMutex);
+
+        if (!file.is_open())
+        {
+            Ogre::LogManager::getSingleton().logMessage("Could not write "
+                    "sound cache index " + fileName);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void SoundCache::loadSources()
+    {
+        std::ifstream file((mPath + SOUND_CACHE_SOURCES_FILE).c_str());
+        std::string line;
+
+        if (!std::getline(file,line) || line != SOUND_CACHE_SOURCES_HEADER)
+        {
+            return;
+        }
+
+        // Paths may hold spaces, so they come last
+        while (std::getline(file,line))
+        {
+            std::istringstream fields(line);
+            std::string path;
+            Source source;
+
+            if (!(fields >> source.key.hash >> source.key.size >>
+                    source.size >> source.modified) || fields.get() != ' ' ||
+                    !std::getline(fields,path) || path.empty())
+            {
+                continue;
+            }
+
+            mSources[path] = source;
+        }
+    }
+    // ----------------------------------------------------------------------
+    void SoundCache::saveSources()
+    {
+        std::string fileName = mPath + SOUND_CACHE_SOURCES_FILE;
+        std::ofstream file;
+
+        SDL_mutexP(mMutex);
+
+        file.open(fileName.c_str(),std::ios_base::out |
+                std::ios_base::trunc);
+        if (file.is_open())
+        {
+            file << SOUND_CACHE_SOURCES_HEADER << '\n';
+            for (SourceMap::const_iterator i = mSources.begin();
+                    i != mSources.end();++i)
+            {
+                const Source &source = i->second;
+
+                if (mEntries.find(getFileName(source.key)) != mEntries.end())
+                {
+                    file << source.key.hash << ' ' << source.key.size << ' ' <<
+                            source.size << ' ' << source.modified << ' ' <<
+                            i->first << '\n';
+                }
+            }
+        }
+
+        SDL_mutexV(mMutex);
+
+        if (!file.is_open())
+        {
+            Ogre::LogManager::getSingleton().logMessage("Could not write "
+                    "sound cache sources " + fileName);
+        }
+    }
+    // ----------------------------------------------------------------------
+    void SoundCache::discard(EntryMap::iterator entry)
+    {
+        std::remove((mPath + entry->first).c_str());
+        mSize -= entry->second.size;
+        mEntries.erase(entry);
+    }
+    // ----------------------------------------------------------------------
+    void SoundCache::trim(size_t size)
+    {
+        while (mSize > size)
+        {
+            EntryMap::iterator oldest = mEntries.end();
+
+            // Mapped files are still being read by a decode job
+            for (EntryMap::iterator i = mEntries.begin();
+                    i != mEntries.end();++i)
+            {
+                if (i->second.users == 0 && (oldest == mEntries.end() ||
+                        i->second.lastUse < oldest->second.lastUse))
+                {
+                    oldest = i;
+                }
+            }
+
+            if (oldest == mEntries.end())
+            {
+                break;
+            }
+
+            discard(oldest);
+        }
+    }
+} // namespace
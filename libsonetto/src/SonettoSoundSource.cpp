@@ -42,7 +42,8 @@ namespace Sonetto
     // Sonetto::SoundSource implementation.
     //-----------------------------------------------------------------------------
     SoundSource::SoundSource()
-            : mSoundID(0),mMaxVolume(1.0f),mNode(NULL)
+            : mSoundID(0),mBoundSoundID(0),mBufferPending(false),
+            mPlayPending(false),mMaxVolume(1.0f),mNode(NULL)
     {
         // Gets AudioManager singleton
         mAudioMan = AudioManager::getSingletonPtr();
@@ -52,20 +53,26 @@ namespace Sonetto
     {
         // If this sound source is invalid, its OpenAL audio source was already
         // deleted, so we can't do this again
-        if (mSoundID > 0)
+        if (hasALSource())
         {
             // Deletes OpenAL audio source
             alDeleteSources(1,&mALSource);
             mAudioMan->_alErrorCheck("SoundSource::~SoundSource()","Failed deleting "
                     "OpenAL audio source");
         }
+
+        // Lets the buffer be evicted
+        if (mBoundSoundID > 0)
+        {
+            mAudioMan->_releaseSound(mBoundSoundID);
+        }
     }
     //-----------------------------------------------------------------------------
     void SoundSource::setMaxVolume(float maxVolume)
     {
         mMaxVolume = Math::clamp(maxVolume,0.0f,1.0f);
 
-        if (mSoundID > 0)
+        if (hasALSource())
         {
             alSourcef(mALSource,AL_GAIN,maxVolume *
                     mAudioMan->getMasterSoundVolume());
@@ -76,8 +83,14 @@ namespace Sonetto
     //-----------------------------------------------------------------------------
     SoundSourceState SoundSource::getState() const
     {
+        // Will start playing as soon as its buffer is uploaded
+        if (mPlayPending)
+        {
+            return SSS_PLAYING;
+        }
+
         // If this sound source is invalid, this method will report it is stopped
-        if (mSoundID > 0)
+        if (hasALSource())
         {
             ALenum state;
 
@@ -102,42 +115,77 @@ namespace Sonetto
     void SoundSource::setSoundID(uint32 id)
     {
         if (id > 0) {
-            if (mSoundID == 0)
+            // Holds the new sound before letting go of the old one; if it
+            // was evicted, it is reloaded in the background and `buffer' is 0
+            ALuint buffer = mAudioMan->_acquireSound(id);
+
+            // Without an audio device, there is no OpenAL audio source; the
+            // sound is only kept track of
+            if (mAudioMan->isInitialised())
             {
-                // Generates OpenAL audio source
-                alGenSources(1,&mALSource);
-                mAudioMan->_alErrorCheck("SoundSource::setSoundID()","Failed "
-                        "generating OpenAL audio source");
-            }
+                if (mSoundID == 0)
+                {
+                    // Generates OpenAL audio source
+                    alGenSources(1,&mALSource);
+                    mAudioMan->_alErrorCheck("SoundSource::setSoundID()",
+                            "Failed generating OpenAL audio source");
+                }
 
-            alSourceStop(mALSource);
+                alSourceStop(mALSource);
 
-            // Attaches buffer to sound source
-            alSourcei(mALSource,AL_BUFFER,mAudioMan->_getSound(id).buffer);
-            mAudioMan->_alErrorCheck("SoundSource::setSoundID()","Failed attaching "
-                    "audio buffer to OpenAL audio source");
+                // Attaches buffer to sound source (detaches the old one if
+                // the new one is not uploaded yet)
+                alSourcei(mALSource,AL_BUFFER,buffer);
+                mAudioMan->_alErrorCheck("SoundSource::setSoundID()",
+                        "Failed attaching audio buffer to OpenAL audio "
+                        "source");
 
-            alSourcef(mALSource,AL_GAIN,mMaxVolume *
-                    mAudioMan->getMasterSoundVolume());
-            mAudioMan->_alErrorCheck("SoundSource::setSoundID()","Failed setting "
-                    "OpenAL audio source gain");
+                alSourcef(mALSource,AL_GAIN,mMaxVolume *
+                        mAudioMan->getMasterSoundVolume());
+                mAudioMan->_alErrorCheck("SoundSource::setSoundID()",
+                        "Failed setting OpenAL audio source gain");
+
+                mBufferPending = (buffer == 0);
+            }
+
+            if (mBoundSoundID > 0)
+            {
+                mAudioMan->_releaseSound(mBoundSoundID);
+            }
+
+            mBoundSoundID = id;
+            mPlayPending = false;
         } else {
-            if (mSoundID > 0)
+            if (hasALSource())
             {
                 alDeleteSources(1,&mALSource);
                 mAudioMan->_alErrorCheck("SoundSource::setSoundID()","Failed deleting "
                         "OpenAL audio source");
             }
+
+            if (mBoundSoundID > 0)
+            {
+                mAudioMan->_releaseSound(mBoundSoundID);
+                mBoundSoundID = 0;
+            }
+
+            mBufferPending = false;
+            mPlayPending = false;
         }
 
         mSoundID = id;
     }
     //-----------------------------------------------------------------------------
+    bool SoundSource::hasALSource() const
+    {
+        return mSoundID > 0 && mAudioMan->isInitialised();
+    }
+    //-----------------------------------------------------------------------------
     void SoundSource::setNode(Ogre::Node *node)
     {
         mNode = node;
 
-        if (mSoundID > 0)
+        if (hasALSource())
         {
             Ogre::Vector3 pos;
 
@@ -156,10 +204,34 @@ namespace Sonetto
     void SoundSource::_update()
     {
         // Only updates valid sound sources
-        if (mSoundID > 0)
+        if (hasALSource())
         {
             Ogre::Vector3 pos;
 
+            // Attaches the bound sound's buffer once it was loaded again
+            if (mBufferPending)
+            {
+                ALuint buffer = mAudioMan->_getSoundBuffer(mBoundSoundID);
+
+                if (buffer != 0)
+                {
+                    alSourcei(mALSource,AL_BUFFER,buffer);
+                    mAudioMan->_alErrorCheck("SoundSource::_update()",
+                            "Failed attaching audio buffer to OpenAL audio "
+                            "source");
+
+                    mBufferPending = false;
+                    if (mPlayPending)
+                    {
+                        mPlayPending = false;
+
+                        alSourcePlay(mALSource);
+                        mAudioMan->_alErrorCheck("SoundSource::_update()",
+                                "Failed playing OpenAL audio source");
+                    }
+                }
+            }
+
             // Gets attached node position or AudioManager's listener position
             // if no node was attached
             if (mNode) {
@@ -184,7 +256,14 @@ namespace Sonetto
     //-----------------------------------------------------------------------------
     void SoundSource::play()
     {
-        if (mSoundID > 0)
+        // Plays once the buffer is uploaded (see _update())
+        if (mBufferPending)
+        {
+            mPlayPending = true;
+            return;
+        }
+
+        if (hasALSource())
         {
             alSourcePlay(mALSource);
             mAudioMan->_alErrorCheck("SoundSource::play()","Failed playing "
@@ -194,8 +273,15 @@ namespace Sonetto
     //-----------------------------------------------------------------------------
     void SoundSource::pause()
     {
+        // Not started yet; it can start over
+        if (mPlayPending)
+        {
+            mPlayPending = false;
+            return;
+        }
+
         // Only pauses valid sound sources that are currently playing
-        if (mSoundID > 0 && getState() == SSS_PLAYING)
+        if (hasALSource() && getState() == SSS_PLAYING)
         {
             alSourcePause(mALSource);
             mAudioMan->_alErrorCheck("SoundSource::pause()","Failed pausing "
@@ -205,8 +291,15 @@ namespace Sonetto
     //-----------------------------------------------------------------------------
     void SoundSource::stop()
     {
+        // Not started yet
+        if (mPlayPending)
+        {
+            mPlayPending = false;
+            return;
+        }
+
         // Only stops valid sound sources that are not stopped yet
-        if (mSoundID > 0 && getState() != SSS_STOPPED)
+        if (hasALSource() && getState() != SSS_STOPPED)
         {
             alSourceStop(mALSource);
             mAudioMan->_alErrorCheck("SoundSource::stop()","Failed stopping "
@@ -42,6 +42,12 @@ namespace Sonetto
     mInitialized(false),
     mStringSize(0),
     mAllocatedSize(0),
+    mGeometryBuilt(false),
+    mBuiltAlpha(0.0f),
+    mBuiltFont(NULL),
+    mBuiltAspect(0.0f),
+    mBuiltLeft(0.0f),
+    mBuiltTop(0.0f),
     mAlpha(1.0f),
     mTextSize(Ogre::Vector2(0.07f,0.07f)),
     mpFont(NULL)
@@ -130,16 +136,42 @@ namespace Sonetto
         return mpFont->mMaterial;
     }
     // ----------------------------------------------------------------------
+    bool StaticTextElement::isGeometryOutdated(float aspect)
+    {
+        return !mGeometryBuilt || mText != mBuiltText ||
+                mAlpha != mBuiltAlpha || mTextSize != mBuiltTextSize ||
+                mpFont != mBuiltFont || aspect != mBuiltAspect ||
+                _getDerivedLeft() != mBuiltLeft ||
+                _getDerivedTop() != mBuiltTop;
+    }
+    // ----------------------------------------------------------------------
     void StaticTextElement::_update(void)
     {
         Ogre::OverlayElement::_update();
 
+        float aspect = Kernel::getSingleton().mAspectRatio;
+
+        // Text rarely changes every frame, so locking and refilling the
+        // buffers each time is mostly wasted; like Ogre's
+        // TextAreaOverlayElement, the last geometry is kept until outdated
+        if (!isGeometryOutdated(aspect))
+        {
+            return;
+        }
+
+        mBuiltText = mText;
+        mBuiltAlpha = mAlpha;
+        mBuiltTextSize = mTextSize;
+        mBuiltFont = mpFont;
+        mBuiltAspect = aspect;
+        mBuiltLeft = _getDerivedLeft();
+        mBuiltTop = _getDerivedTop();
+        mGeometryBuilt = true;
+
         // Check text allocation
         mStringSize = mText.size();
         allocateMemory(mStringSize);
 
-        float aspect = Kernel::getSingleton().mAspectRatio;
-
         // Set text position
         float o_txtPosX = ((_getDerivedLeft() * 2.0) - 1.0f)/aspect;
         float txtPosX = o_txtPosX;
@@ -0,0 +1,130 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#include <cstdio>
+#include "SonettoVorbisDataStream.h"
+
+namespace Sonetto
+{
+    // ----------------------------------------------------------------------
+    /// vorbisfile read callback (`source' is an Ogre::DataStreamPtr *)
+    static size_t ovReadDataStream(void *ptr,size_t size,size_t nmemb,
+            void *source)
+    {
+        Ogre::DataStreamPtr &stream =
+                *static_cast<Ogre::DataStreamPtr *>(source);
+
+        if (size == 0)
+        {
+            return 0;
+        }
+
+        return stream->read(ptr,size * nmemb) / size;
+    }
+    // ----------------------------------------------------------------------
+    /// vorbisfile seek callback
+    static int ovSeekDataStream(void *source,ogg_int64_t offset,int whence)
+    {
+        Ogre::DataStreamPtr &stream =
+                *static_cast<Ogre::DataStreamPtr *>(source);
+
+        switch (whence)
+        {
+            case SEEK_SET:
+                stream->seek(static_cast<size_t>(offset));
+            break;
+
+            case SEEK_CUR:
+                stream->skip(static_cast<long>(offset));
+            break;
+
+            case SEEK_END:
+                stream->seek(static_cast<size_t>(stream->size() + offset));
+            break;
+
+            default:
+                return -1;
+        }
+
+        return 0;
+    }
+    // ----------------------------------------------------------------------
+    /// vorbisfile close callback (releases the stream)
+    static int ovCloseDataStream(void *source)
+    {
+        delete static_cast<Ogre::DataStreamPtr *>(source);
+        return 0;
+    }
+    // ----------------------------------------------------------------------
+    /// vorbisfile tell callback
+    static long ovTellDataStream(void *source)
+    {
+        Ogre::DataStreamPtr &stream =
+                *static_cast<Ogre::DataStreamPtr *>(source);
+
+        return static_cast<long>(stream->tell());
+    }
+    // ----------------------------------------------------------------------
+    int ovOpenDataStream(const Ogre::DataStreamPtr &stream,
+            OggVorbis_File *file)
+    {
+        Ogre::DataStreamPtr *source = new Ogre::DataStreamPtr(stream);
+        int errCode;
+
+        errCode = ovAdoptDataStream(source,file);
+        if (errCode != 0)
+        {
+            delete source;
+        }
+
+        return errCode;
+    }
+    // ----------------------------------------------------------------------
+    int ovAdoptDataStream(Ogre::DataStreamPtr *stream,OggVorbis_File *file)
+    {
+        ov_callbacks callbacks;
+
+        callbacks.read_func = ovReadDataStream;
+        callbacks.close_func = ovCloseDataStream;
+
+        // Without a seek callback, vorbisfile treats the stream as
+        // unseekable (and neither looping nor ov_pcm_total() work)
+        if ((*stream)->size() > 0) {
+            callbacks.seek_func = ovSeekDataStream;
+            callbacks.tell_func = ovTellDataStream;
+        } else {
+            callbacks.seek_func = NULL;
+            callbacks.tell_func = NULL;
+        }
+
+        // vorbisfile only calls close_func once opened successfully
+        return ov_open_callbacks(stream,file,NULL,0,callbacks);
+    }
+} // namespace
@@ -50,6 +50,10 @@ namespace BootModule
 
         void initialize();
         void update();
+
+        /// Touches no Ogre object from update(), so it can be pipelined
+        bool isPipelined() const { return true; }
+
         void deinitialize();
 
         void halt();
@@ -33,7 +33,12 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <exception>
+#include <iostream>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include "SonettoKernel.h"
+#include "SonettoInputManager.h"
 #include "GenericModuleFactory.h"
 
 #ifdef WINDOWS
@@ -47,7 +52,45 @@ int main(int argc, char **argv)
 
         // Instantiates the Kernel, initializes and runs it
         Sonetto::Kernel *kernel = new Sonetto::Kernel(factory);
+
+        #ifndef WINDOWS
+            // `--headless [frames]' runs without window, audio and input
+            for (int i = 1;i < argc;++i)
+            {
+                if (strcmp(argv[i],"--headless") == 0)
+                {
+                    size_t frames = 0;
+
+                    // The frame count is optional, so the next argument
+                    // is only taken if it is a number
+                    if (i + 1 < argc &&
+                            isdigit((unsigned char)(argv[i + 1][0])))
+                    {
+                        frames = strtoul(argv[++i],NULL,10);
+                    }
+
+                    kernel->setHeadless(true,frames);
+                }
+            }
+        #endif
+
         kernel->initialize();
+
+        #ifndef WINDOWS
+            // `--record file' records input into a file, and `--replay file'
+            // plays it back in place of the input devices
+            for (int i = 1;i + 1 < argc;++i)
+            {
+                if (strcmp(argv[i],"--record") == 0) {
+                    Sonetto::InputManager::getSingleton().
+                            startRecording(argv[i + 1]);
+                } else if (strcmp(argv[i],"--replay") == 0) {
+                    Sonetto::InputManager::getSingleton().
+                            startReplay(argv[i + 1]);
+                }
+            }
+        #endif
+
         kernel->run();
 
         // Deletes Kernel when finished running
@@ -64,7 +107,7 @@ int main(int argc, char **argv)
             MessageBox(NULL,what,"Game Runtime Error",
                     MB_OK|MB_ICONERROR|MB_TASKMODAL);
         #else
-            cerr << "[!] Game Runtime Error\n" << what << "\n";
+            std::cerr << "[!] Game Runtime Error\n" << what << "\n";
         #endif
     } catch(std::exception &e) {
         std::cerr << e.what() << std::endl;
@@ -0,0 +1,731 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifdef WINDOWS
+#   include <windows.h>
+#else
+#   include <dirent.h>
+#   include <fcntl.h>
+#   include <sys/stat.h>
+#   include <sys/time.h>
+#   include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "SonettoPackFormat.h"
+#include "SonettoLZ4.h"
+
+using namespace Sonetto;
+
+/// A file to be packed
+struct InputFile
+{
+    /// Normalised name inside the pack
+    std::string name;
+
+    /// Path on disk
+    std::string path;
+
+    /// Size, in bytes
+    size_t size;
+
+    /// Compressed data (empty if stored uncompressed)
+    std::vector<char> compressed;
+
+    inline bool operator<(const InputFile &rhs) const
+    {
+        return name < rhs.name;
+    }
+};
+
+typedef std::vector<InputFile> InputFileVector;
+
+/// When to compress files
+enum CompressionMode
+{
+    /// Never
+    COMPRESS_NONE,
+
+    /// When loading and decompressing them is faster than loading them
+    COMPRESS_AUTO,
+
+    /// Whenever they get smaller
+    COMPRESS_ALL
+};
+
+/// Compression settings
+struct CompressionSettings
+{
+    /// When to compress
+    CompressionMode mode;
+
+    /// Disk read speed assumed by COMPRESS_AUTO, in bytes per second
+    double readSpeed;
+
+    /// Uncompressed block size
+    uint32 blockSize;
+};
+
+// --------------------------------------------------------------------------
+/// Adds the files under `path' to `files' (`prefix' is their pack path)
+static bool collectFiles(const std::string &path,const std::string &prefix,
+        InputFileVector &files)
+{
+#ifdef WINDOWS
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((path + "\\*").c_str(),&data);
+
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        std::cerr << "Could not list " << path << "\n";
+        return false;
+    }
+
+    do {
+        std::string name = data.cFileName;
+
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (!collectFiles(path + "\\" + name,prefix + name + "/",files))
+            {
+                FindClose(find);
+                return false;
+            }
+        } else {
+            InputFile file;
+
+            file.name = prefix + name;
+            file.path = path + "\\" + name;
+            file.size = data.nFileSizeLow;
+            files.push_back(file);
+        }
+    } while (FindNextFileA(find,&data));
+
+    FindClose(find);
+#else
+    DIR *dir = opendir(path.c_str());
+    struct dirent *dirEntry;
+
+    if (!dir)
+    {
+        std::cerr << "Could not list " << path << "\n";
+        return false;
+    }
+
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        std::string name = dirEntry->d_name;
+        std::string filePath = path + "/" + name;
+        struct stat info;
+
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+
+        if (stat(filePath.c_str(),&info) != 0)
+        {
+            std::cerr << "Could not stat " << filePath << "\n";
+            closedir(dir);
+            return false;
+        }
+
+        if (S_ISDIR(info.st_mode)) {
+            if (!collectFiles(filePath,prefix + name + "/",files))
+            {
+                closedir(dir);
+                return false;
+            }
+        } else if (S_ISREG(info.st_mode)) {
+            InputFile file;
+
+            file.name = prefix + name;
+            file.path = filePath;
+            file.size = info.st_size;
+            files.push_back(file);
+        }
+    }
+
+    closedir(dir);
+#endif
+
+    return true;
+}
+// --------------------------------------------------------------------------
+/// Writes `count' zero bytes
+static void writePadding(std::ofstream &out,size_t count)
+{
+    static const char zeros[256] = { 0 };
+
+    while (count > 0)
+    {
+        size_t chunk = std::min(count,sizeof(zeros));
+
+        out.write(zeros,chunk);
+        count -= chunk;
+    }
+}
+// --------------------------------------------------------------------------
+/// Rounds `offset' up to a multiple of `alignment'
+static size_t alignOffset(size_t offset,size_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+// --------------------------------------------------------------------------
+/// Gets a monotonic time, in seconds
+static double getSeconds()
+{
+#ifdef WINDOWS
+    LARGE_INTEGER frequency,counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)(counter.QuadPart) / frequency.QuadPart;
+#else
+    struct timeval now;
+
+    gettimeofday(&now,NULL);
+    return now.tv_sec + now.tv_usec / 1000000.0;
+#endif
+}
+// --------------------------------------------------------------------------
+/// Reads a whole file into `data'
+static bool readFile(const InputFile &file,std::vector<char> &data)
+{
+    std::ifstream in(file.path.c_str(),
+            std::ios_base::in | std::ios_base::binary);
+
+    data.resize(file.size);
+    if (data.empty())
+    {
+        return in.is_open();
+    }
+
+    in.read(&data[0],data.size());
+    if (!in.good())
+    {
+        std::cerr << "Could not read " << file.path << "\n";
+        return false;
+    }
+
+    return true;
+}
+// --------------------------------------------------------------------------
+/** Compresses `data' into independent blocks (see SonettoPackFormat.h)
+
+    Blocks that do not get smaller are stored uncompressed.
+*/
+static void compressEntry(const std::vector<char> &data,uint32 blockSize,
+        std::vector<char> &compressed)
+{
+    uint32 blockCount = packBlockCount(data.size(),blockSize);
+    std::vector<uint32> blockSizes(blockCount);
+    std::vector<char> block(lz4CompressBound(blockSize));
+
+    compressed.assign(blockCount * sizeof(uint32),0);
+    for (uint32 i = 0;i < blockCount;++i)
+    {
+        const char *src = &data[i * blockSize];
+        size_t size = std::min<size_t>(blockSize,data.size() - i * blockSize);
+        size_t storedSize = lz4Compress(src,size,&block[0],block.size());
+
+        if (storedSize == 0 || storedSize >= size) {
+            blockSizes[i] = size | PACK_BLOCK_UNCOMPRESSED;
+            compressed.insert(compressed.end(),src,src + size);
+        } else {
+            blockSizes[i] = storedSize;
+            compressed.insert(compressed.end(),block.begin(),
+                    block.begin() + storedSize);
+        }
+    }
+
+    if (blockCount > 0)
+    {
+        memcpy(&compressed[0],&blockSizes[0],blockCount * sizeof(uint32));
+    }
+}
+// --------------------------------------------------------------------------
+/// Decompresses an entry compressed by compressEntry()
+static bool decompressEntry(const char *stored,size_t storedSize,
+        char *dest,size_t size,uint32 blockSize)
+{
+    uint32 blockCount = packBlockCount(size,blockSize);
+    const char *blocks = stored + blockCount * sizeof(uint32);
+    const char *end = stored + storedSize;
+
+    if (blockCount * sizeof(uint32) > storedSize)
+    {
+        return false;
+    }
+
+    for (uint32 i = 0;i < blockCount;++i)
+    {
+        uint32 blockStoredSize;
+        size_t blockOutSize = std::min<size_t>(blockSize,size - i * blockSize);
+
+        memcpy(&blockStoredSize,stored + i * sizeof(uint32),sizeof(uint32));
+        if (blockStoredSize & PACK_BLOCK_UNCOMPRESSED) {
+            blockStoredSize &= ~PACK_BLOCK_UNCOMPRESSED;
+            if (blockStoredSize != blockOutSize ||
+                    blockStoredSize > (size_t)(end - blocks))
+            {
+                return false;
+            }
+
+            memcpy(dest,blocks,blockStoredSize);
+        } else if (blockStoredSize > (size_t)(end - blocks) ||
+                !lz4Decompress(blocks,blockStoredSize,dest,blockOutSize)) {
+            return false;
+        }
+
+        blocks += blockStoredSize;
+        dest += blockOutSize;
+    }
+
+    return true;
+}
+// --------------------------------------------------------------------------
+/** Decides whether to compress `file', filling InputFile::compressed if so
+
+    Under COMPRESS_AUTO, the file is compressed and decompressed, and the
+    compressed form is kept only if the time it saves reading from disk
+    (at CompressionSettings::readSpeed) is larger than the time it took to
+    decompress, so that already compressed formats (Ogg, PNG) and files
+    that barely compress are left alone.
+*/
+static bool chooseCompression(InputFile &file,const std::vector<char> &data,
+        const CompressionSettings &settings)
+{
+    std::vector<char> check(data.size());
+    double decompressTime,savedTime;
+
+    file.compressed.clear();
+    if (settings.mode == COMPRESS_NONE || data.empty())
+    {
+        return true;
+    }
+
+    compressEntry(data,settings.blockSize,file.compressed);
+
+    decompressTime = getSeconds();
+    if (!decompressEntry(&file.compressed[0],file.compressed.size(),
+            &check[0],check.size(),settings.blockSize) || check != data)
+    {
+        std::cerr << "Compression of " << file.path << " failed\n";
+        return false;
+    }
+    decompressTime = getSeconds() - decompressTime;
+
+    if (file.compressed.size() >= data.size()) {
+        file.compressed.clear();
+    } else if (settings.mode == COMPRESS_AUTO) {
+        savedTime = (data.size() - file.compressed.size()) /
+                settings.readSpeed;
+        if (savedTime <= decompressTime)
+        {
+            file.compressed.clear();
+        }
+    }
+
+    return true;
+}
+// --------------------------------------------------------------------------
+/// Writes a pack with `files' to `packPath'
+static bool writePack(const std::string &packPath,InputFileVector &files,
+        uint32 alignment,const CompressionSettings &settings)
+{
+    PackHeader header;
+    std::vector<uint32> slots;
+    std::vector<PackEntry> entries(files.size());
+    std::string names;
+    size_t offset;
+    std::ofstream out;
+
+    // Normalises names; sorting keeps packs reproducible and makes
+    // duplicates (names only differing in case) adjacent
+    for (size_t i = 0;i < files.size();++i)
+    {
+        std::transform(files[i].name.begin(),files[i].name.end(),
+                files[i].name.begin(),packNormaliseChar);
+    }
+    std::sort(files.begin(),files.end());
+
+    for (size_t i = 1;i < files.size();++i)
+    {
+        if (files[i].name == files[i - 1].name)
+        {
+            std::cerr << "Duplicate name " << files[i].name << "\n";
+            return false;
+        }
+    }
+
+    // At least twice as many slots as entries keeps probe runs short
+    header.slotCount = 1;
+    while (header.slotCount < files.size() * 2)
+    {
+        header.slotCount *= 2;
+    }
+    slots.resize(header.slotCount,0);
+
+    for (size_t i = 0;i < files.size();++i)
+    {
+        PackEntry &entry = entries[i];
+        uint32 slot;
+
+        entry.hash = packHash(files[i].name.c_str(),files[i].name.size());
+        entry.nameOffset = names.size();
+        entry.nameLength = files[i].name.size();
+        names += files[i].name;
+
+        slot = entry.hash & (header.slotCount - 1);
+        while (slots[slot] != 0)
+        {
+            slot = (slot + 1) & (header.slotCount - 1);
+        }
+        slots[slot] = i + 1;
+    }
+
+    header.fourCC = PACK_FOURCC;
+    header.version = PACK_VERSION;
+    header.entryCount = files.size();
+    header.alignment = alignment;
+    header.namesOffset = sizeof(PackHeader) + slots.size() * sizeof(uint32) +
+            entries.size() * sizeof(PackEntry);
+    header.namesSize = names.size();
+    header.blockSize = settings.blockSize;
+
+    // Compresses what is worth it
+    for (size_t i = 0;i < files.size();++i)
+    {
+        std::vector<char> data;
+
+        if (!readFile(files[i],data) ||
+                !chooseCompression(files[i],data,settings))
+        {
+            return false;
+        }
+    }
+
+    // Lays out file data
+    offset = header.namesOffset + header.namesSize;
+    for (size_t i = 0;i < files.size();++i)
+    {
+        offset = alignOffset(offset,alignment);
+        entries[i].offset = offset;
+        entries[i].size = files[i].size;
+
+        if (files[i].compressed.empty()) {
+            entries[i].storedSize = files[i].size;
+            entries[i].flags = 0;
+        } else {
+            entries[i].storedSize = files[i].compressed.size();
+            entries[i].flags = PACK_ENTRY_COMPRESSED;
+        }
+        offset += entries[i].storedSize;
+
+        if (offset > 0xFFFFFFFFUL)
+        {
+            std::cerr << "Packs cannot be larger than 4GB\n";
+            return false;
+        }
+    }
+
+    out.open(packPath.c_str(),std::ios_base::out | std::ios_base::binary |
+            std::ios_base::trunc);
+    if (!out.is_open())
+    {
+        std::cerr << "Could not create " << packPath << "\n";
+        return false;
+    }
+
+    out.write((const char *)(&header),sizeof(header));
+    if (!slots.empty())
+    {
+        out.write((const char *)(&slots[0]),slots.size() * sizeof(uint32));
+    }
+
+    if (!entries.empty())
+    {
+        out.write((const char *)(&entries[0]),
+                entries.size() * sizeof(PackEntry));
+    }
+    out.write(names.data(),names.size());
+
+    offset = header.namesOffset + header.namesSize;
+    for (size_t i = 0;i < files.size();++i)
+    {
+        std::vector<char> data;
+
+        writePadding(out,entries[i].offset - offset);
+
+        if (!files[i].compressed.empty()) {
+            data.swap(files[i].compressed);
+        } else if (!readFile(files[i],data)) {
+            return false;
+        }
+
+        if (!data.empty())
+        {
+            out.write(&data[0],data.size());
+        }
+        offset = entries[i].offset + entries[i].storedSize;
+
+        std::cout << files[i].name << " (" << files[i].size << " bytes";
+        if (entries[i].flags & PACK_ENTRY_COMPRESSED)
+        {
+            std::cout << ", compressed to " << entries[i].storedSize;
+        }
+        std::cout << ")\n";
+    }
+
+    // Ends the pack at an aligned size, so that the last file can be
+    // mapped whole
+    writePadding(out,alignOffset(offset,alignment) - offset);
+
+    if (!out.good())
+    {
+        std::cerr << "Could not write " << packPath << "\n";
+        return false;
+    }
+
+    std::cout << files.size() << " files packed into " << packPath << "\n";
+    return true;
+}
+// --------------------------------------------------------------------------
+/// Evicts a file from the operating system's page cache, where possible
+static bool dropPageCache(const std::string &path)
+{
+#ifdef WINDOWS
+    // Windows has no way to do it for a single file
+    return false;
+#else
+    int fd = open(path.c_str(),O_RDONLY);
+    bool dropped;
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    dropped = (posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED) == 0);
+    close(fd);
+
+    return dropped;
+#endif
+}
+// --------------------------------------------------------------------------
+/** Measures how fast every file in a pack loads
+
+    Reads (and decompresses) every file twice: first after evicting the
+    pack from the page cache (cold), then again (warm). Decompression runs
+    in this thread only, while the engine spreads large files' blocks over
+    its JobSystem, so compressed packs load at least this fast in game.
+    Comparing a pack made with `-c none' against one made with `-c auto'
+    shows what compression gains.
+*/
+static bool benchmarkPack(const std::string &packPath)
+{
+    std::ifstream in(packPath.c_str(),
+            std::ios_base::in | std::ios_base::binary);
+    PackHeader header;
+    std::vector<PackEntry> entries;
+    std::vector<char> stored,data;
+
+    in.read((char *)(&header),sizeof(header));
+    if (!in.good() || header.fourCC != PACK_FOURCC ||
+            header.version != PACK_VERSION || header.blockSize == 0)
+    {
+        std::cerr << packPath << " is not a pack made by this archiver\n";
+        return false;
+    }
+
+    entries.resize(header.entryCount);
+    in.seekg(sizeof(PackHeader) + header.slotCount * sizeof(uint32));
+    if (!entries.empty())
+    {
+        in.read((char *)(&entries[0]),entries.size() * sizeof(PackEntry));
+    }
+
+    for (int pass = 0;pass < 2;++pass)
+    {
+        double readBytes = 0.0,loadedBytes = 0.0;
+        double seconds;
+
+        if (pass == 0 && !dropPageCache(packPath))
+        {
+            std::cout << "(could not evict the pack from the page cache; "
+                    "cold figures may be warm)\n";
+        }
+
+        in.clear();
+        seconds = getSeconds();
+        for (size_t i = 0;i < entries.size();++i)
+        {
+            const PackEntry &entry = entries[i];
+
+            stored.resize(entry.storedSize);
+            in.seekg(entry.offset);
+            if (!stored.empty())
+            {
+                in.read(&stored[0],stored.size());
+            }
+
+            if (!in.good())
+            {
+                std::cerr << packPath << " is truncated\n";
+                return false;
+            }
+
+            if (entry.flags & PACK_ENTRY_COMPRESSED)
+            {
+                data.resize(entry.size);
+                if (!decompressEntry(&stored[0],stored.size(),&data[0],
+                        data.size(),header.blockSize))
+                {
+                    std::cerr << packPath << " is corrupt\n";
+                    return false;
+                }
+            }
+
+            readBytes += entry.storedSize;
+            loadedBytes += entry.size;
+        }
+        seconds = getSeconds() - seconds;
+
+        std::cout << ((pass == 0) ? "Cold: " : "Warm: ")
+                << readBytes / 1048576.0 << " MB read, "
+                << loadedBytes / 1048576.0 << " MB loaded in "
+                << seconds << " s (" << loadedBytes / 1048576.0 /
+                std::max(seconds,0.000001) << " MB/s)\n";
+    }
+
+    return true;
+}
+// --------------------------------------------------------------------------
+/// Prints usage
+static void printUsage()
+{
+    std::cerr << "Usage: archiver [-a alignment] [-c auto|none|all] "
+            "[-r MB/s] <directory> <pack>\n"
+            "       archiver -b <pack>\n"
+            "Packs every file under <directory> into <pack>, to be used "
+            "as a \"Pack\" resource location.\n"
+            "  -a  file data alignment (default 4096)\n"
+            "  -c  compression: auto (default) compresses files that load "
+            "faster compressed,\n"
+            "      none never compresses, all compresses whatever gets "
+            "smaller\n"
+            "  -r  disk read speed assumed by -c auto (default 100 MB/s)\n"
+            "  -b  measures load throughput of <pack>, cold and warm\n";
+}
+// --------------------------------------------------------------------------
+int main(int argc,char **argv)
+{
+    uint32 alignment = PACK_DEFAULT_ALIGNMENT;
+    CompressionSettings compression;
+    InputFileVector files;
+    int arg = 1;
+
+    compression.mode = COMPRESS_AUTO;
+    compression.readSpeed = 100.0 * 1048576.0;
+    compression.blockSize = PACK_DEFAULT_BLOCK_SIZE;
+
+    // `-b pack' benchmarks a pack
+    if (argc == 3 && strcmp(argv[1],"-b") == 0)
+    {
+        return benchmarkPack(argv[2]) ? 0 : 1;
+    }
+
+    while (arg + 1 < argc && argv[arg][0] == '-')
+    {
+        const char *value = argv[arg + 1];
+
+        if (strcmp(argv[arg],"-a") == 0) {
+            // File data alignment (a power of two)
+            alignment = strtoul(value,NULL,10);
+            if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+            {
+                std::cerr << "Alignment must be a power of two\n";
+                return 1;
+            }
+        } else if (strcmp(argv[arg],"-c") == 0) {
+            if (strcmp(value,"auto") == 0) {
+                compression.mode = COMPRESS_AUTO;
+            } else if (strcmp(value,"none") == 0) {
+                compression.mode = COMPRESS_NONE;
+            } else if (strcmp(value,"all") == 0) {
+                compression.mode = COMPRESS_ALL;
+            } else {
+                printUsage();
+                return 1;
+            }
+        } else if (strcmp(argv[arg],"-r") == 0) {
+            compression.readSpeed = strtod(value,NULL) * 1048576.0;
+            if (compression.readSpeed <= 0.0)
+            {
+                std::cerr << "Read speed must be positive\n";
+                return 1;
+            }
+        } else {
+            printUsage();
+            return 1;
+        }
+
+        arg += 2;
+    }
+
+    if (argc - arg != 2)
+    {
+        printUsage();
+        return 1;
+    }
+
+    if (!collectFiles(argv[arg],"",files))
+    {
+        return 1;
+    }
+
+    if (!writePack(argv[arg + 1],files,alignment,compression))
+    {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,382 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#ifdef WINDOWS
+#   include <windows.h>
+#else
+#   include <sys/time.h>
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <vector>
+#include <SDL/SDL_thread.h>
+#include <SDL/SDL_timer.h>
+#include "SonettoJobSystem.h"
+
+using namespace Sonetto;
+
+/// Iterations of busy work done by each benchmark job
+static const size_t BENCH_JOB_WORK = 20000;
+
+/// Number of jobs run by each benchmark pass
+static const size_t BENCH_JOB_COUNT = 20000;
+
+/// Number of jobs forked by the stealing test's root job
+static const size_t STEAL_JOB_COUNT = 64;
+
+// --------------------------------------------------------------------------
+/// Gets a monotonic time, in seconds
+static double getSeconds()
+{
+#ifdef WINDOWS
+    LARGE_INTEGER frequency,counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)(counter.QuadPart) / frequency.QuadPart;
+#else
+    struct timeval now;
+
+    gettimeofday(&now,NULL);
+    return now.tv_sec + now.tv_usec / 1000000.0;
+#endif
+}
+// --------------------------------------------------------------------------
+/// Burns some CPU time (the result is kept so it is not optimised out)
+static unsigned long busyWork(size_t iterations)
+{
+    volatile unsigned long value = 1;
+
+    for (size_t i = 0;i < iterations;++i)
+    {
+        value = value * 1664525UL + 1013904223UL;
+    }
+
+    return value;
+}
+// --------------------------------------------------------------------------
+/// Job that increments the AtomicCounter given as data
+static void incrementJob(void *data)
+{
+    static_cast<AtomicCounter *>(data)->increment();
+}
+// --------------------------------------------------------------------------
+/// Job that throws something that is not an std::exception
+static void throwingJob(void *data)
+{
+    throw 42;
+}
+// --------------------------------------------------------------------------
+/// Stealing test: data of each forked job
+struct StealJob
+{
+    /// Thread that ran the job
+    Uint32 threadID;
+};
+// --------------------------------------------------------------------------
+/// Stealing test: a forked job, which records the thread running it
+static void stealLeafJob(void *data)
+{
+    busyWork(BENCH_JOB_WORK * 10);
+    static_cast<StealJob *>(data)->threadID = SDL_ThreadID();
+}
+// --------------------------------------------------------------------------
+/// Stealing test: runs in a worker and forks jobs into its own queue
+static void stealRootJob(void *data)
+{
+    std::vector<StealJob> &jobs = *static_cast<std::vector<StealJob> *>(data);
+    JobSystem &jobSystem = JobSystem::getSingleton();
+    JobCounter counter;
+
+    for (size_t i = 0;i < jobs.size();++i)
+    {
+        jobSystem.submit(stealLeafJob,&jobs[i],&counter);
+    }
+
+    jobSystem.wait(counter);
+}
+// --------------------------------------------------------------------------
+/// parallelFor() test: marks each visited index
+struct MarkIndices
+{
+    std::vector<AtomicCounter *> *visits;
+
+    void operator()(size_t begin,size_t end)
+    {
+        for (size_t i = begin;i < end;++i)
+        {
+            (*visits)[i]->increment();
+        }
+    }
+};
+// --------------------------------------------------------------------------
+/// parallelFor() test: fails on one index
+struct FailOnIndex
+{
+    size_t index;
+
+    void operator()(size_t begin,size_t end)
+    {
+        if (index >= begin && index < end)
+        {
+            throw std::runtime_error("index reached");
+        }
+    }
+};
+// --------------------------------------------------------------------------
+/// Benchmark job
+static void benchJob(void *data)
+{
+    busyWork(BENCH_JOB_WORK);
+}
+// --------------------------------------------------------------------------
+/// Prints a test result and returns `passed'
+static bool report(const char *name,bool passed)
+{
+    std::cout << (passed ? "PASS  " : "FAIL  ") << name << "\n";
+    return passed;
+}
+// --------------------------------------------------------------------------
+/// Runs the JobSystem tests with `workers' worker threads
+static bool runTests(size_t workers)
+{
+    JobSystem jobSystem(workers);
+    bool passed = true;
+
+    std::cout << "Testing with " << jobSystem.getWorkerNum() <<
+            " worker(s)\n";
+
+    // submit() and wait() from a thread that is not a worker
+    {
+        JobCounter counter;
+        AtomicCounter total;
+
+        for (size_t i = 0;i < 10000;++i)
+        {
+            jobSystem.submit(incrementJob,&total,&counter);
+        }
+        jobSystem.wait(counter);
+
+        passed &= report("submit/wait",counter.get() == 0 &&
+                total.get() == 10000);
+    }
+
+    // Jobs forked from inside a worker go to its own queue; the others
+    // must steal them
+    {
+        std::vector<StealJob> jobs(STEAL_JOB_COUNT);
+        std::set<Uint32> threads;
+        JobCounter counter;
+
+        jobSystem.submit(stealRootJob,&jobs,&counter);
+        jobSystem.wait(counter);
+
+        for (size_t i = 0;i < jobs.size();++i)
+        {
+            threads.insert(jobs[i].threadID);
+        }
+
+        std::cout << "      " << jobs.size() << " forked jobs ran in " <<
+                threads.size() << " thread(s)\n";
+        passed &= report("nested fork/join",counter.get() == 0);
+        passed &= report("stealing",threads.size() > 1);
+    }
+
+    // parallelFor() visits every index exactly once
+    {
+        std::vector<AtomicCounter *> visits(10007);
+        MarkIndices mark;
+        bool once = true;
+
+        for (size_t i = 0;i < visits.size();++i)
+        {
+            visits[i] = new AtomicCounter;
+        }
+
+        mark.visits = &visits;
+        jobSystem.parallelFor(0,visits.size(),0,mark);
+
+        for (size_t i = 0;i < visits.size();++i)
+        {
+            once &= (visits[i]->get() == 1);
+            delete visits[i];
+        }
+
+        passed &= report("parallelFor",once);
+    }
+
+    // parallelFor() rethrows errors once every chunk ended
+    {
+        FailOnIndex fail;
+        bool thrown = false;
+
+        fail.index = 5000;
+        try {
+            jobSystem.parallelFor(0,10007,0,fail);
+        } catch (Exception &e) {
+            thrown = true;
+        }
+
+        passed &= report("parallelFor error",thrown);
+    }
+
+    // A job throwing anything still ends, so wait() returns, and its
+    // failure is recorded in its counter
+    {
+        JobCounter counter;
+        AtomicCounter total;
+
+        jobSystem.submit(incrementJob,&total,&counter);
+        jobSystem.submit(throwingJob,NULL,&counter);
+        jobSystem.submit(incrementJob,&total,&counter);
+        jobSystem.wait(counter);
+
+        passed &= report("throwing job",counter.get() == 0 &&
+                counter.getFailedNum() == 1 && !counter.getError().empty() &&
+                total.get() == 2);
+    }
+
+    // wait() sleeps while the last jobs run in other threads
+    if (jobSystem.getWorkerNum() > 0)
+    {
+        std::vector<StealJob> jobs(1);
+        JobCounter counter;
+
+        // Gives a worker time to take the job first
+        jobSystem.submit(stealLeafJob,&jobs[0],&counter);
+        SDL_Delay(10);
+        jobSystem.wait(counter);
+
+        passed &= report("sleeping wait",counter.get() == 0 &&
+                jobs[0].threadID != SDL_ThreadID());
+    }
+
+    return passed;
+}
+// --------------------------------------------------------------------------
+/// Measures job throughput for 1 up to `maxWorkers' worker threads
+static void runBenchmark(size_t maxWorkers)
+{
+    double baseRate = 0.0;
+
+    std::cout << "Benchmark: " << BENCH_JOB_COUNT << " jobs of " <<
+            BENCH_JOB_WORK << " iterations each\n"
+            "workers     jobs/s  speedup\n";
+
+    for (size_t workers = 1;workers <= maxWorkers;++workers)
+    {
+        JobSystem jobSystem(workers);
+        JobCounter counter;
+        double start,seconds,rate;
+
+        start = getSeconds();
+        for (size_t i = 0;i < BENCH_JOB_COUNT;++i)
+        {
+            jobSystem.submit(benchJob,NULL,&counter);
+        }
+        jobSystem.wait(counter);
+        seconds = getSeconds() - start;
+
+        rate = BENCH_JOB_COUNT / (seconds > 0.000001 ? seconds : 0.000001);
+        if (workers == 1)
+        {
+            baseRate = rate;
+        }
+
+        // The calling thread helps while waiting, so one worker already
+        // means two threads running jobs
+        std::cout.width(7);
+        std::cout << workers;
+        std::cout.width(11);
+        std::cout << (unsigned long)(rate);
+        std::cout.width(8);
+        std::cout.precision(3);
+        std::cout << rate / baseRate << "x\n";
+    }
+}
+// --------------------------------------------------------------------------
+/// Prints usage
+static void printUsage()
+{
+    std::cerr << "Usage: jobbench [-t] [-b] [-w workers]\n"
+            "Tests and benchmarks the Sonetto JobSystem (both by default).\n"
+            "  -t  runs the tests only\n"
+            "  -b  runs the scaling benchmark only\n"
+            "  -w  maximum number of worker threads (default: one per "
+            "hardware thread)\n";
+}
+// --------------------------------------------------------------------------
+int main(int argc,char **argv)
+{
+    size_t maxWorkers = JobSystem::getHardwareThreadNum();
+    bool tests = true,benchmark = true;
+    bool passed = true;
+
+    for (int arg = 1;arg < argc;++arg)
+    {
+        if (strcmp(argv[arg],"-t") == 0) {
+            benchmark = false;
+        } else if (strcmp(argv[arg],"-b") == 0) {
+            tests = false;
+        } else if (strcmp(argv[arg],"-w") == 0 && arg + 1 < argc) {
+            maxWorkers = strtoul(argv[++arg],NULL,10);
+            if (maxWorkers == 0)
+            {
+                std::cerr << "Worker count must be positive\n";
+                return 1;
+            }
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (!tests && !benchmark)
+    {
+        tests = benchmark = true;
+    }
+
+    if (tests)
+    {
+        // Stealing needs at least two workers
+        passed &= runTests(maxWorkers > 1 ? maxWorkers : 2);
+    }
+
+    if (benchmark)
+    {
+        runBenchmark(maxWorkers);
+    }
+
+    return passed ? 0 : 1;
+}
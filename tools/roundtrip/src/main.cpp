@@ -0,0 +1,321 @@
+/*-----------------------------------------------------------------------------
+Copyright (c) 2009, Sonetto Project Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+3.  Neither the name of the Sonetto Project nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+-----------------------------------------------------------------------------*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+#include <OgreRoot.h>
+#include "SonettoInputManager.h"
+#include "SonettoScriptManager.h"
+
+using namespace Sonetto;
+
+/// Recording written and replayed by the input test
+static const char *REPLAY_FILE = "roundtrip.sir";
+
+/// Ticks recorded by the input test
+static const size_t REPLAY_TICKS = 600;
+
+/// Keys pressed and released by the input test
+static const uint16 REPLAY_KEYS[] = {
+    SDLK_UP,SDLK_DOWN,SDLK_LEFT,SDLK_RIGHT,SDLK_z,SDLK_x,SDLK_RETURN,SDLK_ESCAPE
+};
+
+/// Number of entries in REPLAY_KEYS
+static const size_t REPLAY_KEY_NUM = sizeof(REPLAY_KEYS) / sizeof(uint16);
+
+// --------------------------------------------------------------------------
+/// Prints a test result and returns `passed'
+static bool report(const char *name,bool passed)
+{
+    std::cout << (passed ? "PASS  " : "FAIL  ") << name << "\n";
+    return passed;
+}
+// --------------------------------------------------------------------------
+/// Whether two variables have the same type and value
+static bool sameVariable(const Variable &lhs,const Variable &rhs)
+{
+    return lhs._getRawType() == rhs._getRawType() && lhs._int == rhs._int;
+}
+// --------------------------------------------------------------------------
+/// Pops a script's whole operand stack, top first
+static std::vector<Variable> popStack(Script &script)
+{
+    std::vector<Variable> stack;
+
+    while (true)
+    {
+        try {
+            stack.push_back(script.stackPop());
+        } catch (Exception &) {
+            return stack;
+        }
+    }
+}
+// --------------------------------------------------------------------------
+/// Creates a script file with `size' bytes of (empty) script data
+static ScriptFilePtr createScriptFile(const std::string &name,size_t size)
+{
+    ScriptFilePtr file = ScriptManager::getSingleton().create(name,
+            Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,true);
+
+    file->_getScriptData().resize(size);
+    return file;
+}
+// --------------------------------------------------------------------------
+/// Saves and restores a snapshot of running scripts
+static bool testScriptSnapshot()
+{
+    ScriptManager &scriptMan = ScriptManager::getSingleton();
+    ScriptFilePtr fileA = createScriptFile("roundtrip_a",64);
+    ScriptFilePtr fileB = createScriptFile("roundtrip_b",32);
+    VariableMap locals;
+    ScriptSnapshot snapshot,damaged;
+    bool passed = true;
+    bool restored = true;
+    size_t capacity;
+
+    // One script with local variables, one without
+    Script a(fileA);
+    Script b(fileB);
+
+    a.setLocals(&locals);
+    a._setOffset(12);
+    a.stackPush(Variable(VT_INT32,5));
+    a.stackPush(Variable(VT_FLOAT,0.25f));
+    locals[1] = Variable(VT_INT32,-7);
+    locals[2] = Variable(VT_FLOAT,1.5f);
+    b._setOffset(30);
+    b.stackPush(Variable(VT_INT32,9));
+
+    snapshot.reserve(scriptMan.calculateSnapshotSize());
+    capacity = snapshot.capacity();
+    scriptMan.saveSnapshot(snapshot);
+    passed &= report("snapshot size",snapshot.size() ==
+            scriptMan.calculateSnapshotSize() &&
+            snapshot.capacity() == capacity);
+
+    // Everything changes after the snapshot is taken
+    a._setOffset(40);
+    a.stackPop();
+    a.stackPush(Variable(VT_INT32,100));
+    a.stackPush(Variable(VT_INT32,101));
+    locals[1] = Variable(VT_INT32,0);
+    locals.erase(2);
+    locals[3] = Variable(VT_INT32,3);
+    b._setOffset(0);
+    b.stackPop();
+
+    // A damaged snapshot is rejected without touching any script
+    damaged.assign(snapshot.begin(),snapshot.end() - 1);
+    try {
+        scriptMan.restoreSnapshot(damaged);
+        restored = true;
+    } catch (Exception &) {
+        restored = false;
+    }
+    passed &= report("truncated snapshot rejected",!restored &&
+            a._getOffset() == 40 && b._getOffset() == 0);
+
+    scriptMan.restoreSnapshot(snapshot);
+    {
+        std::vector<Variable> stackA = popStack(a);
+        std::vector<Variable> stackB = popStack(b);
+
+        passed &= report("offsets restored",a._getOffset() == 12 &&
+                b._getOffset() == 30);
+        passed &= report("stacks restored",stackA.size() == 2 &&
+                sameVariable(stackA[0],Variable(VT_FLOAT,0.25f)) &&
+                sameVariable(stackA[1],Variable(VT_INT32,5)) &&
+                stackB.size() == 1 &&
+                sameVariable(stackB[0],Variable(VT_INT32,9)));
+        passed &= report("locals restored",locals.size() == 2 &&
+                sameVariable(locals[1],Variable(VT_INT32,-7)) &&
+                sameVariable(locals[2],Variable(VT_FLOAT,1.5f)) &&
+                b.getLocals() == NULL);
+    }
+
+    // Saving again into the same buffer must not reallocate it
+    a.stackPush(Variable(VT_INT32,5));
+    a.stackPush(Variable(VT_FLOAT,0.25f));
+    b.stackPush(Variable(VT_INT32,9));
+    scriptMan.saveSnapshot(damaged);
+    capacity = snapshot.capacity();
+    scriptMan.saveSnapshot(snapshot);
+    passed &= report("snapshot buffer reused",snapshot.capacity() ==
+            capacity && snapshot == damaged);
+
+    // Snapshots only match the scripts they were taken from
+    {
+        Script c(fileA);
+
+        try {
+            scriptMan.restoreSnapshot(snapshot);
+            restored = true;
+        } catch (Exception &) {
+            restored = false;
+        }
+        passed &= report("mismatched snapshot rejected",!restored);
+    }
+
+    return passed;
+}
+// --------------------------------------------------------------------------
+/// Gets the raw state of a key at a tick of the input test
+static bool getTestKey(size_t tick,size_t key)
+{
+    // A long stretch without changes, longer than a run of idle ticks
+    if (tick >= 200 && tick < 450)
+    {
+        return getTestKey(199,key);
+    }
+
+    return ((tick * 7 + key * 13) / (key + 3)) % 2 == 1;
+}
+// --------------------------------------------------------------------------
+/// Records input, replays it and compares the key states of each tick
+static bool testInputReplay()
+{
+    std::vector<KeyState> recorded,replayed;
+    bool passed = true;
+    bool thrown = false;
+    int recordedRoll,replayedRoll;
+
+    // Records
+    {
+        InputManager input(1);
+
+        input.initialize(false);
+        input.startRecording(REPLAY_FILE);
+        recordedRoll = rand();
+
+        for (size_t tick = 0;tick < REPLAY_TICKS;++tick)
+        {
+            for (size_t i = 0;i < REPLAY_KEY_NUM;++i)
+            {
+                input._setRawKeyState(REPLAY_KEYS[i],getTestKey(tick,i));
+            }
+
+            input._updateStates();
+
+            for (size_t i = 0;i < REPLAY_KEY_NUM;++i)
+            {
+                recorded.push_back(input.getDirectKeyState(REPLAY_KEYS[i]));
+            }
+        }
+
+        input.stopRecording();
+    }
+
+    // Replays
+    {
+        InputManager input(1);
+
+        input.initialize(false);
+        input.startReplay(REPLAY_FILE);
+        replayedRoll = rand();
+
+        for (size_t tick = 0;tick < REPLAY_TICKS;++tick)
+        {
+            input._updateStates();
+
+            for (size_t i = 0;i < REPLAY_KEY_NUM;++i)
+            {
+                replayed.push_back(input.getDirectKeyState(REPLAY_KEYS[i]));
+            }
+        }
+
+        passed &= report("replayed key states",replayed == recorded);
+        passed &= report("replayed random seed",replayedRoll == recordedRoll);
+
+        input._updateStates();
+        passed &= report("replay end",input.isReplayFinished() &&
+                !input.isReplaying());
+    }
+
+    // A recording cut in the middle of a record is rejected
+    {
+        std::vector<char> data;
+        InputManager input(1);
+
+        {
+            std::ifstream in(REPLAY_FILE,std::ios_base::in |
+                    std::ios_base::binary);
+
+            data.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+        }
+
+        // Header, the first record's flags and half of its key count
+        data.resize(3 * sizeof(uint32) + 2);
+        {
+            std::ofstream out(REPLAY_FILE,std::ios_base::out |
+                    std::ios_base::binary | std::ios_base::trunc);
+
+            out.write(&data[0],data.size());
+        }
+
+        input.initialize(false);
+        input.startReplay(REPLAY_FILE);
+        try {
+            input._updateStates();
+        } catch (Exception &) {
+            thrown = true;
+        }
+
+        passed &= report("truncated recording rejected",thrown);
+    }
+
+    std::remove(REPLAY_FILE);
+    return passed;
+}
+// --------------------------------------------------------------------------
+int main(int argc,char **argv)
+{
+    bool passed = true;
+
+    try {
+        // No plugins or configuration; only the resource system is used
+        Ogre::Root root("","","roundtrip.log");
+        ScriptManager scriptMan;
+
+        passed &= testScriptSnapshot();
+        passed &= testInputReplay();
+    } catch (Exception &e) {
+        std::cerr << "Unexpected exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return passed ? 0 : 1;
+}